@@ -0,0 +1,30 @@
+/**
+ * @file bench.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Benchmarks and reference checks of the compressor kernels.
+ * @copyright The Unlicense
+ *
+ * The 'bench' subcommand runs each selected kernel against its reference
+ * implementation on generated data. Differences from the reference are
+ * reported as failures, thus the subcommand doubles as a self test. The
+ * timings are the best of a number of rounds.
+ */
+
+#ifndef _BENCH_H_INCLUDED
+#define _BENCH_H_INCLUDED
+
+#define BENCH_NAME          "bench"
+
+/**
+ * @brief The bench subcommand.
+ *
+ * @param[in] argc The number of arguments.
+ * @param[in] argv The arguments, BENCH_NAME at argv[1].
+ *
+ * @return EXIT_SUCCESS if all kernels matched their references.
+ */
+int bench_main(int argc, char** argv);
+
+#endif  // _BENCH_H_INCLUDED
@@ -0,0 +1,60 @@
+/**
+ * @file bintree.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Binary tree based string matcher for LZ engines.
+ * @copyright The Unlicense
+ *
+ * A BT4 style (as in LZMA) binary tree matcher. Every hash bucket heads
+ * a binary search tree of the history positions sorted by the suffix
+ * starting at the position. A search for a new position also inserts
+ * it as the new root of the tree, thus the tree gets rebuilt as we go.
+ * Each visited node gets closer to the string being searched, which
+ * means found matches are reported in increasing length order.
+ */
+
+#ifndef _BINTREE_H_INCLUDED
+#define _BINTREE_H_INCLUDED
+
+#include <iostream>
+#include <cstdint>
+#include "lz_util.h"
+
+#define BINTREE_HASH_SIZE   (1<<16)
+#define BINTREE_MAX_DEPTH   64      // Max tree nodes visited per position
+
+
+class bintree : public lz_match<bintree> {
+    int* m_head;
+    int* m_tree;        ///< Two links per window position: [0]=left, [1]=right
+    match* m_mtch;
+    int m_mask;
+    int m_max_chain;
+    int m_min_match;
+    int m_max_match;
+    int m_max_depth;
+
+    int hash(const char *buf, int pos)
+    {
+        // Same 2 byte bucket as in hash3 to catch 2 byte matches.
+        // Having enough buffer beyond the end of the file is left
+        // to the caller.
+        unsigned int hh;
+        hh = (static_cast<uint8_t>(buf[pos++]) << 8);
+        hh |= static_cast<uint8_t>(buf[pos]);
+        return hh;
+    }
+
+public:
+    bintree(int window_size, int min_match, int max_match,
+        int good_match,
+        int mm2_thres_offset,
+        int mm3_thres_offset);
+    ~bintree(void);
+
+    void impl_init_get_matches(int max_matches, match *matches = NULL);
+    int impl_find_matches(const char *buf, int pos, int len, bool only_better_matches);
+    void impl_reinit(void);
+};
+#endif  // _BINTREE_H_INCLUDED
@@ -13,6 +13,8 @@
 #define _COST4_32K_INCLUDED
 
 #include "lz_base.h"
+#include "lz_codes.h"
+#include "lz_speed.h"
 #include "mtf256.h"
 
 #ifdef MTF_CTX_SAVING_ENABLED
@@ -21,20 +23,44 @@
                                     // allocation for all contexts..
 #endif
 
+/**
+ * The offset classes, shared by the encoder and the decoder:
+ * @verbatim
+   (0ooooooo)                               1 -> 127
+   (1ooooooo) + 00                          128 -> 255
+   (1ooooooo) + 01 + o                      256 -> 511
+   (1ooooooo) + 100 + oo                    512 -> 1023
+   (1ooooooo) + 101 + ooo                   1024 -> 2047
+   (1ooooooo) + 1100 + oooo                 2048 -> 4095
+   (1ooooooo) + 1101 + ooooo                4096 -> 8191
+   (1ooooooo) + 1110 + oooooo               8192 -> 16383
+   (1ooooooo) + 1111 + ooooooo              16384 -> 32767
+ @endverbatim
+ */
+inline constexpr lz_offset_class zxpac4_32k_offset_classes[] = {
+    {0x00,0}, {0x00,2}, {0x01,2}, {0x04,3}, {0x05,3}, {0x0c,4},
+    {0x0d,4}, {0x0e,4}, {0x0f,4}
+};
+inline constexpr lz_offset_codes zxpac4_32k_offset_codes = lz_make_offset_codes(zxpac4_32k_offset_classes);
+
 class zxpac4_32k_cost: public lz_cost<zxpac4_32k_cost> {
     bool m_debug;
     bool m_verbose;
+    lz_speed_cost m_speed;
 public:
    zxpac4_32k_cost(
         const lz_config* p_cfg, int ins=-1, int max=-1);
     ~zxpac4_32k_cost(void);
 
+    // Offsets up to the window size, lengths up to the maximum match
+    typedef cost_table<uint16_t,uint16_t> cost_t;
+
     // Base class interface method implementations
-    int impl_literal_cost(int pos, cost* c, const char* buf);
-    int impl_match_cost(int pos, cost* c, const char* buf, int offset, int length);
-    int impl_init_cost(cost* c, int sta, int len, int pmr);
-    cost* impl_alloc_cost(int len, int max_chain);
-    int impl_free_cost(cost* cost);
+    int impl_literal_cost(int pos, const cost_t& c, const char* buf);
+    int impl_match_cost(int pos, const cost_t& c, const char* buf, int offset, int length);
+    int impl_init_cost(const cost_t& c, int sta, int len, int pmr);
+    cost_t impl_alloc_cost(int len, int max_chain);
+    int impl_free_cost(cost_t& c);
 
     int impl_get_offset_bits(int offset);
     int impl_get_length_bits(int length);
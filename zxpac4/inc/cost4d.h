@@ -24,7 +24,27 @@
 #define TANS4D_LENGTH_SYMS      1
 #define TANS4D_OFFSET_SYMS      2
 
+// Arrival costs are in 1/TANS4D_COST_SCALE bits to allow fractional
+// tANS symbol costs.
+#define TANS4D_COST_SCALE       8
+
 class zxpac4d_cost: public lz_cost<zxpac4d_cost> {
+public:
+    /**
+     * @brief Predicted tANS symbol costs used by the arrival cost calculation.
+     *
+     * Static costs are used until update_tans_costs() derives the costs
+     * from the tANS tables of the previous parsing pass.
+     */
+    struct tans_costs {
+        bool adaptive;
+        int length[TANS4D_NUM_MATCH_SYM];
+        int offset[TANS4D_NUM_OFFSET_SYM];
+    };
+private:
+    int m_min_offset_bits;
+    tans_costs m_tans_costs;
+
     // tANS symbol frequencies
     int m_match_sym_freq[TANS4D_NUM_MATCH_SYM];
     int m_offset_sym_freq[TANS4D_NUM_OFFSET_SYM];
@@ -37,12 +57,15 @@ public:
         const lz_config* p_cfg, int ins=-1, int max=-1);
     ~zxpac4d_cost(void);
 
+    // Offsets up to the window size, lengths up to the maximum match
+    typedef cost_table<int32_t,uint16_t> cost_t;
+
     // Base class interface method implementations
-    int impl_literal_cost(int pos, cost* c, const char* buf);
-    int impl_match_cost(int pos, cost* c, const char* buf, int offset, int length);
-    int impl_init_cost(cost* c, int sta, int len, int pmr);
-    cost* impl_alloc_cost(int len, int max_chain);
-    int impl_free_cost(cost* cost);
+    int impl_literal_cost(int pos, const cost_t& c, const char* buf);
+    int impl_match_cost(int pos, const cost_t& c, const char* buf, int offset, int length);
+    int impl_init_cost(const cost_t& c, int sta, int len, int pmr);
+    cost_t impl_alloc_cost(int len, int max_chain);
+    int impl_free_cost(cost_t& c);
 
     int impl_get_offset_bits(int offset);
     int impl_get_length_bits(int length);
@@ -54,12 +77,16 @@ public:
 
     // New API specific to zxpac4c
     ans_state_t get_tans_state(int type);    
+    void set_tans_state(int type, ans_state_t state);
     void build_tans_tables(void);
     int inc_tans_symbol_freq(int type, uint8_t symbol);
     void set_tans_symbol_freqs(int type, uint8_t* freqs=NULL, int len=0);
     const int* get_tans_scaled_symbol_freqs(int type, int& len);
 
     int predict_tans_cost(int type, int value);
+    void update_tans_costs(void);
+    const tans_costs& get_tans_costs(void) const { return m_tans_costs; }
+    void set_tans_costs(const tans_costs& costs) { m_tans_costs = costs; }
     void dump(int type);
 
 };
@@ -1,11 +1,22 @@
 /**
  * @file hash.h
- * @version 0.1
- * @date 10-Apr-2024
+ * @version 0.2
+ * @date 17-Oct-2026
  * @author Jouni 'Mr.Spiv' Korhonen
  * @brief Hash-based string matcher for LZ engines.
  * @copyright The Unlicense
  *
+ * The hash chain matcher is a template over the number of hashed bytes
+ * and the hash table size. A 2 byte hash is the exact concatenation of
+ * the bytes. 3 and 4 byte hashes are multiplicative, which keeps chains
+ * of common byte pairs short. Since they cannot find 2 byte matches, an
+ * exact 2 byte table holding the most recent position of each byte pair
+ * is kept alongside. It provides the shortest offset 2 byte match.
+ *
+ * Chain links are stored as distances to the previous position with the
+ * same hash, 0 ending the chain. Windows up to 32K fit into 16-bit links,
+ * which halves the chain table and its cache footprint. The next chain
+ * link and candidate are prefetched while the current one is compared.
  */
 
 #ifndef _HASH_H_INCLUDED
@@ -14,18 +25,31 @@
 #include <iostream>
 #include "lz_util.h"
 #include <cstdint>
+#include <limits>
 
-// https://www3.risc.jku.at/people/hemmecke/AldorCombinat/combinatse20.html
-// No magic here. I just selected one prime that fits between 15 and 16 bits.
-#define HASH_MAGIC 46027
+// Knuth's multiplicative hashing constant i.e. 2^32 / golden ratio.
+#define HASH_MULTIPLIER 2654435761U
 
 #define HASH_SIZE  (1<<16)
 #define HASH_MASK  (HASH_SIZE-1)
 
+#define HASH_BYTES_MIN  2
+#define HASH_BYTES_MAX  4
+#define HASH_BITS_MUL   17      // Table size of 3 and 4 byte hashes
+
+#define HASH_LINK16_WINDOW_MAX  32768   // Largest window for 16-bit links
+
+
+template<int HASH_BYTES, int HASH_BITS, typename LINK_T=uint32_t>
+class hash_chain : public lz_match<hash_chain<HASH_BYTES,HASH_BITS,LINK_T> > {
+    static_assert(HASH_BYTES >= HASH_BYTES_MIN && HASH_BYTES <= HASH_BYTES_MAX,
+        "Unsupported hash width");
+    static_assert(HASH_BYTES > 2 || HASH_BITS == 16,
+        "2 byte hash must be 16 bits");
 
-class hash3 : public lz_match<hash3> {
     int* m_head;
-    int* m_next;
+    int* m_head2;       ///< Exact 2 byte table, only with 3 and 4 byte hashes
+    LINK_T* m_next;     ///< Distance to the previous position, 0 ends
     match* m_mtch;
     int m_mask;
     int m_max_chain;
@@ -35,7 +59,7 @@ class hash3 : public lz_match<hash3> {
     int m_min_match2_threshold_offset;
     int m_min_match3_threshold_offset;
 
-    int hash(const char *buf, int pos)
+    int hash2(const char *buf, int pos)
     {
         // Note, this function does not care about the end of file.
         // Having enough buffer beyond the end of the file is left
@@ -43,18 +67,40 @@ class hash3 : public lz_match<hash3> {
         unsigned int hh = 0;
         hh = (static_cast<uint8_t>(buf[pos++]) << 8);
         hh |= static_cast<uint8_t>(buf[pos]);
-        return hh; 
+        return hh;
+    }
+    int hash(const char *buf, int pos)
+    {
+        if constexpr (HASH_BYTES == 2) {
+            return hash2(buf,pos);
+        } else {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(buf + pos);
+            uint32_t hh = p[0] | (p[1] << 8) | (p[2] << 16);
+
+            if constexpr (HASH_BYTES == 4) {
+                hh |= static_cast<uint32_t>(p[3]) << 24;
+            }
+
+            return (hh * HASH_MULTIPLIER) >> (32 - HASH_BITS);
+        }
     }
 
 public:
-    hash3(int window_size, int min_match, int max_match,
+    hash_chain(int window_size, int min_match, int max_match,
         int good_match,
         int mm2_thres_offset,
         int mm3_thres_offset);
-    ~hash3(void);
-    
+    ~hash_chain(void);
+
     void impl_init_get_matches(int max_matches, match *matches = NULL);
     int impl_find_matches(const char *buf, int pos, int len, bool only_better_matches);
     void impl_reinit(void);
 };
+
+// The original 2 byte hash3 and its multiplicative wider variants
+template<typename LINK_T> using hash3_t = hash_chain<2,16,LINK_T>;
+template<typename LINK_T> using hash3_mul3_t = hash_chain<3,HASH_BITS_MUL,LINK_T>;
+template<typename LINK_T> using hash3_mul4_t = hash_chain<4,HASH_BITS_MUL,LINK_T>;
+typedef hash3_t<uint32_t> hash3;
+
 #endif
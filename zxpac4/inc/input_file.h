@@ -0,0 +1,52 @@
+/**
+ * @file input_file.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief The input file buffer of the compressor.
+ * @copyright The Unlicense
+ *
+ * The input file is mapped copy-on-write into memory instead of reading
+ * it into an allocated buffer. The preprocessing and reversing may still
+ * modify the buffer, which only copies the touched pages. The buffer is
+ * followed by zeroed padding bytes, since the hash functions read a few
+ * bytes past the end of the file. If the file cannot be mapped it is
+ * read into an allocated buffer as before.
+ *
+ * The output file is not mapped. Its size is only known once the encoder
+ * is done, the compressed data is then written with a single write() from
+ * the encoder buffer, and the amiga target seeks back into the stream to
+ * patch the hunk headers. A mapped output would need the final size up
+ * front and still copy the buffer once, thus it would not save anything.
+ */
+
+#ifndef _INPUT_FILE_H_INCLUDED
+#define _INPUT_FILE_H_INCLUDED
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+class input_file {
+    char* m_buf;
+    size_t m_map_size;          ///< 0 if the buffer was allocated
+    bool map(const std::string& name, int len, int pad);
+public:
+    input_file(void) : m_buf(NULL), m_map_size(0) {}
+    ~input_file(void) { release(); }
+
+    /**
+     * @brief Load the file of @p len bytes into a buffer followed by
+     *        @p pad zero bytes.
+     *
+     * @param[in] name The name of the file.
+     * @param[in] ifs  The opened file, used if mapping fails.
+     *
+     * @return A pointer to the buffer or NULL on error.
+     */
+    char* load(const std::string& name, std::ifstream& ifs, int len, int pad);
+    void release(void);
+    bool is_mapped(void) const { return m_map_size > 0; }
+};
+
+#endif  // _INPUT_FILE_H_INCLUDED
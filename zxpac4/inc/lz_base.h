@@ -16,7 +16,13 @@
 #include <iostream>
 #include <cassert>
 #include "cstdint"
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <vector>
 #include "lz_util.h"
+#include "match_len.h"
 
 /**
  * \def LZ_MAX_COST     Maximum cost for LZ cost calculations. Used to initialize
@@ -32,26 +38,161 @@
 #define DEBUG_LEVEL_EXTRA   2
 
 /**
- * @struct cost lz_base.h inc/lz_base.h
- * @brief A structure to hold match-length pairs for a LZ string matching engine.
+ * @class cost_table lz_base.h inc/lz_base.h
+ * @brief A handle to the per position cost bookkeeping of the LZ parsers.
+ *
+ * The costs are stored as a structure of arrays. The hot arrival costs are
+ * kept in their own contiguous array and the offset and length fields are
+ * only as wide as the algorithm needs. The handle behaves like a pointer to
+ * the old array of cost structures: h[n].field, h->field and h + n work as
+ * before, h[n] just returns references into the separate arrays.
+ *
+ * A table smaller than the file can be used as a sliding window over the
+ * positions, see slide(). The positions are always absolute file positions.
+ *
+ * @tparam OFFSET_T Type for offsets, must hold the window size.
+ * @tparam LENGTH_T Type for match lengths, must hold the maximum match.
  */
 
-#define MAX_NUM_OF_PMR          1   // Override this in your code if needed
+template<typename OFFSET_T, typename LENGTH_T> class cost_table {
+    uint32_t* m_arrival_cost;
+    int32_t* m_next;
+    OFFSET_T* m_offset;
+    LENGTH_T* m_length;
+    OFFSET_T* m_pmr_offset;
+    int16_t* m_num_literals;    
+    bool* m_last_was_literal;
+    int m_base;                 ///< File position of the first entry
+public:
+    struct ref {
+        uint32_t& arrival_cost;
+        int32_t& next;
+        OFFSET_T& offset;
+        LENGTH_T& length;
+        OFFSET_T& pmr_offset;
+        int16_t& num_literals;      ///< Number of consequtive literal up to this match node.
+        bool& last_was_literal;
+        ref* operator->(void) {
+            return this;
+        }
+    };
 
+    cost_table(void) :
+        m_arrival_cost(NULL), m_next(NULL), m_offset(NULL), m_length(NULL),
+        m_pmr_offset(NULL), m_num_literals(NULL), m_last_was_literal(NULL),
+        m_base(0) {}
 
-struct cost {
-    int32_t next;
-    int32_t offset;
-    int32_t length;
-    int32_t pmr_offsets[MAX_NUM_OF_PMR];
-    uint32_t arrival_cost;
-    int16_t num_literals;       ///< Number of consequtive literal up to this match node.
-    bool last_was_literal;
-};
+    ref operator[](int n) const {
+        n -= m_base;
+        return ref{m_arrival_cost[n], m_next[n], m_offset[n], m_length[n],
+            m_pmr_offset[n], m_num_literals[n], m_last_was_literal[n]};
+    }
+    ref operator->(void) const {
+        return (*this)[m_base];
+    }
+    cost_table operator+(int n) const {
+        cost_table c;
+        n -= m_base;
+        c.m_arrival_cost = m_arrival_cost + n;
+        c.m_next = m_next + n;
+        c.m_offset = m_offset + n;
+        c.m_length = m_length + n;
+        c.m_pmr_offset = m_pmr_offset + n;
+        c.m_num_literals = m_num_literals + n;
+        c.m_last_was_literal = m_last_was_literal + n;
+        return c;
+    }
+    explicit operator bool(void) const {
+        return m_arrival_cost != NULL;
+    }
 
-#define pmr_offset  pmr_offsets[0]
+    /**
+     * @brief Slide the table forward. The positions from @p base to @p end
+     *        move to the beginning of the table and @p base becomes its
+     *        first position. The positions after @p end are left as is.
+     */
+    void slide(int base, int end) {
+        int from = base - m_base;
+        int n = end - base + 1;
 
+        std::memmove(m_arrival_cost,m_arrival_cost+from,n*sizeof(*m_arrival_cost));
+        std::memmove(m_next,m_next+from,n*sizeof(*m_next));
+        std::memmove(m_offset,m_offset+from,n*sizeof(*m_offset));
+        std::memmove(m_length,m_length+from,n*sizeof(*m_length));
+        std::memmove(m_pmr_offset,m_pmr_offset+from,n*sizeof(*m_pmr_offset));
+        std::memmove(m_num_literals,m_num_literals+from,n*sizeof(*m_num_literals));
+        std::memmove(m_last_was_literal,m_last_was_literal+from,n*sizeof(*m_last_was_literal));
+        m_base = base;
+    }
 
+    /**
+     * @brief Undo the slides, i.e. make the first entry file position 0
+     *        again for the next file.
+     */
+    void rewind(void) {
+        m_base = 0;
+    }
+
+    /**
+     * @brief Allocate a cost table for @p len positions.
+     *
+     * @param[in] len        The number of positions.
+     * @param[in] max_offset The largest offset to be stored.
+     * @param[in] max_length The largest match length to be stored.
+     *
+     * @return A handle to the first position.
+     * @throw std::out_of_range if offsets or lengths do not fit.
+     */
+    static cost_table alloc(int len, unsigned max_offset, unsigned max_length) {
+        cost_table c;
+
+        if (max_offset > std::numeric_limits<OFFSET_T>::max() ||
+            max_length > std::numeric_limits<LENGTH_T>::max()) {
+            EXCEPTION(std::out_of_range,"Window or match length too big for the cost table.");
+        }
+
+        c.m_arrival_cost = new uint32_t[len];
+        c.m_next = new int32_t[len];
+        c.m_offset = new OFFSET_T[len];
+        c.m_length = new LENGTH_T[len];
+        c.m_pmr_offset = new OFFSET_T[len];
+        c.m_num_literals = new int16_t[len];
+        c.m_last_was_literal = new bool[len];
+        return c;
+    }
+
+    /**
+     * @brief Release a cost table returned by alloc().
+     */
+    static void free(cost_table& c) {
+        delete[] c.m_arrival_cost;
+        delete[] c.m_next;
+        delete[] c.m_offset;
+        delete[] c.m_length;
+        delete[] c.m_pmr_offset;
+        delete[] c.m_num_literals;
+        delete[] c.m_last_was_literal;
+        c = cost_table();
+    }
+};
+
+/**
+ * Token types of the selected parse.
+ */
+#define LZ_TOKEN_LITERAL    0       // A literal or a run of literals
+#define LZ_TOKEN_MATCH      1       // A match with an explicit offset
+#define LZ_TOKEN_PMR        2       // A PMR match or a PMR literal
+
+/**
+ * @struct lz_token lz_base.h inc/lz_base.h
+ * @brief A literal run, match or PMR of the selected parse. Unlike in the
+ *        cost table, the offset of a PMR is always the PMR offset.
+ */
+struct lz_token {
+    int32_t offset;     ///< 0 for literals
+    uint16_t length;    ///< Match length or the number of literals
+    uint8_t type;
+};
 
 
 /**
@@ -66,7 +207,38 @@ struct cost {
 #define LZ_CFG_MASK		0x7f
 #define LZ_CFG_BOOLMASK	0x01
 
+/**
+ * String matchers selectable with lz_config::matcher.
+ */
+#define LZ_MATCHER_HASH3    0       // Hash chains, see hash.h
+#define LZ_MATCHER_BINTREE  1       // Binary trees, see bintree.h
+#define LZ_MATCHER_SUFFIX   2       // Suffix array, see suffix_array.h
+#define LZ_MATCHER_ZARRAY   3       // Z-array, see z_alg.h
+#define LZ_MATCHER_ZARRAY_INC   4   // Incremental Z-array, see z_alg.h
+#define LZ_MATCHER_MAX      LZ_MATCHER_ZARRAY_INC+1
+
+/**
+ * Parsers selectable with lz_config::parse_level.
+ */
+#define LZ_PARSE_OPTIMAL    0       // Arrival cost optimal parse
+#define LZ_PARSE_GREEDY     1       // Greedy parse, see lz_fast.h
+#define LZ_PARSE_LAZY1      2       // One step lazy parse, see lz_fast.h
+#define LZ_PARSE_LAZY2      3       // Two step lazy parse, see lz_fast.h
+#define LZ_PARSE_MAX        LZ_PARSE_LAZY2+1
+
+/**
+ * Algorithms selectable with lz_config::algorithm.
+ */
+#define ZXPAC4              0
+#define ZXPAC4B             1
+#define ZXPAC4_32K          2
+#define ZXPAC4C             3
+#define ZXPAC4D             4
+#define ZXPAC_DEFAULT       ZXPAC4
+#define ZXPAC_MAX           ZXPAC4D+1
+
 
+struct lz_speed_cycles;
 
 typedef struct lz_config {
     int window_size;                                // Only power of two allowed
@@ -82,8 +254,20 @@ typedef struct lz_config {
     int initial_pmr_offset;
     int debug_level;                                // 
     int algorithm;                                  // Selected algorithm..
+    int matcher;                                    // Selected string matcher..
+    int hash_bytes;                                 // Hashed bytes for hash3 matcher
+    int num_threads;                                // Match search threads
+    const char* match_cache;                        // Match cache directory or NULL
+    int max_passes;                                 // Optimal parsing passes
+    int parse_block;                                // Windowed parse block or 0
+    int parse_level;                                // Selected parser..
+    int parse_split;                                // Parallel parse blocks
+    const char* token_file;                         // Dump the selected parse here or NULL
+    int speed_lambda;                               // Bits per 1000 decompression cycles
+    const lz_speed_cycles* speed_cycles;            // Cycles of the tokens, see lz_speed.h
     //
     bool only_better_matches;
+    bool match_ladder;                              // One match per length
     mutable uint8_t reverse_file;                   // Safe to change by target constructor
     mutable uint8_t reverse_encoded;                // Safe to change by target constructor
     mutable uint8_t is_ascii;                        // Safe to change by target constructor
@@ -107,9 +291,8 @@ protected:
     int m_max_bits;
 
     int check_match(const char* s, const char* d, int max) {
-        int len = 0;
-        while (*s++ == *d++ && ++len < max); 
-        return len;
+        assert(max > 0);
+        return match_length(s,d,max);
     }
 
 public:
@@ -129,20 +312,24 @@ public:
     const lz_config* lz_get_config(void) {
         return m_lz_config;
     }
-    int literal_cost(int pos, cost* c, const char* buf) {
+    // The file length when the cost table does not cover the whole file
+    void set_max_len(int len) {
+        m_max_len = len;
+    }
+    template<class C> int literal_cost(int pos, const C& c, const char* buf) {
         return impl().impl_literal_cost(pos,c,buf);
     }
-    int match_cost(int pos, cost* c, const char* buf, int offset, int length) {
+    template<class C> int match_cost(int pos, const C& c, const char* buf, int offset, int length) {
         return impl().impl_match_cost(pos,c,buf,offset,length);
     }
-    int init_cost(cost* c, int sta, int len, int pmr) {
+    template<class C> int init_cost(const C& c, int sta, int len, int pmr) {
         return impl().impl_init_cost(c,sta,len,pmr);
     }
-    cost* alloc_cost(int len, int max_chain) {
+    auto alloc_cost(int len, int max_chain) {
         return impl().impl_alloc_cost(len,max_chain);
     }
-    int free_cost(cost* cost) {
-        return impl().impl_free_cost(cost);
+    template<class C> int free_cost(C& c) {
+        return impl().impl_free_cost(c);
     }
     int get_offset_bits(int offset) {
         return impl().impl_get_offset_bits(offset);
@@ -182,9 +369,77 @@ protected:
     // debugs and configs
     const lz_config* m_lz_config;
     int m_security_distance;
+    int m_inplace_margin;               ///< Smallest read minus written bytes
+    std::vector<lz_token> m_tokens;     ///< The selected parse
+
+    /**
+     * @brief Start replaying the in-place decompression of the encoded
+     *        tokens.
+     *
+     *  An in-place decompressor has the compressed data at the end of
+     *  the destination buffer (or at its beginning when decompressing
+     *  backwards from a reversed file) and must never write over the
+     *  compressed bytes it has not read yet. The security distance is
+     *  the exact number of bytes the buffer must exceed the decompressed
+     *  length so that this holds after every token.
+     */
+    void inplace_begin(void) {
+        m_inplace_margin = std::numeric_limits<int>::max();
+        m_security_distance = 0;
+    }
+
+    /**
+     * @brief Replay one token of the in-place decompression.
+     *
+     * @param[in] read    The compressed bytes read after the token, the
+     *                    header and the partially used tag bytes included.
+     * @param[in] written The decompressed bytes written after the token.
+     */
+    void inplace_token(int read, int written) {
+        m_inplace_margin = std::min(m_inplace_margin,read - written);
+    }
+
+    /**
+     * @brief Finish the replay and set the security distance.
+     *
+     * @param[in] compressed_len The final length of the compressed data.
+     * @param[in] len            The length of the decompressed data.
+     */
+    void inplace_end(int compressed_len, int len) {
+        if (m_inplace_margin < std::numeric_limits<int>::max()) {
+            m_security_distance = std::max(0,compressed_len - len - m_inplace_margin);
+        }
+    }
+
+    /**
+     * @brief Append a literal, match or PMR of the cost table to the
+     *        selected parse.
+     *
+     * @param[in] offset       The offset in the cost table, 0 for a literal
+     *                         or a PMR match.
+     * @param[in] length       The length in the cost table.
+     * @param[in] pmr_offset   The PMR offset after the literal or match.
+     * @param[in] literal_runs True if consecutive literals are merged
+     *                         into one run.
+     */
+    void add_token(int offset, int length, int pmr_offset, bool literal_runs) {
+        if (offset == 0 && length == 1) {
+            if (literal_runs && !m_tokens.empty() && m_tokens.back().type == LZ_TOKEN_LITERAL &&
+                m_tokens.back().length < std::numeric_limits<uint16_t>::max()) {
+                ++m_tokens.back().length;
+            } else {
+                m_tokens.push_back(lz_token{0,1,LZ_TOKEN_LITERAL});
+            }
+        } else if (offset == 0 || length == 1) {
+            m_tokens.push_back(lz_token{offset > 0 ? offset : pmr_offset,
+                static_cast<uint16_t>(length),LZ_TOKEN_PMR});
+        } else {
+            m_tokens.push_back(lz_token{offset,static_cast<uint16_t>(length),LZ_TOKEN_MATCH});
+        }
+    }
 public:
     lz_base(const lz_config* p_cfg): m_lz_config(p_cfg), 
-        m_security_distance(0) { }
+        m_security_distance(0), m_inplace_margin(0) { }
     virtual ~lz_base(void) { }
 
     // The interface definition for the base LZ class..
@@ -199,10 +454,15 @@ public:
      */
     virtual int lz_search_matches(char* buf, int len, int interval) = 0;
     virtual int lz_parse(const char* buf, int len, int interval) = 0;
-    virtual const cost* lz_get_result(void) = 0;
-    virtual const cost* lz_cost_array_get(int len) = 0;
+    virtual void lz_cost_array_get(int len) = 0;
     virtual void lz_cost_array_done(void) = 0;
     virtual int lz_encode(char* buf, int len, char* outb, std::ofstream* ofs) = 0;
+    /**
+     * Prepares the engine for the next file, so that a long lived engine
+     * compresses it exactly like a new one. The string matcher and the
+     * cost table keep their memory, see lz_cost_array_get().
+     */
+    virtual void lz_reset(void) = 0;
     
     // Methods implemented within the base class
     int get_num_literals(void) const {
@@ -223,6 +483,9 @@ public:
     int get_security_distance(void) const {
         return m_security_distance;
     }
+    const std::vector<lz_token>& get_tokens(void) const {
+        return m_tokens;
+    }
 };
 
 
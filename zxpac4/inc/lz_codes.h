@@ -0,0 +1,145 @@
+/**
+ * @file lz_codes.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Compile time code tables for the offset and length encodings.
+ * @copyright The Unlicense
+ *
+ * The prefix coded offsets and the interleaved Elias-gamma lengths of
+ * zxpac4, zxpac4b and zxpac4_32k only depend on the bit width of the
+ * value. Their codes are described once per format and expanded at
+ * compile time into tables indexed with the bit width, which the cost
+ * calculation and the encoder both use.
+ *
+ * An offset is encoded as a byte, possibly followed by a prefix and the
+ * low bits of the offset that did not fit into the byte:
+ * @verbatim
+   0ooooooo                                 offsets 1 to 127
+   1ooooooo + prefix + shift low bits       offsets from 128 up
+ @endverbatim
+ * The first offset class holds the offsets of 7 bits or less and each
+ * following class one more bit.
+ */
+
+#ifndef _LZ_CODES_H_INCLUDED
+#define _LZ_CODES_H_INCLUDED
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+#define LZ_CODE_MAX_WIDTH       32
+#define LZ_GAMMA_MAX_WIDTH      16
+
+/**
+ * @brief The number of bits needed to represent @p value, 0 for 0.
+ */
+constexpr int lz_bit_width(uint32_t value)
+{
+    return std::bit_width(value);
+}
+
+/**
+ * @brief The prefix of an offset class.
+ */
+struct lz_offset_class {
+    uint16_t prefix;
+    uint8_t prefix_bits;
+};
+
+/**
+ * @brief The encoding of offsets of the same bit width.
+ */
+struct lz_offset_code {
+    uint8_t bits;       ///< All bits including the offset byte, 0 for a PMR
+    uint8_t tag_bits;   ///< Bits after the offset byte
+    uint8_t shift;      ///< Low bits of the offset after the prefix
+    uint16_t tag;       ///< The prefix shifted above the low bits
+};
+
+typedef std::array<lz_offset_code,LZ_CODE_MAX_WIDTH+1> lz_offset_codes;
+typedef std::array<uint8_t,LZ_GAMMA_MAX_WIDTH+1> lz_gamma_codes;
+
+/**
+ * @brief Expand the offset classes of a format into a table indexed
+ *        with the bit width of the offset. Widths beyond the last class
+ *        are left empty.
+ */
+template<size_t N> constexpr lz_offset_codes lz_make_offset_codes(const lz_offset_class (&classes)[N])
+{
+    lz_offset_codes codes{};
+
+    for (int width = 1; width <= LZ_CODE_MAX_WIDTH; width++) {
+        size_t cls = width <= 7 ? 0 : width - 7;
+
+        if (cls < N) {
+            codes[width].shift = width <= 8 ? 0 : width - 8;
+            codes[width].tag_bits = classes[cls].prefix_bits + codes[width].shift;
+            codes[width].tag = classes[cls].prefix << codes[width].shift;
+            codes[width].bits = 8 + codes[width].tag_bits;
+        }
+    }
+
+    return codes;
+}
+
+/**
+ * @brief The lengths of the interleaved Elias-gamma codes indexed with
+ *        the bit width of the value. The code of @p max_width bits drops
+ *        its terminating 0 bit.
+ */
+constexpr lz_gamma_codes lz_make_gamma_codes(int max_width)
+{
+    lz_gamma_codes codes{};
+
+    for (int width = 1; width <= LZ_GAMMA_MAX_WIDTH; width++) {
+        codes[width] = 2 * width - 1 - (width == max_width ? 1 : 0);
+    }
+
+    return codes;
+}
+
+/**
+ * @brief Gamma code lengths for each maximum width.
+ */
+constexpr std::array<lz_gamma_codes,LZ_GAMMA_MAX_WIDTH+1> lz_gamma_table = [] {
+    std::array<lz_gamma_codes,LZ_GAMMA_MAX_WIDTH+1> table{};
+
+    for (int max_width = 1; max_width <= LZ_GAMMA_MAX_WIDTH; max_width++) {
+        table[max_width] = lz_make_gamma_codes(max_width);
+    }
+
+    return table;
+}();
+
+/**
+ * @brief Build the interleaved Elias-gamma code of @p value.
+ *
+ * @param[in]  value     The value to encode, > 0.
+ * @param[in]  max_width The bit width whose code drops the terminating
+ *                       0 bit.
+ * @param[out] bit_tag   The code.
+ *
+ * @return The number of bits in the code.
+ */
+inline int lz_gamma_tag(int value, int max_width, int& bit_tag)
+{
+    int width = lz_bit_width(value);
+    int mask;
+
+    bit_tag = 0;
+
+    for (mask = 1 << width >> 2; mask > 0; mask >>= 1) {
+        bit_tag = (bit_tag | 0x1) << 2;
+        bit_tag = mask & value ? bit_tag | 0x2 : bit_tag;
+    }
+    if (width == max_width) {
+        bit_tag >>= 1;
+    }
+
+    return lz_gamma_table[max_width][width];
+}
+
+#endif  // _LZ_CODES_H_INCLUDED
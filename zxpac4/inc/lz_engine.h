@@ -0,0 +1,349 @@
+/**
+ * @file lz_engine.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief The common optimal parsing engine of the zxpac4 formats.
+ * @copyright The Unlicense
+ *
+ * All zxpac4 formats find the matches and relax the arrival costs the
+ * same way, and only differ in their cost classes, how the selected
+ * parse is fixed up and how it is encoded. The lz_engine template holds
+ * the shared part. It is instantiated with the engine class itself
+ * (CRTP) and its cost class, thus the hooks and the cost calculation of
+ * the hot loop are resolved at compile time for each format. Only the per
+ * file lz_base interface remains virtual.
+ *
+ * The string matcher is selected at run time and called through the
+ * match_finder function pointers. Templating the engine on the matcher
+ * as well would compile every format for every matcher, window and link
+ * type combination. The 'bench dispatch' test measures the cost of the
+ * indirect calls against direct calls.
+ *
+ * An engine may replace the following hooks:
+ *  - impl_search_init(buf,len) prepares the cost table for a new search.
+ *  - impl_search_position(pos,num) is called with the matches of each
+ *    position and returns false if the position must not be relaxed.
+ *  - impl_search_done(len) is called when all positions are searched.
+ *  - impl_reset() clears the engine specific state between files.
+ *
+ * An engine may compress several files. lz_reset() is called between
+ * the files and the cost table is only reallocated when a file needs a
+ * bigger one.
+ *
+ * The parallel block-split parse does not call impl_search_position().
+ */
+
+#ifndef _LZ_ENGINE_H_INCLUDED
+#define _LZ_ENGINE_H_INCLUDED
+
+#include <iostream>
+#include <iomanip>
+#include <cctype>
+#include <cassert>
+#include "lz_base.h"
+#include "match_finder.h"
+#include "lz_fast.h"
+#include "lz_split.h"
+#include "lz_window.h"
+
+template<class ENGINE, class COST> class lz_engine : public lz_base {
+    ENGINE& engine() { return *static_cast<ENGINE*>(this); }
+protected:
+    match_finder m_lz;
+    typename COST::cost_t m_cost_array;
+    match* m_match_array;
+    int m_alloc_len;
+    COST m_cost;
+
+    void cost_position(const char* buf, int pos, int len, const match* matches, int num);
+    void collect_tokens(bool literal_runs);
+    void debug_costs(const char* buf, int len);
+public:
+    lz_engine(const lz_config* p_cfg);
+    virtual ~lz_engine(void);
+    int lz_search_matches(char* buf, int len, int interval);
+    void lz_cost_array_get(int len);
+    void lz_cost_array_done(void);
+    void lz_reset(void);
+
+    // Default hooks
+    void impl_search_init(const char* buf, int len) {
+        (void)buf;
+        m_cost.init_cost(m_cost_array,0,len,m_lz_config->initial_pmr_offset);
+    }
+    bool impl_search_position(int pos, int num) {
+        (void)pos;
+        (void)num;
+        return true;
+    }
+    void impl_search_done(int len) {
+        (void)len;
+    }
+    void impl_reset(void) {
+    }
+};
+
+template<class ENGINE, class COST>
+lz_engine<ENGINE,COST>::lz_engine(const lz_config* p_cfg) :
+    lz_base(p_cfg),
+    m_lz(p_cfg),  // may throw exception
+    m_cost_array(),
+    m_cost(p_cfg)
+{
+    m_match_array = new match[match_finder::match_array_size(p_cfg)];
+    m_alloc_len  = 0;
+}
+
+template<class ENGINE, class COST>
+lz_engine<ENGINE,COST>::~lz_engine(void)
+{
+    if (m_cost_array) {
+        lz_cost_array_done();
+    }
+
+    delete[] m_match_array;
+}
+
+template<class ENGINE, class COST>
+int lz_engine<ENGINE,COST>::lz_search_matches(char* buf, int len, int interval)
+{
+    int pos;
+    int num;
+
+    // Unused at the moment..
+    (void)interval;
+
+    // init statistics
+    m_num_literals = 0;
+    m_num_pmr_literals = 0;
+    m_num_matches = 0;
+    m_num_matched_bytes = 0;
+    m_num_pmr_matches = 0;
+
+    engine().impl_search_init(buf,len);
+
+    if (m_lz_config->verbose) {
+        std::cout << "Finding all matches" << std::endl;
+    }
+    if (m_lz_config->parse_level != LZ_PARSE_OPTIMAL) {
+        // Greedy or lazy parse along the selected path only
+        lz_fast_parser<COST,typename COST::cost_t> fast(m_lz,m_cost,m_lz_config,m_match_array);
+        return fast.parse(buf,len,m_cost_array);
+    }
+    if (lz_split_parser<COST,typename COST::cost_t>::num_blocks(len,m_lz_config) > 1) {
+        // Per position hooks are not called in the parallel parse
+        lz_split_parser<COST,typename COST::cost_t> split(m_lz,m_cost,m_lz_config);
+        split.parse(buf,len,m_cost_array);
+        engine().impl_search_done(len);
+        return 0;
+    }
+    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
+        std::cerr << ">- Match debugging phase --------------------------------------------------------\n";
+        std::cerr << "  file pos: asc (hx) -> offset:length(s) or 'no macth'\n";
+    }
+
+    for (pos = 0; pos < len; pos++) {
+        m_lz.init_get_matches(m_lz_config->max_chain,m_match_array);
+
+        // Find all matches at this position. Returned 'num' is the
+        // the number of found matches.
+        num = m_lz.find_matches(buf,pos,len-pos,m_lz_config->only_better_matches);
+
+        if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
+            std::cerr << std::setw(10) << std::dec << std::setfill(' ') << pos << ": '"
+                << (std::isprint(buf[pos]) ? buf[pos] : ' ')
+                << "' (" << std::setw(2) << std::setfill('0') << std::hex << (buf[pos] & 0xff)
+                << std::dec << std::setw(0) <<  ") -> " << num << ": ";
+            if (num > 0) {
+                for (int n = 0; n < num; n++) {
+                    assert(m_match_array[n].offset < m_lz_config->window_size);
+                    assert(m_match_array[n].length <= m_lz_config->max_match);
+                    std::cerr << m_match_array[n].offset << ":"
+                              << m_match_array[n].length << " ";
+                }
+            } else {
+                std::cerr << "no match";
+            }
+            std::cerr << "\n";
+        }
+        if (engine().impl_search_position(pos,num)) {
+            cost_position(buf,pos,len,m_match_array,num);
+        }
+    }
+
+    engine().impl_search_done(len);
+    return 0;
+}
+
+/**
+ * @brief Relax the arrival costs of a literal and the given matches at
+ *        the position @p pos.
+ */
+template<class ENGINE, class COST>
+void lz_engine<ENGINE,COST>::cost_position(const char* buf, int pos, int len, const match* matches, int num)
+{
+    int offset, length;
+
+    // always do literal cost calculation
+    m_cost.literal_cost(pos,m_cost_array,buf);
+
+    // match cost calculation if not at the end of file and there was a match
+    if (pos < (len - m_lz_config->min_match)) {
+        for (int match_pos = 0; match_pos < num; match_pos++) {
+            offset = matches[match_pos].offset;
+            length = matches[match_pos].length;
+            length = m_cost.match_cost(pos,m_cost_array,buf,offset,length);
+        }
+    }
+}
+
+/**
+ * @brief Turn the linked parse of the cost table into the token stream,
+ *        so that the cost table is no longer needed for encoding.
+ *
+ * @param[in] literal_runs True if consecutive literals are merged into
+ *                         one literal run token.
+ */
+template<class ENGINE, class COST>
+void lz_engine<ENGINE,COST>::collect_tokens(bool literal_runs)
+{
+    size_t num = 0;
+    int pos = 0;
+
+    // Reserve exactly to keep the peak memory use low
+    while ((pos = m_cost_array[pos].next)) {
+        ++num;
+    }
+
+    m_tokens.clear();
+    m_tokens.reserve(num);
+
+    while ((pos = m_cost_array[pos].next)) {
+        add_token(m_cost_array[pos].offset,m_cost_array[pos].length,
+            m_cost_array[pos].pmr_offset,literal_runs);
+    }
+}
+
+template<class ENGINE, class COST>
+void lz_engine<ENGINE,COST>::lz_cost_array_get(int len)
+{
+    if (len < 1) {
+       return;
+    }
+
+    // The windowed parse only needs a part of the cost table
+    len = lz_window<typename COST::cost_t>::table_size(len,m_lz_config->parse_block,
+        m_lz_config->max_match) - 1;
+
+    if (m_alloc_len >= len) {
+        // Reuse the table of a previous file, it only needs the length
+        m_cost.set_max_len(len);
+        return;
+    }
+
+    lz_cost_array_done();
+    m_cost_array = m_cost.alloc_cost(len,m_lz_config->max_chain);
+    m_alloc_len = len;
+}
+
+template<class ENGINE, class COST>
+void lz_engine<ENGINE,COST>::lz_cost_array_done(void)
+{
+    if (m_alloc_len > 0) {
+        m_cost.free_cost(m_cost_array);
+    }
+    m_alloc_len = 0;
+}
+
+/**
+ * @brief Forget the previous file. The matcher tables are cleared and the
+ *        cost table slid by a windowed parse starts from position 0.
+ */
+template<class ENGINE, class COST>
+void lz_engine<ENGINE,COST>::lz_reset(void)
+{
+    m_lz.reinit();
+    m_cost_array.rewind();
+    m_tokens.clear();
+    engine().impl_reset();
+}
+
+/**
+ * @brief Dump the cost table and the selected parse to stderr, depending
+ *        on the debug level.
+ */
+template<class ENGINE, class COST>
+void lz_engine<ENGINE,COST>::debug_costs(const char* buf, int len)
+{
+    int pos;
+
+    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
+        std::cerr << ">- Cost debugging phase ------------------------------------------------------" << std::endl;
+        std::cerr << "  file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr" << std::endl;
+        pos = 0;
+
+        while (pos < len+1) {
+            std::cerr
+                // cost array position
+                << std::setw(10) << std::setfill(' ') << pos << ": '"
+                // ascii character at the same file position
+                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
+                // same as hexadecimal
+                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
+                // length of the literal run
+                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals
+                // PMR offset
+                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
+                // match offset, may be 0 if PMR was selected
+                << std::setw(6) << m_cost_array[pos].offset
+                // match length
+                << ":" << std::setw(3) << m_cost_array[pos].length
+                // arrival cost
+                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
+                // next position in cost array
+                << " -> " << std::setw(10) << m_cost_array[pos].next << " "
+                // mark possible PMR match
+                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(l)" : "")
+                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(m)" : "")
+                << "\n";
+            ++pos;
+        }
+    }
+    if (m_lz_config->debug_level > DEBUG_LEVEL_NONE) {
+        std::cerr << ">- Show final selected -------------------------------------------------------" << std::endl;
+        std::cerr << "     file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr    " << std::endl;
+        pos = m_cost_array[0].next;
+
+        do {
+            std::cerr
+                // Final debug marker
+                << "F: "
+                // cost array position
+                << std::setw(10) << std::setfill(' ') << pos << ": '"
+                // ascii character at the same file position
+                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
+                // same as hexadecimal
+                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
+                // length of the literal run
+                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals
+                // PMR offset
+                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
+                // match offset, may be 0 if PMR was selected
+                << std::setw(6) << m_cost_array[pos].offset
+                // match length
+                << ":" << std::setw(3) << m_cost_array[pos].length
+                // arrival cost
+                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
+                // next position in cost array
+                << " -> " << std::setw(10) << m_cost_array[pos].next << " "
+                // mark possible PMR match
+                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(L)" : "")
+                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(M)" : "")
+                << "\n";
+            pos = m_cost_array[pos].next;
+        } while (pos > 0);
+    }
+}
+
+#endif  // _LZ_ENGINE_H_INCLUDED
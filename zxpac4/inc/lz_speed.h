@@ -0,0 +1,163 @@
+/**
+ * @file lz_speed.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Decompression time of the tokens for the speed aware parsing.
+ * @copyright The Unlicense
+ *
+ * The optimal parse minimizes bits + lambda * cycles when a lambda is
+ * given. The cycles of a literal, a match and a PMR are estimated from
+ * the shipped decompressors of zxpac4 and zxpac4_32k, the Z80 T-states
+ * from z80/z80tap.asm and the 68000 cycles from m68k/zxpac4_exe.asm.
+ * Reading a tag bit is counted as its average, i.e. a bit buffer refill
+ * every eighth bit. The ASCII literals are counted as binary literals.
+ *
+ * The lambda is given in bits per 1000 cycles. Rounding the cycles of
+ * each token to whole bits would turn a small lambda into no cost for
+ * cheap tokens and a cost for the others, thus with a lambda all arrival
+ * costs are kept in 1/16 bits instead. Fewer fraction bits are used if a
+ * long input with a large lambda would not fit into the arrival costs.
+ */
+
+#ifndef _LZ_SPEED_H_INCLUDED
+#define _LZ_SPEED_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+#include "lz_base.h"
+#include "lz_codes.h"
+
+// Maximum fraction bits of the arrival costs when a lambda is set
+#define LZ_SPEED_FRAC_BITS  4
+
+/**
+ * @brief The decompression cycles of the tokens on one CPU.
+ */
+struct lz_speed_cycles {
+    const char* cpu;
+    uint16_t literal;       ///< A literal with its tag bit
+    uint16_t match;         ///< A match of 2 bytes with an offset below 128
+    uint16_t pmr;           ///< A PMR of 1 byte
+    uint16_t long_offset;   ///< Added for an offset from 128 up
+    uint16_t prefix_bit;    ///< Per offset prefix bit
+    uint16_t low_bit;       ///< Per low offset bit after the prefix
+    uint16_t length_pair;   ///< Per bit pair of the gamma coded length
+    uint16_t copy_byte;     ///< Per byte beyond the match or the PMR above
+};
+
+inline constexpr lz_speed_cycles lz_speed_z80 = {
+    "Z80", 58, 388, 275, 25, 42, 50, 64, 32
+};
+inline constexpr lz_speed_cycles lz_speed_68000 = {
+    "68000", 56, 214, 160, 40, 30, 38, 54, 24
+};
+
+inline int lz_speed_literal_cycles(const lz_speed_cycles& cycles)
+{
+    return cycles.literal;
+}
+
+inline int lz_speed_match_cycles(const lz_speed_cycles& cycles, const lz_offset_code& code, int length)
+{
+    int n = cycles.match + (length - 2) * cycles.copy_byte;
+
+    n += (lz_bit_width(length - 1) - 1) * cycles.length_pair;
+
+    if (code.bits > 8) {
+        n += cycles.long_offset + (code.tag_bits - code.shift) * cycles.prefix_bit;
+        n += code.shift * cycles.low_bit;
+    }
+
+    return n;
+}
+
+inline int lz_speed_pmr_cycles(const lz_speed_cycles& cycles, int length)
+{
+    return cycles.pmr + (length - 1) * cycles.copy_byte +
+        (lz_bit_width(length) - 1) * cycles.length_pair;
+}
+
+/**
+ * @brief Estimate the decompression cycles of the selected parse.
+ */
+inline uint64_t lz_speed_parse_cycles(const lz_speed_cycles& cycles, const lz_offset_codes& codes,
+    const std::vector<lz_token>& tokens)
+{
+    uint64_t n = 0;
+
+    for (const lz_token& token : tokens) {
+        switch (token.type) {
+        case LZ_TOKEN_LITERAL:
+            n += uint64_t(token.length) * lz_speed_literal_cycles(cycles);
+            break;
+        case LZ_TOKEN_MATCH:
+            n += lz_speed_match_cycles(cycles,codes[lz_bit_width(token.offset)],token.length);
+            break;
+        default:
+            n += lz_speed_pmr_cycles(cycles,token.length);
+            break;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * @class lz_speed_cost lz_speed.h inc/lz_speed.h
+ * @brief The arrival cost of the tokens. Unless both lz_config::speed_lambda
+ *        and lz_config::speed_cycles are set, the cost is the encoded bits
+ *        of the token. Otherwise it is the bits plus the lambda weighted
+ *        cycles, both in fixed point with up to LZ_SPEED_FRAC_BITS fraction
+ *        bits.
+ */
+class lz_speed_cost {
+    const lz_speed_cycles* m_cycles;
+    int m_lambda;
+    int m_frac_bits;
+
+    uint32_t cost(int bits, int cycles) const {
+        return (uint32_t(bits) << m_frac_bits) +
+            (int64_t(m_lambda) * cycles * (1 << m_frac_bits) + 500) / 1000;
+    }
+public:
+    lz_speed_cost(const lz_config* p_cfg) :
+        m_cycles(p_cfg->speed_cycles),
+        m_lambda(p_cfg->speed_cycles ? p_cfg->speed_lambda : 0),
+        m_frac_bits(LZ_SPEED_FRAC_BITS) {}
+
+    uint32_t literal(int bits) const {
+        return m_lambda ? cost(bits,lz_speed_literal_cycles(*m_cycles)) : bits;
+    }
+    uint32_t match(int bits, const lz_offset_code& code, int length) const {
+        return m_lambda ? cost(bits,lz_speed_match_cycles(*m_cycles,code,length)) : bits;
+    }
+    uint32_t pmr(int bits, int length) const {
+        return m_lambda ? cost(bits,lz_speed_pmr_cycles(*m_cycles,length)) : bits;
+    }
+
+    /**
+     * @brief Select the fraction bits so that the arrival costs of @p len
+     *        literals fit below LZ_MAX_COST. Half of it is left for the
+     *        match costs.
+     *
+     * @param[in] len          The length of the input.
+     * @param[in] literal_bits The bits of the most expensive literal.
+     *
+     * @return none.
+     * @throw std::out_of_range if the input is too long for the lambda.
+     */
+    void init_length(int len, int literal_bits) {
+        m_frac_bits = LZ_SPEED_FRAC_BITS;
+
+        while (m_lambda && int64_t(len) * literal(literal_bits) > LZ_MAX_COST / 2) {
+            if (m_frac_bits == 0) {
+                EXCEPTION(std::out_of_range,"Input too long for the speed lambda.");
+            }
+
+            --m_frac_bits;
+        }
+    }
+};
+
+#endif  // _LZ_SPEED_H_INCLUDED
@@ -0,0 +1,266 @@
+/**
+ * @file lz_split.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Parallel block-split optimal parsing.
+ * @copyright The Unlicense
+ *
+ * The input is cut into blocks, whose arrival costs are relaxed in
+ * parallel, each block on its own thread. All matches are searched into
+ * the match store first, thus matches still reach back into the earlier
+ * blocks. A block starts with a zero arrival cost and the initial PMR
+ * offset, and stops relaxing one maximum match before its end, so that no
+ * two threads ever write the same part of the cost table.
+ *
+ * The blocks are then stitched together from the last boundary to the
+ * first. Around each boundary the selected path of the left block is
+ * followed back from its last relaxed position a stitch distance beyond
+ * the unrelaxed gap, and the final path from the right a stitch distance
+ * into the right block. The positions between the two path nodes are
+ * relaxed again serially with the arrival cost and PMR state of the left
+ * node, and matches may not cross the right node.
+ *
+ * A block assumed the initial PMR offset at its start, thus the PMR state
+ * along the stitched path may differ from what a block used. A final pass
+ * follows the path and turns a PMR match with the wrong PMR offset into
+ * a normal match, and a PMR literal into a literal. The output format is
+ * unchanged, only the ratio may be a bit worse than with a serial parse.
+ */
+
+#ifndef _LZ_SPLIT_H_INCLUDED
+#define _LZ_SPLIT_H_INCLUDED
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include "lz_base.h"
+#include "match_finder.h"
+
+#define LZ_SPLIT_MIN_BLOCK      65536
+#define LZ_SPLIT_STITCH         4096
+
+template<class COST, class COST_T> class lz_split_parser {
+    match_finder& m_lz;
+    COST& m_cost;
+    const lz_config* m_cfg;
+    const char* m_buf;
+    int m_len;
+    int m_gap;                  ///< Unrelaxed positions at the end of a block
+    int m_fixups;               ///< PMRs turned into matches or literals
+    std::vector<int> m_start;   ///< Block starts followed by the file length
+    std::vector<int> m_path;
+
+    // Relax a position with matches that end at or before end
+    void relax(const COST_T& c, int pos, int end, match* matches) {
+        int num = m_lz.get_stored_matches(pos,matches,m_cfg->max_chain);
+        int length;
+
+        m_cost.literal_cost(pos,c,m_buf);
+
+        if (pos < m_len - m_cfg->min_match) {
+            for (int n = 0; n < num; n++) {
+                length = matches[n].length < end - pos ? matches[n].length : end - pos;
+
+                if (length >= m_cfg->min_match) {
+                    m_cost.match_cost(pos,c,m_buf,matches[n].offset,length);
+                }
+            }
+        }
+    }
+
+    void relax_block(const COST_T& c, int block) {
+        std::vector<match> matches(match_finder::match_array_size(m_cfg));
+        int start = m_start[block];
+        int end = block+1 < int(m_start.size())-1 ? m_start[block+1] - m_gap : m_len;
+
+        if (block > 0) {
+            m_cost.init_cost(c,start,start,m_cfg->initial_pmr_offset);
+        }
+        for (int pos = start; pos < end; pos++) {
+            relax(c,pos,m_len,matches.data());
+        }
+    }
+
+    /**
+     * @brief Relax the positions around the boundary of a block again.
+     *
+     * @param[inout] c     The cost table.
+     * @param[in]    block The block right of the boundary.
+     * @param[in]    right A node of the final path right of the boundary.
+     *
+     * @return The left node of the stitched region, which is on the
+     *         final path.
+     */
+    int stitch(const COST_T& c, int block, int right) {
+        std::vector<match> matches(match_finder::match_array_size(m_cfg));
+        int boundary = m_start[block];
+        int left = boundary - m_gap;
+        int pos;
+
+        while (right - c[right].length >= boundary + LZ_SPLIT_STITCH) {
+            right -= c[right].length;
+        }
+        while (left > boundary - m_gap - LZ_SPLIT_STITCH) {
+            left -= c[left].length;
+        }
+        for (pos = left+1; pos <= right; pos++) {
+            c[pos].arrival_cost = LZ_MAX_COST;
+        }
+
+        // No PMR match of the cost class may cross the right node either
+        m_cost.set_max_len(right);
+
+        for (pos = left; pos < right; pos++) {
+            relax(c,pos,right,matches.data());
+        }
+
+        m_cost.set_max_len(m_len);
+        return left;
+    }
+
+    // Fix the PMRs that do not match the PMR state of the stitched path
+    void fix_pmrs(const COST_T& c) {
+        int pmr = m_cfg->initial_pmr_offset;
+        int offset;
+        int length;
+        int used;
+        int pos;
+
+        m_path.clear();
+
+        for (pos = m_len; pos > 0; pos -= c[pos].length) {
+            m_path.push_back(pos);
+        }
+        for (auto p = m_path.rbegin(); p != m_path.rend(); ++p) {
+            offset = c[*p].offset;
+            length = c[*p].length;
+
+            if (offset > 0 && length > 1) {
+                pmr = offset;
+            } else if (offset > 0 || length > 1) {
+                used = offset > 0 ? offset : c[*p].pmr_offset;
+
+                if (used != pmr) {
+                    if (length == 1) {
+                        c[*p].offset = 0;
+                    } else {
+                        c[*p].offset = used;
+                        pmr = used;
+                    }
+                    ++m_fixups;
+                }
+            }
+            c[*p].pmr_offset = pmr;
+        }
+    }
+public:
+    lz_split_parser(match_finder& lz, COST& cost, const lz_config* p_cfg) :
+        m_lz(lz), m_cost(cost), m_cfg(p_cfg), m_buf(NULL), m_len(0),
+        m_gap(p_cfg->max_match + 1), m_fixups(0) {}
+
+    /**
+     * @brief The number of blocks to parse a file of @p len bytes in.
+     *        A block must be long enough to keep the stitched regions
+     *        apart.
+     */
+    static int num_blocks(int len, const lz_config* p_cfg) {
+        int min_block = 4 * (p_cfg->max_match + 1 + LZ_SPLIT_STITCH);
+        int num = p_cfg->parse_split;
+
+        if (min_block < LZ_SPLIT_MIN_BLOCK) {
+            min_block = LZ_SPLIT_MIN_BLOCK;
+        }
+        if (num > len / min_block) {
+            num = len / min_block;
+        }
+
+        return num > 1 ? num : 1;
+    }
+
+    /**
+     * @brief Parse the @p buf into the cost table @p c, which must have
+     *        been initialized with init_cost().
+     *
+     * @return 0.
+     * @throw Exceptions of the threads are passed to the caller.
+     */
+    int parse(const char* buf, int len, const COST_T& c) {
+        int num = num_blocks(len,m_cfg);
+        int right;
+        int n;
+
+        m_buf = buf;
+        m_len = len;
+        m_fixups = 0;
+        m_start.clear();
+
+        for (n = 0; n < num; n++) {
+            m_start.push_back(int(int64_t(len) * n / num));
+        }
+        m_start.push_back(len);
+
+        if (m_cfg->verbose) {
+            std::cout << "Parsing in " << num << " blocks in parallel" << std::endl;
+        }
+
+        auto t_start = std::chrono::steady_clock::now();
+        m_lz.store_matches(buf,len,m_cfg->max_chain,m_cfg->only_better_matches);
+        auto t_matches = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(num);
+
+        auto worker = [&](int b) {
+            try {
+                relax_block(c,b);
+            } catch (...) {
+                errors[b] = std::current_exception();
+            }
+        };
+
+        for (n = 1; n < num; n++) {
+            threads.emplace_back(worker,n);
+        }
+
+        worker(0);
+
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (auto& e : errors) {
+            if (e) {
+                std::rethrow_exception(e);
+            }
+        }
+
+        auto t_relax = std::chrono::steady_clock::now();
+        right = len;
+
+        for (n = num-1; n > 0; n--) {
+            right = stitch(c,n,right);
+        }
+
+        fix_pmrs(c);
+        m_lz.release_matches();
+
+        if (m_cfg->verbose) {
+            std::chrono::duration<double,std::milli> match_ms = t_matches - t_start;
+            std::chrono::duration<double,std::milli> relax_ms = t_relax - t_matches;
+            std::chrono::duration<double,std::milli> stitch_ms = std::chrono::steady_clock::now() - t_relax;
+
+            std::cout << "Stitched " << num-1 << " block boundaries, fixed "
+                      << m_fixups << " PMRs" << std::endl;
+            std::cout << "Split parse times: matches " << std::fixed << std::setprecision(1)
+                      << match_ms.count() << " ms, blocks " << relax_ms.count()
+                      << " ms, stitching " << stitch_ms.count() << " ms" << std::defaultfloat << std::endl;
+        }
+
+        return 0;
+    }
+};
+
+#endif  // _LZ_SPLIT_H_INCLUDED
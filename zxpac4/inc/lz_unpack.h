@@ -0,0 +1,57 @@
+/**
+ * @file lz_unpack.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Native decompressors of the zxpac4 formats.
+ * @copyright The Unlicense
+ *
+ * The decompressors take the encoded data as lz_encode() returned it,
+ * i.e. without the target specific headers, and reversed if it was
+ * saved with --reverse-encoded. A --reverse-file input is decompressed
+ * back into its original order. The ASCII literal mode is taken from
+ * the header, the rest from the lz_config the file was compressed with:
+ * the algorithm, max_match, reverse_encoded, reverse_file and
+ * preshift_last_ascii_literal.
+ *
+ * The zxpac4c and zxpac4d files cannot be decompressed. Their header
+ * holds the tANS states before the first symbol, while the tANS tables
+ * decode the symbols in the reverse order starting from the final
+ * states.
+ */
+
+#ifndef _LZ_UNPACK_H_INCLUDED
+#define _LZ_UNPACK_H_INCLUDED
+
+#include "lz_base.h"
+
+#define LZ_UNPACK_CORRUPT       -1
+#define LZ_UNPACK_UNSUPPORTED   -2
+#define LZ_UNPACK_OVERFLOW      -3
+
+/**
+ * @brief Check if the algorithm of @p p_cfg can be decompressed.
+ */
+bool lz_unpack_supported(const lz_config* p_cfg);
+
+/**
+ * @brief The decompressed length of the file from its header.
+ *
+ * @return The length or LZ_UNPACK_CORRUPT.
+ */
+int lz_unpack_length(const char* p_in, int in_len, const lz_config* p_cfg);
+
+/**
+ * @brief Decompress a file.
+ *
+ * @param[in]  p_in    The encoded data.
+ * @param[in]  in_len  The length of the encoded data.
+ * @param[out] p_out   The buffer for the decompressed data.
+ * @param[in]  out_len The size of the buffer.
+ * @param[in]  p_cfg   The configuration the file was compressed with.
+ *
+ * @return The decompressed length or a negative LZ_UNPACK_ error.
+ */
+int lz_unpack(const char* p_in, int in_len, char* p_out, int out_len, const lz_config* p_cfg);
+
+#endif  // _LZ_UNPACK_H_INCLUDED
@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <exception>
+#include <cstdint>
 
 #define EXCEPTION(exp,str) throw(exp(std::string(__FILE__) + ":" +  \
             std::to_string(__LINE__) + " " + #str))
@@ -47,63 +48,67 @@ public:
 };
 
 
+/**
+ * @brief The bit writer of the history formats.
+ *
+ * The bits go into tag bytes interleaved with the raw bytes. A tag byte
+ * is reserved at the output position where its first bit is written.
+ * A tag byte that was filled exactly is stored and the next one reserved
+ * only when more bits follow, thus raw bytes written in between come
+ * before the next tag byte.
+ *
+ * The bits are shifted into a 64-bit accumulator, which holds the bits
+ * of the current tag byte and of the value being written. All completed
+ * tag bytes of a value are stored in one loop. Raw bytes are stored
+ * directly, thus the pointer returned by byte() can be used to modify
+ * the byte later.
+ */
 class putbits_history : public putbits<putbits_history> {
-    int m_bb;
-    int m_bc;
+    uint64_t m_acc;             ///< Bits, the current tag byte in the low m_fill
+    int m_fill;                 ///< Bits in the current tag byte, 0 to 8
     char* m_bitbuf_tag_ptr;
     char* m_bitbuf_ptr;
     char* m_start_ptr;
 public:
     putbits_history(char* p_buf) {
-        m_bb = 0;
-        m_bc = 8;
+        m_acc = 0;
+        m_fill = 0;
         m_bitbuf_tag_ptr = NULL;
         m_bitbuf_ptr = p_buf;
         m_start_ptr = p_buf;
     }
     ~putbits_history(void) { impl_flush();  }
     char* impl_bits(int value, int num_bits) {
-        int t;
-
         if (m_bitbuf_tag_ptr == NULL) {
             m_bitbuf_tag_ptr = m_bitbuf_ptr++;
         }
-        if (num_bits > 8) {
-            t = num_bits - 8;
-            // put remaining high order bits
-            bits(value>>8,t);
-            // and then low order 8 bits
-            num_bits = 8;
-            value &= 0xff;
-        }
-        
-        char* p_old_pos = m_bitbuf_ptr;   
-        m_bb = (m_bb << num_bits) | value;
-
-        //if (num_bits >= m_bc) {
-        if (num_bits > m_bc) {
-            t = num_bits - m_bc;
-            *m_bitbuf_tag_ptr = m_bb >> t;
+
+        // A filled tag byte is stored only after the new bits are in,
+        // since a value may have stray bits above num_bits
+        char* p_old_pos = m_bitbuf_ptr;
+        m_acc = (m_acc << num_bits) | uint32_t(value);
+        m_fill += num_bits;
+
+        while (m_fill > 8) {
+            m_fill -= 8;
+            *m_bitbuf_tag_ptr = m_acc >> m_fill;
             m_bitbuf_tag_ptr = m_bitbuf_ptr++;
-            m_bc = 8;
-            num_bits = t;
         }
-          
-        m_bc -= num_bits;
+
         return p_old_pos;
     }
     char* impl_flush(void) {
         char* p_old_pos = m_bitbuf_ptr;
-        if (m_bc < 8) {
-            *m_bitbuf_tag_ptr = m_bb << m_bc;
+        if (m_fill > 0) {
+            *m_bitbuf_tag_ptr = m_acc << (8 - m_fill);
             m_bitbuf_tag_ptr = m_bitbuf_ptr++;
-            m_bc = 8;
+            m_fill = 0;
         }
         return p_old_pos;
     }
     char* impl_byte(int byte) {
         char* p_old_pos = m_bitbuf_ptr;
-        *m_bitbuf_ptr++ = byte & 0xff;
+        *m_bitbuf_ptr++ = byte;
         return p_old_pos;
     }
     int impl_size(void) {
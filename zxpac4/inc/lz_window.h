@@ -0,0 +1,180 @@
+/**
+ * @file lz_window.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Bounded memory windowed optimal parsing.
+ * @copyright The Unlicense
+ *
+ * The optimal parsers relax the arrival costs of the whole file into a
+ * cost table and then backtrack the selected path from the end of the
+ * file. In the windowed mode the cost table only holds a block of
+ * positions plus the maximum match length, and slides forward over the
+ * file.
+ *
+ * When a block has been relaxed, the arrival costs up to the current
+ * position are final. Every path to a later position leaves from the
+ * current position or from a predecessor of a position not yet relaxed.
+ * The selected paths back from those are followed until they meet. The
+ * path up to the meeting point belongs to the final parse whatever comes
+ * later, thus it is committed and the table slides to the meeting point.
+ * The committed parse is the same as with the whole file cost table.
+ *
+ * If the paths do not meet within half a block, the path is forced
+ * through the current position or the end of a match over it, whichever
+ * has the lowest arrival cost relative to the bit rate so far. The later
+ * positions are relaxed again from there, and the positions before it
+ * are not relaxed at all. Such a checkpoint may lose a better parse over
+ * it, but keeps the memory use bounded. A block of twice the maximum
+ * match length or more rarely needs one.
+ */
+
+#ifndef _LZ_WINDOW_H_INCLUDED
+#define _LZ_WINDOW_H_INCLUDED
+
+#include <set>
+#include <vector>
+#include "lz_base.h"
+
+template<typename COST_T> class lz_window {
+    int m_block;            ///< Positions relaxed between commits, 0 for the whole file
+    int m_size;             ///< Positions held by the cost table
+    int m_base;             ///< First position held by the cost table
+    int m_len;              ///< Length of the file
+    int m_commits;
+    int m_forced;           ///< Number of forced checkpoints
+    std::set<int> m_heads;
+    std::vector<int> m_path;
+
+    int last_position(void) const {
+        return m_base + m_size - 1 < m_len ? m_base + m_size - 1 : m_len;
+    }
+public:
+    lz_window(void) :
+        m_block(0), m_size(0), m_base(0), m_len(0), m_commits(0), m_forced(0) {}
+
+    /**
+     * @brief The number of positions the cost table must hold.
+     *
+     * @param[in] len       The file length.
+     * @param[in] block     The parse block size or 0 for the whole file.
+     * @param[in] max_match The maximum match length.
+     *
+     * @return The number of cost table positions.
+     */
+    static int table_size(int len, int block, int max_match) {
+        if (block > 0 && len > block + max_match) {
+            return block + max_match + 1;
+        }
+        return len + 1;
+    }
+
+    void init(int len, int block, int max_match) {
+        m_size = table_size(len,block,max_match);
+        m_block = m_size < len + 1 ? block : 0;
+        m_base = 0;
+        m_len = len;
+        m_commits = 0;
+        m_forced = 0;
+    }
+
+    bool windowed(void) const { return m_block > 0; }
+    int get_commits(void) const { return m_commits; }
+    int get_base(void) const { return m_base; }
+    int get_forced(void) const { return m_forced; }
+
+    /**
+     * @return The last position to initialize in a fresh cost table.
+     */
+    int get_init_len(void) const { return m_size - 1 < m_len ? m_size - 1 : m_len; }
+
+    /**
+     * @return True if relaxing the position @p pos could write beyond
+     *         the cost table.
+     */
+    bool is_full(int pos) const {
+        return m_block > 0 && pos > m_base + m_block;
+    }
+
+    /**
+     * @brief Commit the final part of the selected path and slide the
+     *        cost table forward.
+     *
+     * @param[inout] c   The cost table.
+     * @param[in]    pos The next position to relax. Arrival costs up to
+     *                   it are final. At the end of the file the whole
+     *                   remaining path is committed.
+     * @param[in]   emit Called with the end position of each committed
+     *                   literal or match in the file order.
+     */
+    template<typename F> void commit(COST_T& c, int pos, F emit) {
+        int end = last_position();
+        int to;
+        int n;
+
+        // Paths to positions not yet relaxed leave from these
+        m_heads.clear();
+        m_heads.insert(pos);
+
+        for (n = pos+1; n <= end; n++) {
+            if (c[n].arrival_cost != LZ_MAX_COST && n - c[n].length < pos) {
+                m_heads.insert(n - c[n].length);
+            }
+        }
+        // Step the latest path back until all paths meet
+        while (m_heads.size() > 1) {
+            n = *m_heads.rbegin();
+            m_heads.erase(n);
+            m_heads.insert(n - c[n].length);
+        }
+
+        to = *m_heads.begin();
+
+        if (pos < m_len && pos - to > m_block / 2) {
+            // No convergence. Force the path through the frontier position
+            // that has the lowest arrival cost relative to the bit rate so
+            // far. A long match over pos is kept this way.
+            double rate = double(c[pos].arrival_cost - c[m_base].arrival_cost) / (pos - m_base);
+            double best = 0;
+            double score;
+
+            to = pos;
+
+            for (n = pos+1; n <= end; n++) {
+                if (c[n].arrival_cost != LZ_MAX_COST && n - c[n].length < pos) {
+                    score = double(c[n].arrival_cost) - c[pos].arrival_cost - rate * (n - pos);
+
+                    if (score < best) {
+                        best = score;
+                        to = n;
+                    }
+                }
+            }
+            for (n = to+1; n <= end; n++) {
+                c[n].arrival_cost = LZ_MAX_COST;
+            }
+            ++m_forced;
+        }
+
+        m_path.clear();
+        for (n = to; n > m_base; n -= c[n].length) {
+            m_path.push_back(n);
+        }
+        for (auto p = m_path.rbegin(); p != m_path.rend(); ++p) {
+            emit(*p);
+        }
+
+        ++m_commits;
+
+        if (pos < m_len) {
+            c.slide(to,end);
+            m_base = to;
+
+            for (n = end+1; n <= last_position(); n++) {
+                c[n].arrival_cost = LZ_MAX_COST;
+            }
+        }
+    }
+};
+
+#endif  // _LZ_WINDOW_H_INCLUDED
@@ -0,0 +1,110 @@
+/**
+ * @file m68k_emu.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief A host side 68000 emulator for timing the Amiga decompressors.
+ * @copyright The Unlicense
+ *
+ * The emulator runs the user mode integer instructions of the 68000 in
+ * a flat 16M address space and counts their clock cycles as given in the
+ * MC68000 user's manual. The cycles are those of a 68000 without wait
+ * states, i.e. the chip memory DMA contention is not emulated. The
+ * supervisor mode, exceptions, BCD arithmetic and MOVEP are not
+ * supported, and stop the emulation. So do odd word and long accesses,
+ * which would raise an address error on a real 68000.
+ */
+
+#ifndef _M68K_EMU_H_INCLUDED
+#define _M68K_EMU_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+#define M68K_MEM_SIZE       (1<<24)
+
+class m68k_emu {
+    // A decoded effective address
+    struct ea_t {
+        int mode;               ///< 0 Dn, 1 An, 2 memory, 3 immediate
+        int reg;
+        uint32_t addr;          ///< Memory address or the immediate value
+    };
+
+    std::vector<uint8_t> m_mem;
+    uint32_t m_d[8];
+    uint32_t m_a[8];
+    uint32_t m_pc;
+    uint8_t m_ccr;
+    uint64_t m_cycles;
+    int m_op_cycles;
+    bool m_error;
+    uint16_t m_opcode;
+
+    uint8_t rd8(uint32_t addr) {
+        return m_mem[addr & (M68K_MEM_SIZE-1)];
+    }
+    void wr8(uint32_t addr, uint8_t value) {
+        m_mem[addr & (M68K_MEM_SIZE-1)] = value;
+    }
+    uint16_t rd16(uint32_t addr);
+    uint32_t rd32(uint32_t addr);
+    void wr16(uint32_t addr, uint16_t value);
+    void wr32(uint32_t addr, uint32_t value);
+    uint32_t rd(uint32_t addr, int size);
+    void wr(uint32_t addr, int size, uint32_t value);
+    uint16_t fetch16(void);
+    uint32_t fetch32(void);
+
+    uint32_t index_addr(uint32_t base);
+    ea_t ea_decode(int mode, int reg, int size, bool move_dst=false);
+    uint32_t ea_read(const ea_t& ea, int size);
+    void ea_write(const ea_t& ea, int size, uint32_t value);
+    uint32_t ea_control(int mode, int reg, const int cycles[7]);
+
+    bool cond(int cc) const;
+    void set_nz(uint32_t value, int size);
+    uint32_t add(uint32_t src, uint32_t dst, int size, bool with_x, bool cmp=false);
+    uint32_t sub(uint32_t src, uint32_t dst, int size, bool with_x, bool cmp=false);
+    uint32_t shift(int type, bool left, uint32_t value, int count, int size);
+
+    void unsupported(void);
+    void exec_immediate(void);
+    void exec_bit(void);
+    void exec_move(void);
+    void exec_misc(void);
+    void exec_movem(void);
+    void exec_quick(void);
+    void exec_branch(void);
+    void exec_arith(void);
+    void exec_logic(void);
+    void exec_shift(void);
+    void exec_muldiv(void);
+public:
+    m68k_emu(void);
+
+    void reset(void);
+    void load(uint32_t addr, const void* p, int len);
+    uint8_t peek(uint32_t addr) const { return m_mem[addr & (M68K_MEM_SIZE-1)]; }
+    void poke(uint32_t addr, uint8_t value) { m_mem[addr & (M68K_MEM_SIZE-1)] = value; }
+    void poke16(uint32_t addr, uint16_t value);
+    void poke32(uint32_t addr, uint32_t value);
+    void push32(uint32_t value);
+
+    /**
+     * @brief Execute one instruction.
+     *
+     * @return The clock cycles of the instruction or -1 if the instruction
+     *         is not supported or caused an address error.
+     */
+    int step(void);
+
+    uint32_t get_pc(void) const { return m_pc; }
+    uint32_t get_sp(void) const { return m_a[7]; }
+    void set_pc(uint32_t pc) { m_pc = pc; }
+    void set_sp(uint32_t sp) { m_a[7] = sp; }
+    uint64_t cycles(void) const { return m_cycles; }
+    uint16_t opcode(void) const { return m_opcode; }
+};
+
+#endif  // _M68K_EMU_H_INCLUDED
@@ -0,0 +1,76 @@
+/**
+ * @file match_finder.h
+ * @version 0.2
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief A run time selectable string matcher for LZ engines.
+ * @copyright The Unlicense
+ *
+ * The LZ engines own one match_finder, which forwards the lz_match<>
+ * interface to the string matcher selected in the lz_config. When more
+ * than one thread or a match cache is configured, the matches of all
+ * positions are streamed through a match_store, which is started on the
+ * first position.
+ *
+ * The parallel parse searches all matches into the match store up front
+ * with store_matches(), and then gets them from several threads with the
+ * get_stored_matches() method, which does not touch the matcher state.
+ *
+ * In the match ladder mode the found matches are turned into one match
+ * per length, from the minimum match up to the good match, each with the
+ * nearest offset reaching that length, and the longest found match with
+ * its nearest offset. The caller's match array
+ * must then hold match_finder::match_array_size() matches.
+ */
+
+#ifndef _MATCH_FINDER_H_INCLUDED
+#define _MATCH_FINDER_H_INCLUDED
+
+#include "lz_base.h"
+#include "lz_util.h"
+#include "hash.h"
+#include "bintree.h"
+#include "suffix_array.h"
+#include "z_alg.h"
+
+class match_store;
+
+class match_finder : public lz_match<match_finder> {
+    int m_type;
+    // The selected matcher and its lz_match<> interface
+    void* m_matcher;
+    void (*m_init_get_matches)(void* p, int max_matches, match* matches);
+    int (*m_find_matches)(void* p, const char* buf, int pos, int len, bool only_better);
+    void (*m_reinit)(void* p);
+    void (*m_delete)(void* p);
+    match_store* m_store;
+    match* m_mtch;
+    int m_max_chain;
+    // Match ladder mode
+    match* m_found;     ///< Matches found before building the ladder
+    int m_found_size;   ///< Size of m_found i.e. the raw --max-chain
+    int* m_nearest;     ///< Nearest offset for each length
+    int m_min_match;
+    int m_max_match;
+    int m_good_match;
+
+    template<class M> void attach(M* p_matcher);
+    template<typename LINK_T> void attach_hash(const lz_config* p_cfg);
+    int build_ladder(int num);
+public:
+    match_finder(const lz_config* p_cfg);
+    ~match_finder(void);
+
+    void impl_init_get_matches(int max_matches, match *matches = NULL);
+    int impl_find_matches(const char *buf, int pos, int len, bool only_better_matches);
+    void impl_reinit(void);
+
+    void store_matches(const char* buf, int len, int max_chain, bool only_better_matches);
+    int get_stored_matches(int pos, match* matches, int max_matches) const;
+    void release_matches(void);
+
+    int get_type(void) const { return m_type; }
+    static int match_array_size(const lz_config* p_cfg);
+};
+
+#endif  // _MATCH_FINDER_H_INCLUDED
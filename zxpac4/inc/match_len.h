@@ -0,0 +1,80 @@
+/**
+ * @file match_len.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Match length extension kernels for string matchers and cost
+ *        calculation.
+ * @copyright The Unlicense
+ *
+ * Most match candidates fail within the first few bytes, thus the first
+ * 8 bytes are compared inline with a single XOR and count trailing zeros.
+ * Longer matches continue in a kernel selected at run time: AVX2 (32
+ * bytes per step), SSE2 (16 bytes per step) or portable 8-byte XOR.
+ */
+
+#ifndef _MATCH_LEN_H_INCLUDED
+#define _MATCH_LEN_H_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+
+
+typedef int (*match_len_func_t)(const char* s, const char* d, int max);
+
+// Run time selected kernel for the bytes after the first 8
+extern match_len_func_t match_length_long;
+
+int match_length_u64(const char* s, const char* d, int max);
+#if defined(__x86_64__) || defined(__i386__)
+int match_length_sse2(const char* s, const char* d, int max);
+int match_length_avx2(const char* s, const char* d, int max);
+#endif
+const char* match_length_kernel_name(void);
+
+/**
+ * @brief Return the index of the first differing byte given two
+ *        differing 64-bit words loaded from memory.
+ */
+static inline int match_length_diff64(uint64_t x)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_clzll(x) >> 3;
+#else
+    return __builtin_ctzll(x) >> 3;
+#endif
+}
+
+/**
+ * @brief Calculate the length of the common prefix of two strings.
+ *
+ * @param[in] s   A ptr to the first string.
+ * @param[in] d   A ptr to the second string.
+ * @param[in] max The maximum length to compare. Must be at least 1.
+ *                No bytes beyond @p max are read.
+ *
+ * @return The number of equal bytes, at most @p max.
+ */
+static inline int match_length(const char* s, const char* d, int max)
+{
+    uint64_t a, b;
+    int len = 0;
+
+    if (max >= 8) {
+        ::memcpy(&a,s,8);
+        ::memcpy(&b,d,8);
+
+        if (a ^ b) {
+            return match_length_diff64(a ^ b);
+        }
+
+        return 8 + match_length_long(s + 8,d + 8,max - 8);
+    }
+    while (len < max && s[len] == d[len]) {
+        ++len;
+    }
+
+    return len;
+}
+
+#endif  // _MATCH_LEN_H_INCLUDED
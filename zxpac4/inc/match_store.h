@@ -0,0 +1,146 @@
+/**
+ * @file match_store.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Multi-threaded match search into a per-position match store.
+ * @copyright The Unlicense
+ *
+ * The input is split into shards, which are searched in parallel, each
+ * with its own string matcher instance. A matcher first runs over the
+ * window size worth of input preceding its shard without storing the
+ * matches, thus the history seen at the start of the shard is the same
+ * as in a serial search. The found matches are stored per position and
+ * then handed out to the serial cost calculation one position at a time.
+ * The stored matches are always the raw matcher output; the --ladder
+ * mode is applied afterwards by the match_finder, thus it is not a part
+ * of the cache parameters.
+ *
+ * The store needs up to max chain matches per position, which is far
+ * more than the input itself. When the positions are consumed in order,
+ * stream() searches the shards on worker threads at most the number of
+ * threads ahead of the consumer, and a shard is released once the
+ * consumer has moved past it. The memory use then depends on the thread
+ * count and the shard size but not on the input length. search() keeps
+ * all matches and is used when positions are needed in any order.
+ *
+ * Optionally the stored matches are saved into a cache directory. The
+ * cache file name is derived from a hash of the input and the matcher
+ * parameters. A later search with the same input and parameters memory
+ * maps the file and serves the matches directly from it.
+ */
+
+#ifndef _MATCH_STORE_H_INCLUDED
+#define _MATCH_STORE_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "lz_base.h"
+#include "lz_util.h"
+
+// Do not bother to split inputs shorter than this per thread
+#define MATCH_STORE_MIN_SHARD   65536
+// Matches per position reserved for a shard up front, the rest grows
+#define MATCH_STORE_RESERVE     4
+
+#define MATCH_CACHE_MAGIC       0x434d585a      // "ZXMC"
+// Version 3: the cached matches are always raw, never a match ladder
+#define MATCH_CACHE_VERSION     3
+
+
+class match_store {
+    struct shard {
+        int start;
+        int end;
+        bool done;                  ///< Searched, set under m_mutex
+        std::exception_ptr error;
+        std::vector<int> index;     ///< Start of matches for each position
+        std::vector<match> matches;
+    };
+
+    // Everything that affects the found matches
+    struct cache_header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t hash;
+        int32_t len;
+        int32_t window_size;
+        int32_t min_match;
+        int32_t max_match;
+        int32_t good_match;
+        int32_t max_chain;
+        int32_t min_match2_threshold;
+        int32_t min_match3_threshold;
+        int32_t matcher;
+        int32_t hash_bytes;
+        int32_t only_better_matches;
+        uint32_t num_matches;
+    };
+
+    const lz_config* m_lz_config;
+    int m_num_threads;
+    int m_shard_size;
+    std::vector<shard> m_shards;
+    size_t m_memory;            ///< Bytes held by searched shards
+    size_t m_peak_memory;
+
+    // Streamed search
+    bool m_streaming;
+    const char* m_buf;
+    int m_len;
+    int m_max_chain;
+    bool m_only_better;
+    int m_next;                 ///< Next shard for the workers
+    int m_current;              ///< Shard of the consumer
+    bool m_ready;               ///< The consumer's shard is done
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<std::thread> m_workers;
+
+    // Cache file written while streaming
+    cache_header m_hdr;
+    std::ofstream m_cache;
+    uint32_t m_cache_base;      ///< Matches written into the cache file
+
+    // Memory mapped match cache
+    void* m_map;
+    size_t m_map_size;
+    const uint32_t* m_map_index;
+    const match* m_map_matches;
+    int m_map_len;
+
+    void search_shard(const char* buf, int len, shard* p_shard,
+        int max_chain, bool only_better_matches);
+    void init_shards(int len, int shard_size);
+    static size_t shard_memory(const shard* p_shard);
+    int copy_matches(const shard* p_shard, int pos, match* matches, int max_matches) const;
+    void stream_worker(void);
+    void retire_shard(int s);
+    void stop_stream(void);
+    void init_cache_header(cache_header* p_hdr, const char* buf, int len,
+        int max_chain, bool only_better_matches);
+    std::string cache_file_name(const cache_header* p_hdr);
+    static size_t cache_size(const cache_header* p_hdr);
+    bool load_cache(const cache_header* p_hdr);
+    void save_cache(cache_header* p_hdr);
+    void open_cache(void);
+    void close_cache(bool complete);
+public:
+    match_store(const lz_config* p_cfg, int num_threads);
+    ~match_store(void);
+
+    void search(const char* buf, int len, int max_chain, bool only_better_matches);
+    void stream(const char* buf, int len, int max_chain, bool only_better_matches);
+    int get_matches(int pos, match* matches, int max_matches) const;
+    int next_matches(int pos, match* matches, int max_matches);
+    void release(void);
+};
+
+#endif  // _MATCH_STORE_H_INCLUDED
@@ -0,0 +1,113 @@
+/**
+ * @file radixsort.h
+ * @brief A byte size bucket based radix sort for sorting indices by keys.
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @version 0.2
+ * @date 2023
+ * @date 17-Oct-2026
+ * @copyright The Unlicense
+ *
+ * This is the zxpac3 radixsort_8bb (8-bit buckets, LSB first) reworked
+ * to sort an array of indices by a separate array of keys. The sort is
+ * stable, which allows sorting by multiple keys by sorting the least
+ * significant key first.
+ */
+
+#ifndef _RADIXSORT_H_INCLUDED
+#define _RADIXSORT_H_INCLUDED
+
+#include <new>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include "lz_util.h"
+
+template<typename T> class radixsort_8bb {
+    int* p_bucket;
+    int* p_tmp;
+    int m_size;
+    radixsort_8bb(const radixsort_8bb&)=delete;
+    radixsort_8bb& operator=(const radixsort_8bb&)=delete;
+public:
+    radixsort_8bb(int size);
+    ~radixsort_8bb(void);
+    void sort(int* p_idx, const T* p_key, int bits, int size=0);
+};
+
+template<typename T> radixsort_8bb<T>::radixsort_8bb(int size) :
+    p_bucket(NULL), p_tmp(NULL), m_size(size)
+{
+    if (size < 1) {
+        EXCEPTION(std::invalid_argument,"Array size too small");
+    }
+
+    p_bucket = new int[256];
+    p_tmp = new int[size];
+}
+
+template<typename T> radixsort_8bb<T>::~radixsort_8bb(void)
+{
+    if (p_bucket) {
+        delete[] p_bucket;
+    }
+    if (p_tmp) {
+        delete[] p_tmp;
+    }
+}
+
+/**
+ * @brief Sort indices by their keys, i.e. p_key[p_idx[n]] is in increasing
+ *        order after the sort. Equal keys keep their original order.
+ * @param[inout] p_idx A ptr to the indices to sort.
+ * @param[in] p_key    A ptr to the keys indexed by @p p_idx.
+ * @param[in] bits     The number of significant bits in keys.
+ * @param[in] size     The number of indices. If 0 then the size given
+ *                     in the constructor is used.
+ *
+ * @return none
+ */
+template<typename T> void radixsort_8bb<T>::sort(int* p_idx, const T* p_key, int bits, int size)
+{
+    if (size > m_size) {
+        EXCEPTION(std::out_of_range,"Array too big");
+    }
+    if (size == 0) {
+        size = m_size;
+    }
+
+    int* p_a = p_idx;
+    int* p_b = p_tmp;
+    int* p_t;
+    int m;
+
+    for (int n = 0; n < bits; n += 8) {
+        // count buckets..
+        ::memset(p_bucket,0,sizeof(*p_bucket)*256);
+
+        for (m = 0; m < size; m++) {
+            p_bucket[(p_key[p_a[m]] >> n) & 0xff]++;
+        }
+
+        // cumulative counts..
+        for (m = 1; m < 256; m++) {
+            p_bucket[m] += p_bucket[m-1];
+        }
+
+        // sort per bucket
+        for (m = size-1; m >= 0; m--) {
+            p_b[--p_bucket[(p_key[p_a[m]] >> n) & 0xff]] = p_a[m];
+        }
+
+        // swap buffers
+        p_t = p_a;
+        p_a = p_b;
+        p_b = p_t;
+    }
+
+    // Odd number of passes leaves the result into the temporary buffer
+    if (p_a != p_idx) {
+        ::memcpy(p_idx,p_a,sizeof(*p_idx)*size);
+    }
+}
+
+#endif  // _RADIXSORT_H_INCLUDED
@@ -0,0 +1,76 @@
+/**
+ * @file suffix_array.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Suffix array based exhaustive string matcher for LZ engines.
+ * @copyright The Unlicense
+ *
+ * The matcher builds a suffix array and an LCP array over the whole input
+ * when the position 0 is searched. The LCP array is then turned into a
+ * tree of LCP intervals, where each interval remembers the most recent
+ * position visited within it. Walking from a position towards the root
+ * of the tree gives, for every distinct match length, the nearest
+ * previous position. There is no search depth limit; the max chain only
+ * limits the number of returned matches, longest ones first.
+ *
+ * Intervals at least SUFFIX_ARRAY_LONG_LCP long are not walked one by one,
+ * since on runs of the same byte there is one per length up to the max
+ * match. Instead a min tree over the LCP array finds the bounds of an
+ * interval and a max tree over the suffix ranks of visited positions
+ * finds the nearest enclosing interval with a more recent position. Each
+ * long match costs O(log n) and the result is the same as with the walk.
+ */
+
+#ifndef _SUFFIX_ARRAY_H_INCLUDED
+#define _SUFFIX_ARRAY_H_INCLUDED
+
+#include <iostream>
+#include <cstdint>
+#include "lz_util.h"
+
+// Intervals with at least this LCP are searched through the trees
+#define SUFFIX_ARRAY_LONG_LCP   32
+
+
+class suffix_array : public lz_match<suffix_array> {
+    int* m_node;        ///< The deepest LCP interval of each position
+    int* m_iv_lcp;      ///< LCP (i.e. match length) of the interval
+    int* m_iv_parent;   ///< Enclosing interval. 0 is the root.
+    int* m_iv_last;     ///< The most recent position within a short interval
+    int* m_iv_short;    ///< The deepest ancestor shorter than m_long_lcp
+    int* m_rank;        ///< Suffix rank of each position
+    int* m_lcp;         ///< Min tree of LCPs of adjacent suffix ranks
+    int* m_seen;        ///< Max tree of visited positions over suffix ranks
+    match* m_mtch;
+    int m_len;
+    int m_leaves;       ///< Leaves of the trees, a power of two >= m_len
+    int m_max_offset;
+    int m_max_chain;
+    int m_min_match;
+    int m_max_match;
+    int m_long_lcp;
+
+    void free_tables(void);
+    int min_lcp(int lb, int rb) const;
+    int max_seen(int lb, int rb) const;
+    int lcp_left(int r, int l) const;
+    int lcp_right(int r, int l) const;
+    int seen_left(int r, int p) const;
+    int seen_right(int r, int p) const;
+    void build_suffix_array(const char* buf, int len, int* sa, int* rank);
+    void build_intervals(const char* buf, int len);
+    int find_long_matches(int pos, int len, int& last);
+public:
+    suffix_array(int window_size, int min_match, int max_match,
+        int good_match,
+        int mm2_thres_offset,
+        int mm3_thres_offset);
+    ~suffix_array(void);
+
+    void impl_init_get_matches(int max_matches, match *matches = NULL);
+    int impl_find_matches(const char *buf, int pos, int len, bool only_better_matches);
+    void impl_reinit(void);
+};
+
+#endif  // _SUFFIX_ARRAY_H_INCLUDED
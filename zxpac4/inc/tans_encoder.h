@@ -48,6 +48,9 @@ public:
     ans_state_t get_state(void) {
         return state_;
     };
+    void set_state(ans_state_t state) {
+        state_ = state;
+    };
     void dump(void);
 };
 
@@ -59,6 +62,7 @@ tans_encoder<T,M>::tans_encoder(void) : ans_base(M)
     next_state_ = NULL;
     symbol_last_ = NULL;
     Ls_len_ = 0;
+    state_ = 0;
 }
 
 template<class T, int M>
@@ -68,6 +72,7 @@ tans_encoder<T,M>::tans_encoder(const int* Ls, int Ls_len) : ans_base(M)
     Ls_ = NULL;
     next_state_ = NULL;
     symbol_last_ = NULL;
+    state_ = 0;
     init_tans(Ls,Ls_len);
 }
 
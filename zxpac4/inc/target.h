@@ -21,7 +21,9 @@
 #include "lz_base.h"
 #include "hunk.h"
 
-#define AMIGA_EXE_SECURITY_DISTANCE     8
+// A fixed guess of the overlay file buffer. It is not sized from the exact
+// security distance, since there is no overlay decompressor to patch yet
+// and --overlay is rejected.
 #define AMIGA_OVERLAY_BUFFER_SIZE       2048
 
 #define TRG_FALSE   0       // false
@@ -92,6 +94,7 @@ protected:
     const lz_config* m_cfg;
     std::ofstream& m_ofs;
     bool m_nohunks;
+    int m_security_distance;    /**< The exact in-place security distance of the compressed data. */
 public:
     /**
      * @brief A constructor for all targets.
@@ -100,9 +103,21 @@ public:
      * @param[in] ofs The ouput file stream.  
      */
     target_base(const targets::target* trg, const lz_config_t* cfg, std::ofstream& ofs) : 
-        m_trg(trg), m_cfg(cfg), m_ofs(ofs) {}
+        m_trg(trg), m_cfg(cfg), m_ofs(ofs), m_security_distance(0) {}
     virtual ~target_base(void) {}
 
+    /**
+     * @brief Set the security distance the compressed data needs for
+     *        an in-place decompression. See lz_base::inplace_begin().
+     *        The main loop calls this after the compression before
+     *        run_decompressor() and post_save().
+     *
+     * @param distance[in] The security distance in bytes.
+     */
+    void set_security_distance(int distance) {
+        m_security_distance = distance;
+    }
+
     /**
      * @brief Do preprocessing to the input file. 
      *
@@ -154,11 +169,46 @@ public:
      *         an error.
      */
     virtual int post_save(const char* buf, int len) = 0;
+
+    /**
+     * @brief Run the decompressor of the target over the compressed data
+     *        in an emulator, report its run time and memory use, and
+     *        compare the decompressed data to the input.
+     *
+     * @param buf[in]    A const ptr to the input buffer as it was compressed.
+     * @param len[in]    The length of the input buffer.
+     * @param p_out[in]  A const ptr to the compressed data.
+     * @param n[in]      The length of the compressed data.
+     *
+     * @return 0 if the decompressed data matched the input, 1 if the
+     *         target has no emulated decompressor and negative value if
+     *         there was an error.
+     */
+    virtual int run_decompressor(const char* buf, int len, const char* p_out, int n) {
+        (void)buf;
+        (void)len;
+        (void)p_out;
+        (void)n;
+        return 1;
+    }
+
+    /**
+     * @brief Check whether run_decompressor() can run the decompressor
+     *        of the target with the configured algorithm and options.
+     *        The main loop rejects --report-tstates before compressing
+     *        if it cannot.
+     *
+     * @return True if the decompressor can be emulated.
+     */
+    virtual bool can_run_decompressor(void) const {
+        return false;
+    }
 };
 
 class target_amiga : public target_base {
 private:
     std::vector<amiga_hunks::new_hunk_info_t> m_new_hunks; 
+    int m_exe_length;           /**< The length of the preprocessed executable. */
     static const targets::decompressor exe_decompressors[]; 
     static const targets::decompressor abs_decompressors[]; 
     static const targets::decompressor exe_decompressors_255[]; 
@@ -175,12 +225,18 @@ private:
     int post_save_exe(int len);
     int post_save_abs(int len);
     int post_save_overlay(int len);
+
+    const targets::decompressor* emulated_decompressor(void) const;
+    uint32_t exe_security_distance(void) const;
+    uint32_t exe_memory_size(void) const;
 public:
     target_amiga(const targets::target* trg, const lz_config_t* cfg, std::ofstream& ofs);
     ~target_amiga(void);
     int preprocess(char* buf, int len);
     int save_header(const char* buf, int len);
     int post_save(const char* buf, int len);
+    int run_decompressor(const char* buf, int len, const char* p_out, int n);
+    bool can_run_decompressor(void) const;
 };
 
 class target_ascii : public target_base {
@@ -204,6 +260,7 @@ public:
 class target_spectrum : public target_base {
     char tap_chksum(const char* b, char c, int n);
     char m_chksum;      /**< Partial checksum for data */
+    int m_file_length;  /**< The length of the file to compress */
 
 public:
     target_spectrum(const targets::target* trg, const lz_config_t* cfg, std::ofstream& ofs);
@@ -211,6 +268,8 @@ public:
     int preprocess(char* buf, int len);
     int save_header(const char* buf, int len);
     int post_save(const char* buf, int len);
+    int run_decompressor(const char* buf, int len, const char* p_out, int n);
+    bool can_run_decompressor(void) const;
 };
 
 class target_bbc : public target_base {
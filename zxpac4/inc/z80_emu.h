@@ -0,0 +1,144 @@
+/**
+ * @file z80_emu.h
+ * @version 0.1
+ * @date 17-Oct-2026
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief A host side Z80 emulator for timing the decompressors.
+ * @copyright The Unlicense
+ *
+ * The emulator runs the assembled Z80 decompressors over the compressed
+ * file and counts their T-states. All documented instructions and the
+ * undocumented IXH/IXL/IYH/IYL and SLL forms are supported. The timings
+ * are those of an uncontended Z80, i.e. the memory contention and the
+ * interrupts of a real machine are not emulated. The IN instructions read
+ * 0xff and the OUT instructions are ignored.
+ *
+ * Every memory address the code reads or writes, including the opcode
+ * fetches and the stack, is recorded for reporting the memory touched
+ * during the run. The writes below the ROM size are ignored.
+ */
+
+#ifndef _Z80_EMU_H_INCLUDED
+#define _Z80_EMU_H_INCLUDED
+
+#include <cstdint>
+#include <bitset>
+
+#define Z80_MEM_SIZE        65536
+
+class z80_emu {
+    uint8_t m_mem[Z80_MEM_SIZE];
+    std::bitset<Z80_MEM_SIZE> m_touched;
+    int m_rom_size;
+
+    // Registers
+    uint8_t m_a, m_f, m_b, m_c, m_d, m_e, m_h, m_l;
+    uint16_t m_af2, m_bc2, m_de2, m_hl2;
+    uint16_t m_ix, m_iy, m_sp, m_pc;
+    uint8_t m_i, m_r;
+    bool m_iff1, m_iff2;
+    int m_im;
+    bool m_halted;
+
+    int m_index;                ///< 0 for HL, 1 for IX and 2 for IY
+    int m_tstates;              ///< T-states of the current instruction
+    uint64_t m_total;
+    uint16_t m_min_sp;
+
+    uint8_t rd(uint16_t addr) {
+        m_touched.set(addr);
+        return m_mem[addr];
+    }
+    void wr(uint16_t addr, uint8_t value) {
+        m_touched.set(addr);
+
+        if (addr >= m_rom_size) {
+            m_mem[addr] = value;
+        }
+    }
+    uint16_t rd16(uint16_t addr) {
+        return rd(addr) | rd(addr+1) << 8;
+    }
+    void wr16(uint16_t addr, uint16_t value) {
+        wr(addr,value);
+        wr(addr+1,value >> 8);
+    }
+    uint8_t fetch(void) {
+        return rd(m_pc++);
+    }
+    uint16_t fetch16(void) {
+        uint16_t value = rd16(m_pc);
+        m_pc += 2;
+        return value;
+    }
+    uint8_t fetch_opcode(void) {
+        m_r = (m_r & 0x80) | ((m_r + 1) & 0x7f);
+        return fetch();
+    }
+    void push(uint16_t value);
+    uint16_t pop(void);
+
+    uint16_t bc(void) const { return m_b << 8 | m_c; }
+    uint16_t de(void) const { return m_d << 8 | m_e; }
+    uint16_t hl(void) const { return m_h << 8 | m_l; }
+    void set_bc(uint16_t value) { m_b = value >> 8; m_c = value; }
+    void set_de(uint16_t value) { m_d = value >> 8; m_e = value; }
+    void set_hl(uint16_t value) { m_h = value >> 8; m_l = value; }
+
+    uint16_t get_index(void) const;
+    void set_index(uint16_t value);
+    uint16_t get_rp(int p) const;
+    void set_rp(int p, uint16_t value);
+    uint16_t get_rp2(int p) const;
+    void set_rp2(int p, uint16_t value);
+    uint8_t get_r(int r, bool no_index=false);
+    void set_r(int r, uint8_t value, bool no_index=false);
+    uint16_t index_addr(void);
+    bool cond(int y) const;
+
+    void alu(int op, uint8_t value);
+    uint8_t inc8(uint8_t value);
+    uint8_t dec8(uint8_t value);
+    uint16_t add16(uint16_t a, uint16_t b);
+    uint8_t rot(int op, uint8_t value);
+
+    void exec_main(uint8_t op);
+    void exec_cb(void);
+    void exec_index_cb(void);
+    void exec_ed(uint8_t op);
+    void block(int y, int z);
+public:
+    z80_emu(void);
+
+    /**
+     * @brief Clear the memory and the registers.
+     *
+     * @param[in] rom_size The size of the read only memory at address 0.
+     */
+    void reset(int rom_size=0);
+    void load(uint16_t addr, const void* p, int len);
+    uint8_t peek(uint16_t addr) const { return m_mem[addr]; }
+    void poke(uint16_t addr, uint8_t value) { m_mem[addr] = value; }
+
+    /**
+     * @brief Execute one instruction.
+     *
+     * @return The T-states of the instruction.
+     */
+    int step(void);
+
+    uint16_t get_pc(void) const { return m_pc; }
+    uint16_t get_sp(void) const { return m_sp; }
+    void set_pc(uint16_t pc) { m_pc = pc; }
+    void set_sp(uint16_t sp) { m_sp = m_min_sp = sp; }
+    void call(uint16_t addr, uint16_t ret);
+    bool halted(void) const { return m_halted; }
+
+    uint64_t tstates(void) const { return m_total; }
+    uint16_t min_sp(void) const { return m_min_sp; }
+    int touched(void) const { return m_touched.count(); }
+    int lowest_touched(void) const;
+    int highest_touched(void) const;
+};
+
+#endif  // _Z80_EMU_H_INCLUDED
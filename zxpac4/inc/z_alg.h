@@ -1,18 +1,29 @@
 /**
  * @file z_alg.h
  * @brief A Z-array algorithm implemntation for LZ string matching.
- * @version 0.1
+ * @version 0.2
  * @author Jouni 'Mr.Spiv' Korhonen
  * @date 11-Apr-2022
+ * @date 17-Oct-2026
  * @copyright The Unlicense
  *
  * This file implements a Z-array class for serching matches. It is tailored
  * towards serving as a generic building block for LZ string matching engine.
+ *
+ * The matcher is exhaustive within the window and intended for small
+ * windows. For each match length it reports the nearest offset only.
+ * In the default mode the Z-array of the string at the current position
+ * concatenated with the window is built for every position. In the
+ * incremental mode the Z-value of each offset is kept between positions:
+ * a match of length L at offset d on the position p is a match of length
+ * L-1 at the same offset on the position p+1, thus only offsets whose
+ * match ended (or hit the maximum length) need to be compared again.
  */
 
 #ifndef _Z_ALG_H_INCLUDED
 #define _Z_ALG_H_INCLUDED
 
+#include <cstdint>
 #include "lz_util.h"
 
 /**
@@ -23,26 +34,37 @@
  *
  */
 
-class z_array : public lz_match {
-    int32_t *m_z;       ///< Pointer to Z-array 
+class z_array : public lz_match<z_array> {
+    int32_t *m_z;       ///< Pointer to Z-array, or lengths per offset
+    int16_t *m_s;       ///< Pattern, separator and window for the Z-array
     int m_len;          ///< Length of the Z-array
     int m_max;          ///< Maximum prefix length for matches
     int m_min;          ///< Minimum prefix length for matches
     int m_size;         ///< Size of the m_m array.
     match *m_m;         ///< Pointer to collected matches.. may be NULL
+    match *m_ladder;    ///< One match per length before trimming to m_size
     int m_min_match2_threshold_offset;
     int m_min_match3_threshold_offset;
     int m_good;         ///< A good match length
+    bool m_incremental; ///< Reuse Z-values between positions
+    int m_next_pos;     ///< Position the incremental state is valid for
+    int m_window;       ///< Z-array length used by the last search
+    int m_last_max;     ///< Maximum match length on the previous position
+
+    int build_z_array(const char *buf, int pos, int len);
+    int update_z_values(const char *buf, int pos, int len);
 public:
     // common interface
     virtual ~z_array();
     z_array(int window_len,
         int min_match, int max_match, int good_match,
         int mm2_thres_offset,
-        int mm3_thres_offset);
+        int mm3_thres_offset,
+        bool incremental=false);
 
-    int find_matches(const char *buf, int pos, int len , bool only_better);
-    void init_get_matches(int, match *);
+    int impl_find_matches(const char *buf, int pos, int len , bool only_better);
+    void impl_init_get_matches(int, match *);
+    void impl_reinit(void);
 
     // class specific methods
     int get_window(void) const;
@@ -18,7 +18,8 @@
 #include <cstdint>
 #include "lz_base.h"
 #include "lz_util.h"
-#include "hash.h"
+#include "lz_engine.h"
+#include "lz_window.h"
 #include "cost4_32k.h"
 
 /**
@@ -94,24 +95,19 @@
  *
  */
 
-class zxpac4_32k : public lz_base {
-    hash3 m_lz;
-    cost* m_cost_array;
-    match* m_match_array;
-    int m_alloc_len;
-    zxpac4_32k_cost m_cost;
-private:
+class zxpac4_32k : public lz_engine<zxpac4_32k,zxpac4_32k_cost> {
+    lz_window<zxpac4_32k_cost::cost_t> m_window;
     int encode_history(const char* buf, char* out, int len, int pos);
+    void commit_token(int pos);
 public:
     zxpac4_32k(const lz_config* cfg, int ins=-1, int max=-1);
-    ~zxpac4_32k();
-    int lz_search_matches(char* buf, int len, int interval);
+
+    // lz_engine hooks
+    void impl_search_init(const char* buf, int len);
+    bool impl_search_position(int pos, int num);
     int lz_parse(const char* buf, int len, int interval);
     int lz_encode(char* buf, int len, char* outb, std::ofstream* ofs);
 
-    const cost* lz_get_result(void) { return m_cost_array; }
-    const cost* lz_cost_array_get(int len);
-    void lz_cost_array_done(void);
     bool is_ascii(void) { return m_lz_config->is_ascii; }
     bool only_better(void) { return m_lz_config->only_better_matches; }
 };
@@ -17,7 +17,7 @@
 #include <cstdint>
 #include "lz_base.h"
 #include "lz_util.h"
-#include "hash.h"
+#include "lz_engine.h"
 #include "cost4b.h"
 
 /**
@@ -89,6 +89,7 @@
 
 #define ZXPAC4B_MATCH_MIN                   2
 #define ZXPAC4B_MATCH_MAX                   255
+#define ZXPAC4B_GAMMA_MAX_WIDTH             8       // Lengths and literal runs up to 255
 #define ZXPAC4B_MATCH_GOOD                  63
 #define ZXPAC4B_HEADER_SIZE                 4
 
@@ -99,24 +100,14 @@
  *
  */
 
-class zxpac4b : public lz_base {
-    hash3 m_lz;
-    cost* m_cost_array;
-    match* m_match_array;
-    int m_alloc_len;
-    zxpac4b_cost m_cost;
+class zxpac4b : public lz_engine<zxpac4b,zxpac4b_cost> {
 private:
     int encode_history(const char* buf, char* out, int len, int pos);
 public:
     zxpac4b(const lz_config* cfg, int ins=-1, int max=-1);
-    ~zxpac4b();
-    int lz_search_matches(char* buf, int len, int interval);
     int lz_parse(const char* buf, int len, int interval);
     int lz_encode(char* buf, int len, char* outb, std::ofstream* ofs);
 
-    const cost* lz_get_result(void) { return m_cost_array; }
-    const cost* lz_cost_array_get(int len);
-    void lz_cost_array_done(void);
     bool is_ascii(void) { return m_lz_config->is_ascii; }
     bool only_better(void) { return m_lz_config->only_better_matches; }
 };
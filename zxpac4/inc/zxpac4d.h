@@ -17,7 +17,7 @@
 #include <cstdint>
 #include "lz_base.h"
 #include "lz_util.h"
-#include "hash.h"
+#include "lz_engine.h"
 #include "cost4d.h"
 
 /**
@@ -84,6 +84,7 @@
 #define ZXPAC4D_OFFSET_MIN					256
 #define ZXPAC4D_HEADER_SIZE					4
 #define ZXPAC4D_LITRUN_MAX					1
+#define ZXPAC4D_TRIAL_OVERHEAD				64      // Header and tANS tables
 
 /**
  * @class matches utils.h
@@ -92,24 +93,27 @@
  *
  */
 
-class zxpac4d : public lz_base {
-    hash3 m_lz;
-    cost* m_cost_array;
-    match* m_match_array;
-    int m_alloc_len;
-    zxpac4d_cost m_cost;
+class zxpac4d : public lz_engine<zxpac4d,zxpac4d_cost> {
+    // Matches of every position for the later parsing passes
+    std::vector<int> m_pass_index;
+    std::vector<match> m_pass_matches;
 private:
     int encode_history(const char* buf, char* out, int len, int pos);
+    void relax_stored_matches(const char* buf, int len);
+    int select_matches(const char* buf, int len);
+    int trial_encode(const char* buf, int len);
 public:
     zxpac4d(const lz_config* cfg, int ins=-1, int max=-1);
-    ~zxpac4d();
-    int lz_search_matches(char* buf, int len, int interval);
+
+    // lz_engine hooks
+    void impl_search_init(const char* buf, int len);
+    bool impl_search_position(int pos, int num);
+    void impl_search_done(int len);
+    void impl_reset(void);
     int lz_parse(const char* buf, int len, int interval);
     int lz_encode(char* buf, int len, char* outb, std::ofstream* ofs);
 
-    const cost* lz_get_result(void) { return m_cost_array; }
-    const cost* lz_cost_array_get(int len);
-    void lz_cost_array_done(void);
+    void lz_cost_array_get(int len);
     bool is_ascii(void) { return m_lz_config->is_ascii; }
     bool only_better(void) { return m_lz_config->only_better_matches; }
 
@@ -3,7 +3,7 @@
 ; @file zxpac4_exe.asm
 ; @brief Executable file decompressor for ZXPAC4
 ; @author Jouni 'Mr.Spiv' Korhonen
-; @version 0.5
+; @version 0.6
 ; @copyright The Unlicense
 ; 
 ; 20250109 0.1 - Initial version.
@@ -12,6 +12,8 @@
 ; 20250122 0.4 - Added 65535 bytes max match
 ; 20250128 0.5 - Moved the compressed file size into ADD instead
 ;                of having first 4 bytes the file for it.
+; 20261017 0.6 - The security length is an ADD patched by the packer
+;                with the exact in-place distance of the file.
 ;
 ; Note:
 ;  - Reversed file
@@ -34,8 +36,6 @@ __LVOFreeMem        equ     -210
 __LVOCacheClearU    equ     -636
 __LIB_VERSION       equ     20
 
-SECURITY_LENGTH	    equ	    8
-
 ;  Each segment in memory is as follows:
 ;
 ;  segment_address: dc.l size_in_bytes
@@ -66,7 +66,8 @@ start:  moveq   #$7f,d7
         move.b	-(a2),d6
         lsl.l	#8,d6
         move.b	-(a2),d6
-        addq.l	#SECURITY_LENGTH,a0
+        ; Security length
+        add.l	#$00000000,a0               ; 2(+4) -> offset 42
         move.l	a0,a3
         add.l	d6,a3
         moveq   #-128,d6
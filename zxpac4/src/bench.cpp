@@ -0,0 +1,1068 @@
+/**
+ * @file bench.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Benchmarks and reference checks of the compressor kernels.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <getopt.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include "bench.h"
+#include "lz_util.h"
+#include "match_len.h"
+#include "hash.h"
+#include "bintree.h"
+#include "match_finder.h"
+#include "lz_base.h"
+#include "lz_codes.h"
+#include "version.h"
+
+#define BENCH_DEF_SIZE      (1 << 20)
+#define BENCH_MAX_SIZE      (1 << 26)
+#define BENCH_DEF_ROUNDS    3
+#define BENCH_MAX_ROUNDS    100
+
+
+namespace {
+
+/**
+ * @brief The options shared by all benchmarks.
+ */
+struct bench_config {
+    int size;                   ///< Bytes of generated data
+    int rounds;                 ///< Timing rounds, the best is reported
+    uint32_t seed;              ///< Seed of the generated data
+    const char* file;           ///< Data for the tests that can use a file or NULL
+};
+
+/**
+ * @brief Load at most cfg.size bytes of the --file into @p buf.
+ *
+ * @return False if no file was given.
+ * @throw std::runtime_error if the file cannot be read.
+ */
+bool bench_file(const bench_config& cfg, std::vector<char>& buf)
+{
+    if (cfg.file == NULL) {
+        return false;
+    }
+
+    std::ifstream ifs(cfg.file,std::ios::binary);
+
+    if (!ifs.is_open()) {
+        EXCEPTION(std::runtime_error,"Cannot open the --file.");
+    }
+
+    buf.resize(cfg.size);
+    ifs.read(buf.data(),cfg.size);
+    buf.resize(ifs.gcount());
+
+    if (buf.size() < 2) {
+        EXCEPTION(std::runtime_error,"The --file is too short.");
+    }
+
+    std::cout << " " << buf.size() << " bytes of " << cfg.file << "\n";
+    return true;
+}
+
+/**
+ * @brief Run @p func @p rounds times and return the best time in seconds.
+ */
+double best_of(int rounds, const std::function<void(void)>& func)
+{
+    double best = 0;
+
+    for (int n = 0; n < rounds; n++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        if (n == 0 || seconds.count() < best) {
+            best = seconds.count();
+        }
+    }
+
+    return best;
+}
+
+std::ostream& print_rate(std::ostream& os, const char* name, uint64_t bytes, double seconds)
+{
+    os << "  " << std::left << std::setw(24) << name << std::right << std::fixed
+       << std::setprecision(3) << std::setw(9) << seconds * 1000.0 << " ms "
+       << std::setw(10) << (seconds > 0 ? bytes / seconds / 1000000.0 : 0.0) << " MB/s";
+    return os;
+}
+
+/**
+ * @brief Last level cache and L1 data cache read misses of this process
+ *        read with perf_event_open(). Not all systems, e.g. most virtual
+ *        machines, provide the hardware counters.
+ */
+class perf_counters {
+    int m_fd[2];
+public:
+    perf_counters(void) {
+#ifdef __linux__
+        static const uint64_t configs[2] = {
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                PERF_COUNT_HW_CACHE_RESULT_MISS << 16
+        };
+
+        for (int n = 0; n < 2; n++) {
+            perf_event_attr attr;
+
+            ::memset(&attr,0,sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = n == 0 ? PERF_TYPE_HARDWARE : PERF_TYPE_HW_CACHE;
+            attr.config = configs[n];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fd[n] = syscall(SYS_perf_event_open,&attr,0,-1,-1,0);
+        }
+#else
+        m_fd[0] = m_fd[1] = -1;
+#endif
+    }
+    ~perf_counters(void) {
+#ifdef __linux__
+        for (int fd : m_fd) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    /**
+     * @brief Count the misses of one call of @p func.
+     *
+     * @return False if the counters are not available.
+     */
+    bool count(const std::function<void(void)>& func, uint64_t misses[2]) {
+#ifdef __linux__
+        if (m_fd[0] < 0 || m_fd[1] < 0) {
+            return false;
+        }
+        for (int fd : m_fd) {
+            ioctl(fd,PERF_EVENT_IOC_RESET,0);
+            ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+        }
+
+        func();
+
+        for (int n = 0; n < 2; n++) {
+            ioctl(m_fd[n],PERF_EVENT_IOC_DISABLE,0);
+
+            if (read(m_fd[n],&misses[n],sizeof(misses[n])) != sizeof(misses[n])) {
+                return false;
+            }
+        }
+        return true;
+#else
+        (void)func;
+        (void)misses;
+        return false;
+#endif
+    }
+};
+
+/**
+ * @brief Print the cache misses of one call of @p func after a rate.
+ */
+std::ostream& print_misses(std::ostream& os, perf_counters& pc, const std::function<void(void)>& func)
+{
+    uint64_t misses[2];
+
+    if (pc.count(func,misses)) {
+        os << std::setw(12) << misses[0] << " LLC " << std::setw(12) << misses[1] << " L1D misses";
+    } else {
+        os << "  cache misses n/a";
+    }
+    return os;
+}
+
+bool report_check(const char* name, bool ok)
+{
+    std::cout << "  " << std::left << std::setw(24) << name << std::right
+              << (ok ? "ok" : "FAILED") << "\n";
+    return ok;
+}
+
+//
+// putbits
+//
+
+/**
+ * @brief The bit writer of the history formats before the 64-bit
+ *        accumulator. Kept as the reference of the byte stream.
+ */
+class putbits_reference : public putbits<putbits_reference> {
+    int m_bb;
+    int m_bc;
+    char* m_bitbuf_tag_ptr;
+    char* m_bitbuf_ptr;
+    char* m_start_ptr;
+public:
+    putbits_reference(char* p_buf) {
+        m_bb = 0;
+        m_bc = 8;
+        m_bitbuf_tag_ptr = NULL;
+        m_bitbuf_ptr = p_buf;
+        m_start_ptr = p_buf;
+    }
+    ~putbits_reference(void) { impl_flush();  }
+    char* impl_bits(int value, int num_bits) {
+        int t;
+
+        if (m_bitbuf_tag_ptr == NULL) {
+            m_bitbuf_tag_ptr = m_bitbuf_ptr++;
+        }
+        if (num_bits > 8) {
+            t = num_bits - 8;
+            // put remaining high order bits
+            bits(value>>8,t);
+            // and then low order 8 bits
+            num_bits = 8;
+            value &= 0xff;
+        }
+
+        char* p_old_pos = m_bitbuf_ptr;
+        m_bb = (m_bb << num_bits) | value;
+
+        if (num_bits > m_bc) {
+            t = num_bits - m_bc;
+            *m_bitbuf_tag_ptr = m_bb >> t;
+            m_bitbuf_tag_ptr = m_bitbuf_ptr++;
+            m_bc = 8;
+            num_bits = t;
+        }
+
+        m_bc -= num_bits;
+        return p_old_pos;
+    }
+    char* impl_flush(void) {
+        char* p_old_pos = m_bitbuf_ptr;
+        if (m_bc < 8) {
+            *m_bitbuf_tag_ptr = m_bb << m_bc;
+            m_bitbuf_tag_ptr = m_bitbuf_ptr++;
+            m_bc = 8;
+        }
+        return p_old_pos;
+    }
+    char* impl_byte(int byte) {
+        char* p_old_pos = m_bitbuf_ptr;
+        *m_bitbuf_ptr++ = byte & 0xff;
+        return p_old_pos;
+    }
+    int impl_size(void) {
+        return m_bitbuf_ptr - m_start_ptr;
+    }
+};
+
+struct putbits_op {
+    int value;
+    int num_bits;               ///< 0 for a byte
+};
+
+/**
+ * @brief Generate a token like mix of tag bits, raw bytes and long
+ *        values. Every 16th value has stray bits above num_bits, which
+ *        the encoders must not rely on but the writers must agree on.
+ */
+std::vector<putbits_op> putbits_ops(int num, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<putbits_op> ops(num);
+
+    for (putbits_op& op : ops) {
+        uint32_t r = rng();
+
+        switch (r & 3) {
+            case 0:
+                op.num_bits = 0;
+                op.value = rng() & 0xff;
+                break;
+            case 1:
+                op.num_bits = 1;
+                op.value = (r >> 2) & 1;
+                break;
+            default:
+                op.num_bits = 1 + (r >> 2) % 24;
+                op.value = rng() & ((1 << op.num_bits) - 1);
+
+                if ((r >> 8 & 15) == 0) {
+                    op.value |= rng() << op.num_bits;
+                }
+                break;
+        }
+    }
+
+    return ops;
+}
+
+/**
+ * @brief Write @p ops and return the output size. The offsets returned
+ *        by byte() and by bits() of at most 8 bits are appended to
+ *        @p p_pos. The former writer returned the position after the
+ *        high bits of a wider value, which no encoder uses.
+ */
+template<class PUTBITS> int putbits_write(const std::vector<putbits_op>& ops, char* p_out, std::vector<int>* p_pos)
+{
+    PUTBITS pb(p_out);
+    char* p;
+
+    for (const putbits_op& op : ops) {
+        p = op.num_bits > 0 ? pb.bits(op.value,op.num_bits) : pb.byte(op.value);
+
+        if (p_pos && op.num_bits <= 8) {
+            p_pos->push_back(p - p_out);
+        }
+    }
+
+    pb.flush();
+    return pb.size();
+}
+
+bool bench_putbits(const bench_config& cfg)
+{
+    std::vector<putbits_op> ops = putbits_ops(cfg.size,cfg.seed);
+    std::vector<char> ref(cfg.size * 4 + 16);
+    std::vector<char> out(cfg.size * 4 + 16);
+    std::vector<int> ref_pos;
+    std::vector<int> out_pos;
+    int ref_len;
+    int out_len;
+    bool ok = true;
+
+    // Short streams cover the tag byte boundaries at the start and the
+    // final flush, the long one everything in between
+    for (int num = 1; num < 64 && ok; num++) {
+        std::vector<putbits_op> part(ops.begin(),ops.begin() + std::min<int>(num,ops.size()));
+
+        ref_pos.clear();
+        out_pos.clear();
+        ref_len = putbits_write<putbits_reference>(part,ref.data(),&ref_pos);
+        out_len = putbits_write<putbits_history>(part,out.data(),&out_pos);
+        ok = ref_len == out_len && ref_pos == out_pos && !memcmp(ref.data(),out.data(),ref_len);
+    }
+
+    ref_pos.clear();
+    out_pos.clear();
+    ref_len = putbits_write<putbits_reference>(ops,ref.data(),&ref_pos);
+    out_len = putbits_write<putbits_history>(ops,out.data(),&out_pos);
+    ok = ok && ref_len == out_len && ref_pos == out_pos && !memcmp(ref.data(),out.data(),ref_len);
+
+    report_check("bit exact",ok);
+
+    double ref_time = best_of(cfg.rounds,[&](void) {
+        putbits_write<putbits_reference>(ops,ref.data(),NULL);
+    });
+    double out_time = best_of(cfg.rounds,[&](void) {
+        putbits_write<putbits_history>(ops,out.data(),NULL);
+    });
+
+    print_rate(std::cout,"reference",ref_len,ref_time) << "\n";
+    print_rate(std::cout,"putbits_history",out_len,out_time)
+        << std::setprecision(2) << std::setw(8) << (out_time > 0 ? ref_time / out_time : 0.0) << "x\n";
+
+    return ok;
+}
+
+//
+// match_length
+//
+
+/**
+ * @brief Generate test data of @p len bytes. Zero filled BSS, sprite
+ *        sheet like tiles with sparse edits and random bytes give long,
+ *        medium and short matches at the distance returned.
+ */
+int bench_data(const char* type, std::vector<char>& buf, int len, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+
+    buf.assign(len + 64,0);
+
+    if (!strcmp(type,"zeros")) {
+        return 1;
+    }
+    if (!strcmp(type,"sprites")) {
+        // 16x16 sprites of 4 bit pixels with a few pixels edited per frame
+        for (int n = 0; n < len; n++) {
+            buf[n] = n < 128 || rng() % 97 == 0 ? static_cast<char>(rng() & 0x77) : buf[n-128];
+        }
+        return 128;
+    }
+    for (int n = 0; n < len; n++) {
+        buf[n] = rng();
+    }
+    return 1 + rng() % 1024;
+}
+
+int match_length_scalar(const char* s, const char* d, int max)
+{
+    int len = 0;
+
+    while (len < max && s[len] == d[len]) {
+        ++len;
+    }
+
+    return len;
+}
+
+int match_length_dispatch(const char* s, const char* d, int max)
+{
+    return max > 0 ? match_length(s,d,max) : 0;
+}
+
+struct match_len_kernel {
+    const char* name;
+    match_len_func_t func;
+};
+
+std::vector<match_len_kernel> match_len_kernels(void)
+{
+    std::vector<match_len_kernel> kernels;
+
+    kernels.push_back({"scalar",match_length_scalar});
+    kernels.push_back({"u64",match_length_u64});
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back({"sse2",match_length_sse2});
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"avx2",match_length_avx2});
+    }
+#endif
+    kernels.push_back({"match_length",match_length_dispatch});
+    return kernels;
+}
+
+bool bench_match_len(const bench_config& cfg)
+{
+    static const char* data_types[] = {"zeros","sprites","random"};
+    std::vector<match_len_kernel> kernels = match_len_kernels();
+    std::mt19937 rng(cfg.seed);
+    std::vector<char> a(512 + 64);
+    std::vector<char> b(512 + 64);
+    std::vector<char> buf;
+    bool ok = true;
+
+    // Every mismatch position and length up to 512 at every alignment
+    for (int n = 0; n < 200000; n++) {
+        int max = rng() % 512;
+        int diff = rng() % (max + 2);
+        int sa = rng() % 64;
+        int sb = rng() % 64;
+
+        for (int i = 0; i < max; i++) {
+            a[sa+i] = b[sb+i] = rng();
+        }
+        if (diff < max) {
+            b[sb+diff] ^= 1 << (rng() % 8);
+        }
+
+        int ref = match_length_scalar(&a[sa],&b[sb],max);
+
+        for (const match_len_kernel& k : kernels) {
+            if (k.func(&a[sa],&b[sb],max) != ref) {
+                std::cout << "  " << k.name << " returned " << k.func(&a[sa],&b[sb],max)
+                          << " instead of " << ref << " for max " << max << "\n";
+                ok = false;
+            }
+        }
+    }
+
+    report_check("same as scalar",ok);
+    std::cout << "  selected kernel: " << match_length_kernel_name() << "\n";
+
+    // Extend a match at every position as a matcher does for a candidate,
+    // up to the longest zxpac4 match
+    for (const char* type : data_types) {
+        int dist = bench_data(type,buf,cfg.size,cfg.seed);
+        double scalar_time = 0;
+
+        std::cout << " " << type << " data, distance " << dist << ":\n";
+
+        for (const match_len_kernel& k : kernels) {
+            uint64_t matched = 0;
+
+            double t = best_of(cfg.rounds,[&](void) {
+                matched = 0;
+
+                for (int pos = dist; pos < cfg.size; pos++) {
+                    matched += k.func(&buf[pos],&buf[pos-dist],std::min(cfg.size - pos,255));
+                }
+            });
+
+            if (k.func == match_length_scalar) {
+                scalar_time = t;
+            }
+
+            print_rate(std::cout,k.name,matched,t) << std::setprecision(2) << std::setw(8)
+                << (t > 0 ? scalar_time / t : 0.0) << "x\n";
+        }
+    }
+
+    return ok;
+}
+
+//
+// hash chains
+//
+
+/**
+ * @brief The 2 byte hash chains of hash3 with either the distance links
+ *        and prefetching of hash_chain or the former position links.
+ *        Both layouts are compiled the same way here, which hash3 in its
+ *        own translation unit is not.
+ */
+template<typename LINK_T, bool DISTANCE> class hash_layout : public lz_match<hash_layout<LINK_T,DISTANCE> > {
+    std::vector<int> m_head;
+    std::vector<LINK_T> m_next;
+    match* m_mtch;
+    int m_mask;
+    int m_max_chain;
+    int m_min_match;
+    int m_max_match;
+    int m_good_match;
+public:
+    hash_layout(int window_size, int min_match, int max_match, int good_match) :
+        m_head(HASH_SIZE,-1), m_next(window_size), m_mtch(NULL), m_mask(window_size - 1), m_max_chain(0),
+        m_min_match(min_match), m_max_match(max_match), m_good_match(good_match) {}
+
+    void impl_init_get_matches(int max_matches, match* matches) {
+        m_mtch = matches;
+        m_max_chain = max_matches;
+    }
+    void impl_reinit(void) {
+        std::fill(m_head.begin(),m_head.end(),-1);
+    }
+    int impl_find_matches(const char* buf, int pos, int len, bool only_better_matches) {
+        (void)only_better_matches;
+        int head = (static_cast<uint8_t>(buf[pos]) << 8) | static_cast<uint8_t>(buf[pos+1]);
+        int next = m_head[head];
+        int low = std::max(pos - m_mask,0);
+        int found = 0;
+        int length;
+        const LINK_T* link;
+
+        len = std::min(len,m_max_match);
+
+        while (next >= low && found < m_max_chain) {
+            link = &m_next[next & m_mask];
+
+            if constexpr (DISTANCE) {
+                __builtin_prefetch(link);
+            }
+
+            length = match_length(buf+next,buf+pos,len);
+
+            if (length >= m_min_match) {
+                m_mtch[found].length = length;
+                m_mtch[found].offset = pos-next;
+                ++found;
+
+                if (length >= m_good_match || length >= m_max_match - 1) {
+                    break;
+                }
+            }
+            if constexpr (DISTANCE) {
+                if (*link == 0) {
+                    break;
+                }
+
+                next -= *link;
+                __builtin_prefetch(buf+next);
+            } else {
+                next = *link;
+            }
+        }
+
+        if constexpr (DISTANCE) {
+            m_next[pos & m_mask] = m_head[head] >= 0 && pos - m_head[head] <= m_mask ? pos - m_head[head] : 0;
+        } else {
+            m_next[pos & m_mask] = m_head[head];
+        }
+        m_head[head] = pos;
+        return found;
+    }
+};
+
+/**
+ * @brief Search all positions of @p buf.
+ *
+ * @return A checksum of the found matches in the order found.
+ */
+template<class M> uint64_t hash_search(M& matcher, const char* buf, int len, int max_chain,
+    uint64_t& num_matches)
+{
+    std::vector<match> mtch(max_chain);
+    uint64_t sum = 0;
+
+    num_matches = 0;
+
+    matcher.reinit();
+    matcher.init_get_matches(max_chain,mtch.data());
+
+    for (int pos = 0; pos < len - 1; pos++) {
+        int num = matcher.find_matches(buf,pos,len-pos,false);
+
+        for (int n = 0; n < num; n++) {
+            sum = (sum ^ (static_cast<uint64_t>(mtch[n].offset) << 16 | mtch[n].length)) * 0x100000001b3ULL;
+        }
+
+        num_matches += num;
+    }
+
+    return sum;
+}
+
+template<typename LINK_T> bool bench_hash_window(const bench_config& cfg, const std::vector<char>& buf, int window)
+{
+    const int max_chain = 256;
+    const int len = buf.size();
+    hash_chain<2,16,LINK_T> chains(window,2,255,255,0,0);
+    uint64_t sum;
+    uint64_t num;
+    uint64_t chains_num;
+    uint64_t sum_num;
+    perf_counters pc;
+    bool ok;
+
+    sum = hash_search(chains,buf.data(),len,max_chain,chains_num);
+    std::cout << " " << window << " window, " << chains_num << " matches:\n";
+
+    auto run_chains = [&](void) {
+        hash_search(chains,buf.data(),len,max_chain,num);
+    };
+    auto run_positions = [&](void) {
+        hash_layout<int,false> h(window,2,255,255);
+        sum_num = hash_search(h,buf.data(),len,max_chain,num);
+    };
+    auto run_distances = [&](void) {
+        hash_layout<LINK_T,true> h(window,2,255,255);
+        sum_num = hash_search(h,buf.data(),len,max_chain,num);
+    };
+
+    run_positions();
+    ok = sum_num == sum && num == chains_num;
+    run_distances();
+    ok = ok && sum_num == sum && num == chains_num;
+    report_check("same matches",ok);
+
+    double chains_time = best_of(cfg.rounds,run_chains);
+    double positions_time = best_of(cfg.rounds,run_positions);
+    double distances_time = best_of(cfg.rounds,run_distances);
+    std::string name = std::to_string(sizeof(LINK_T) * 8) + "-bit distances";
+
+    print_misses(print_rate(std::cout,"former positions",len,positions_time),pc,run_positions) << "\n";
+    print_misses(print_rate(std::cout,name.c_str(),len,distances_time),pc,run_distances)
+        << std::setprecision(2) << std::setw(8)
+        << (distances_time > 0 ? positions_time / distances_time : 0.0) << "x\n";
+    print_misses(print_rate(std::cout,"hash3",len,chains_time),pc,run_chains) << "\n";
+
+    return ok;
+}
+
+bool bench_hash(const bench_config& cfg)
+{
+    std::vector<char> buf;
+    bool ok;
+
+    if (!bench_file(cfg,buf)) {
+        bench_data("sprites",buf,cfg.size,cfg.seed);
+        buf.resize(cfg.size);
+    }
+
+    ok = bench_hash_window<uint16_t>(cfg,buf,32768);
+    ok = bench_hash_window<uint32_t>(cfg,buf,131072) && ok;
+    return ok;
+}
+
+//
+// matcher dispatch
+//
+
+/**
+ * @brief The lz_match<> interface as virtual functions, the way lz_base
+ *        dispatches the per file calls.
+ */
+class matcher_interface {
+public:
+    virtual ~matcher_interface(void) {}
+    virtual void init_get_matches(int max_matches, match* matches) = 0;
+    virtual int find_matches(const char* buf, int pos, int len, bool only_better) = 0;
+    virtual void reinit(void) = 0;
+};
+
+template<class M> class matcher_virtual : public matcher_interface {
+    M m_matcher;
+public:
+    matcher_virtual(const lz_config& cfg) :
+        m_matcher(cfg.window_size,cfg.min_match,cfg.max_match,cfg.good_match,0,0) {}
+    void init_get_matches(int max_matches, match* matches) {
+        m_matcher.init_get_matches(max_matches,matches);
+    }
+    int find_matches(const char* buf, int pos, int len, bool only_better) {
+        return m_matcher.find_matches(buf,pos,len,only_better);
+    }
+    void reinit(void) {
+        m_matcher.reinit();
+    }
+};
+
+/**
+ * @brief Search all positions the way the optimal parser does, i.e. with
+ *        init_get_matches() and find_matches() at every position.
+ *
+ * @return A checksum of the found matches in the order found.
+ */
+template<class M> uint64_t dispatch_search(M& matcher, const char* buf, int len, int max_chain)
+{
+    std::vector<match> mtch(max_chain);
+    uint64_t sum = 0;
+
+    matcher.reinit();
+
+    for (int pos = 0; pos < len; pos++) {
+        matcher.init_get_matches(max_chain,mtch.data());
+        int num = matcher.find_matches(buf,pos,len-pos,false);
+
+        for (int n = 0; n < num; n++) {
+            sum = (sum ^ (static_cast<uint64_t>(mtch[n].offset) << 16 | mtch[n].length)) * 0x100000001b3ULL;
+        }
+    }
+
+    return sum;
+}
+
+template<class M> bool bench_dispatch_matcher(const bench_config& cfg, const std::vector<char>& buf,
+    const lz_config& lzc, const char* name)
+{
+    const int len = buf.size() - 1;
+    M direct(lzc.window_size,lzc.min_match,lzc.max_match,lzc.good_match,0,0);
+    match_finder finder(&lzc);
+    matcher_interface* p_virtual = new matcher_virtual<M>(lzc);
+    uint64_t sums[3];
+    bool ok;
+
+    double direct_time = best_of(cfg.rounds,[&](void) {
+        sums[0] = dispatch_search(direct,buf.data(),len,lzc.max_chain);
+    });
+    double finder_time = best_of(cfg.rounds,[&](void) {
+        sums[1] = dispatch_search(finder,buf.data(),len,lzc.max_chain);
+    });
+    double virtual_time = best_of(cfg.rounds,[&](void) {
+        sums[2] = dispatch_search(*p_virtual,buf.data(),len,lzc.max_chain);
+    });
+
+    delete p_virtual;
+    ok = sums[0] == sums[1] && sums[0] == sums[2];
+
+    std::cout << " " << name << ", max chain " << lzc.max_chain << ":\n";
+    report_check("same matches",ok);
+    print_rate(std::cout,"template call",len,direct_time) << "\n";
+    print_rate(std::cout,"match_finder thunk",len,finder_time)
+        << std::setprecision(2) << std::setw(8) << (finder_time > 0 ? direct_time / finder_time : 0.0) << "x\n";
+    print_rate(std::cout,"virtual call",len,virtual_time)
+        << std::setprecision(2) << std::setw(8) << (virtual_time > 0 ? direct_time / virtual_time : 0.0) << "x\n";
+
+    return ok;
+}
+
+bool bench_dispatch(const bench_config& cfg)
+{
+    std::vector<char> buf;
+    lz_config lzc;
+    bool ok;
+
+    if (!bench_file(cfg,buf)) {
+        bench_data("sprites",buf,cfg.size,cfg.seed);
+        buf.resize(cfg.size);
+    }
+
+    // The matchers read a byte past the end
+    buf.push_back(0);
+
+    // zxpac4 with the default --max-chain
+    ::memset(&lzc,0,sizeof(lzc));
+    lzc.window_size = 131072;
+    lzc.min_match = 2;
+    lzc.max_match = 255;
+    lzc.good_match = 63;
+    lzc.max_chain = 16;
+    lzc.hash_bytes = 2;
+    lzc.num_threads = 1;
+    lzc.parse_split = 1;
+
+    lzc.matcher = LZ_MATCHER_HASH3;
+    ok = bench_dispatch_matcher<hash3>(cfg,buf,lzc,"hash3");
+    lzc.matcher = LZ_MATCHER_BINTREE;
+    ok = bench_dispatch_matcher<bintree>(cfg,buf,lzc,"bintree") && ok;
+    return ok;
+}
+
+//
+// cost table
+//
+
+/**
+ * @brief The per position cost structure before the structure of arrays
+ *        cost_table, about 24 bytes per position. Kept as the reference
+ *        of the table layout.
+ */
+struct cost_reference {
+    int32_t next;
+    int32_t offset;
+    int32_t length;
+    int32_t pmr_offset;
+    uint32_t arrival_cost;
+    int16_t num_literals;
+    bool last_was_literal;
+};
+
+/**
+ * @brief Relax the arrival costs of @p len positions as the optimal
+ *        parser does, with a literal and two generated matches per
+ *        position. The cost of the matches follows zxpac4 loosely.
+ *        @p C is either a pointer to cost_reference or a cost_table.
+ */
+template<class C> void cost_relax(const C& c, int len, uint32_t seed)
+{
+    c[0].arrival_cost = 0;
+    c[0].pmr_offset = 1;
+    c[0].last_was_literal = false;
+
+    for (int pos = 1; pos <= len; pos++) {
+        c[pos].arrival_cost = LZ_MAX_COST;
+    }
+    for (int pos = 0; pos < len; pos++) {
+        C p_ctx = c + pos;
+        uint32_t new_cost = p_ctx->arrival_cost + 9;
+
+        if (p_ctx[1].arrival_cost > new_cost) {
+            p_ctx[1].offset = 0;
+            p_ctx[1].length = 1;
+            p_ctx[1].pmr_offset = p_ctx->pmr_offset;
+            p_ctx[1].arrival_cost = new_cost;
+            p_ctx[1].last_was_literal = true;
+        }
+        for (int m = 0; m < 2; m++) {
+            uint32_t h = (pos * 2 + m + seed) * HASH_MULTIPLIER;
+            int offset = 1 + (h >> 15) % std::max(pos,1);
+            int length = 2 + ((h & 0x3f) < 60 ? h & 0x0f : h >> 8 & 0xff);
+
+            if (pos + length > len || offset > 131071) {
+                continue;
+            }
+
+            bool pmr_found = offset == static_cast<int>(p_ctx->pmr_offset);
+
+            new_cost = p_ctx->arrival_cost + 2 + (pmr_found ? 0 : 7 + lz_bit_width(offset)) +
+                2 * lz_bit_width(length);
+
+            if (p_ctx[length].arrival_cost > new_cost) {
+                p_ctx[length].offset = pmr_found ? 0 : offset;
+                p_ctx[length].pmr_offset = offset;
+                p_ctx[length].arrival_cost = new_cost;
+                p_ctx[length].length = length;
+                p_ctx[length].last_was_literal = false;
+            }
+        }
+    }
+}
+
+bool bench_cost_table(const bench_config& cfg)
+{
+    typedef cost_table<int32_t,uint16_t> table_t;
+    std::vector<cost_reference> ref(cfg.size + 1);
+    table_t table = table_t::alloc(cfg.size + 1,131072,255);
+    perf_counters pc;
+    bool ok = true;
+
+    cost_relax(ref.data(),cfg.size,cfg.seed);
+    cost_relax(table,cfg.size,cfg.seed);
+
+    for (int pos = 1; pos <= cfg.size && ok; pos++) {
+        ok = ref[pos].arrival_cost == table[pos].arrival_cost && ref[pos].offset == table[pos].offset &&
+            ref[pos].length == table[pos].length && ref[pos].pmr_offset == table[pos].pmr_offset &&
+            ref[pos].last_was_literal == table[pos].last_was_literal;
+    }
+
+    report_check("same costs",ok);
+    std::cout << "  bytes per position: " << sizeof(cost_reference) << " struct, "
+              << sizeof(uint32_t) + sizeof(int32_t) + 2 * sizeof(int32_t) + sizeof(uint16_t) +
+                 sizeof(int16_t) + sizeof(bool) << " cost_table\n";
+
+    auto run_ref = [&](void) {
+        cost_relax(ref.data(),cfg.size,cfg.seed);
+    };
+    auto run_table = [&](void) {
+        cost_relax(table,cfg.size,cfg.seed);
+    };
+    double ref_time = best_of(cfg.rounds,run_ref);
+    double table_time = best_of(cfg.rounds,run_table);
+
+    print_misses(print_rate(std::cout,"struct array",cfg.size,ref_time),pc,run_ref) << "\n";
+    print_misses(print_rate(std::cout,"cost_table",cfg.size,table_time),pc,run_table)
+        << std::setprecision(2) << std::setw(8) << (table_time > 0 ? ref_time / table_time : 0.0) << "x\n";
+
+    table_t::free(table);
+    return ok;
+}
+
+struct bench_test {
+    const char* name;
+    const char* help;
+    bool (*func)(const bench_config& cfg);
+};
+
+const bench_test bench_tests[] = {
+    {"putbits",     "history format bit writer against the former writer, size = tokens",
+                    bench_putbits},
+    {"matchlen",    "match length kernels against a byte loop, size = data bytes",
+                    bench_match_len},
+    {"hash",        "hash chain distance links against position links, size = data bytes, takes a file",
+                    bench_hash},
+    {"dispatch",    "matcher calls through match_finder and virtuals against direct calls,\n"
+                    "                        size = data bytes, takes a file",
+                    bench_dispatch},
+    {"costtable",   "cost_table arrays against the former cost structures, size = positions",
+                    bench_cost_table},
+};
+
+void bench_usage(char* prg)
+{
+    std::cerr << "ZXPAC4 v" << ZXPAC4_MAJOR << "." << ZXPAC4_MINOR << " (c) 2022-24 Jouni 'Mr.Spiv' Korhonen\n\n";
+    std::cerr << "Usage: " << prg << " " << BENCH_NAME << " [options] [test ...]\n";
+    std::cerr << " Runs the named tests or all of them. Each test checks a kernel against\n"
+              << " its reference and reports the best time of the rounds.\n";
+    std::cerr << " Tests:\n";
+    for (const bench_test& t : bench_tests) {
+        std::cerr << "  " << std::left << std::setw(22) << t.name << t.help << "\n";
+    }
+    std::cerr << " Options:\n";
+    std::cerr << "  --size,-s num         Size of the generated data (default " << BENCH_DEF_SIZE << ").\n";
+    std::cerr << "  --rounds,-r num       Timing rounds (1-" << BENCH_MAX_ROUNDS << ", default " << BENCH_DEF_ROUNDS << ").\n";
+    std::cerr << "  --seed,-S num         Seed of the generated data (default 1).\n";
+    std::cerr << "  --file,-f file        Use the first size bytes of a file instead of generated data\n"
+              << "                        in the tests that take a file.\n";
+    std::cerr << "  --help,-h             Print this output ;)\n";
+    std::cerr << std::flush;
+    exit(EXIT_FAILURE);
+}
+
+}   // namespace
+
+
+int bench_main(int argc, char** argv)
+{
+    static struct option bench_longopts[] = {
+        {"size",        required_argument,  NULL, 's'},
+        {"rounds",      required_argument,  NULL, 'r'},
+        {"seed",        required_argument,  NULL, 'S'},
+        {"file",        required_argument,  NULL, 'f'},
+        {"help",        no_argument,        NULL, 'h'},
+        {0,0,0,0}
+    };
+    std::vector<const bench_test*> tests;
+    bench_config cfg = {BENCH_DEF_SIZE,BENCH_DEF_ROUNDS,1,NULL};
+    char* endptr;
+    int num_failed = 0;
+    int n;
+
+    optind = 2;
+
+    while ((n = getopt_long(argc, argv, "s:r:S:f:h", bench_longopts, NULL)) != -1) {
+        switch (n) {
+            case 's':   // --size
+                cfg.size = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg.size < 1 || cfg.size > BENCH_MAX_SIZE) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --size value '" << optarg << "'\n";
+                    bench_usage(argv[0]);
+                }
+                break;
+            case 'r':   // --rounds
+                cfg.rounds = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg.rounds < 1 || cfg.rounds > BENCH_MAX_ROUNDS) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --rounds value '" << optarg << "'\n";
+                    bench_usage(argv[0]);
+                }
+                break;
+            case 'S':   // --seed
+                cfg.seed = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0') {
+                    std::cerr << ERR_PREAMBLE << "Invalid --seed value '" << optarg << "'\n";
+                    bench_usage(argv[0]);
+                }
+                break;
+            case 'f':   // --file
+                cfg.file = optarg;
+                break;
+            default:
+                bench_usage(argv[0]);
+        }
+    }
+    for (n = optind; n < argc; n++) {
+        const bench_test* p_test = NULL;
+
+        for (const bench_test& t : bench_tests) {
+            if (!strcmp(argv[n],t.name)) {
+                p_test = &t;
+            }
+        }
+        if (p_test == NULL) {
+            std::cerr << ERR_PREAMBLE << "unknown test '" << argv[n] << "'\n";
+            bench_usage(argv[0]);
+        }
+
+        tests.push_back(p_test);
+    }
+    if (tests.empty()) {
+        for (const bench_test& t : bench_tests) {
+            tests.push_back(&t);
+        }
+    }
+    for (const bench_test* p_test : tests) {
+        std::cout << p_test->name << ":\n";
+
+        try {
+            if (!p_test->func(cfg)) {
+                ++num_failed;
+            }
+        } catch (std::exception& e) {
+            std::cerr << ERR_PREAMBLE << e.what() << "\n";
+            ++num_failed;
+        }
+    }
+
+    std::cout << tests.size() << " tests, " << num_failed << " failed" << std::endl;
+    return num_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
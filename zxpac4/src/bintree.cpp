@@ -0,0 +1,183 @@
+/**
+ * @file bintree.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Binary tree based string matcher for LZ engines.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <iostream>
+#include <cassert>
+#include "lz_util.h"
+#include "bintree.h"
+#include "match_len.h"
+
+
+bintree::bintree(int window_size, int min_match, int max_match,
+    int good_match,
+    int mm2_thres_offset,
+    int mm3_thres_offset):
+    m_head(NULL),
+    m_tree(NULL),
+    m_mtch(NULL)
+{
+    // The tree cannot be cut at a good match without breaking it..
+    (void)good_match;
+    (void)mm2_thres_offset;
+    (void)mm3_thres_offset;
+
+#ifdef WINDOW_IS_POWER_OF_TWO
+    if ((window_size-1) & window_size) {
+        EXCEPTION(std::invalid_argument,"Window size not a power of two.");
+    }
+
+    m_mask = window_size-1;
+#else
+    m_mask = window_size;
+#endif // WINDOW_IS_POWER_OF_TWO
+    m_head = new int[BINTREE_HASH_SIZE];
+    m_tree = new int[2*window_size];
+    m_min_match = min_match;
+    m_max_match = max_match;
+    m_max_depth = BINTREE_MAX_DEPTH;
+    m_max_chain = 0;
+    reinit();
+}
+
+void bintree::impl_reinit(void)
+{
+    int n;
+
+    for (n = 0; n < BINTREE_HASH_SIZE; n++) {
+        m_head[n] = -1;
+    }
+}
+
+
+bintree::~bintree(void)
+{
+    if (m_head) {
+        delete[] m_head;
+    }
+    if (m_tree) {
+        delete[] m_tree;
+    }
+}
+
+void bintree::impl_init_get_matches(int max_matches, match *matches)
+{
+    m_mtch = matches;
+    m_max_chain = max_matches;
+}
+
+/**
+ * @brief Find matches for the @p pos and insert the position into
+ *        the binary tree.
+ *
+ * The tree of the hash bucket is walked from the most recent position
+ * towards older positions. Each step descends to the subtree, which is
+ * closer to the current string. The current position becomes the new
+ * root and the visited nodes get split into its left (smaller) and
+ * right (greater) subtrees.
+ *
+ * @param[in] buf A ptr to the input buffer.
+ * @param[in] pos The current position in the buffer.
+ * @param[in] len The number of bytes left in the buffer from @p pos.
+ * @param[in] only_better_matches Ignored. The tree walk only finds
+ *                                better matches anyway.
+ *
+ * @return Number of found matches or 0. Matches are in the increasing
+ *         length order.
+ */
+
+int bintree::impl_find_matches(const char *buf, int pos, int len, bool only_better_matches=false)
+{
+    int low    = pos - m_mask;
+    int best   = m_min_match - 1;
+    int found  = 0;
+    int depth  = m_max_depth;
+    int len0   = 0;     // Common prefix length with the left subtree
+    int len1   = 0;     // Common prefix length with the right subtree
+    int head;
+    int next;
+    int length;
+    int* ptr0;
+    int* ptr1;
+    int* pair;
+    const uint8_t* m;
+    const uint8_t* n = reinterpret_cast<const uint8_t*>(buf + pos);
+
+    (void)only_better_matches;
+
+    if (low < 0) {
+        low = 0;
+    }
+    if (len > m_max_match) {
+        len = m_max_match;
+    }
+    if (len < m_min_match) {
+        return 0;
+    }
+
+    head = hash(buf,pos);
+    next = m_head[head];
+    m_head[head] = pos;
+
+#ifdef WINDOW_IS_POWER_OF_TWO
+    ptr0 = &m_tree[2*(pos & m_mask)];
+#else
+    ptr0 = &m_tree[2*(pos % m_mask)];
+#endif // WINDOW_IS_POWER_OF_TWO
+    ptr1 = ptr0 + 1;
+
+    while (next >= low && depth-- > 0) {
+        m = reinterpret_cast<const uint8_t*>(buf + next);
+#ifdef WINDOW_IS_POWER_OF_TWO
+        pair = &m_tree[2*(next & m_mask)];
+#else
+        pair = &m_tree[2*(next % m_mask)];
+#endif // WINDOW_IS_POWER_OF_TWO
+
+        // Everything in this subtree shares at least this much
+        // with the current string.
+        length = len0 < len1 ? len0 : len1;
+
+        if (length < len) {
+            length += match_length(reinterpret_cast<const char*>(m + length),
+                reinterpret_cast<const char*>(n + length),len - length);
+        }
+        if (length > best) {
+            best = length;
+
+            if (found < m_max_chain) {
+                m_mtch[found].length = length;
+                m_mtch[found].offset = pos-next;
+                ++found;
+            }
+            if (length == len) {
+                // Identical strings. The old node gets replaced by
+                // the current one and its subtrees are inherited.
+                *ptr0 = pair[0];
+                *ptr1 = pair[1];
+                return found;
+            }
+        }
+        if (length < len && m[length] < n[length]) {
+            // History string is smaller.. goes to the left
+            *ptr0 = next;
+            ptr0 = &pair[1];
+            next = *ptr0;
+            len0 = length;
+        } else {
+            *ptr1 = next;
+            ptr1 = &pair[0];
+            next = *ptr1;
+            len1 = length;
+        }
+    }
+
+    *ptr0 = -1;
+    *ptr1 = -1;
+    return found;
+}
@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <string.h>
 #include "cost4_32k.h"
+#include "lz_codes.h"
 #include "zxpac4.h"
 
 /**
@@ -40,7 +41,8 @@
 
 zxpac4_32k_cost::zxpac4_32k_cost(
     const lz_config* p_cfg, int ins, int max): 
-    lz_cost(p_cfg)
+    lz_cost(p_cfg),
+    m_speed(p_cfg)
     //m_mtf(256,129,p_cfg->mtf_insert_pos,1,p_cfg->mtf_num_steps)
 {
     (void)ins;
@@ -58,54 +60,17 @@ zxpac4_32k_cost::~zxpac4_32k_cost(void)
 {
 }
 
+static_assert(zxpac4_32k_offset_codes[15].bits == 7+5+7, "Offset classes");
+
 int zxpac4_32k_cost::impl_get_offset_tag(int offset, char& byte_tag, int& bit_tag)
 {
-    if (offset < 128) {
-        // (0ooooooo)
-        byte_tag = offset;
-        bit_tag = 0;
-        return 0;
-    } else if (offset < 256) {
-        // (1ooooooo) + 00
-        byte_tag = offset;
-        bit_tag = 0;
-        return 2;
-    } else if (offset < 512) {
-        // (1ooooooo) + 01 + o
-        byte_tag = offset >> 1;
-        bit_tag = (0x1 << 1) | (offset & 0x01);
-        return 3;
-    } else if (offset < 1024) {
-        // (1ooooooo) + 100 + oo
-        byte_tag = offset >> 2;
-        bit_tag = (0x4 << 2) | (offset & 0x03);
-        return 5;
-    } else if (offset < 2048) {
-        // (1ooooooo) + 101 + ooo
-        byte_tag = offset >> 3;
-        bit_tag = (0x5 << 3) | (offset & 0x07);
-        return 6;
-    } else if (offset < 4096) {
-        // (1ooooooo) + 1100 + oooo
-        byte_tag = offset >> 4;
-        bit_tag = (0xc << 4) | (offset & 0x0f);
-        return 8;
-    } else if (offset < 8192) {
-        // (1ooooooo) + 1101 + oooo + o
-        byte_tag = offset >> 5;
-        bit_tag = (0xd << 5) | (offset & 0x1f);
-        return 9;
-    } else if (offset < 16384) {
-        // (1ooooooo) + 1110 + oooo + oo
-        byte_tag = offset >> 6;
-        bit_tag = (0xe << 6) | (offset & 0x3f);
-        return 10;
-    } else {
-        // (1ooooooo) + 1111 + oooo + ooo
-        byte_tag = offset >> 7;
-        bit_tag = (0xf << 7) | (offset & 0x7f);
-        return 11;
-    }
+    const lz_offset_code& code = zxpac4_32k_offset_codes[lz_bit_width(offset)];
+
+    assert(offset > 0 && offset < 32768);
+
+    byte_tag = offset >> code.shift;
+    bit_tag = code.tag | (offset & ((1 << code.shift) - 1));
+    return code.tag_bits;
 }
 
 int zxpac4_32k_cost::impl_get_length_tag(int length, int& bit_tag)
@@ -113,37 +78,7 @@ int zxpac4_32k_cost::impl_get_length_tag(int length, int& bit_tag)
     assert(length > 0);
     assert(length <= lz_get_config()->max_match);
 
-    int bits = 1;
-    int mask = 1;
-    int mask_bit = 0;
-    bit_tag = 0;
-
-    while (mask < length) {
-        ++mask_bit;
-        mask = mask * 2 + 1;
-    }
-
-    if (mask_bit == 0) {
-        // 0 + [0] = 1
-        return bits;
-    }
-
-    mask = 1 << (mask_bit - 1);
-   
-    while (mask > 0) {
-        bit_tag = (bit_tag | 0x1) << 2;
-        bit_tag = mask & length ? bit_tag | 0x2 : bit_tag;
-        bits += 2;
-        mask >>= 1;
-    }
-
-    if (mask_bit == m_max_bits) {
-        //std::cerr << ">>>> " << std::hex << bit_tag << ", " << std::dec << bits << std::endl;
-        bit_tag >>= 1;
-        bits -= 1;
-    }
-
-    return bits;
+    return lz_gamma_tag(length,m_max_bits + 1,bit_tag);
 }
 
 int zxpac4_32k_cost::impl_get_literal_tag(const char* literals, int length, char& byte_tag, int& bit_tag)
@@ -163,61 +98,17 @@ int zxpac4_32k_cost::impl_get_literal_tag(const char* literals, int length, char
 int zxpac4_32k_cost::impl_get_offset_bits(int offset)
 {
     assert(offset < 32768);
-    
-    if (offset == 0) {
-        return 0;
-    }
-    if (offset < 128) {
-        return (7+1 + 0);
-    } else if (offset < 256) {
-        return (7+3+0);
-    } else if (offset < 512) {
-        return (7+3+1);
-    } else if (offset < 1024) {
-        return (7+4+2);
-    } else if (offset < 2048) {
-        return (7+4+3);
-    } else if (offset < 4096) {
-        return (7+5+4);
-    } else if (offset < 8192) {
-        return (7+5+5);
-    } else if (offset < 16384) {
-        return (7+5+6);
-    } else if (offset < 32768) {
-        return (7+5+7);
-    }
-    return 0;
+
+    // A PMR has no offset bits
+    return zxpac4_32k_offset_codes[lz_bit_width(offset)].bits;
 }
 
 int zxpac4_32k_cost::impl_get_length_bits(int length)
 {
     assert(length > 0);
-    
-    // Maximum match length can be either 255 or 65535
-    if (lz_get_config()->max_match > 255) {
-        assert(length < 65536);
-    } else {
-        assert(length < 256);
-    }
+    assert(length <= lz_get_config()->max_match);
 
-    // matchlen cost..
-    if (length == 1) {
-        return (1+0);
-    } else if (length < 4) {
-        return (2+1);
-    } else if (length < 8) {
-        return (3+2);
-    } else if (length < 16) {
-        return (4+3);
-    } else if (length < 32) {
-        return (5+4);
-    } else if (length < 64) {
-        return (6+5);
-    } else if (length < 128) {
-        return (7+6);
-    }
-    // < 256
-    return (7+7);
+    return lz_gamma_table[m_max_bits + 1][lz_bit_width(length)];
 }
 
 int zxpac4_32k_cost::impl_get_literal_bits(char literal, bool is_ascii)
@@ -246,22 +137,23 @@ int zxpac4_32k_cost::impl_get_literal_bits(char literal, bool is_ascii)
  */
 
 
-int zxpac4_32k_cost::impl_literal_cost(int pos, cost* c, const char* buf)
+int zxpac4_32k_cost::impl_literal_cost(int pos, const cost_t& c, const char* buf)
 {
-    cost* p_ctx = &c[pos];
+    cost_t p_ctx = c + pos;
     uint32_t new_cost = p_ctx->arrival_cost;
     int offset = p_ctx->offset;
+    int tag_cost = 0;
 
+    if (lz_get_config()->is_ascii == false || p_ctx->last_was_literal == false) {
+        tag_cost = 1;
+    }
     if (pos >= p_ctx->pmr_offset && buf[pos-p_ctx->pmr_offset] == buf[pos]) {
         offset = p_ctx->pmr_offset;
-        new_cost += 2;
+        new_cost += m_speed.pmr(tag_cost + 2,1);
     } else {
-        new_cost = new_cost + get_literal_bits(buf[pos],lz_get_config()->is_ascii);
+        new_cost += m_speed.literal(tag_cost + get_literal_bits(buf[pos],lz_get_config()->is_ascii));
         offset = 0;
     }
-    if (lz_get_config()->is_ascii == false || p_ctx->last_was_literal == false) {
-        new_cost = new_cost + 1;
-    }
     if (p_ctx[1].arrival_cost >= new_cost) {
         p_ctx[1].arrival_cost = new_cost;
         p_ctx[1].length = 1;
@@ -295,14 +187,15 @@ int zxpac4_32k_cost::impl_literal_cost(int pos, cost* c, const char* buf)
  */
 
 
-int zxpac4_32k_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset, int length)
+int zxpac4_32k_cost::impl_match_cost(int pos, const cost_t& c, const char* buf, int offset, int length)
 {
-    cost* p_ctx = &c[pos];
+    cost_t p_ctx = c + pos;
     bool pmr_found = false;
     uint32_t new_cost;
     int local_pmr_offset; 
     int encode_length;
     int tag_cost;
+    int bits;
     int n;
         
     if (lz_get_config()->is_ascii == false || p_ctx->last_was_literal == false) {
@@ -311,7 +204,6 @@ int zxpac4_32k_cost::impl_match_cost(int pos, cost* c, const char* buf, int offs
         tag_cost = 0+1;
     }
 
-    new_cost = p_ctx->arrival_cost + tag_cost;
     local_pmr_offset = p_ctx->pmr_offset; 
 
     if (offset == local_pmr_offset) {
@@ -325,8 +217,9 @@ int zxpac4_32k_cost::impl_match_cost(int pos, cost* c, const char* buf, int offs
 
     assert(encode_length > 0);
     assert(offset < 32768);
-    new_cost += get_offset_bits(offset);
-    new_cost += get_length_bits(encode_length);
+    bits = tag_cost + get_offset_bits(offset) + get_length_bits(encode_length);
+    new_cost = p_ctx->arrival_cost;
+    new_cost += pmr_found ? m_speed.pmr(bits,length) : m_speed.match(bits,zxpac4_32k_offset_codes[lz_bit_width(offset)],length);
             
     if (p_ctx[length].arrival_cost > new_cost) {
         p_ctx[length].offset       = offset;
@@ -346,8 +239,8 @@ int zxpac4_32k_cost::impl_match_cost(int pos, cost* c, const char* buf, int offs
         assert(length <= max_match);
 
         if (length >= lz_get_config()->min_match) {
-            new_cost = p_ctx->arrival_cost + tag_cost;
-            new_cost += get_length_bits(length);
+            new_cost = p_ctx->arrival_cost;
+            new_cost += m_speed.pmr(tag_cost + get_length_bits(length),length);
             
             if (p_ctx[length].arrival_cost >= new_cost) {
             //std::cerr << "PMR at " << pos << ", " << pmr_offset << ", " << length << "\n";
@@ -361,9 +254,14 @@ int zxpac4_32k_cost::impl_match_cost(int pos, cost* c, const char* buf, int offs
     return length >= lz_get_config()->good_match ? lz_get_config()->good_match : 1;
 }
 
-int zxpac4_32k_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
+int zxpac4_32k_cost::impl_init_cost(const cost_t& p_ctx, int sta, int len, int pmr)
 {
-    assert(p_ctx != NULL);
+    assert(p_ctx);
+
+    if (sta == 0) {
+        // The whole file with literals of 8 bits and their tags
+        m_speed.init_length(m_max_len,8+1);
+    }
 
     p_ctx[sta].next         = 0;
     p_ctx[sta].num_literals = 0;
@@ -377,27 +275,19 @@ int zxpac4_32k_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
     return 0;
 }
 
-cost* zxpac4_32k_cost::impl_alloc_cost(int len, int max_chain)
+zxpac4_32k_cost::cost_t zxpac4_32k_cost::impl_alloc_cost(int len, int max_chain)
 {
-    cost* cc;
     (void)max_chain;
 
     m_max_len = len;
-
-    try {
-        cc = new cost[len+1];
-    } catch (...) {
-        throw;
-    }
-
-    return cc;
+    return cost_t::alloc(len+1,lz_get_config()->window_size,lz_get_config()->max_match);
 }
 
 
-int zxpac4_32k_cost::impl_free_cost(cost* cost)
+int zxpac4_32k_cost::impl_free_cost(cost_t& c)
 {
-    if (cost) {
-        delete[] cost;
+    if (c) {
+        cost_t::free(c);
     }
     return 0;
 }
@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <string.h>
 #include "cost4b.h"
+#include "lz_codes.h"
 #include "zxpac4b.h"
 
 /**
@@ -57,64 +58,17 @@ zxpac4b_cost::~zxpac4b_cost(void)
 {
 }
 
+static_assert(zxpac4b_offset_codes[17].bits == 7+6+9, "Offset classes");
+
 int zxpac4b_cost::impl_get_offset_tag(int offset, char& byte_tag, int& bit_tag)
 {
-    if (offset < 128) {
-        // (0ooooooo)
-        byte_tag = offset;
-        bit_tag = 0;
-        return 0;
-    } else if (offset < 256) {
-        // (1ooooooo) + 00
-        byte_tag = offset;
-        bit_tag = 0;
-        return 2;
-    } else if (offset < 512) {
-        // (1ooooooo) + 01 + o
-        byte_tag = offset >> 1;
-        bit_tag = (0x1 << 1) | (offset & 0x01);
-        return 3;
-    } else if (offset < 1024) {
-        // (1ooooooo) + 100 + oo
-        byte_tag = offset >> 2;
-        bit_tag = (0x4 << 2) | (offset & 0x03);
-        return 5;
-    } else if (offset < 2048) {
-        // (1ooooooo) + 101 + ooo
-        byte_tag = offset >> 3;
-        bit_tag = (0x5 << 3) | (offset & 0x07);
-        return 6;
-    } else if (offset < 4096) {
-        // (1ooooooo) + 1100 + oooo
-        byte_tag = offset >> 4;
-        bit_tag = (0xc << 4) | (offset & 0x0f);
-        return 8;
-    } else if (offset < 8192) {
-        // (1ooooooo) + 1101 + oooo + o
-        byte_tag = offset >> 5;
-        bit_tag = (0xd << 5) | (offset & 0x1f);
-        return 9;
-    } else if (offset < 16384) {
-        // (1ooooooo) + 11100 + ooo + ooo
-        byte_tag = offset >> 6;
-        bit_tag = (0x1c << 6) | (offset & 0x3f);
-        return 11;
-    } else if (offset < 32768) {
-        // (1ooooooo) + 11101 + ooo + oooo
-        byte_tag = offset >> 7;
-        bit_tag = (0x1d << 7) | (offset & 0x7f);
-        return 12;
-    } else if (offset < 65536) {
-        // (1ooooooo) + 11110 + ooo + ooooo
-        byte_tag = offset >> 8;
-        bit_tag = (0x1e << 8) | (offset & 0xff);
-        return 13;
-    } else /*(offset < 131072)*/ {
-    // (1ooooooo) + 11111 + ooo + oooooo
-        byte_tag = offset >> 9;
-        bit_tag = (0x1f << 9) | (offset & 0x1ff);
-        return 14;
-    }
+    const lz_offset_code& code = zxpac4b_offset_codes[lz_bit_width(offset)];
+
+    assert(offset > 0 && offset < 131072);
+
+    byte_tag = offset >> code.shift;
+    bit_tag = code.tag | (offset & ((1 << code.shift) - 1));
+    return code.tag_bits;
 }
 
 int zxpac4b_cost::impl_get_length_tag(int length, int& bit_tag)
@@ -122,35 +76,7 @@ int zxpac4b_cost::impl_get_length_tag(int length, int& bit_tag)
     assert(length > 0);
     assert(length < 256);
 
-    int mask_bit = 7;
-    int bits = 1;
-    int mask;
-    bit_tag = 0;
-
-    while ((1 << mask_bit) > length) {
-        mask_bit--;
-    }
-
-    if (mask_bit == 0) {
-        // 0 + [0] = 1
-        return bits;
-    }
-
-    mask = 1 << (mask_bit - 1);
-   
-    while (mask > 0) {
-        bit_tag = (bit_tag | 0x1) << 2;
-        bit_tag = mask & length ? bit_tag | 0x2 : bit_tag;
-        bits += 2;
-        mask >>= 1;
-    }
-
-    if (mask_bit == 7) {
-        bit_tag >>= 1;
-        bits -= 1;
-    }
-
-    return bits;
+    return lz_gamma_tag(length,ZXPAC4B_GAMMA_MAX_WIDTH,bit_tag);
 }
 
 int zxpac4b_cost::impl_get_literal_tag(const char* literals, int length, char& byte_tag, int& bit_tag)
@@ -164,34 +90,9 @@ int zxpac4b_cost::impl_get_literal_tag(const char* literals, int length, char& b
 int zxpac4b_cost::impl_get_offset_bits(int offset)
 {
     assert(offset < 131072);
-    
-    if (offset == 0) {
-        return 0;
-    }
-    if (offset < 128) {
-        return (7+1 + 0);
-    } else if (offset < 256) {
-        return (7+3+0);
-    } else if (offset < 512) {
-        return (7+3+1);
-    } else if (offset < 1024) {
-        return (7+4+2);
-    } else if (offset < 2048) {
-        return (7+4+3);
-    } else if (offset < 4096) {
-        return (7+5+4);
-    } else if (offset < 8192) {
-        return (7+5+5);
-    } else if (offset < 16384) {
-        return (7+6+6);
-    } else if (offset < 32768) {
-        return (7+6+7);
-    } else if (offset < 65536) {         // up to 65535
-        return (7+6+8);
-    } else if (offset < 131072) {
-        return (7+6+9);
-    }
-    return 0;
+
+    // A PMR has no offset bits
+    return zxpac4b_offset_codes[lz_bit_width(offset)].bits;
 }
 
 int zxpac4b_cost::impl_get_length_bits(int length)
@@ -199,24 +100,7 @@ int zxpac4b_cost::impl_get_length_bits(int length)
     assert(length > 0);
     assert(length < 256);
 
-    // matchlen cost..
-    if (length == 1) {
-        return (1+0);
-    } else if (length < 4) {
-        return (2+1);
-    } else if (length < 8) {
-        return (3+2);
-    } else if (length < 16) {
-        return (4+3);
-    } else if (length < 32) {
-        return (5+4);
-    } else if (length < 64) {
-        return (6+5);
-    } else if (length < 128) {
-        return (7+6);
-    }
-    // < 256
-    return (7+7);
+    return lz_gamma_table[ZXPAC4B_GAMMA_MAX_WIDTH][lz_bit_width(length)];
 }
 
 int zxpac4b_cost::impl_get_literal_bits(char literal, bool is_ascii)
@@ -241,15 +125,15 @@ int zxpac4b_cost::impl_get_literal_bits(char literal, bool is_ascii)
  */
 
 
-int zxpac4b_cost::impl_literal_cost(int pos, cost* c, const char* buf)
+int zxpac4b_cost::impl_literal_cost(int pos, const cost_t& c, const char* buf)
 {
-    cost* p_ctx = &c[pos];
+    cost_t p_ctx = c + pos;
     uint32_t new_cost = p_ctx->arrival_cost;
     int offset = p_ctx->offset;
     int num_literals = p_ctx->num_literals;
 
-    if (pos >= p_ctx->pmr_offset && (buf[pos-p_ctx->pmr_offset] == buf[pos])) {
-        // PMR of length 1 
+    if (num_literals > 0 && pos >= p_ctx->pmr_offset && (buf[pos-p_ctx->pmr_offset] == buf[pos])) {
+        // PMR of length 1, which can only follow a literal run
         offset = p_ctx->pmr_offset;
         num_literals = 1;
     } else {
@@ -303,9 +187,9 @@ int zxpac4b_cost::impl_literal_cost(int pos, cost* c, const char* buf)
  */
 
 
-int zxpac4b_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset, int length)
+int zxpac4b_cost::impl_match_cost(int pos, const cost_t& c, const char* buf, int offset, int length)
 {
-    cost* p_ctx = &c[pos];
+    cost_t p_ctx = c + pos;
     bool pmr_found = false;
     int local_pmr_offset; 
     uint32_t new_cost;
@@ -322,7 +206,8 @@ int zxpac4b_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
     local_pmr_offset = p_ctx->pmr_offset; 
     new_cost = p_ctx->arrival_cost + tag_cost;
         
-    if (offset == local_pmr_offset) {
+    // After a match the 0 tag selects a literal run and not a PMR
+    if (offset == local_pmr_offset && p_ctx->num_literals > 0) {
         offset = 0;
         encode_length = length;
         pmr_found = true;
@@ -347,7 +232,7 @@ int zxpac4b_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
     
     local_pmr_offset = p_ctx->pmr_offset;
 
-    if (pmr_found == false && pos >= local_pmr_offset) {
+    if (pmr_found == false && p_ctx->num_literals > 0 && pos >= local_pmr_offset) {
         int max_match = lz_get_config()->max_match;
         
         n = pos < m_max_len - max_match ? max_match : m_max_len - pos;
@@ -370,9 +255,9 @@ int zxpac4b_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
     return length >= lz_get_config()->good_match ? lz_get_config()->good_match : 1;
 }
 
-int zxpac4b_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
+int zxpac4b_cost::impl_init_cost(const cost_t& p_ctx, int sta, int len, int pmr)
 {
-    assert(p_ctx != NULL);
+    assert(p_ctx);
 
     p_ctx[sta].next         = 0;
     p_ctx[sta].num_literals = 0;
@@ -387,27 +272,19 @@ int zxpac4b_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
     return 0;
 }
 
-cost* zxpac4b_cost::impl_alloc_cost(int len, int max_chain)
+zxpac4b_cost::cost_t zxpac4b_cost::impl_alloc_cost(int len, int max_chain)
 {
-    cost* cc;
     (void)max_chain;
 
     m_max_len = len;
-    
-    try {
-        cc = new cost[len+1];
-    } catch (...) {
-        throw;
-    }
-
-    return cc;
+    return cost_t::alloc(len+1,lz_get_config()->window_size,lz_get_config()->max_match);
 }
 
 
-int zxpac4b_cost::impl_free_cost(cost* cost)
+int zxpac4b_cost::impl_free_cost(cost_t& c)
 {
-    if (cost) {
-        delete[] cost;
+    if (c) {
+        cost_t::free(c);
     }
     return 0;
 }
@@ -20,6 +20,7 @@
 #include <string.h>
 
 #include "cost4c.h"
+#include "lz_codes.h"
 #include "zxpac4c.h"
 
 /**
@@ -46,6 +47,9 @@ zxpac4c_cost::zxpac4c_cost(
     if (p_cfg->backward_steps < 0 || p_cfg->backward_steps > 256-2) {
         EXCEPTION(std::out_of_range,"Backward steps must be > 0 and < 256");
     }
+
+    m_min_offset_bits = log2(p_cfg->min_offset);
+    m_tans_costs.adaptive = false;
 }
 
 zxpac4c_cost::~zxpac4c_cost(void)
@@ -185,23 +189,14 @@ int zxpac4c_cost::impl_get_literal_tag(const char* literals, int length, char& b
 int zxpac4c_cost::impl_get_offset_bits(int offset)
 {
     assert(offset < m_lz_config->window_size);
-    int bits = 0;
-
-    while (offset >= (2 << bits)) {
-        ++bits;
-    }
 
-    return bits;
+    // Index of the highest set bit, 0 for 0 and 1
+    return lz_bit_width(offset | 1) - 1;
 }
 
 int zxpac4c_cost::impl_get_length_bits(int length)
 {
-    int bits = 0;
-    while (length >= (2 << bits)) {
-        ++bits;
-    }
-    
-    return bits;
+    return lz_bit_width(length | 1) - 1;
 }
 
 int zxpac4c_cost::impl_get_literal_bits(char literal, bool is_ascii)
@@ -227,10 +222,10 @@ int zxpac4c_cost::impl_get_literal_bits(char literal, bool is_ascii)
  */
 
 
-int zxpac4c_cost::impl_literal_cost(int pos, cost* c, const char* buf)
+int zxpac4c_cost::impl_literal_cost(int pos, const cost_t& c, const char* buf)
 {
-    cost* p_ctx = &c[pos];
-    uint32_t new_cost = p_ctx->arrival_cost + 1;
+    cost_t p_ctx = c + pos;
+    uint32_t new_cost = p_ctx->arrival_cost + 1 * TANS_COST_SCALE;
     int offset = p_ctx->offset;
     int num_literals = p_ctx->num_literals;
 
@@ -238,23 +233,35 @@ int zxpac4c_cost::impl_literal_cost(int pos, cost* c, const char* buf)
         // PMR of length 1 
         offset = p_ctx->pmr_offset;
         num_literals = 1;
-		new_cost += 4;
+
+        if (m_tans_costs.adaptive) {
+            // encoded as a match length of 1
+            new_cost += predict_tans_cost(TANS_LENGTH_SYMS,1);
+        } else {
+            new_cost += 4 * TANS_COST_SCALE;
+            new_cost += impl_get_length_bits(num_literals) * TANS_COST_SCALE;
+            new_cost += predict_tans_cost(TANS_LITERAL_RUN_SYMS,num_literals);
+        }
     } else {
         // get the cost of the new literal
-        new_cost += impl_get_literal_bits(buf[pos],false);
+        new_cost += impl_get_literal_bits(buf[pos],false) * TANS_COST_SCALE;
         if (num_literals > 0) {
             // substract the previous literal run encoding.. since this is delta..
-            new_cost -= impl_get_length_bits(num_literals);
+            new_cost -= impl_get_length_bits(num_literals) * TANS_COST_SCALE;
+
+            if (m_tans_costs.adaptive) {
+                new_cost -= predict_tans_cost(TANS_LITERAL_RUN_SYMS,num_literals);
+            }
         }
         ++num_literals;
 
         // mark as a literal run instead of a PMR with length 1
         offset = 0;
-    }
 
-    // get the cost of literal run encoding
-    new_cost += impl_get_length_bits(num_literals);
-    new_cost += predict_tans_cost(TANS_LITERAL_RUN_SYMS,num_literals);
+        // get the cost of literal run encoding
+        new_cost += impl_get_length_bits(num_literals) * TANS_COST_SCALE;
+        new_cost += predict_tans_cost(TANS_LITERAL_RUN_SYMS,num_literals);
+    }
 
 	if (p_ctx[1].arrival_cost >= new_cost) {
         p_ctx[1].arrival_cost = new_cost;
@@ -289,9 +296,9 @@ int zxpac4c_cost::impl_literal_cost(int pos, cost* c, const char* buf)
  */
 
 
-int zxpac4c_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset, int length)
+int zxpac4c_cost::impl_match_cost(int pos, const cost_t& c, const char* buf, int offset, int length)
 {
-    cost* p_ctx = &c[pos];
+    cost_t p_ctx = c + pos;
     int local_pmr_offset; 
     uint32_t new_cost;
 
@@ -304,7 +311,7 @@ int zxpac4c_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
 
     // Tag cost is 1 bit as a baseline..
     local_pmr_offset = p_ctx->pmr_offset; 
-    new_cost = p_ctx->arrival_cost + 1;
+    new_cost = p_ctx->arrival_cost + 1 * TANS_COST_SCALE;
     
     if (pos >= local_pmr_offset && offset == local_pmr_offset) {
         // We have a PMR match
@@ -316,11 +323,11 @@ int zxpac4c_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
 
     // weight of offset encoding 
 	if (offset > 0) {
-		new_cost += get_offset_bits(offset);
+		new_cost += get_offset_bits(offset) * TANS_COST_SCALE;
 		new_cost += predict_tans_cost(TANS_OFFSET_SYMS,offset); 
 	}
 	// weight of length encoding 
-    new_cost += get_length_bits(length);
+    new_cost += get_length_bits(length) * TANS_COST_SCALE;
     new_cost += predict_tans_cost(TANS_LENGTH_SYMS,length);
 
     if (p_ctx[length].arrival_cost > new_cost) {
@@ -341,10 +348,10 @@ int zxpac4c_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
  *
  *
  */
-int zxpac4c_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
+int zxpac4c_cost::impl_init_cost(const cost_t& p_ctx, int sta, int len, int pmr)
 {
     int n;
-    assert(p_ctx != NULL);
+    assert(p_ctx);
 
     // Initialize the cost array
     p_ctx[sta].next         = 0;
@@ -360,50 +367,103 @@ int zxpac4c_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
     return 0;
 }
 
-cost* zxpac4c_cost::impl_alloc_cost(int len, int max_chain)
+zxpac4c_cost::cost_t zxpac4c_cost::impl_alloc_cost(int len, int max_chain)
 {
-    cost* cc;
     (void)max_chain;
 
     m_max_len = len;
-    
-    try {
-        cc = new cost[len+1];
-    } catch (...) {
-        throw;
-    }
-
-    return cc;
+    return cost_t::alloc(len+1,lz_get_config()->window_size,lz_get_config()->max_match);
 }
 
 
-int zxpac4c_cost::impl_free_cost(cost* cost)
+int zxpac4c_cost::impl_free_cost(cost_t& c)
 {
-    if (cost) {
-        delete[] cost;
+    if (c) {
+        cost_t::free(c);
     }
     return 0;
 }
 
 // New tANS helper functions
 
+/**
+ * @brief Predict the tANS encoding cost of a literal run, length or offset.
+ *
+ * @param[in] type  The tANS symbol type.
+ * @param[in] value The literal run length, match length or offset.
+ *
+ * @return The predicted cost in 1/TANS_COST_SCALE bits.
+ */
 int zxpac4c_cost::predict_tans_cost(int type, int value)
 {
-    (void)value;
-
-    // For now just static costs.. subject to change..
+    int sym;
+
+    if (m_tans_costs.adaptive == false) {
+        // Static costs until the first parsing pass is done
+        switch (type) {
+        case TANS_LITERAL_RUN_SYMS:
+            return 1 * TANS_COST_SCALE;
+        case TANS_LENGTH_SYMS:
+            return 0;
+        case TANS_OFFSET_SYMS:
+            return 0;
+        default:
+            assert(0);
+        }
+    }
 
     switch (type) {
     case TANS_LITERAL_RUN_SYMS:
-        return 1;
+        return m_tans_costs.literal_run[impl_get_length_bits(value)];
     case TANS_LENGTH_SYMS:
-        return 0;
+        return m_tans_costs.length[impl_get_length_bits(value)];
     case TANS_OFFSET_SYMS:
-        return 0;
+        if (value < m_lz_config->min_offset) {
+            sym = 0;
+        } else {
+            sym = impl_get_offset_bits(value) - m_min_offset_bits + 1;
+        }
+        return m_tans_costs.offset[sym];
     default:
         assert(0);
     }
 
+    return 0;
+}
+
+/**
+ * @brief Calculate a tANS symbol cost of log2(M/Ls) bits from the scaled
+ *        symbol frequency. Unused symbols get the cost of half an Ls.
+ */
+static int tans_symbol_cost(int Ls, int M)
+{
+    double bits = Ls > 0 ? std::log2(double(M) / Ls) : std::log2(2.0 * M);
+    return static_cast<int>(bits * TANS_COST_SCALE + 0.5);
+}
+
+/**
+ * @brief Derive adaptive tANS symbol costs from the current tANS tables,
+ *        i.e. from the symbol statistics of the previous parsing pass.
+ */
+void zxpac4c_cost::update_tans_costs(void)
+{
+    const int* Ls;
+    int n;
+
+    Ls = m_tans_literal.get_scaled_Ls();
+    for (n = 0; n < TANS_NUM_LITERAL_SYM; n++) {
+        m_tans_costs.literal_run[n] = tans_symbol_cost(Ls[n],TANS_SIZE_LITERAL);
+    }
+    Ls = m_tans_match.get_scaled_Ls();
+    for (n = 0; n < TANS_NUM_MATCH_SYM; n++) {
+        m_tans_costs.length[n] = tans_symbol_cost(Ls[n],TANS_SIZE_MATCH);
+    }
+    Ls = m_tans_offset.get_scaled_Ls();
+    for (n = 0; n < TANS_NUM_OFFSET_SYM; n++) {
+        m_tans_costs.offset[n] = tans_symbol_cost(Ls[n],TANS_SIZE_OFFSET);
+    }
+
+    m_tans_costs.adaptive = true;
 }
 
 ans_state_t zxpac4c_cost::get_tans_state(int type)
@@ -420,6 +480,23 @@ ans_state_t zxpac4c_cost::get_tans_state(int type)
     }
 }
 
+void zxpac4c_cost::set_tans_state(int type, ans_state_t state)
+{ 
+    switch (type) {
+    case TANS_LITERAL_RUN_SYMS:
+        m_tans_literal.set_state(state); 
+        break;
+    case TANS_LENGTH_SYMS:
+        m_tans_match.set_state(state);
+        break;
+    case TANS_OFFSET_SYMS:
+        m_tans_offset.set_state(state);
+        break;
+    default:
+        assert(0);
+    }
+}
+
 int zxpac4c_cost::inc_tans_symbol_freq(int type, uint8_t symbol)
 {
     switch (type) {
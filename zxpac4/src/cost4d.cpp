@@ -20,6 +20,7 @@
 #include <string.h>
 
 #include "cost4d.h"
+#include "lz_codes.h"
 #include "zxpac4d.h"
 
 /**
@@ -46,6 +47,9 @@ zxpac4d_cost::zxpac4d_cost(
     if (p_cfg->backward_steps < 0 || p_cfg->backward_steps > 256-2) {
         EXCEPTION(std::out_of_range,"Backward steps must be > 0 and < 256");
     }
+
+    m_min_offset_bits = log2(p_cfg->min_offset);
+    m_tans_costs.adaptive = false;
 }
 
 zxpac4d_cost::~zxpac4d_cost(void)
@@ -162,23 +166,14 @@ int zxpac4d_cost::impl_get_literal_tag(const char* literals, int length, char& b
 int zxpac4d_cost::impl_get_offset_bits(int offset)
 {
     assert(offset < m_lz_config->window_size);
-    int bits = 0;
-
-    while (offset >= (2 << bits)) {
-        ++bits;
-    }
 
-    return bits;
+    // Index of the highest set bit, 0 for 0 and 1
+    return lz_bit_width(offset | 1) - 1;
 }
 
 int zxpac4d_cost::impl_get_length_bits(int length)
 {
-    int bits = 0;
-    while (length >= (2 << bits)) {
-        ++bits;
-    }
-    
-    return bits;
+    return lz_bit_width(length | 1) - 1;
 }
 
 int zxpac4d_cost::impl_get_literal_bits(char literal, bool is_ascii)
@@ -204,10 +199,10 @@ int zxpac4d_cost::impl_get_literal_bits(char literal, bool is_ascii)
  */
 
 
-int zxpac4d_cost::impl_literal_cost(int pos, cost* c, const char* buf)
+int zxpac4d_cost::impl_literal_cost(int pos, const cost_t& c, const char* buf)
 {
-    cost* p_ctx = &c[pos];
-    uint32_t new_cost = p_ctx->arrival_cost + 1;
+    cost_t p_ctx = c + pos;
+    uint32_t new_cost = p_ctx->arrival_cost + 1 * TANS4D_COST_SCALE;
     int offset = p_ctx->offset;
     int num_literals = p_ctx->num_literals;
 
@@ -215,14 +210,14 @@ int zxpac4d_cost::impl_literal_cost(int pos, cost* c, const char* buf)
         // PMR of length 1 
         offset = p_ctx->pmr_offset;
         num_literals = 1;
-		new_cost += 1;
+		new_cost += 1 * TANS4D_COST_SCALE;
 		
 		// get the cost of match length encoding
-		new_cost += impl_get_length_bits(num_literals);
+		new_cost += impl_get_length_bits(num_literals) * TANS4D_COST_SCALE;
 		new_cost += predict_tans_cost(TANS4D_LENGTH_SYMS,num_literals);
     } else {
         // get the cost of the new literal
-        new_cost += impl_get_literal_bits(buf[pos],false);
+        new_cost += impl_get_literal_bits(buf[pos],false) * TANS4D_COST_SCALE;
         ++num_literals;
 
         // mark as a literal run instead of a PMR with length 1
@@ -261,9 +256,9 @@ int zxpac4d_cost::impl_literal_cost(int pos, cost* c, const char* buf)
  */
 
 
-int zxpac4d_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset, int length)
+int zxpac4d_cost::impl_match_cost(int pos, const cost_t& c, const char* buf, int offset, int length)
 {
-    cost* p_ctx = &c[pos];
+    cost_t p_ctx = c + pos;
     int local_pmr_offset; 
     uint32_t new_cost;
 
@@ -276,7 +271,7 @@ int zxpac4d_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
 
     // Tag cost is 1 bit as a baseline..
     local_pmr_offset = p_ctx->pmr_offset; 
-    new_cost = p_ctx->arrival_cost + 1;
+    new_cost = p_ctx->arrival_cost + 1 * TANS4D_COST_SCALE;
     
     if (pos >= local_pmr_offset && offset == local_pmr_offset) {
         // We have a PMR match
@@ -288,11 +283,11 @@ int zxpac4d_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
 
     // weight of offset encoding 
 	if (offset > 0) {
-		new_cost += get_offset_bits(offset);
+		new_cost += get_offset_bits(offset) * TANS4D_COST_SCALE;
 		new_cost += predict_tans_cost(TANS4D_OFFSET_SYMS,offset); 
 	}
 	// weight of length encoding 
-    new_cost += get_length_bits(length);
+    new_cost += get_length_bits(length) * TANS4D_COST_SCALE;
     new_cost += predict_tans_cost(TANS4D_LENGTH_SYMS,length);
 
     if (p_ctx[length].arrival_cost > new_cost) {
@@ -313,10 +308,10 @@ int zxpac4d_cost::impl_match_cost(int pos, cost* c, const char* buf, int offset,
  *
  *
  */
-int zxpac4d_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
+int zxpac4d_cost::impl_init_cost(const cost_t& p_ctx, int sta, int len, int pmr)
 {
     int n;
-    assert(p_ctx != NULL);
+    assert(p_ctx);
 
     // Initialize the cost array
     p_ctx[sta].next         = 0;
@@ -332,48 +327,88 @@ int zxpac4d_cost::impl_init_cost(cost* p_ctx, int sta, int len, int pmr)
     return 0;
 }
 
-cost* zxpac4d_cost::impl_alloc_cost(int len, int max_chain)
+zxpac4d_cost::cost_t zxpac4d_cost::impl_alloc_cost(int len, int max_chain)
 {
-    cost* cc;
     (void)max_chain;
 
     m_max_len = len;
-    
-    try {
-        cc = new cost[len+1];
-    } catch (...) {
-        throw;
-    }
-
-    return cc;
+    return cost_t::alloc(len+1,lz_get_config()->window_size,lz_get_config()->max_match);
 }
 
 
-int zxpac4d_cost::impl_free_cost(cost* cost)
+int zxpac4d_cost::impl_free_cost(cost_t& c)
 {
-    if (cost) {
-        delete[] cost;
+    if (c) {
+        cost_t::free(c);
     }
     return 0;
 }
 
 // New tANS helper functions
 
+/**
+ * @brief Predict the tANS encoding cost of a match length or offset.
+ *
+ * @param[in] type  The tANS symbol type.
+ * @param[in] value The match length or offset.
+ *
+ * @return The predicted cost in 1/TANS4D_COST_SCALE bits.
+ */
 int zxpac4d_cost::predict_tans_cost(int type, int value)
 {
-    (void)value;
+    int sym;
 
-    // For now just static costs.. subject to change..
+    if (m_tans_costs.adaptive == false) {
+        // Static costs until the first parsing pass is done
+        return 0;
+    }
 
     switch (type) {
     case TANS4D_LENGTH_SYMS:
-        return 0;
+        return m_tans_costs.length[impl_get_length_bits(value)];
     case TANS4D_OFFSET_SYMS:
-        return 0;
+        if (value < m_lz_config->min_offset) {
+            sym = 0;
+        } else {
+            sym = impl_get_offset_bits(value) - m_min_offset_bits + 1;
+        }
+        return m_tans_costs.offset[sym];
     default:
         assert(0);
     }
 
+    return 0;
+}
+
+/**
+ * @brief Calculate a tANS symbol cost of log2(M/Ls) bits from the scaled
+ *        symbol frequency. Unused symbols get the cost of half an Ls.
+ */
+static int tans_symbol_cost(int Ls, int M)
+{
+    double bits = Ls > 0 ? std::log2(double(M) / Ls) : std::log2(2.0 * M);
+    return static_cast<int>(bits * TANS4D_COST_SCALE + 0.5);
+}
+
+/**
+ * @brief Derive adaptive tANS symbol costs from the current tANS tables,
+ *        i.e. from the symbol statistics of the previous parsing pass.
+ */
+void zxpac4d_cost::update_tans_costs(void)
+{
+    const int* Ls;
+    int n;
+
+    Ls = m_tans_match.get_scaled_Ls();
+    for (n = 0; n < TANS4D_NUM_MATCH_SYM; n++) {
+        m_tans_costs.length[n] = tans_symbol_cost(Ls[n],TANS4D_SIZE_MATCH);
+    }
+    Ls = m_tans_offset.get_scaled_Ls();
+    for (n = 0; n < TANS4D_NUM_OFFSET_SYM; n++) {
+        m_tans_costs.offset[n] = tans_symbol_cost(Ls[n],TANS4D_SIZE_OFFSET);
+    }
+
+    m_tans_costs.adaptive = true;
 }
 
 ans_state_t zxpac4d_cost::get_tans_state(int type)
@@ -388,6 +423,20 @@ ans_state_t zxpac4d_cost::get_tans_state(int type)
     }
 }
 
+void zxpac4d_cost::set_tans_state(int type, ans_state_t state)
+{ 
+    switch (type) {
+    case TANS4D_LENGTH_SYMS:
+        m_tans_match.set_state(state);
+        break;
+    case TANS4D_OFFSET_SYMS:
+        m_tans_offset.set_state(state);
+        break;
+    default:
+        assert(0);
+    }
+}
+
 int zxpac4d_cost::inc_tans_symbol_freq(int type, uint8_t symbol)
 {
     switch (type) {
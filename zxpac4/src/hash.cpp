@@ -1,6 +1,6 @@
 /**
  * @file hash.cpp
- * @version 0.2
+ * @version 0.3
  * @author Jouni 'Mr.Spiv' Korhonen
  *
  *
@@ -11,6 +11,7 @@
 #include <cassert>
 #include "lz_util.h"
 #include "hash.h"
+#include "match_len.h"
 
 // Handle accordingly.. depending on your implementation
 //#ifdef WINDOW_IS_POWER_OF_TWO
@@ -18,11 +19,13 @@
 //#endif
 
 
-hash3::hash3(int window_size, int min_match, int max_match,
+template<int HASH_BYTES, int HASH_BITS, typename LINK_T>
+hash_chain<HASH_BYTES,HASH_BITS,LINK_T>::hash_chain(int window_size, int min_match, int max_match,
     int good_match,
     int mm2_thres_offset,
     int mm3_thres_offset):
     m_head(NULL),
+    m_head2(NULL),
     m_next(NULL),
     m_mtch(NULL)
 {
@@ -35,37 +38,56 @@ hash3::hash3(int window_size, int min_match, int max_match,
 #else
     m_mask = window_size;
 #endif // WINDOW_IS_POWER_OF_TWO
-    m_head = new int[HASH_SIZE];
-    m_next = new int[window_size];
+    if (static_cast<unsigned>(m_mask) > std::numeric_limits<LINK_T>::max()) {
+        EXCEPTION(std::invalid_argument,"Window size too big for chain links.");
+    }
+    m_head = new int[1 << HASH_BITS];
+    m_next = new LINK_T[window_size];
     m_min_match = min_match;
     m_max_match = max_match;
     m_good_match = good_match;
     m_min_match2_threshold_offset = mm2_thres_offset;
     m_min_match3_threshold_offset = mm3_thres_offset;
-    reinit();
+
+    if (HASH_BYTES > 2) {
+        m_head2 = new int[HASH_SIZE];
+    }
+
+    this->reinit();
 }
 
-void hash3::impl_reinit(void)
+template<int HASH_BYTES, int HASH_BITS, typename LINK_T>
+void hash_chain<HASH_BYTES,HASH_BITS,LINK_T>::impl_reinit(void)
 {
     int n;
 
-    for (n = 0; n < HASH_SIZE; n++) {
+    for (n = 0; n < (1 << HASH_BITS); n++) {
         m_head[n] = -1;
     }
+    if (m_head2) {
+        for (n = 0; n < HASH_SIZE; n++) {
+            m_head2[n] = -1;
+        }
+    }
 }
 
 
-hash3::~hash3(void)
+template<int HASH_BYTES, int HASH_BITS, typename LINK_T>
+hash_chain<HASH_BYTES,HASH_BITS,LINK_T>::~hash_chain(void)
 {
     if (m_head) {
         delete[] m_head;
     }
+    if (m_head2) {
+        delete[] m_head2;
+    }
     if (m_next) {
         delete[] m_next;
     }
 }
 
-void hash3::impl_init_get_matches(int max_matches, match *matches)
+template<int HASH_BYTES, int HASH_BITS, typename LINK_T>
+void hash_chain<HASH_BYTES,HASH_BITS,LINK_T>::impl_init_get_matches(int max_matches, match *matches)
 {
     m_mtch = matches;
     m_max_chain = max_matches;
@@ -78,7 +100,8 @@ void hash3::impl_init_get_matches(int max_matches, match *matches)
  * @return Number of found matches or 0.
  */
 
-int hash3::impl_find_matches(const char *buf, int pos, int len, bool only_better_matches=false)
+template<int HASH_BYTES, int HASH_BITS, typename LINK_T>
+int hash_chain<HASH_BYTES,HASH_BITS,LINK_T>::impl_find_matches(const char *buf, int pos, int len, bool only_better_matches)
 {
     int length;
     int best   = m_min_match - 1;
@@ -88,11 +111,11 @@ int hash3::impl_find_matches(const char *buf, int pos, int len, bool only_better
     int low    = pos - m_mask;
 #endif  // WINDOW_IS_POWER_OF_TWO
     int found  = 0;
-    int head   = hash(buf,pos);
-    int next   = m_head[head];
+    int head;
+    int next;
+    const LINK_T* link;
     const char* m;
     const char* n;
-    const char* e;
 
 
     if (low < 0) {
@@ -102,12 +125,54 @@ int hash3::impl_find_matches(const char *buf, int pos, int len, bool only_better
         len = m_max_match;
     }
 
-    e = buf + pos + len;
+    if (HASH_BYTES > 2) {
+        // The shortest offset 2 byte match from the exact table. Longer
+        // matches are found from the hash chain as well.
+        int head2 = hash2(buf,pos);
+        int next2 = m_head2[head2];
+        m_head2[head2] = pos;
+
+        if (len < HASH_BYTES) {
+            // Too close to the end of file for the wider hash.
+            if (next2 >= low && len >= m_min_match && found < m_max_chain) {
+                length = match_length(buf+next2,buf+pos,len);
+
+                if (length >= m_min_match) {
+                    m_mtch[found].length = length;
+                    m_mtch[found].offset = pos-next2;
+                    ++found;
+                }
+            }
+            return found;
+        }
+        if (next2 >= low && found < m_max_chain) {
+            length = match_length(buf+next2,buf+pos,len);
+
+            if (length >= m_min_match && length < HASH_BYTES) {
+                m_mtch[found].length = length;
+                m_mtch[found].offset = pos-next2;
+                ++found;
+
+                if (only_better_matches) {
+                    best = length;
+                }
+            }
+        }
+    }
+
+    head = hash(buf,pos);
+    next = m_head[head];
 
     while (next >= low && found < m_max_chain) {
+#ifdef WINDOW_IS_POWER_OF_TWO
+        link = &m_next[next & m_mask];
+#else
+        link = &m_next[next % m_mask];
+#endif // WINDOW_IS_POWER_OF_TWO
+        // Fetch the link to the next candidate while comparing this one
+        __builtin_prefetch(link);
         m = buf+next;
         n = buf+pos;
-        length = 0;
 
         if (only_better_matches) {
             if (m[best] != n[best]) {
@@ -115,7 +180,7 @@ int hash3::impl_find_matches(const char *buf, int pos, int len, bool only_better
             }
         }
 
-        while (*m++ == *n++ && ++length < len && n < e);
+        length = match_length(m,n,len);
         assert(length <= m_max_match);
 
         if (length >= m_min_match) {
@@ -136,20 +201,30 @@ int hash3::impl_find_matches(const char *buf, int pos, int len, bool only_better
         }
 next_in_chain:
         // Advance to the next history position in the hash chain
-#ifdef WINDOW_IS_POWER_OF_TWO
-        next = m_next[next & m_mask];
-#else
-        next = m_next[next % m_mask];
-#endif // WINDOW_IS_POWER_OF_TWO
+        if (*link == 0) {
+            break;
+        }
+
+        next -= *link;
+        __builtin_prefetch(buf+next);
     }
-    // Update the hash chain with the current position..
+
+    // Update the hash chain with the current position. A position too
+    // far to be reached from any later position ends the chain.
+    next = m_head[head] >= 0 && pos - m_head[head] <= m_mask ? pos - m_head[head] : 0;
 #ifdef WINDOW_IS_POWER_OF_TWO
-    m_next[pos & m_mask] = m_head[head];
+    m_next[pos & m_mask] = next;
 #else
-    m_next[pos % m_mask] = m_head[head];
+    m_next[pos % m_mask] = next;
 #endif // WINDOW_IS_POWER_OF_TWO
     m_head[head] = pos;
 
     return found;
 }
 
+template class hash_chain<2,16,uint16_t>;
+template class hash_chain<3,HASH_BITS_MUL,uint16_t>;
+template class hash_chain<4,HASH_BITS_MUL,uint16_t>;
+template class hash_chain<2,16,uint32_t>;
+template class hash_chain<3,HASH_BITS_MUL,uint32_t>;
+template class hash_chain<4,HASH_BITS_MUL,uint32_t>;
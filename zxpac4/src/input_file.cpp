@@ -0,0 +1,85 @@
+/**
+ * @file input_file.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Copy-on-write mapped input file buffer.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <new>
+#include <cstring>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "input_file.h"
+
+
+bool input_file::map(const std::string& name, int len, int pad)
+{
+    size_t page = ::sysconf(_SC_PAGESIZE);
+    size_t size = (len + pad + page - 1) / page * page;
+    void* base;
+    void* map;
+    int fd;
+
+    if (len < 1) {
+        return false;
+    }
+
+    // Reserve zeroed memory for the file and the padding first, then map
+    // the file over it. The tail of the last file page is zero-filled.
+    base = ::mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    if ((fd = ::open(name.c_str(),O_RDONLY)) < 0) {
+        ::munmap(base,size);
+        return false;
+    }
+
+    map = ::mmap(base,len,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_FIXED,fd,0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        ::munmap(base,size);
+        return false;
+    }
+
+    ::madvise(base,len,MADV_WILLNEED);
+    m_buf = static_cast<char*>(base);
+    m_map_size = size;
+    return true;
+}
+
+char* input_file::load(const std::string& name, std::ifstream& ifs, int len, int pad)
+{
+    release();
+
+    if (map(name,len,pad)) {
+        return m_buf;
+    }
+    if ((m_buf = new (std::nothrow) char[len+pad]) == NULL) {
+        return NULL;
+    }
+    if (!ifs.read(m_buf,len)) {
+        release();
+        return NULL;
+    }
+
+    std::memset(m_buf+len,0,pad);
+    return m_buf;
+}
+
+void input_file::release(void)
+{
+    if (m_map_size > 0) {
+        ::munmap(m_buf,m_map_size);
+    } else {
+        delete[] m_buf;
+    }
+
+    m_buf = NULL;
+    m_map_size = 0;
+}
@@ -0,0 +1,292 @@
+/**
+ * @file lz_unpack.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Native decompressors of the zxpac4, zxpac4b and zxpac4_32k formats.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include "lz_base.h"
+#include "lz_codes.h"
+#include "lz_unpack.h"
+#include "cost4.h"
+#include "cost4_32k.h"
+#include "cost4b.h"
+#include "zxpac4.h"
+#include "zxpac4b.h"
+
+namespace {
+
+/**
+ * @brief Read bytes and tag bits of an encoded file, forwards or from
+ *        the end of a reversed file. Reading past the end returns zeros
+ *        and marks the input corrupt.
+ */
+template<bool REVERSE> class unpack_input {
+    const uint8_t* m_buf;
+    int m_len;
+    int m_pos;
+    uint32_t m_tag;
+    int m_bits;
+    bool m_corrupt;
+public:
+    unpack_input(const char* p_in, int len) :
+        m_buf(reinterpret_cast<const uint8_t*>(p_in)), m_len(len),
+        m_pos(0), m_tag(0), m_bits(0), m_corrupt(false) {}
+
+    int byte(void) {
+        if (m_pos >= m_len) {
+            m_corrupt = true;
+            return 0;
+        }
+        return m_buf[REVERSE ? m_len - 1 - m_pos++ : m_pos++];
+    }
+    int bit(void) {
+        if (m_bits == 0) {
+            m_tag = byte();
+            m_bits = 8;
+        }
+        return (m_tag >> --m_bits) & 1;
+    }
+    int bits(int num_bits) {
+        int value = 0;
+
+        while (num_bits-- > 0) {
+            value = value << 1 | bit();
+        }
+        return value;
+    }
+
+    // Interleaved Elias-gamma, the code of max_width bits has no stop bit
+    int gamma(int max_width) {
+        int value = 1;
+
+        for (int width = 1; width < max_width && bit(); width++) {
+            value = value << 1 | bit();
+        }
+        return value;
+    }
+
+    // A byte and, from 128 on, the class prefix and the low offset bits
+    int offset(const lz_offset_codes& codes) {
+        int value = byte();
+        int prefix = 0;
+        int prefix_bits = 0;
+        int width;
+
+        if (value < 128) {
+            return value;
+        }
+        while (prefix_bits < 8) {
+            prefix = prefix << 1 | bit();
+            ++prefix_bits;
+
+            for (width = 8; width <= LZ_CODE_MAX_WIDTH && codes[width].bits > 0; width++) {
+                if (codes[width].tag_bits - codes[width].shift == prefix_bits &&
+                    codes[width].tag >> codes[width].shift == prefix) {
+                    return value << codes[width].shift | bits(codes[width].shift);
+                }
+            }
+        }
+
+        m_corrupt = true;
+        return 0;
+    }
+    bool corrupt(void) const {
+        return m_corrupt;
+    }
+};
+
+class unpack_output {
+    char* m_buf;
+    int m_len;
+    int m_pos;
+public:
+    unpack_output(char* p_out, int len) : m_buf(p_out), m_len(len), m_pos(0) {}
+
+    bool literal(int byte) {
+        if (m_pos >= m_len) {
+            return false;
+        }
+        m_buf[m_pos++] = byte;
+        return true;
+    }
+    bool match(int offset, int length) {
+        if (offset < 1 || offset > m_pos || length > m_len - m_pos) {
+            return false;
+        }
+        for (; length > 0; length--, m_pos++) {
+            m_buf[m_pos] = m_buf[m_pos-offset];
+        }
+        return true;
+    }
+    int pos(void) const {
+        return m_pos;
+    }
+    bool done(void) const {
+        return m_pos == m_len;
+    }
+    bool last(void) const {
+        return m_pos + 1 == m_len;
+    }
+};
+
+/**
+ * @brief zxpac4 and zxpac4_32k. After the first literal a 0 bit selects
+ *        a literal, 10 a match and 11 a PMR. In the ASCII mode the
+ *        selector after a literal is the lowest bit of the literal byte.
+ */
+template<bool REVERSE>
+int unpack_zxpac4(unpack_input<REVERSE>& in, unpack_output& out, int pmr, bool ascii,
+    const lz_offset_codes& codes, const lz_config* p_cfg)
+{
+    int max_width = lz_bit_width(p_cfg->max_match);
+    bool after_literal = true;
+    int literal = in.byte();
+    int offset;
+    int length;
+    bool ok;
+
+    ok = out.literal(ascii ? literal >> 1 : literal);
+
+    while (ok && !out.done() && !in.corrupt()) {
+        if (ascii && after_literal ? !(literal & 1) : !in.bit()) {
+            literal = in.byte();
+
+            if (ascii && !(p_cfg->preshift_last_ascii_literal && out.last())) {
+                ok = out.literal(literal >> 1);
+            } else {
+                ok = out.literal(literal);
+            }
+            after_literal = true;
+            continue;
+        }
+        if (in.bit()) {
+            ok = out.match(pmr,in.gamma(max_width));
+        } else {
+            offset = in.offset(codes);
+            length = in.gamma(max_width) + 1;
+            ok = out.match(offset,length);
+            pmr = offset;
+        }
+        after_literal = false;
+    }
+
+    return ok && !in.corrupt() ? out.pos() : LZ_UNPACK_CORRUPT;
+}
+
+/**
+ * @brief zxpac4b. After a match 0 selects a literal run and 1 a match.
+ *        After a literal run 0 selects a PMR and 1 a match, taken from
+ *        the lowest bit of the last literal in the ASCII mode.
+ */
+template<bool REVERSE>
+int unpack_zxpac4b(unpack_input<REVERSE>& in, unpack_output& out, int pmr, bool ascii)
+{
+    bool after_literal = false;
+    int literal = 0;
+    int offset;
+    int length;
+    bool ok = true;
+
+    while (ok && !out.done() && !in.corrupt()) {
+        if (!after_literal && !in.bit()) {
+            for (length = in.gamma(ZXPAC4B_GAMMA_MAX_WIDTH); ok && length > 1; length--) {
+                ok = out.literal(in.byte());
+            }
+
+            literal = in.byte();
+            ok = ok && out.literal(ascii ? literal >> 1 : literal);
+            after_literal = true;
+            continue;
+        }
+        if (after_literal && !(ascii ? literal & 1 : in.bit())) {
+            ok = out.match(pmr,in.gamma(ZXPAC4B_GAMMA_MAX_WIDTH));
+        } else {
+            offset = in.offset(zxpac4b_offset_codes);
+            length = in.gamma(ZXPAC4B_GAMMA_MAX_WIDTH) + 1;
+            ok = out.match(offset,length);
+            pmr = offset;
+        }
+        after_literal = false;
+    }
+
+    return ok && !in.corrupt() ? out.pos() : LZ_UNPACK_CORRUPT;
+}
+
+template<bool REVERSE>
+int unpack(const char* p_in, int in_len, char* p_out, int out_len, const lz_config* p_cfg)
+{
+    unpack_input<REVERSE> in(p_in,in_len);
+    int header = in.byte();
+    int len = in.byte() << 16;
+    len |= in.byte() << 8;
+    len |= in.byte();
+    bool ascii = header & 0x80;
+    int pmr = header & 0x7f;
+    unpack_output out(p_out,len);
+
+    if (in.corrupt()) {
+        return LZ_UNPACK_CORRUPT;
+    }
+    if (len > out_len) {
+        return LZ_UNPACK_OVERFLOW;
+    }
+
+    switch (p_cfg->algorithm) {
+    case ZXPAC4:
+        len = unpack_zxpac4(in,out,pmr,ascii,zxpac4_offset_codes,p_cfg);
+        break;
+    case ZXPAC4_32K:
+        len = unpack_zxpac4(in,out,pmr,ascii,zxpac4_32k_offset_codes,p_cfg);
+        break;
+    case ZXPAC4B:
+        len = unpack_zxpac4b(in,out,pmr,ascii);
+        break;
+    default:
+        return LZ_UNPACK_UNSUPPORTED;
+    }
+    if (len > 0 && p_cfg->reverse_file) {
+        std::reverse(p_out,p_out+len);
+    }
+
+    return len;
+}
+
+}   // namespace
+
+
+bool lz_unpack_supported(const lz_config* p_cfg)
+{
+    return p_cfg->algorithm == ZXPAC4 || p_cfg->algorithm == ZXPAC4B ||
+        p_cfg->algorithm == ZXPAC4_32K;
+}
+
+int lz_unpack_length(const char* p_in, int in_len, const lz_config* p_cfg)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(p_in);
+
+    if (in_len < ZXPAC4_HEADER_SIZE) {
+        return LZ_UNPACK_CORRUPT;
+    }
+    if (p_cfg->reverse_encoded) {
+        return p[in_len-2] << 16 | p[in_len-3] << 8 | p[in_len-4];
+    }
+
+    return p[1] << 16 | p[2] << 8 | p[3];
+}
+
+int lz_unpack(const char* p_in, int in_len, char* p_out, int out_len, const lz_config* p_cfg)
+{
+    if (!lz_unpack_supported(p_cfg)) {
+        return LZ_UNPACK_UNSUPPORTED;
+    }
+    if (p_cfg->reverse_encoded) {
+        return unpack<true>(p_in,in_len,p_out,out_len,p_cfg);
+    }
+
+    return unpack<false>(p_in,in_len,p_out,out_len,p_cfg);
+}
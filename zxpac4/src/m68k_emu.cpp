@@ -0,0 +1,1026 @@
+/**
+ * @file m68k_emu.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief A host side 68000 emulator for timing the Amiga decompressors.
+ *
+ * The opcodes are decoded by their top four bits into the instruction
+ * groups of the MC68000 user's manual. The effective address calculation
+ * times are added while decoding the effective address, and the
+ * instructions add their own execution times on top of that.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <algorithm>
+#include <bitset>
+#include "m68k_emu.h"
+
+#define CCR_C   0x01
+#define CCR_V   0x02
+#define CCR_Z   0x04
+#define CCR_N   0x08
+#define CCR_X   0x10
+
+namespace {
+
+// Effective address calculation times for byte/word and long operands,
+// indexed by mode 0-6 and then abs.W, abs.L, d16(PC), d8(PC,Xn) and #imm
+const int ea_cycles_bw[] = {0,0,4,4,6,8,10,8,12,8,10,4};
+const int ea_cycles_l[]  = {0,0,8,8,10,12,14,12,16,12,14,8};
+
+// Control addressing mode times for (An), d16(An), d8(An,Xn), abs.W,
+// abs.L, d16(PC) and d8(PC,Xn)
+const int lea_cycles[]  = {4,8,12,8,12,8,12};
+const int pea_cycles[]  = {12,16,20,16,20,16,20};
+const int jmp_cycles[]  = {8,10,14,10,12,10,14};
+const int jsr_cycles[]  = {16,18,22,18,20,18,22};
+const int movem_rm_cycles[] = {8,12,14,12,16,0,0};
+const int movem_mr_cycles[] = {12,16,18,16,20,16,18};
+
+inline uint32_t size_mask(int size)
+{
+    return size == 1 ? 0xff : size == 2 ? 0xffff : 0xffffffff;
+}
+
+inline uint32_t size_msb(int size)
+{
+    return size == 1 ? 0x80 : size == 2 ? 0x8000 : 0x80000000;
+}
+
+inline int size_code(int code)
+{
+    return code == 0 ? 1 : code == 1 ? 2 : 4;
+}
+
+// Register or immediate source modes, which make some long operations slower
+inline bool is_reg_or_imm(int mode, int reg)
+{
+    return mode <= 1 || (mode == 7 && reg == 4);
+}
+
+}   // namespace
+
+
+m68k_emu::m68k_emu(void) : m_mem(M68K_MEM_SIZE)
+{
+    reset();
+}
+
+void m68k_emu::reset(void)
+{
+    std::fill(m_mem.begin(),m_mem.end(),0);
+    std::fill(m_d,m_d+8,0);
+    std::fill(m_a,m_a+8,0);
+    m_pc = 0;
+    m_ccr = 0;
+    m_cycles = 0;
+    m_op_cycles = 0;
+    m_error = false;
+    m_opcode = 0;
+}
+
+void m68k_emu::load(uint32_t addr, const void* p, int len)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(p);
+
+    for (int n = 0; n < len; n++) {
+        poke(addr+n,src[n]);
+    }
+}
+
+void m68k_emu::poke16(uint32_t addr, uint16_t value)
+{
+    poke(addr,value >> 8);
+    poke(addr+1,value);
+}
+
+void m68k_emu::poke32(uint32_t addr, uint32_t value)
+{
+    poke16(addr,value >> 16);
+    poke16(addr+2,value);
+}
+
+void m68k_emu::push32(uint32_t value)
+{
+    m_a[7] -= 4;
+    wr32(m_a[7],value);
+}
+
+//
+// Memory accesses. Odd word and long accesses are address errors.
+//
+
+uint16_t m68k_emu::rd16(uint32_t addr)
+{
+    if (addr & 1) {
+        m_error = true;
+        return 0;
+    }
+    return rd8(addr) << 8 | rd8(addr+1);
+}
+
+uint32_t m68k_emu::rd32(uint32_t addr)
+{
+    return uint32_t(rd16(addr)) << 16 | rd16(addr+2);
+}
+
+void m68k_emu::wr16(uint32_t addr, uint16_t value)
+{
+    if (addr & 1) {
+        m_error = true;
+        return;
+    }
+    wr8(addr,value >> 8);
+    wr8(addr+1,value);
+}
+
+void m68k_emu::wr32(uint32_t addr, uint32_t value)
+{
+    wr16(addr,value >> 16);
+    wr16(addr+2,value);
+}
+
+uint32_t m68k_emu::rd(uint32_t addr, int size)
+{
+    return size == 1 ? rd8(addr) : size == 2 ? rd16(addr) : rd32(addr);
+}
+
+void m68k_emu::wr(uint32_t addr, int size, uint32_t value)
+{
+    if (size == 1) {
+        wr8(addr,value);
+    } else if (size == 2) {
+        wr16(addr,value);
+    } else {
+        wr32(addr,value);
+    }
+}
+
+uint16_t m68k_emu::fetch16(void)
+{
+    uint16_t value = rd16(m_pc);
+    m_pc += 2;
+    return value;
+}
+
+uint32_t m68k_emu::fetch32(void)
+{
+    uint32_t value = rd32(m_pc);
+    m_pc += 4;
+    return value;
+}
+
+//
+// Effective addresses
+//
+
+// d8(An,Xn) and d8(PC,Xn) from the brief extension word
+uint32_t m68k_emu::index_addr(uint32_t base)
+{
+    uint16_t ext = fetch16();
+    int32_t xn = ext & 0x8000 ? m_a[ext >> 12 & 7] : m_d[ext >> 12 & 7];
+
+    if (!(ext & 0x0800)) {
+        xn = int16_t(xn);
+    }
+
+    return base + xn + int8_t(ext & 0xff);
+}
+
+m68k_emu::ea_t m68k_emu::ea_decode(int mode, int reg, int size, bool move_dst)
+{
+    ea_t ea = {2,reg,0};
+    int step = (reg == 7 && size == 1) ? 2 : size;
+    int index = mode;
+
+    switch (mode) {
+    case 0:
+    case 1:
+        ea.mode = mode;
+        break;
+    case 2:
+        ea.addr = m_a[reg];
+        break;
+    case 3:
+        ea.addr = m_a[reg];
+        m_a[reg] += step;
+        break;
+    case 4:
+        m_a[reg] -= step;
+        ea.addr = m_a[reg];
+        break;
+    case 5:
+        ea.addr = m_a[reg] + int16_t(fetch16());
+        break;
+    case 6:
+        ea.addr = index_addr(m_a[reg]);
+        break;
+    default:
+        index = 7 + reg;
+
+        switch (reg) {
+        case 0:
+            ea.addr = int16_t(fetch16());
+            break;
+        case 1:
+            ea.addr = fetch32();
+            break;
+        case 2:
+            ea.addr = m_pc;
+            ea.addr += int16_t(fetch16());
+            break;
+        case 3:
+            ea.addr = index_addr(m_pc);
+            break;
+        case 4:
+            ea.mode = 3;
+            ea.addr = size == 4 ? fetch32() : fetch16() & size_mask(size);
+            break;
+        default:
+            unsupported();
+            return ea;
+        }
+        break;
+    }
+    // A predecrement destination of MOVE costs as much as (An)
+    if (move_dst && mode == 4) {
+        index = 2;
+    }
+
+    m_op_cycles += size == 4 ? ea_cycles_l[index] : ea_cycles_bw[index];
+    return ea;
+}
+
+uint32_t m68k_emu::ea_read(const ea_t& ea, int size)
+{
+    switch (ea.mode) {
+    case 0: return m_d[ea.reg] & size_mask(size);
+    case 1: return m_a[ea.reg] & size_mask(size);
+    case 2: return rd(ea.addr,size);
+    default: return ea.addr;
+    }
+}
+
+void m68k_emu::ea_write(const ea_t& ea, int size, uint32_t value)
+{
+    uint32_t mask = size_mask(size);
+
+    switch (ea.mode) {
+    case 0: m_d[ea.reg] = (m_d[ea.reg] & ~mask) | (value & mask); break;
+    case 1: m_a[ea.reg] = value; break;
+    case 2: wr(ea.addr,size,value); break;
+    default: unsupported(); break;
+    }
+}
+
+// The address of a control addressing mode. The instruction time with the
+// address calculation comes from the table of the instruction.
+uint32_t m68k_emu::ea_control(int mode, int reg, const int cycles[7])
+{
+    int index = mode == 7 ? 3 + reg : mode == 2 ? 0 : mode - 4;
+    int op_cycles = m_op_cycles;
+    uint32_t addr;
+
+    if (mode < 2 || mode == 3 || mode == 4 || (mode == 7 && reg > 3) || cycles[index] == 0) {
+        unsupported();
+        return 0;
+    }
+
+    addr = ea_decode(mode,reg,4).addr;
+    m_op_cycles = op_cycles + cycles[index];
+    return addr;
+}
+
+//
+// Condition codes and arithmetic
+//
+
+bool m68k_emu::cond(int cc) const
+{
+    bool c = m_ccr & CCR_C;
+    bool v = m_ccr & CCR_V;
+    bool z = m_ccr & CCR_Z;
+    bool n = m_ccr & CCR_N;
+
+    switch (cc) {
+    case 0: return true;
+    case 1: return false;
+    case 2: return !c && !z;
+    case 3: return c || z;
+    case 4: return !c;
+    case 5: return c;
+    case 6: return !z;
+    case 7: return z;
+    case 8: return !v;
+    case 9: return v;
+    case 10: return !n;
+    case 11: return n;
+    case 12: return n == v;
+    case 13: return n != v;
+    case 14: return !z && n == v;
+    default: return z || n != v;
+    }
+}
+
+void m68k_emu::set_nz(uint32_t value, int size)
+{
+    value &= size_mask(size);
+    m_ccr = (m_ccr & CCR_X) | (value ? 0 : CCR_Z) | (value & size_msb(size) ? CCR_N : 0);
+}
+
+uint32_t m68k_emu::add(uint32_t src, uint32_t dst, int size, bool with_x, bool cmp)
+{
+    uint32_t mask = size_mask(size);
+    uint32_t msb = size_msb(size);
+    uint64_t r = uint64_t(src & mask) + (dst & mask) + (with_x && (m_ccr & CCR_X) ? 1 : 0);
+    uint32_t res = r & mask;
+    bool carry = r > mask;
+    bool zero = with_x ? (m_ccr & CCR_Z) && res == 0 : res == 0;
+
+    m_ccr = (cmp ? m_ccr & CCR_X : carry ? CCR_X : 0) | (carry ? CCR_C : 0) |
+        (zero ? CCR_Z : 0) | (res & msb ? CCR_N : 0) |
+        ((src ^ res) & (dst ^ res) & msb ? CCR_V : 0);
+    return res;
+}
+
+uint32_t m68k_emu::sub(uint32_t src, uint32_t dst, int size, bool with_x, bool cmp)
+{
+    uint32_t mask = size_mask(size);
+    uint32_t msb = size_msb(size);
+    uint64_t s = uint64_t(src & mask) + (with_x && (m_ccr & CCR_X) ? 1 : 0);
+    uint32_t res = uint32_t((dst & mask) - s) & mask;
+    bool borrow = s > (dst & mask);
+    bool zero = with_x ? (m_ccr & CCR_Z) && res == 0 : res == 0;
+
+    m_ccr = (cmp ? m_ccr & CCR_X : borrow ? CCR_X : 0) | (borrow ? CCR_C : 0) |
+        (zero ? CCR_Z : 0) | (res & msb ? CCR_N : 0) |
+        ((src ^ dst) & (res ^ dst) & msb ? CCR_V : 0);
+    return res;
+}
+
+// ASx, LSx, ROXx and ROx by count bits
+uint32_t m68k_emu::shift(int type, bool left, uint32_t value, int count, int size)
+{
+    uint32_t mask = size_mask(size);
+    uint32_t msb = size_msb(size);
+    bool x = m_ccr & CCR_X;
+    bool c = type == 2 ? x : false;
+    bool v = false;
+    uint32_t prev;
+
+    value &= mask;
+
+    for (int n = 0; n < count; n++) {
+        prev = value;
+        c = left ? value & msb : value & 1;
+
+        switch (type) {
+        case 0:
+            value = left ? value << 1 : value >> 1 | (value & msb);
+            v |= ((value ^ prev) & msb) != 0;
+            break;
+        case 1:
+            value = left ? value << 1 : value >> 1;
+            break;
+        case 2:
+            value = left ? value << 1 | x : value >> 1 | (x ? msb : 0);
+            break;
+        default:
+            value = left ? value << 1 | c : value >> 1 | (c ? msb : 0);
+            break;
+        }
+
+        value &= mask;
+        x = type == 3 ? x : c;
+    }
+
+    m_ccr = (x ? CCR_X : 0) | (c ? CCR_C : 0) | (v ? CCR_V : 0) |
+        (value ? 0 : CCR_Z) | (value & msb ? CCR_N : 0);
+    return value;
+}
+
+//
+// Instructions
+//
+
+void m68k_emu::unsupported(void)
+{
+    m_error = true;
+}
+
+int m68k_emu::step(void)
+{
+    m_op_cycles = 0;
+    m_opcode = fetch16();
+
+    switch (m_opcode >> 12) {
+    case 0x0:
+        if (m_opcode & 0x0100 || (m_opcode & 0x0f00) == 0x0800) {
+            exec_bit();
+        } else {
+            exec_immediate();
+        }
+        break;
+    case 0x1:
+    case 0x2:
+    case 0x3:
+        exec_move();
+        break;
+    case 0x4:
+        exec_misc();
+        break;
+    case 0x5:
+        exec_quick();
+        break;
+    case 0x6:
+        exec_branch();
+        break;
+    case 0x7:                               // MOVEQ
+        if (m_opcode & 0x0100) {
+            unsupported();
+            break;
+        }
+        m_d[m_opcode >> 9 & 7] = int8_t(m_opcode & 0xff);
+        set_nz(m_opcode & 0xff,1);
+        m_op_cycles += 4;
+        break;
+    case 0x9:
+    case 0xd:
+        exec_arith();
+        break;
+    case 0x8:
+    case 0xb:
+    case 0xc:
+        exec_logic();
+        break;
+    case 0xe:
+        exec_shift();
+        break;
+    default:
+        unsupported();
+        break;
+    }
+    if (m_error) {
+        return -1;
+    }
+
+    m_cycles += m_op_cycles;
+    return m_op_cycles;
+}
+
+// ORI, ANDI, SUBI, ADDI, EORI and CMPI
+void m68k_emu::exec_immediate(void)
+{
+    int op = m_opcode >> 9 & 7;
+    int code = m_opcode >> 6 & 3;
+    int mode = m_opcode >> 3 & 7;
+    int reg = m_opcode & 7;
+    int size = size_code(code);
+    uint32_t imm;
+    uint32_t value;
+    ea_t ea;
+
+    if (code == 3 || op == 4 || op == 7 || (mode == 7 && reg == 4) || mode == 1) {
+        unsupported();
+        return;
+    }
+
+    imm = size == 4 ? fetch32() : fetch16() & size_mask(size);
+    ea = ea_decode(mode,reg,size);
+    value = ea_read(ea,size);
+
+    switch (op) {
+    case 0: value |= imm; set_nz(value,size); break;
+    case 1: value &= imm; set_nz(value,size); break;
+    case 2: value = sub(imm,value,size,false); break;
+    case 3: value = add(imm,value,size,false); break;
+    case 5: value ^= imm; set_nz(value,size); break;
+    default: sub(imm,value,size,false,true); break;
+    }
+    if (op == 6) {
+        m_op_cycles += mode == 0 ? (size == 4 ? 14 : 8) : (size == 4 ? 12 : 8);
+    } else {
+        ea_write(ea,size,value);
+        m_op_cycles += mode == 0 ? (size == 4 ? 16 : 8) : (size == 4 ? 20 : 12);
+    }
+}
+
+// BTST, BCHG, BCLR and BSET with a dynamic or a static bit number
+void m68k_emu::exec_bit(void)
+{
+    bool dynamic = m_opcode & 0x0100;
+    int type = m_opcode >> 6 & 3;
+    int mode = m_opcode >> 3 & 7;
+    int reg = m_opcode & 7;
+    uint32_t bit;
+    uint32_t value;
+    ea_t ea;
+
+    if (mode == 1) {                        // MOVEP
+        unsupported();
+        return;
+    }
+
+    bit = dynamic ? m_d[m_opcode >> 9 & 7] : fetch16() & 0xff;
+
+    if (mode == 0) {
+        bit &= 31;
+        value = m_d[reg];
+        ea = {0,reg,0};
+        m_op_cycles += type == 0 ? 6 : type == 2 ? 10 : 8;
+    } else {
+        bit &= 7;
+        ea = ea_decode(mode,reg,1);
+        value = ea_read(ea,1);
+        m_op_cycles += type == 0 ? 4 : 8;
+    }
+    if (!dynamic) {
+        m_op_cycles += 4;
+    }
+
+    m_ccr = (m_ccr & ~CCR_Z) | (value >> bit & 1 ? 0 : CCR_Z);
+
+    switch (type) {
+    case 0: return;
+    case 1: value ^= 1 << bit; break;
+    case 2: value &= ~(1 << bit); break;
+    default: value |= 1 << bit; break;
+    }
+
+    if (mode == 0) {
+        m_d[reg] = value;
+    } else {
+        ea_write(ea,1,value);
+    }
+}
+
+// MOVE and MOVEA
+void m68k_emu::exec_move(void)
+{
+    int top = m_opcode >> 12;
+    int size = top == 1 ? 1 : top == 3 ? 2 : 4;
+    int dst_mode = m_opcode >> 6 & 7;
+    int dst_reg = m_opcode >> 9 & 7;
+    uint32_t value;
+    ea_t ea;
+
+    ea = ea_decode(m_opcode >> 3 & 7,m_opcode & 7,size);
+    value = ea_read(ea,size);
+    m_op_cycles += 4;
+
+    if (dst_mode == 1) {
+        if (size == 1) {
+            unsupported();
+            return;
+        }
+        m_a[dst_reg] = size == 2 ? uint32_t(int16_t(value)) : value;
+        return;
+    }
+
+    ea = ea_decode(dst_mode,dst_reg,size,true);
+    ea_write(ea,size,value);
+    set_nz(value,size);
+}
+
+void m68k_emu::exec_misc(void)
+{
+    int mode = m_opcode >> 3 & 7;
+    int reg = m_opcode & 7;
+    int code = m_opcode >> 6 & 3;
+    int size = size_code(code);
+    uint32_t value;
+    uint32_t addr;
+    ea_t ea;
+
+    if (m_opcode == 0x4e71) {               // NOP
+        m_op_cycles += 4;
+    } else if (m_opcode == 0x4e75) {        // RTS
+        m_pc = rd32(m_a[7]);
+        m_a[7] += 4;
+        m_op_cycles += 16;
+    } else if ((m_opcode & 0xfff8) == 0x4e50) {     // LINK
+        push32(m_a[reg]);
+        m_a[reg] = m_a[7];
+        m_a[7] += int16_t(fetch16());
+        m_op_cycles += 16;
+    } else if ((m_opcode & 0xfff8) == 0x4e58) {     // UNLK
+        m_a[7] = m_a[reg];
+        m_a[reg] = rd32(m_a[7]);
+        m_a[7] += 4;
+        m_op_cycles += 12;
+    } else if ((m_opcode & 0xff80) == 0x4e80) {     // JSR and JMP
+        bool jsr = !(m_opcode & 0x0040);
+
+        addr = ea_control(mode,reg,jsr ? jsr_cycles : jmp_cycles);
+
+        if (jsr) {
+            push32(m_pc);
+        }
+        m_pc = addr;
+    } else if ((m_opcode & 0xf1c0) == 0x41c0) {     // LEA
+        m_a[m_opcode >> 9 & 7] = ea_control(mode,reg,lea_cycles);
+    } else if ((m_opcode & 0xfff8) == 0x4840) {     // SWAP
+        m_d[reg] = m_d[reg] << 16 | m_d[reg] >> 16;
+        set_nz(m_d[reg],4);
+        m_op_cycles += 4;
+    } else if ((m_opcode & 0xffc0) == 0x4840) {     // PEA
+        push32(ea_control(mode,reg,pea_cycles));
+    } else if ((m_opcode & 0xfff8) == 0x4880) {     // EXT.W
+        m_d[reg] = (m_d[reg] & 0xffff0000) | uint16_t(int8_t(m_d[reg]));
+        set_nz(m_d[reg],2);
+        m_op_cycles += 4;
+    } else if ((m_opcode & 0xfff8) == 0x48c0) {     // EXT.L
+        m_d[reg] = int16_t(m_d[reg]);
+        set_nz(m_d[reg],4);
+        m_op_cycles += 4;
+    } else if ((m_opcode & 0xfb80) == 0x4880) {
+        exec_movem();
+    } else if ((m_opcode & 0xff00) == 0x4a00 && code != 3) {    // TST
+        ea = ea_decode(mode,reg,size);
+        set_nz(ea_read(ea,size),size);
+        m_op_cycles += 4;
+    } else if ((m_opcode & 0xf900) == 0x4000 && code != 3 && mode != 1) {
+        // NEGX, CLR, NEG and NOT
+        ea = ea_decode(mode,reg,size);
+        value = ea_read(ea,size);
+
+        switch (m_opcode >> 9 & 3) {
+        case 0: value = sub(value,0,size,true); break;
+        case 1: value = 0; set_nz(value,size); break;
+        case 2: value = sub(value,0,size,false); break;
+        default: value = ~value; set_nz(value,size); break;
+        }
+
+        ea_write(ea,size,value);
+        m_op_cycles += mode == 0 ? (size == 4 ? 6 : 4) : (size == 4 ? 12 : 8);
+    } else {
+        unsupported();
+    }
+}
+
+// MOVEM to and from memory
+void m68k_emu::exec_movem(void)
+{
+    bool to_regs = m_opcode & 0x0400;
+    int size = m_opcode & 0x0040 ? 4 : 2;
+    int mode = m_opcode >> 3 & 7;
+    int reg = m_opcode & 7;
+    uint16_t mask = fetch16();
+    int num = std::bitset<16>(mask).count();
+    uint32_t addr;
+    uint32_t* regs[16];
+    int n;
+
+    for (n = 0; n < 8; n++) {
+        regs[n] = &m_d[n];
+        regs[n+8] = &m_a[n];
+    }
+
+    m_op_cycles += num * (size == 4 ? 8 : 4);
+
+    if (mode == 4 && !to_regs) {
+        // The mask is reversed, bit 0 is A7
+        addr = m_a[reg];
+
+        for (n = 0; n < 16; n++) {
+            if (mask & 1 << n) {
+                addr -= size;
+                wr(addr,size,*regs[15-n]);
+            }
+        }
+
+        m_a[reg] = addr;
+        m_op_cycles += 8;
+        return;
+    }
+    if (mode == 3 && to_regs) {
+        addr = m_a[reg];
+        m_op_cycles += 12;
+    } else if (mode == 3 || mode == 4) {
+        unsupported();
+        return;
+    } else {
+        addr = ea_control(mode,reg,to_regs ? movem_mr_cycles : movem_rm_cycles);
+    }
+
+    for (n = 0; n < 16; n++) {
+        if (mask & 1 << n) {
+            if (!to_regs) {
+                wr(addr,size,*regs[n]);
+            } else if (size == 2) {
+                *regs[n] = int16_t(rd16(addr));
+            } else {
+                *regs[n] = rd32(addr);
+            }
+            addr += size;
+        }
+    }
+    if (mode == 3) {
+        m_a[reg] = addr;
+    }
+}
+
+// ADDQ, SUBQ, Scc and DBcc
+void m68k_emu::exec_quick(void)
+{
+    int code = m_opcode >> 6 & 3;
+    int mode = m_opcode >> 3 & 7;
+    int reg = m_opcode & 7;
+    int cc = m_opcode >> 8 & 15;
+    int size = size_code(code);
+    uint32_t data;
+    uint32_t base;
+    int16_t disp;
+    ea_t ea;
+
+    if (code == 3 && mode == 1) {           // DBcc
+        base = m_pc;
+        disp = fetch16();
+
+        if (cond(cc)) {
+            m_op_cycles += 12;
+        } else {
+            m_d[reg] = (m_d[reg] & 0xffff0000) | uint16_t(m_d[reg] - 1);
+
+            if ((m_d[reg] & 0xffff) != 0xffff) {
+                m_pc = base + disp;
+                m_op_cycles += 10;
+            } else {
+                m_op_cycles += 14;
+            }
+        }
+    } else if (code == 3) {                 // Scc
+        ea = ea_decode(mode,reg,1);
+        ea_write(ea,1,cond(cc) ? 0xff : 0x00);
+        m_op_cycles += mode == 0 ? (cond(cc) ? 6 : 4) : 8;
+    } else {                                // ADDQ and SUBQ
+        data = m_opcode >> 9 & 7;
+        data = data ? data : 8;
+
+        if (mode == 1) {
+            m_a[reg] += m_opcode & 0x0100 ? -data : data;
+            m_op_cycles += 8;
+            return;
+        }
+
+        ea = ea_decode(mode,reg,size);
+
+        if (m_opcode & 0x0100) {
+            ea_write(ea,size,sub(data,ea_read(ea,size),size,false));
+        } else {
+            ea_write(ea,size,add(data,ea_read(ea,size),size,false));
+        }
+        m_op_cycles += mode == 0 ? (size == 4 ? 8 : 4) : (size == 4 ? 12 : 8);
+    }
+}
+
+// Bcc, BRA and BSR
+void m68k_emu::exec_branch(void)
+{
+    int cc = m_opcode >> 8 & 15;
+    uint32_t base = m_pc;
+    int32_t disp = int8_t(m_opcode & 0xff);
+    bool word = disp == 0;
+
+    if (word) {
+        disp = int16_t(fetch16());
+    }
+    if (cc == 1) {
+        push32(m_pc);
+        m_pc = base + disp;
+        m_op_cycles += 18;
+    } else if (cond(cc)) {
+        m_pc = base + disp;
+        m_op_cycles += 10;
+    } else {
+        m_op_cycles += word ? 12 : 8;
+    }
+}
+
+// ADD, ADDA, ADDX, SUB, SUBA and SUBX
+void m68k_emu::exec_arith(void)
+{
+    bool is_add = m_opcode >> 12 == 0xd;
+    int dn = m_opcode >> 9 & 7;
+    int opmode = m_opcode >> 6 & 7;
+    int mode = m_opcode >> 3 & 7;
+    int reg = m_opcode & 7;
+    int size = size_code(opmode & 3);
+    uint32_t src;
+    uint32_t dst;
+    ea_t ea;
+
+    if (opmode == 3 || opmode == 7) {
+        size = opmode == 3 ? 2 : 4;
+        ea = ea_decode(mode,reg,size);
+        src = ea_read(ea,size);
+        src = size == 2 ? uint32_t(int16_t(src)) : src;
+        m_a[dn] = is_add ? m_a[dn] + src : m_a[dn] - src;
+        m_op_cycles += size == 2 || is_reg_or_imm(mode,reg) ? 8 : 6;
+        return;
+    }
+    if (opmode & 4 && mode <= 1) {          // ADDX and SUBX
+        ea_t src_ea = {0,reg,0};
+        ea_t dst_ea = {0,dn,0};
+
+        if (mode == 1) {
+            src_ea = ea_decode(4,reg,size);
+            dst_ea = ea_decode(4,dn,size);
+            m_op_cycles = size == 4 ? 30 : 18;
+        } else {
+            m_op_cycles += size == 4 ? 8 : 4;
+        }
+
+        src = ea_read(src_ea,size);
+        dst = ea_read(dst_ea,size);
+        ea_write(dst_ea,size,is_add ? add(src,dst,size,true) : sub(src,dst,size,true));
+        return;
+    }
+
+    ea = ea_decode(mode,reg,size);
+
+    if (opmode & 4) {                       // Dn,<ea>
+        dst = ea_read(ea,size);
+        src = m_d[dn];
+        ea_write(ea,size,is_add ? add(src,dst,size,false) : sub(src,dst,size,false));
+        m_op_cycles += size == 4 ? 12 : 8;
+    } else {                                // <ea>,Dn
+        src = ea_read(ea,size);
+        dst = m_d[dn];
+        ea = {0,dn,0};
+        ea_write(ea,size,is_add ? add(src,dst,size,false) : sub(src,dst,size,false));
+        m_op_cycles += size == 4 ? (is_reg_or_imm(mode,reg) ? 8 : 6) : 4;
+    }
+}
+
+// OR, AND, EOR, CMP, CMPA, CMPM, EXG and the multiplications and divisions
+void m68k_emu::exec_logic(void)
+{
+    int top = m_opcode >> 12;
+    int dn = m_opcode >> 9 & 7;
+    int opmode = m_opcode >> 6 & 7;
+    int mode = m_opcode >> 3 & 7;
+    int reg = m_opcode & 7;
+    int size = size_code(opmode & 3);
+    uint32_t src;
+    uint32_t dst;
+    ea_t ea;
+
+    if (top != 0xb && (opmode == 3 || opmode == 7)) {
+        exec_muldiv();
+        return;
+    }
+    if (top != 0xb && (m_opcode & 0x01f0) == 0x0100) {      // ABCD and SBCD
+        unsupported();
+        return;
+    }
+    if (top == 0xc && (opmode == 5 || opmode == 6) && mode <= 1) {
+        // EXG Dx,Dy, Ax,Ay and Dx,Ay
+        uint32_t* x = opmode == 5 && mode == 1 ? &m_a[dn] : &m_d[dn];
+        uint32_t* y = opmode == 5 && mode == 0 ? &m_d[reg] : &m_a[reg];
+
+        if (opmode == 6 && mode == 0) {
+            unsupported();
+            return;
+        }
+
+        std::swap(*x,*y);
+        m_op_cycles += 6;
+        return;
+    }
+    if (top == 0xb) {
+        if (opmode == 3 || opmode == 7) {   // CMPA
+            size = opmode == 3 ? 2 : 4;
+            ea = ea_decode(mode,reg,size);
+            src = ea_read(ea,size);
+            src = size == 2 ? uint32_t(int16_t(src)) : src;
+            sub(src,m_a[dn],4,false,true);
+            m_op_cycles += 6;
+        } else if (opmode < 3) {            // CMP
+            ea = ea_decode(mode,reg,size);
+            sub(ea_read(ea,size),m_d[dn],size,false,true);
+            m_op_cycles += size == 4 ? 6 : 4;
+        } else if (mode == 1) {             // CMPM
+            src = rd(m_a[reg],size);
+            m_a[reg] += reg == 7 && size == 1 ? 2 : size;
+            dst = rd(m_a[dn],size);
+            m_a[dn] += dn == 7 && size == 1 ? 2 : size;
+            sub(src,dst,size,false,true);
+            m_op_cycles += size == 4 ? 20 : 12;
+        } else {                            // EOR
+            ea = ea_decode(mode,reg,size);
+            dst = ea_read(ea,size) ^ m_d[dn];
+            ea_write(ea,size,dst);
+            set_nz(dst,size);
+            m_op_cycles += mode == 0 ? (size == 4 ? 8 : 4) : (size == 4 ? 12 : 8);
+        }
+        return;
+    }
+
+    // OR and AND
+    ea = ea_decode(mode,reg,size);
+    src = ea_read(ea,size);
+
+    if (mode == 1) {
+        unsupported();
+        return;
+    }
+    if (opmode & 4) {                       // Dn,<ea>
+        dst = top == 0x8 ? src | m_d[dn] : src & m_d[dn];
+        ea_write(ea,size,dst);
+        m_op_cycles += size == 4 ? 12 : 8;
+    } else {                                // <ea>,Dn
+        dst = top == 0x8 ? src | m_d[dn] : src & m_d[dn];
+        ea = {0,dn,0};
+        ea_write(ea,size,dst);
+        m_op_cycles += size == 4 ? (is_reg_or_imm(mode,reg) ? 8 : 6) : 4;
+    }
+
+    set_nz(dst,size);
+}
+
+// MULU, MULS, DIVU and DIVS. The divisions take their worst case time.
+void m68k_emu::exec_muldiv(void)
+{
+    bool is_signed = m_opcode & 0x0100;
+    int dn = m_opcode >> 9 & 7;
+    ea_t ea = ea_decode(m_opcode >> 3 & 7,m_opcode & 7,2);
+    uint32_t src = ea_read(ea,2);
+    int32_t quot;
+    int32_t rem;
+
+    if (m_opcode >> 12 == 0xc) {
+        if (is_signed) {
+            m_d[dn] = int32_t(int16_t(m_d[dn])) * int16_t(src);
+            m_op_cycles += 38 + 2 * std::bitset<17>((src ^ src << 1) & 0xffff).count();
+        } else {
+            m_d[dn] = (m_d[dn] & 0xffff) * src;
+            m_op_cycles += 38 + 2 * std::bitset<16>(src).count();
+        }
+        set_nz(m_d[dn],4);
+        return;
+    }
+    if (src == 0) {                         // Division by zero trap
+        unsupported();
+        return;
+    }
+    if (is_signed) {
+        quot = int32_t(m_d[dn]) / int16_t(src);
+        rem = int32_t(m_d[dn]) % int16_t(src);
+        m_op_cycles += 158;
+
+        if (quot < -32768 || quot > 32767) {
+            m_ccr = (m_ccr & CCR_X) | CCR_V;
+            return;
+        }
+    } else {
+        quot = m_d[dn] / src;
+        rem = m_d[dn] % src;
+        m_op_cycles += 140;
+
+        if (uint32_t(quot) > 0xffff) {
+            m_ccr = (m_ccr & CCR_X) | CCR_V;
+            return;
+        }
+    }
+
+    m_d[dn] = uint32_t(rem) << 16 | uint16_t(quot);
+    set_nz(quot,2);
+}
+
+// The shifts and rotates of data registers and memory words
+void m68k_emu::exec_shift(void)
+{
+    int code = m_opcode >> 6 & 3;
+    bool left = m_opcode & 0x0100;
+    int reg = m_opcode & 7;
+    int size;
+    int count;
+    ea_t ea;
+
+    if (code == 3) {
+        if (m_opcode & 0x0800) {
+            unsupported();
+            return;
+        }
+
+        ea = ea_decode(m_opcode >> 3 & 7,reg,2);
+        ea_write(ea,2,shift(m_opcode >> 9 & 3,left,ea_read(ea,2),1,2));
+        m_op_cycles += 8;
+        return;
+    }
+
+    size = size_code(code);
+    count = m_opcode >> 9 & 7;
+
+    if (m_opcode & 0x0020) {
+        count = m_d[count] & 63;
+    } else if (count == 0) {
+        count = 8;
+    }
+
+    ea = {0,reg,0};
+    ea_write(ea,size,shift(m_opcode >> 3 & 3,left,m_d[reg],count,size));
+    m_op_cycles += (size == 4 ? 8 : 6) + 2 * count;
+}
@@ -20,6 +20,13 @@
 #include <cstring>
 #include <cstdlib>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <set>
+#include <string>
+#include <sstream>
 #include <getopt.h>
 
 #include "zxpac4.h"
@@ -31,6 +38,10 @@
 #include "lz_base.h"
 #include "hunk.h"
 #include "target.h"
+#include "input_file.h"
+#include "lz_unpack.h"
+#include "lz_speed.h"
+#include "bench.h"
 
 #include "version.h"
 
@@ -56,16 +67,11 @@
 #define DEF_CHAIN           16
 #define MAX_BACKWARD_STEPS  16
 #define DEF_BACKWARD_STEPS  0
-
-// Algorithms - these should be moved to somewhere common place
-// accessible to different targets as well.
-#define ZXPAC4              0
-#define ZXPAC4B             1
-#define ZXPAC4_32K          2
-#define ZXPAC4C             3
-#define ZXPAC4D             4
-#define ZXPAC_DEFAULT       ZXPAC4
-#define ZXPAC_MAX           ZXPAC4D+1
+#define MAX_THREADS         256
+#define MAX_PASSES          16
+#define MIN_PARSE_BLOCK     1024
+#define MAX_SPEED_LAMBDA    1000
+#define BATCH_NAME          "batch"
 
 
 static const char *algo_names[] = {
@@ -78,6 +84,31 @@ static const char *algo_names[] = {
 
 
 
+static const char *matcher_names[] = {
+    "hash3",
+    "bintree",
+    "suffix",
+    "zarray",
+    "zarray-inc",
+};
+
+
+static const char *level_names[] = {
+    "optimal",
+    "greedy",
+    "lazy1",
+    "lazy2",
+};
+
+// Default --max-chain of the fast parse levels, unless given with -c
+static const int level_max_chain[] = {
+    0,
+    4,
+    8,
+    16,
+};
+
+
 static const char* def_filename = "SCOOPEX";
 
 
@@ -91,6 +122,7 @@ static struct option longopts[] = {
 	{"max-match",   required_argument,  NULL, 'm'},
 	{"backward",    required_argument,  NULL, 'B'},
 	{"only-better", no_argument,        NULL, 'b'},
+	{"ladder",      no_argument,        NULL, 'X'},
     {"pmr-offset",  required_argument,  NULL, 'p'},
     // generic parameters
 	{"reverse-file",no_argument,        NULL, 'R'},
@@ -110,6 +142,18 @@ static struct option longopts[] = {
     {"file-name",   required_argument,  NULL, 'n'},
     {"preload",     required_argument,  NULL, 'L'},
     {"preset",      required_argument,  NULL, 'S'},
+    {"matcher",     required_argument,  NULL, 'F'},
+    {"hash-bytes",  required_argument,  NULL, 'H'},
+    {"threads",     required_argument,  NULL, 'T'},
+    {"match-cache", required_argument,  NULL, 'C'},
+    {"passes",      required_argument,  NULL, 'N'},
+    {"parse-block", required_argument,  NULL, 'W'},
+    {"level",       required_argument,  NULL, 'G'},
+    {"dump-tokens", required_argument,  NULL, 'Q'},
+    {"split-parse", required_argument,  NULL, 'J'},
+    {"verify",      no_argument,        NULL, 'V'},
+    {"report-tstates", no_argument,     NULL, 't'},
+    {"speed-lambda", required_argument, NULL, 'Y'},
     {0,0,0,0}
 };
 
@@ -119,6 +163,8 @@ static void usage(char *prg, const targets::target* trg)
 
     std::cerr << "ZXPAC4 v" << ZXPAC4_MAJOR << "." << ZXPAC4_MINOR << " (c) 2022-24 Jouni 'Mr.Spiv' Korhonen\n\n";
     std::cerr << "Usage: " << prg << " target [options] infile [outfile]\n";
+    std::cerr << "       " << prg << " " << BATCH_NAME << " [options] manifest (see '" << BATCH_NAME << " -h')\n";
+    std::cerr << "       " << prg << " " << BENCH_NAME << " [options] [test ...] (see '" << BENCH_NAME << " -h')\n";
 	std::cerr << " Targets:\n";
     std::cerr << "  bin - Binary data file\n"
               << "  asc - 7bit ASCII data file\n"
@@ -135,6 +181,8 @@ static void usage(char *prg, const targets::target* trg)
               << "(min 0, max " << MAX_BACKWARD_STEPS << ").\n";
     std::cerr << "  --only-better,-b      Further matches in the history must always be better than previous\n"
               << "                        matches for the same position (default no).\n";
+    std::cerr << "  --ladder,-X           Report one match per length up to the good match with the\n"
+                 "                        nearest offset, plus the longest match (default no).\n";
     std::cerr << "  --pmr-offset,-p       Initial PMR offset between 1 and 63 (default depends on the target).\n";
     std::cerr << "  --reverse-encoded,-r  Reverse the encoded file to allow end-to-start decompression\n"
               << "                        (default no reverse).\n";
@@ -146,12 +194,34 @@ static void usage(char *prg, const targets::target* trg)
               << "                          2=zxpac4_32k Same as zxpac4 with 32K window\n"
               << "                          3=zxpac4c    LZSS, literal runs, 16/32/64/128K window, tANS backend\n"
               << "                          4=zxpac4d    LZSS, 16/32/64/128K window, tANS backend\n";
+    std::cerr << "  --matcher,-F num      Select used string matcher (default depends on the algorithm):\n"
+              << "                          0=hash3      Hash chains limited by --max-chain\n"
+              << "                          1=bintree    Binary trees, matches in increasing length\n"
+              << "                          2=suffix     Suffix array, nearest match for every length\n"
+              << "                          3=zarray     Z-array per position, for small windows\n"
+              << "                          4=zarray-inc Z-array updated incrementally, for small windows\n";
+    std::cerr << "  --hash-bytes,-H num   Hashed bytes for hash3 (2=exact pairs, 3 or 4 multiplicative).\n";
+    std::cerr << "  --threads,-T num      Number of match search threads, 0 for all cores (default 1).\n";
+    std::cerr << "  --match-cache,-C dir  Load found matches from or save them into a cache directory.\n";
+    std::cerr << "  --passes,-N num       Maximum optimal parsing passes for zxpac4c/zxpac4d (1-" << MAX_PASSES << ", default 1).\n";
+    std::cerr << "  --parse-block,-W num  Windowed optimal parsing in blocks of num bytes for zxpac4\n"
+              << "                        and zxpac4_32k (default 0 = whole file).\n";
+    std::cerr << "  --level,-G name       Parse level: optimal, greedy, lazy1 or lazy2 (default optimal).\n"
+              << "                        The greedy and lazy levels trade ratio for speed.\n";
+    std::cerr << "  --split-parse,-J num  Parse num blocks in parallel, 0 for all cores (default 1).\n";
+    std::cerr << "  --dump-tokens,-Q file Write the selected literals, matches and PMRs into a text file.\n";
+    std::cerr << "  --verify,-V           Decompress the encoded file and compare it to the input (not for\n"
+              << "                        zxpac4c and zxpac4d).\n";
+    std::cerr << "  --report-tstates,-t   Run the decompressor in a Z80 or 68000 emulator, report its\n"
+              << "                        T-states or cycles and check the output (zx and ami targets).\n";
+    std::cerr << "  --speed-lambda,-Y num Weigh in the decompression time with num bits per 1000 Z80\n"
+              << "                        T-states or 68000 cycles (zxpac4 and zxpac4_32k, default 0).\n";
     std::cerr << "  --preshift,-P         Preshift the last ASCII literal (requires 'asc' target):\n";
     std::cerr << "  --abs,-A load,jump    Self-extracting decruncher parameters for absolute address location.\n";
     std::cerr << "  --merge-hunks,-M      Merge hunks (Amiga target).\n";
     std::cerr << "  --equalize-hunks,-E   Treat HUNK_CODE/DATA/BSS all the same. This setting will enable\n"
               << "                        '--merge-hunks' as well (Amiga target).\n";
-    std::cerr << "  --overlay,-O          Self-extracting overlay decruncher (Amiga target).\n";
+    std::cerr << "  --overlay,-O          Self-extracting overlay decruncher (Amiga target, not implemented).\n";
     std::cerr << "  --debug,-d            Output a LOT OF debug prints to stderr.\n";
     std::cerr << "  --DEBUG,-D            Output EVEN MORE debug prints to stderr.\n";
     std::cerr << "  --verbose,-v          Output some additional information to stdout.\n";
@@ -204,7 +274,7 @@ static targets::target my_targets[] = {
         "Draft: A TAP file contains a decompressor and runs the compressed program.",
         (1<<16) - 1,
         1<<ZXPAC4_32K,
-        ZXPAC4_32K | 1<<ZXPAC4C | 1<<ZXPAC4D,
+        ZXPAC4_32K,
         255,
         0x0,
         0x0,
@@ -257,7 +327,19 @@ static const lz_config algos[] {
         ZXPAC4_INIT_PMR_OFFSET,
         DEBUG_LEVEL_NONE,
         ZXPAC4,
+        LZ_MATCHER_HASH3,   // matcher
+        2,                  // hash_bytes
+        1,                  // num_threads
+        NULL,               // match_cache
+        1,                  // max_passes
+        0,                  // parse_block
+        LZ_PARSE_OPTIMAL,   // parse_level
+        1,                  // parse_split
+        NULL,               // token_file
+        0,                  // speed_lambda
+        NULL,               // speed_cycles
         false,      // only_better_matches
+        false,      // match_ladder
         LZ_CFG_FALSE,      // reverse_file
         LZ_CFG_FALSE,      // reverse_encoded
         LZ_CFG_FALSE,      // is_ascii
@@ -272,7 +354,19 @@ static const lz_config algos[] {
         ZXPAC4B_INIT_PMR_OFFSET,
         DEBUG_LEVEL_NONE,
         ZXPAC4B,
+        LZ_MATCHER_HASH3,   // matcher
+        2,                  // hash_bytes
+        1,                  // num_threads
+        NULL,               // match_cache
+        1,                  // max_passes
+        0,                  // parse_block
+        LZ_PARSE_OPTIMAL,   // parse_level
+        1,                  // parse_split
+        NULL,               // token_file
+        0,                  // speed_lambda
+        NULL,               // speed_cycles
         false,      // only_better_matches
+        false,      // match_ladder
         LZ_CFG_FALSE,      // reverse_file
         LZ_CFG_FALSE,      // reverse_encoded
         LZ_CFG_FALSE,      // is_ascii
@@ -287,7 +381,19 @@ static const lz_config algos[] {
         ZXPAC4_32K_INIT_PMR_OFFSET,
         DEBUG_LEVEL_NONE,
         ZXPAC4_32K,
+        LZ_MATCHER_HASH3,   // matcher
+        2,                  // hash_bytes
+        1,                  // num_threads
+        NULL,               // match_cache
+        1,                  // max_passes
+        0,                  // parse_block
+        LZ_PARSE_OPTIMAL,   // parse_level
+        1,                  // parse_split
+        NULL,               // token_file
+        0,                  // speed_lambda
+        NULL,               // speed_cycles
         false,      // only_better_matches
+        false,      // match_ladder
         LZ_CFG_FALSE,      // reverse_file
         LZ_CFG_FALSE,      // reverse_encoded
         LZ_CFG_FALSE,      // is_ascii
@@ -302,7 +408,19 @@ static const lz_config algos[] {
         ZXPAC4C_INIT_PMR_OFFSET,
         DEBUG_LEVEL_NONE,
         ZXPAC4C,
+        LZ_MATCHER_HASH3,   // matcher
+        2,                  // hash_bytes
+        1,                  // num_threads
+        NULL,               // match_cache
+        1,                  // max_passes
+        0,                  // parse_block
+        LZ_PARSE_OPTIMAL,   // parse_level
+        1,                  // parse_split
+        NULL,               // token_file
+        0,                  // speed_lambda
+        NULL,               // speed_cycles
         false,          // only_better_matches
+        false,          // match_ladder
         LZ_CFG_TRUE|LZ_CFG_CONST,           // reverse_file
         LZ_CFG_TRUE|LZ_CFG_CONST,           // reverse_encoded
         LZ_CFG_NSUP,    // is_ascii
@@ -317,7 +435,19 @@ static const lz_config algos[] {
         ZXPAC4D_INIT_PMR_OFFSET,
         DEBUG_LEVEL_NONE,
         ZXPAC4D,
+        LZ_MATCHER_HASH3,   // matcher
+        2,                  // hash_bytes
+        1,                  // num_threads
+        NULL,               // match_cache
+        1,                  // max_passes
+        0,                  // parse_block
+        LZ_PARSE_OPTIMAL,   // parse_level
+        1,                  // parse_split
+        NULL,               // token_file
+        0,                  // speed_lambda
+        NULL,               // speed_cycles
         false,          // only_better_matches
+        false,          // match_ladder
         LZ_CFG_TRUE|LZ_CFG_CONST,           // reverse_file
         LZ_CFG_TRUE|LZ_CFG_CONST,           // reverse_encoded
         LZ_CFG_NSUP,    // is_ascii
@@ -382,6 +512,7 @@ void list(const char* argv, const targets::target* trg)
             std::cout << "  Window size: " << algos[i].window_size << "\n";
             std::cout << "  Minimum offset: " << algos[i].min_offset << "\n";
             std::cout << "  Default length of hash linked list of matches: " << algos[i].max_chain << "\n";
+            std::cout << "  Default string matcher: " << matcher_names[algos[i].matcher] << "\n";
             std::cout << "  Minimum match length: " << algos[i].min_match << "\n";
             std::cout << "  Maximum match length: " << algos[i].max_match << "\n";
             std::cout << "  Default good match length: " << algos[i].good_match << "\n";
@@ -456,28 +587,133 @@ static target_base* create_target(const targets::target* trg, lz_config* cfg, st
     return ptr;
 }
 
+/**
+ * @brief Select the decompression cycles of the target for the speed aware
+ *        parsing. The Amiga decompressors run on a 68000, the ZX Spectrum
+ *        one on a Z80, and the raw data targets are counted as Z80 too.
+ *
+ * @param[in] trg A ptr to the target.
+ *
+ * @return A ptr to the cycles or NULL if the target has none (e.g. the
+ *         6502 decompressor of the BBC Micro).
+ */
+static const lz_speed_cycles* speed_cycles_for(const targets::target* trg)
+{
+    if (!(strcmp(trg->target_name,"ami"))) {
+        return &lz_speed_68000;
+    } else if (!(strcmp(trg->target_name,"zx")) ||
+               !(strcmp(trg->target_name,"bin")) ||
+               !(strcmp(trg->target_name,"asc"))) {
+        return &lz_speed_z80;
+    } else {
+        return NULL;
+    }
+}
+
+/**
+ * @brief Write the selected parse into a text file, one token per line:
+ *        the file position, the token type, the offset and the length.
+ *
+ * @param[in] lz   A ptr to lz_base of the parsed file.
+ * @param[in] name The name of the token file.
+ *
+ * @return 0 or negative in case of an error.
+ */
+static int dump_tokens(const lz_base* lz, const char* name)
+{
+    static const char* type_names[] = {"LIT","MATCH","PMR"};
+    std::ofstream tfs(name);
+    int pos = 0;
+
+    if (!tfs.is_open()) {
+        std::cerr << ERR_PREAMBLE << "opening token file '" << name << "' failed\n";
+        return -1;
+    }
+    for (const lz_token& token : lz->get_tokens()) {
+        tfs << pos << " " << type_names[token.type] << " "
+            << token.offset << " " << token.length << "\n";
+        pos += token.length;
+    }
+    if (!tfs) {
+        std::cerr << ERR_PREAMBLE << "writing token file '" << name << "' failed\n";
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Decompress the encoded file and compare it to the input.
+ *
+ * @param[in] buf   The input file after preprocessing, reversed with
+ *                  --reverse-file.
+ * @param[in] p_out The encoded file, reversed with --reverse-encoded.
+ *
+ * @return 0 if the files match or -1 on a mismatch or if the algorithm
+ *         cannot be verified.
+ */
+static int verify_file(const lz_config* cfg, const char* buf, int len, const char* p_out, int n)
+{
+    std::vector<char> out;
+    int pos;
+
+    if (!lz_unpack_supported(cfg)) {
+        std::cerr << ERR_PREAMBLE << "--verify not supported for " << algo_names[cfg->algorithm] << "\n";
+        return -1;
+    }
+
+    out.resize(len);
+    n = lz_unpack(p_out,n,out.data(),len,cfg);
+
+    if (n != len) {
+        std::cerr << ERR_PREAMBLE << "verify failed, decompression returned " << n << "\n";
+        return -1;
+    }
+    for (pos = 0; pos < len; pos++) {
+        // The decompressor undoes --reverse-file
+        if (out[pos] != buf[cfg->reverse_file ? len - 1 - pos : pos]) {
+            std::cerr << ERR_PREAMBLE << "verify failed at offset " << pos << "\n";
+            return -1;
+        }
+    }
+    if (cfg->verbose) {
+        std::cout << "Verified " << len << " bytes" << std::endl;
+    }
+
+    return 0;
+}
+
 /**
  * @brief Driver function for a generic LZ compression..
  * @param[in] trg A const ptr to targets::target for this file.
  * @param[in] lz  A ptr to lz_base for this file.
  * @param[in] cfg A ptr to lz_cinfig for this file.
+ * @param[in] name The name of the input file.
  * @param[in] ifs A reference to input file (=this file).
  * @param[in] ofs A reference to output file.
  * @param[in] len The length of the input file (=length of this file).
  *                (This is actually redundant information).
+ * @param[in] verify True if the encoded file is decompressed and
+ *                compared to the input.
+ * @param[in] report_tstates True if the decompressor of the target is
+ *                run in an emulator.
+ * @param[in] keep_cost_array True if the cost table is kept for the next
+ *                file, see batch_worker.
  *
  * @return Final saved file length or negative in case of an error.
  */
-static int handle_file(const targets::target* trg, lz_base* lz, lz_config_t* cfg, std::ifstream& ifs, std::ofstream& ofs, int len)
+static int handle_file(const targets::target* trg, lz_base* lz, lz_config_t* cfg, const std::string& name,
+    std::ifstream& ifs, std::ofstream& ofs, int len, bool verify, bool report_tstates, bool keep_cost_array)
 {
     int n = 0;
+    input_file in;
     // extra N characters to avoid buffer overrun with 3 byte hash function..
-    char* buf = new (std::nothrow) char[len+3];
+    char* buf = in.load(name,ifs,len,3);
     char* p_out = NULL;
     target_base* trg_ptr = create_target(trg,cfg,ofs);
 
     if (buf == NULL) {
-        std::cerr << ERR_PREAMBLE << "failed to allocate memory for the input file\n";
+        std::cerr << ERR_PREAMBLE << "reading the input file failed\n";
         n = -1;
 		goto error_exit;
     }
@@ -485,18 +721,22 @@ static int handle_file(const targets::target* trg, lz_base* lz, lz_config_t* cfg
         std::cerr << ERR_PREAMBLE << "failed to instantiate a target object\n";
         n = -1;
 		goto error_exit;
+    }
+    if (report_tstates && !trg_ptr->can_run_decompressor()) {
+        std::cerr << ERR_PREAMBLE << "-t,--report-tstates not supported for " << trg->target_name
+                  << " target with " << algo_names[cfg->algorithm] << "\n";
+        n = -1;
+		goto error_exit;
     }
 	if (( p_out = new(std::nothrow) char[len+MAX_HEADER_OVERHEAD]) == NULL) {
 		std::cerr << "**Error: Allocating memory for the file failed" << std::endl;
 		n = -1;
 		goto error_exit;
 	}
-    if (!ifs.read(buf,len)) {
-        std::cerr << ERR_PREAMBLE << "reading the input file failed\n";
-        n = -1;
-		goto error_exit;
+    if (cfg->verbose && in.is_mapped()) {
+        std::cout << "Input file mapped into memory" << std::endl;
     }
-    
+
     len = trg_ptr->preprocess(buf,len);
     if (cfg->verbose) {
         std::cout << "File size after preprocessing is " << len << std::endl;
@@ -517,8 +757,29 @@ static int handle_file(const targets::target* trg, lz_base* lz, lz_config_t* cfg
 		reverse_buffer(buf,len);
 	}
 
-    lz->lz_search_matches(buf,len,0); 
-    lz->lz_parse(buf,len,0); 
+    try {
+        lz->lz_search_matches(buf,len,0); 
+        lz->lz_parse(buf,len,0); 
+    } catch (std::exception& e) {
+        // E.g. running out of memory in the match search
+        std::cerr << ERR_PREAMBLE << e.what() << "\n";
+        n = -1;
+        goto error_exit;
+    }
+
+    // The encoders only need the selected tokens
+    if (!keep_cost_array) {
+        lz->lz_cost_array_done();
+    }
+
+    if (cfg->token_file && (n = dump_tokens(lz,cfg->token_file)) < 0) {
+        goto error_exit;
+    }
+    if (cfg->verbose && cfg->speed_cycles) {
+        std::cout << "Estimated decompression time " << lz_speed_parse_cycles(*cfg->speed_cycles,
+            cfg->algorithm == ZXPAC4 ? zxpac4_offset_codes : zxpac4_32k_offset_codes,lz->get_tokens())
+                  << " " << cfg->speed_cycles->cpu << " cycles" << std::endl;
+    }
 
     if (cfg->verbose) {
         std::cout << "Encoding the compressed file" << std::endl;
@@ -527,6 +788,8 @@ static int handle_file(const targets::target* trg, lz_base* lz, lz_config_t* cfg
 	n = lz->lz_encode(buf,len,p_out,NULL);
     
 	if (n > 0) {
+        trg_ptr->set_security_distance(lz->get_security_distance());
+
         if (cfg->reverse_encoded) {
             if (cfg->verbose) {
                 std::cout << "Reversing the encoded file.." << std::endl;
@@ -536,6 +799,16 @@ static int handle_file(const targets::target* trg, lz_base* lz, lz_config_t* cfg
         if (cfg->verbose) {
             std::cout << "Compressed length: " << n << std::endl;
         }
+        if (verify && verify_file(cfg,buf,len,p_out,n) < 0) {
+            n = -1;
+            goto error_exit;
+        }
+        if (report_tstates) {
+            if (trg_ptr->run_decompressor(buf,len,p_out,n) != 0) {
+                n = -1;
+                goto error_exit;
+            }
+        }
     } else {
         if (cfg->verbose) {
             std::cout << "Compression failed.." << std::endl;
@@ -553,35 +826,63 @@ static int handle_file(const targets::target* trg, lz_base* lz, lz_config_t* cfg
     }
 error_exit: 
     delete trg_ptr;
-    delete[] buf;
 	delete[] p_out;
     return n;
 }
 
 
-int main(int argc, char** argv)
+/**
+ * @struct compress_job
+ * @brief The target, the LZ configuration and the files of one command
+ *        line, i.e. of one compressed file.
+ */
+struct compress_job {
+    targets::target trg;        ///< A copy of the target with the options applied
+    lz_config cfg;
+    std::string infile_name;
+    std::string outfile_name;
+    bool verify;
+    bool report_tstates;
+};
+
+/**
+ * @brief Parse the command line of one file into a compress_job. Invalid
+ *        options print the usage and exit.
+ *
+ * @param[in]  argc The number of arguments.
+ * @param[in]  argv The arguments, the target name at argv[1]. The job
+ *                  may point to the strings of @p argv.
+ * @param[out] job  The parsed job.
+ */
+static void parse_command_line(int argc, char** argv, compress_job& job)
 {
     int n;
-    int file_len = -1;
     char* endptr;
-    int compressed_len = 0;
-    
-    std::ifstream ifs;
-    std::ofstream ofs;
 
     int cfg_debug_level = DEBUG_LEVEL_NONE;
     bool cfg_preshift = false; 
     bool cfg_verbose_on = false;
-    std::string cfg_infile_name;
-    std::string cfg_outfile_name(DEF_OUTPUT_NAME);
     int cfg_algo = ZXPAC_DEFAULT;
     int cfg_good_match = -1;
     int cfg_backward_steps = -1;
     int cfg_initial_pmr_offset = -1;
     int cfg_max_chain = -1;
     int cfg_max_match = -1;
+    int cfg_matcher = -1;
+    int cfg_hash_bytes = -1;
+    int cfg_num_threads = -1;
+    int cfg_max_passes = -1;
+    int cfg_parse_block = -1;
+    int cfg_parse_level = LZ_PARSE_OPTIMAL;
+    int cfg_parse_split = -1;
+    int cfg_speed_lambda = 0;
+    const char* cfg_match_cache = NULL;
+    const char* cfg_token_file = NULL;
 	int cfg_win_scale = 0;
     bool cfg_only_better_matches = false;
+    bool cfg_match_ladder = false;
+    bool cfg_verify = false;
+    bool cfg_report_tstates = false;
     bool cfg_reverse_file = false;
     bool cfg_reverse_encoded = false;
     bool trg_merge_hunks = false;
@@ -589,7 +890,6 @@ int main(int argc, char** argv)
     bool trg_overlay = false;
     uint32_t trg_load_addr = 0;
     uint32_t trg_jump_addr = 0;
-    lz_base* lz = NULL;
     const char* trg_file_name = NULL;
 
     targets::target* trg = NULL;
@@ -617,7 +917,7 @@ int main(int argc, char** argv)
     optind = 2;
 
     // 
-	while ((n = getopt_long(argc, argv, "Em:g:c:e:B:i:s:p:hPvdDa:A:OMrRbn:lL:S:w:", longopts, NULL)) != -1) {
+	while ((n = getopt_long(argc, argv, "Em:g:c:e:B:i:s:p:hPvdDa:A:OMrRbXn:lL:S:w:F:H:T:C:N:W:G:Q:J:VtY:", longopts, NULL)) != -1) {
 		switch (n) {
             case 'O':   // --overlay
                 trg_overlay = true;
@@ -648,6 +948,78 @@ int main(int argc, char** argv)
                         << "for the target" << std::endl;
                     usage(argv[0],trg);
                 }
+                break;
+            case 'F':   // --matcher
+                cfg_matcher = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg_matcher < 0 || cfg_matcher >= LZ_MATCHER_MAX) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --matcher value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
+                break;
+            case 'H':   // --hash-bytes
+                cfg_hash_bytes = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg_hash_bytes < HASH_BYTES_MIN || cfg_hash_bytes > HASH_BYTES_MAX) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --hash-bytes value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
+                break;
+            case 'T':   // --threads
+                cfg_num_threads = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg_num_threads < 0 || cfg_num_threads > MAX_THREADS) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --threads value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
+                break;
+            case 'J':   // --split-parse
+                cfg_parse_split = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg_parse_split < 0 || cfg_parse_split > MAX_THREADS) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --split-parse value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
+                break;
+            case 'C':   // --match-cache
+                cfg_match_cache = optarg;
+                break;
+            case 'Q':   // --dump-tokens
+                cfg_token_file = optarg;
+                break;
+            case 'V':   // --verify
+                cfg_verify = true;
+                break;
+            case 't':   // --report-tstates
+                cfg_report_tstates = true;
+                break;
+            case 'Y':   // --speed-lambda
+                cfg_speed_lambda = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg_speed_lambda < 0 || cfg_speed_lambda > MAX_SPEED_LAMBDA) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --speed-lambda value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
+                break;
+            case 'N':   // --passes
+                cfg_max_passes = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || cfg_max_passes < 1 || cfg_max_passes > MAX_PASSES) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --passes value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
+                break;
+            case 'W':   // --parse-block
+                cfg_parse_block = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || (cfg_parse_block != 0 && cfg_parse_block < MIN_PARSE_BLOCK)) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --parse-block value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
+                break;
+            case 'G':   // --level
+                for (cfg_parse_level = 0; cfg_parse_level < LZ_PARSE_MAX; cfg_parse_level++) {
+                    if (!std::strcmp(optarg,level_names[cfg_parse_level])) {
+                        break;
+                    }
+                }
+                if (cfg_parse_level == LZ_PARSE_MAX) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --level value '" << optarg << "'\n";
+                    usage(argv[0],trg);
+                }
                 break;
 			case 'w':	// --win-scale
                 cfg_win_scale = std::strtoul(optarg,&endptr,10);
@@ -666,6 +1038,9 @@ int main(int argc, char** argv)
             case 'b':   // --only-better
                 cfg_only_better_matches = true;
                 break;
+            case 'X':   // --ladder
+                cfg_match_ladder = true;
+                break;
             case 'p':   // --pmr-offset
                 cfg_initial_pmr_offset = std::strtoul(optarg,&endptr,10);
                 if (*endptr != '\0' || cfg_initial_pmr_offset > 63 || cfg_initial_pmr_offset < 1) {
@@ -759,15 +1134,113 @@ int main(int argc, char** argv)
     if (cfg_initial_pmr_offset > 0) {
         cfg.initial_pmr_offset = cfg_initial_pmr_offset;
     }
+    if (cfg_parse_level != LZ_PARSE_OPTIMAL) {
+        cfg.parse_level = cfg_parse_level;
+        cfg.max_chain = level_max_chain[cfg_parse_level];
+    }
     if (cfg_max_chain > -1) {
         cfg.max_chain = cfg_max_chain;
     }
+    if (cfg_matcher > -1) {
+        cfg.matcher = cfg_matcher;
+    }
+    if (cfg_hash_bytes > -1) {
+        cfg.hash_bytes = cfg_hash_bytes;
+    }
+    if (cfg_num_threads == 0) {
+        cfg_num_threads = std::thread::hardware_concurrency();
+
+        if (cfg_num_threads == 0) {
+            cfg_num_threads = 1;
+        } else if (cfg_num_threads > MAX_THREADS) {
+            cfg_num_threads = MAX_THREADS;
+        }
+    }
+    if (cfg_parse_split == 0) {
+        cfg_parse_split = std::thread::hardware_concurrency();
+
+        if (cfg_parse_split == 0) {
+            cfg_parse_split = 1;
+        } else if (cfg_parse_split > MAX_THREADS) {
+            cfg_parse_split = MAX_THREADS;
+        }
+    }
+    if (cfg_parse_split > 1) {
+        cfg.parse_split = cfg_parse_split;
+
+        // The blocks need their matches searched up front
+        if (cfg_num_threads < 0) {
+            cfg_num_threads = cfg_parse_split;
+        }
+    }
+    if (cfg_num_threads > 0) {
+        cfg.num_threads = cfg_num_threads;
+    }
+    if (cfg_match_cache) {
+        cfg.match_cache = cfg_match_cache;
+    }
+    if (cfg_token_file) {
+        cfg.token_file = cfg_token_file;
+    }
+    if (cfg_max_passes > 0) {
+        cfg.max_passes = cfg_max_passes;
+    }
+    if (cfg_parse_block > 0) {
+        if (cfg_algo != ZXPAC4 && cfg_algo != ZXPAC4_32K) {
+            std::cerr << ERR_PREAMBLE << "-W,--parse-block not supported for " << algo_names[cfg_algo] << "\n";
+            exit(EXIT_FAILURE);
+        }
+        cfg.parse_block = cfg_parse_block;
+    }
+    if (cfg.parse_level != LZ_PARSE_OPTIMAL) {
+        if (cfg.max_passes > 1) {
+            std::cout << "**Warning: -N,--passes not applicable for this parse level\n";
+            cfg.max_passes = 1;
+        }
+        if (cfg.parse_block > 0) {
+            std::cout << "**Warning: -W,--parse-block not applicable for this parse level\n";
+            cfg.parse_block = 0;
+        }
+        if (cfg.parse_split > 1) {
+            std::cout << "**Warning: -J,--split-parse not applicable for this parse level\n";
+            cfg.parse_split = 1;
+        }
+    }
+    if (cfg.parse_split > 1) {
+        if (cfg.max_passes > 1) {
+            std::cout << "**Warning: -N,--passes not applicable with a split parse\n";
+            cfg.max_passes = 1;
+        }
+        if (cfg.parse_block > 0) {
+            std::cout << "**Warning: -W,--parse-block not applicable with a split parse\n";
+            cfg.parse_block = 0;
+        }
+        if (cfg_match_ladder) {
+            std::cout << "**Warning: -J,--split-parse not applicable with a match ladder\n";
+            cfg.parse_split = 1;
+        }
+    }
+    if (cfg_speed_lambda > 0) {
+        if (cfg.parse_level != LZ_PARSE_OPTIMAL || (cfg_algo != ZXPAC4 && cfg_algo != ZXPAC4_32K)) {
+            std::cout << "**Warning: -Y,--speed-lambda not applicable for this algorithm or parse level\n";
+        } else if (speed_cycles_for(trg) == NULL) {
+            std::cout << "**Warning: -Y,--speed-lambda not applicable for the '" << trg->target_name << "' target\n";
+        } else {
+            cfg.speed_lambda = cfg_speed_lambda;
+            cfg.speed_cycles = speed_cycles_for(trg);
+        }
+    }
     if (trg_overlay && (trg_load_addr || trg_jump_addr)) {
         trg_overlay = false;
         if (cfg_verbose_on) {
             std::cout << "**Warning: absolute address decompression overrides overlay\n";
         }
     }
+    if (trg_overlay) {
+        // Neither the decompressor nor its emulation exist yet
+        std::cerr << ERR_PREAMBLE << "-O,--overlay not supported, the overlay decompressor is not implemented\n";
+        exit(EXIT_FAILURE);
+    }
     if (trg->max_match > 0) {
         if (cfg_max_match > trg->max_match || cfg_max_match < 0) {
             cfg_max_match = trg->max_match;
@@ -790,6 +1263,7 @@ int main(int argc, char** argv)
     
     // We do not check for all possible dump combinations..
     cfg.only_better_matches = cfg_only_better_matches;
+    cfg.match_ladder = cfg_match_ladder;
     
 	if ((cfg.preshift_last_ascii_literal & LZ_CFG_CONST) && cfg_preshift) {
 		std::cout << "**Warning: -P,--preshift not applicable for this target\n";
@@ -828,58 +1302,478 @@ int main(int argc, char** argv)
         trg->file_name = trg_file_name;
     }
 
-    // The following stuff is horrible.. Needs to be hidden under
-    // multiple functions to avoid recurring cleanup due initialization
-    // failures..
-
-    cfg_infile_name  = std::string(argv[optind++]);
+    cfg.algorithm = cfg_algo;
 
-    if (argc - optind >= 1) {
-        cfg_outfile_name = std::string(argv[optind++]);
+    // Do not let an unverified file pass as a verified one
+    if (cfg_verify && !lz_unpack_supported(&cfg)) {
+        std::cerr << ERR_PREAMBLE << "-V,--verify not supported for " << algo_names[cfg_algo] << "\n";
+        exit(EXIT_FAILURE);
     }
 
-    ifs.open(cfg_infile_name,std::ios::binary|std::ios::in|std::ios::ate);
+    job.trg = *trg;
+    job.cfg = cfg;
+    job.infile_name = argv[optind++];
+    job.outfile_name = argc - optind >= 1 ? argv[optind++] : DEF_OUTPUT_NAME;
+    job.verify = cfg_verify;
+    job.report_tstates = cfg_report_tstates;
+}
+
+/**
+ * @brief Open the input file of a job and get its length.
+ *
+ * @param[in]  job A const reference to the job.
+ * @param[out] ifs The input file stream to open.
+ *
+ * @return The length of the input file or negative in case of an error.
+ */
+static int open_input_file(const compress_job& job, std::ifstream& ifs)
+{
+    int file_len;
+
+    ifs.open(job.infile_name,std::ios::binary|std::ios::in|std::ios::ate);
     if (ifs.is_open() == false) {
-        std::cerr << ERR_PREAMBLE << "failed to open input file '" << cfg_infile_name << "'\n";
-        goto error_exit;
+        std::cerr << ERR_PREAMBLE << "failed to open input file '" << job.infile_name << "'\n";
+        return -1;
     }
 
     file_len = ifs.tellg();
     ifs.seekg(0);
 
     if (file_len < 0) {
-        std::cerr << ERR_PREAMBLE << "getting file length  of '" << cfg_infile_name 
+        std::cerr << ERR_PREAMBLE << "getting file length  of '" << job.infile_name 
             << "' failed" << std::endl;
-        goto error_exit;
+        return -1;
     }
-    if (file_len > trg->max_file_size) {
-        std::cerr << ERR_PREAMBLE << "maximum file length is " << trg->max_file_size
+    if (file_len > job.trg.max_file_size) {
+        std::cerr << ERR_PREAMBLE << "maximum file length is " << job.trg.max_file_size
             << " bytes" << std::endl;
-        goto error_exit;
+        return -1;
     }
 
+    return file_len;
+}
+
+/**
+ * @brief A factory function to instantiate the LZ engine of an algorithm.
+ * @param[in] cfg A ptr to LZ-config. The engine keeps the ptr.
+ *
+ * @return A ptr to the engine or NULL in case of an error.
+ */
+static lz_base* create_engine(const lz_config* cfg)
+{
     try {
-        switch (cfg_algo) {
+        switch (cfg->algorithm) {
         case ZXPAC4B:
-            lz = new zxpac4b(&cfg);
-            break;
+            return new zxpac4b(cfg);
         case ZXPAC4_32K:
-            lz = new zxpac4_32k(&cfg);
-            break;
+            return new zxpac4_32k(cfg);
         case ZXPAC4C:
-            lz = new zxpac4c(&cfg); 
-            break;
+            return new zxpac4c(cfg); 
         case ZXPAC4D:
-            lz = new zxpac4d(&cfg); 
-            break;
+            return new zxpac4d(cfg); 
         case ZXPAC4:
         default:
-            lz = new zxpac4(&cfg);
-            break;
+            return new zxpac4(cfg);
         }
     } catch (std::exception& e) {
         std::cerr << ERR_PREAMBLE << e.what() << "\n";
-        lz = NULL;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Print the file names and the LZ configuration of a job with
+ *        --verbose.
+ */
+static void print_config(const compress_job& job, int file_len)
+{
+    const lz_config& cfg = job.cfg;
+
+    std::cout << "Loading from file '" << job.infile_name << "'\n";
+    std::cout << "File length is " << file_len << "\n";
+    std::cout << "Saving to file '" << job.outfile_name << "'\n";
+    std::cout << "Using target '" << job.trg.target_name << "' and algorithm " << cfg.algorithm << "\n";
+    std::cout << "Min match is " << cfg.min_match << "\n";
+    std::cout << "Max match is " << cfg.max_match << "\n";
+    std::cout << "Good match is " << cfg.good_match << "\n";
+    std::cout << "String matcher is " << matcher_names[cfg.matcher] << "\n";
+    if (cfg.matcher == LZ_MATCHER_HASH3) {
+        std::cout << "Hashed bytes " << cfg.hash_bytes << "\n";
+    }
+    std::cout << "Match search threads " << cfg.num_threads << "\n";
+    std::cout << "Parse level is " << level_names[cfg.parse_level] << "\n";
+    std::cout << "Maximum parsing passes " << cfg.max_passes << "\n";
+    if (cfg.parse_block > 0) {
+        std::cout << "Windowed parse block " << cfg.parse_block << "\n";
+    }
+    if (cfg.parse_split > 1) {
+        std::cout << "Split parse blocks " << cfg.parse_split << "\n";
+    }
+    if (cfg.match_ladder) {
+        std::cout << "Matches reported as a ladder\n";
+    }
+    std::cout << "Match length kernel is " << match_length_kernel_name() << "\n";
+}
+
+
+/**
+ * @brief Compare two LZ configurations field by field.
+ *
+ * @return True if an engine created with @p a compresses exactly like
+ *         one created with @p b.
+ */
+static bool same_lz_config(const lz_config& a, const lz_config& b)
+{
+    auto same_string = [](const char* s, const char* t) {
+        return s == t || (s && t && !std::strcmp(s,t));
+    };
+
+    return a.window_size == b.window_size && a.min_offset == b.min_offset &&
+        a.max_chain == b.max_chain && a.min_match == b.min_match &&
+        a.max_match == b.max_match && a.good_match == b.good_match &&
+        a.max_literal_run == b.max_literal_run && a.backward_steps == b.backward_steps &&
+        a.min_match2_threshold == b.min_match2_threshold &&
+        a.min_match3_threshold == b.min_match3_threshold &&
+        a.initial_pmr_offset == b.initial_pmr_offset && a.debug_level == b.debug_level &&
+        a.algorithm == b.algorithm && a.matcher == b.matcher &&
+        a.hash_bytes == b.hash_bytes && a.num_threads == b.num_threads &&
+        same_string(a.match_cache,b.match_cache) && a.max_passes == b.max_passes &&
+        a.parse_block == b.parse_block && a.parse_level == b.parse_level &&
+        a.parse_split == b.parse_split && same_string(a.token_file,b.token_file) &&
+        a.speed_lambda == b.speed_lambda && a.speed_cycles == b.speed_cycles &&
+        a.only_better_matches == b.only_better_matches && a.match_ladder == b.match_ladder &&
+        a.reverse_file == b.reverse_file && a.reverse_encoded == b.reverse_encoded &&
+        a.is_ascii == b.is_ascii &&
+        a.preshift_last_ascii_literal == b.preshift_last_ascii_literal &&
+        a.verbose == b.verbose;
+}
+
+/**
+ * @class batch_worker
+ * @brief One worker of the batch mode. The worker keeps its LZ engine,
+ *        i.e. the string matcher, the cost table and the tANS tables,
+ *        and resets it for the next file with the same LZ configuration.
+ */
+class batch_worker {
+    lz_config m_engine_cfg;     ///< The configuration the engine was created with
+    lz_config m_cfg;            ///< The configuration of the engine, targets may change it
+    lz_base* m_lz;
+public:
+    batch_worker(void) : m_lz(NULL) {}
+    ~batch_worker(void) {
+        delete m_lz;
+    }
+
+    /**
+     * @brief Get an engine for the configuration of the next file.
+     *
+     * @param[in] cfg The LZ configuration of the file.
+     *
+     * @return A ptr to the engine or NULL in case of an error.
+     */
+    lz_base* get_engine(const lz_config& cfg) {
+        if (m_lz && same_lz_config(m_engine_cfg,cfg)) {
+            m_lz->lz_reset();
+        } else {
+            delete m_lz;
+            m_engine_cfg = cfg;
+            m_cfg = cfg;
+            m_lz = create_engine(&m_cfg);
+        }
+
+        // Undo the changes the target of the previous file did
+        m_cfg = cfg;
+        return m_lz;
+    }
+
+    lz_config* get_config(void) {
+        return &m_cfg;
+    }
+
+    /**
+     * @brief Drop the engine, e.g. after an error left it half way.
+     */
+    void drop_engine(void) {
+        delete m_lz;
+        m_lz = NULL;
+    }
+};
+
+/**
+ * @brief Compress one file of the batch with the engine of a worker.
+ *
+ * @param[in] worker A reference to the worker.
+ * @param[in] job    The file to compress.
+ * @param[out] file_len The length of the input file.
+ *
+ * @return Final saved file length or negative in case of an error.
+ */
+static int batch_file(batch_worker& worker, compress_job& job, int& file_len)
+{
+    std::ifstream ifs;
+    std::ofstream ofs;
+    lz_base* lz;
+    int n;
+
+    if ((file_len = open_input_file(job,ifs)) < 0) {
+        return -1;
+    }
+    if ((lz = worker.get_engine(job.cfg)) == NULL) {
+        return -1;
+    }
+    try {
+        lz->lz_cost_array_get(file_len);
+
+        ofs.open(job.outfile_name,std::ios::binary|std::ios::out);
+        if (ofs.is_open() == false) {
+            std::cerr << ERR_PREAMBLE << "opening output file '" << job.outfile_name << "' failed\n";
+            return -1;
+        }
+
+        n = handle_file(&job.trg,lz,worker.get_config(),job.infile_name,ifs,ofs,file_len,
+            job.verify,job.report_tstates,true);
+    } catch (std::exception& e) {
+        std::cerr << ERR_PREAMBLE << e.what() << "\n";
+        n = -1;
+    }
+    if (n < 0) {
+        worker.drop_engine();
+    }
+
+    return n;
+}
+
+/**
+ * @brief Print the lengths, the gain, the time and the input throughput
+ *        of a file or of the whole batch.
+ */
+static std::ostream& print_throughput(std::ostream& os, uint64_t len, uint64_t compressed_len, double seconds)
+{
+    double gain = len ? 1.0 - static_cast<double>(compressed_len) / static_cast<double>(len) : 0.0;
+
+    os << "original: " << len << ", compressed: " << compressed_len
+       << ", gained: " << std::fixed << std::setprecision(2) << gain*100 << "%, "
+       << std::setprecision(3) << seconds << " s, "
+       << (seconds > 0 ? len / seconds / 1000000.0 : 0.0) << " MB/s";
+    return os;
+}
+
+static void batch_usage(char* prg)
+{
+    std::cerr << "ZXPAC4 v" << ZXPAC4_MAJOR << "." << ZXPAC4_MINOR << " (c) 2022-24 Jouni 'Mr.Spiv' Korhonen\n\n";
+    std::cerr << "Usage: " << prg << " " << BATCH_NAME << " [options] manifest\n";
+    std::cerr << " Each line of the manifest is a command line without the program name, i.e.\n"
+              << " 'target [options] infile [outfile]'. Empty lines and lines starting with '#'\n"
+              << " are skipped.\n";
+    std::cerr << " Options:\n";
+    std::cerr << "  --jobs,-j num         Number of files compressed in parallel, 0 for all cores (default 0).\n";
+    std::cerr << "  --help,-h             Print this output ;)\n";
+    std::cerr << std::flush;
+    exit(EXIT_FAILURE); 
+}
+
+/**
+ * @brief The batch mode: compress the files of a manifest in one process.
+ *
+ *  The manifest is parsed up front like separate command lines. Then a
+ *  pool of workers takes the files in the manifest order. Each worker
+ *  reuses its engine for the files with the same LZ configuration, thus
+ *  the matcher and cost table allocation and the engine setup are paid
+ *  once per worker instead of once per file. The compressed files are
+ *  identical to the ones of separate command lines.
+ *
+ * @param[in] argc The number of arguments.
+ * @param[in] argv The arguments, BATCH_NAME at argv[1].
+ *
+ * @return EXIT_SUCCESS if all files were compressed.
+ */
+static int batch_main(int argc, char** argv)
+{
+    static struct option batch_longopts[] = {
+        {"jobs",        required_argument,  NULL, 'j'},
+        {"help",        no_argument,        NULL, 'h'},
+        {0,0,0,0}
+    };
+    std::vector<std::vector<std::string> > lines;
+    std::vector<std::vector<char*> > line_argv;
+    std::vector<int> line_numbers;
+    std::vector<compress_job> jobs;
+    std::set<std::string> outfile_names;
+    std::ifstream mfs;
+    std::string line;
+    std::string token;
+    char* endptr;
+    int num_workers = 0;
+    int line_number = 0;
+    int n;
+
+    optind = 2;
+
+    while ((n = getopt_long(argc, argv, "j:h", batch_longopts, NULL)) != -1) {
+        switch (n) {
+            case 'j':   // --jobs
+                num_workers = std::strtoul(optarg,&endptr,10);
+                if (*endptr != '\0' || num_workers < 0 || num_workers > MAX_THREADS) {
+                    std::cerr << ERR_PREAMBLE << "Invalid --jobs value '" << optarg << "'\n";
+                    batch_usage(argv[0]);
+                }
+                break;
+            default:
+                batch_usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1) {
+        batch_usage(argv[0]);
+    }
+
+    mfs.open(argv[optind]);
+    if (mfs.is_open() == false) {
+        std::cerr << ERR_PREAMBLE << "failed to open manifest '" << argv[optind] << "'\n";
+        return EXIT_FAILURE;
+    }
+    while (std::getline(mfs,line)) {
+        std::istringstream iss(line);
+        std::vector<std::string> tokens;
+
+        ++line_number;
+
+        while (iss >> token) {
+            tokens.push_back(token);
+        }
+        if (tokens.empty() || tokens[0][0] == '#') {
+            continue;
+        }
+
+        lines.push_back(tokens);
+        line_numbers.push_back(line_number);
+    }
+
+    // The jobs point to the option strings, thus all lines are kept
+    // until the batch is done
+    line_argv.resize(lines.size());
+    jobs.resize(lines.size());
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        std::vector<char*>& args = line_argv[i];
+
+        args.push_back(argv[0]);
+        for (std::string& s : lines[i]) {
+            args.push_back(&s[0]);
+        }
+        args.push_back(NULL);
+
+        for (n = 0; n < LZ_TARGET_SIZE; n++) {
+            if (!strcmp(args[1],my_targets[n].target_name)) {
+                break;
+            }
+        }
+        if (n == LZ_TARGET_SIZE) {
+            std::cerr << ERR_PREAMBLE << "unknown target '" << args[1] << "' on manifest line "
+                      << line_numbers[i] << "\n";
+            return EXIT_FAILURE;
+        }
+
+        parse_command_line(args.size() - 1,args.data(),jobs[i]);
+
+        if (!outfile_names.insert(jobs[i].outfile_name).second) {
+            std::cerr << ERR_PREAMBLE << "output file '" << jobs[i].outfile_name << "' on manifest line "
+                      << line_numbers[i] << " is written twice\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (num_workers == 0) {
+        num_workers = std::thread::hardware_concurrency();
+
+        if (num_workers == 0) {
+            num_workers = 1;
+        } else if (num_workers > MAX_THREADS) {
+            num_workers = MAX_THREADS;
+        }
+    }
+    if (num_workers > static_cast<int>(jobs.size())) {
+        num_workers = jobs.size() > 0 ? jobs.size() : 1;
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next_job(0);
+    std::atomic<uint64_t> total_len(0);
+    std::atomic<uint64_t> total_compressed_len(0);
+    std::atomic<int> num_failed(0);
+    std::mutex report_lock;
+    auto batch_start = std::chrono::steady_clock::now();
+
+    auto worker = [&](void) {
+        batch_worker w;
+        size_t i;
+
+        while ((i = next_job++) < jobs.size()) {
+            auto start = std::chrono::steady_clock::now();
+            int file_len = 0;
+            int compressed_len = batch_file(w,jobs[i],file_len);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            std::lock_guard<std::mutex> lock(report_lock);
+
+            if (compressed_len < 0) {
+                std::cerr << ERR_PREAMBLE << "compression of '" << jobs[i].infile_name << "' failed\n";
+                ++num_failed;
+                continue;
+            }
+
+            total_len += file_len;
+            total_compressed_len += compressed_len;
+            print_throughput(std::cout << jobs[i].infile_name << ": ",file_len,compressed_len,
+                seconds.count()) << std::endl;
+        }
+    };
+
+    for (n = 1; n < num_workers; n++) {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - batch_start;
+
+    print_throughput(std::cout << "Batch of " << jobs.size() << " files, " << num_failed << " failed, "
+        << num_workers << " workers: ",total_len,total_compressed_len,seconds.count()) << std::endl;
+
+    return num_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+int main(int argc, char** argv)
+{
+    int file_len = -1;
+    int compressed_len = 0;
+    lz_base* lz = NULL;
+    compress_job job;
+
+    std::ifstream ifs;
+    std::ofstream ofs;
+
+    if (argc >= 2 && !strcmp(argv[1],BATCH_NAME)) {
+        return batch_main(argc,argv);
+    }
+    if (argc >= 2 && !strcmp(argv[1],BENCH_NAME)) {
+        return bench_main(argc,argv);
+    }
+
+    parse_command_line(argc,argv,job);
+
+    // The following stuff is horrible.. Needs to be hidden under
+    // multiple functions to avoid recurring cleanup due initialization
+    // failures..
+
+    if ((file_len = open_input_file(job,ifs)) < 0) {
+        goto error_exit;
+    }
+    if ((lz = create_engine(&job.cfg)) == NULL) {
         goto error_exit;
     }
     try {
@@ -889,25 +1783,20 @@ int main(int argc, char** argv)
         goto error_exit;
     }
    
-    cfg.algorithm = cfg_algo;
-    
 	// *FIX* these are redundant
 	//lz->set_debug_level(cfg_debug_level);
     //lz->enable_verbose(cfg_verbose_on);
     
-    if (cfg_verbose_on) {
-        std::cout << "Loading from file '" << cfg_infile_name << "'\n";
-        std::cout << "File length is " << file_len << "\n";
-        std::cout << "Saving to file '" << cfg_outfile_name << "'\n";
-        std::cout << "Using target '" << trg->target_name << "' and algorithm " << cfg.algorithm << "\n";
-        std::cout << "Min match is " << cfg.min_match << "\n";
-        std::cout << "Max match is " << cfg.max_match << "\n";
-        std::cout << "Good match is " << cfg.good_match << "\n";
+    if (job.cfg.verbose) {
+        print_config(job,file_len);
     }
 
-    ofs.open(cfg_outfile_name,std::ios::binary|std::ios::out);
+    ofs.open(job.outfile_name,std::ios::binary|std::ios::out);
     if (ofs.is_open()) {
-        compressed_len = handle_file(trg,lz,&cfg,ifs,ofs,file_len);
+        auto start = std::chrono::steady_clock::now();
+        compressed_len = handle_file(&job.trg,lz,&job.cfg,job.infile_name,ifs,ofs,file_len,
+            job.verify,job.report_tstates,false);
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
         
         if (compressed_len < 0) {
             std::cerr << ERR_PREAMBLE << "compression failed\n";
@@ -918,7 +1807,14 @@ int main(int argc, char** argv)
         std::cout << std::dec << "Original: " << file_len << ", compressed: " << std::setprecision(4)
                   << compressed_len << ", gained: " << gain*100 << "%\n";
 
-        if (cfg_verbose_on) {
+        if (job.cfg.parse_split > 1 || job.cfg.verbose) {
+            // The ratio against the wall-clock time, to weigh --split-parse
+            std::cout << (job.cfg.parse_split > 1 ? "Split parse: " : "Serial parse: ");
+            print_throughput(std::cout,file_len,compressed_len,seconds.count()) << std::endl;
+            std::cout << std::defaultfloat;
+        }
+
+        if (job.cfg.verbose) {
             std::cout << "Number of literals: " << lz->get_num_literals() << std::endl;
             std::cout << "Number of matches: " << lz->get_num_matches() << std::endl;
             std::cout << "Number of matched bytes: " << lz->get_num_matched_bytes() << std::endl;
@@ -927,7 +1823,7 @@ int main(int argc, char** argv)
             std::cout << "Security distance: " << lz->get_security_distance() << std::endl;
         }
     } else {
-        std::cerr << ERR_PREAMBLE << "opening output file '" << cfg_outfile_name << "' failed\n";
+        std::cerr << ERR_PREAMBLE << "opening output file '" << job.outfile_name << "' failed\n";
     }
 
 error_exit:
@@ -0,0 +1,343 @@
+/**
+ * @file match_finder.cpp
+ * @version 0.2
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief A run time selectable string matcher for LZ engines.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <iostream>
+#include <cassert>
+#include <climits>
+#include "lz_util.h"
+#include "match_finder.h"
+#include "match_store.h"
+
+
+template<class M> static void init_get_matches_thunk(void* p, int max_matches, match* matches)
+{
+    static_cast<M*>(p)->init_get_matches(max_matches,matches);
+}
+
+template<class M> static int find_matches_thunk(void* p, const char* buf, int pos, int len, bool only_better)
+{
+    return static_cast<M*>(p)->find_matches(buf,pos,len,only_better);
+}
+
+template<class M> static void reinit_thunk(void* p)
+{
+    static_cast<M*>(p)->reinit();
+}
+
+template<class M> static void delete_thunk(void* p)
+{
+    delete static_cast<M*>(p);
+}
+
+template<class M> void match_finder::attach(M* p_matcher)
+{
+    m_matcher = p_matcher;
+    m_init_get_matches = init_get_matches_thunk<M>;
+    m_find_matches = find_matches_thunk<M>;
+    m_reinit = reinit_thunk<M>;
+    m_delete = delete_thunk<M>;
+}
+
+/**
+ * @brief Attach a hash chain matcher with the configured hash width
+ *        and the given chain link type.
+ */
+template<typename LINK_T> void match_finder::attach_hash(const lz_config* p_cfg)
+{
+    switch (p_cfg->hash_bytes) {
+    case 4:
+        attach(new hash3_mul4_t<LINK_T>(p_cfg->window_size,
+            p_cfg->min_match,
+            p_cfg->max_match,
+            p_cfg->good_match,
+            p_cfg->min_match2_threshold,
+            p_cfg->min_match3_threshold));
+        break;
+    case 3:
+        attach(new hash3_mul3_t<LINK_T>(p_cfg->window_size,
+            p_cfg->min_match,
+            p_cfg->max_match,
+            p_cfg->good_match,
+            p_cfg->min_match2_threshold,
+            p_cfg->min_match3_threshold));
+        break;
+    case 2:
+        attach(new hash3_t<LINK_T>(p_cfg->window_size,
+            p_cfg->min_match,
+            p_cfg->max_match,
+            p_cfg->good_match,
+            p_cfg->min_match2_threshold,
+            p_cfg->min_match3_threshold));
+        break;
+    default:
+        EXCEPTION(std::invalid_argument,"Unsupported hash width.");
+    }
+}
+
+match_finder::match_finder(const lz_config* p_cfg):
+    m_type(p_cfg->matcher),
+    m_matcher(NULL),
+    m_init_get_matches(NULL),
+    m_find_matches(NULL),
+    m_reinit(NULL),
+    m_delete(NULL),
+    m_store(NULL),
+    m_mtch(NULL),
+    m_max_chain(0),
+    m_found(NULL),
+    m_found_size(0),
+    m_nearest(NULL),
+    m_min_match(p_cfg->min_match),
+    m_max_match(p_cfg->max_match),
+    m_good_match(p_cfg->good_match)
+{
+    switch (m_type) {
+    case LZ_MATCHER_ZARRAY:
+    case LZ_MATCHER_ZARRAY_INC:
+        attach(new z_array(p_cfg->window_size,
+            p_cfg->min_match,
+            p_cfg->max_match,
+            p_cfg->good_match,
+            p_cfg->min_match2_threshold,
+            p_cfg->min_match3_threshold,
+            m_type == LZ_MATCHER_ZARRAY_INC));
+        break;
+    case LZ_MATCHER_SUFFIX:
+        attach(new suffix_array(p_cfg->window_size,
+            p_cfg->min_match,
+            p_cfg->max_match,
+            p_cfg->good_match,
+            p_cfg->min_match2_threshold,
+            p_cfg->min_match3_threshold));
+        break;
+    case LZ_MATCHER_BINTREE:
+        attach(new bintree(p_cfg->window_size,
+            p_cfg->min_match,
+            p_cfg->max_match,
+            p_cfg->good_match,
+            p_cfg->min_match2_threshold,
+            p_cfg->min_match3_threshold));
+        break;
+    case LZ_MATCHER_HASH3:
+        // Small windows get 16-bit chain links
+        if (p_cfg->window_size <= HASH_LINK16_WINDOW_MAX) {
+            attach_hash<uint16_t>(p_cfg);
+        } else {
+            attach_hash<uint32_t>(p_cfg);
+        }
+        break;
+    default:
+        EXCEPTION(std::invalid_argument,"Unknown string matcher.");
+    }
+    if (p_cfg->num_threads > 1 || p_cfg->match_cache || p_cfg->parse_split > 1) {
+        m_store = new match_store(p_cfg,p_cfg->num_threads > 1 ? p_cfg->num_threads : 1);
+    }
+    if (p_cfg->match_ladder) {
+        m_found_size = p_cfg->max_chain;
+        m_found = new match[m_found_size];
+        m_nearest = new int[(m_good_match < m_max_match ? m_good_match : m_max_match) + 2];
+    }
+}
+
+match_finder::~match_finder(void)
+{
+    if (m_matcher) {
+        m_delete(m_matcher);
+    }
+    if (m_store) {
+        delete m_store;
+    }
+    if (m_found) {
+        delete[] m_found;
+        delete[] m_nearest;
+    }
+}
+
+/**
+ * @brief The number of matches the caller's match array must hold.
+ *
+ * @param[in] p_cfg A ptr to the LZ configuration.
+ *
+ * @return --max-chain or, in the match ladder mode, the larger of
+ *         --max-chain and the number of possible ladder steps.
+ */
+int match_finder::match_array_size(const lz_config* p_cfg)
+{
+    int size = p_cfg->good_match < p_cfg->max_match ? p_cfg->good_match : p_cfg->max_match;
+
+    if (p_cfg->match_ladder && size + 1 > p_cfg->max_chain) {
+        return size + 1;
+    }
+
+    return p_cfg->max_chain;
+}
+
+/**
+ * @brief Turn the found matches into a match ladder.
+ *
+ * The found matches may come in any order and have several offsets for
+ * the same length. The ladder has exactly one match for each length from
+ * the minimum match to the good match, or to the longest found match if
+ * it is shorter, in increasing length order. The offset of each length is
+ * the nearest offset of all matches at least that long, which is never
+ * more expensive to encode than a farther one. A longest match beyond the
+ * good match is appended as the last step with its nearest offset, and
+ * the lengths between are left out to keep the cost calculation of long
+ * matches bounded.
+ *
+ * @param[in] num The number of matches in m_found.
+ *
+ * @return The number of matches in the ladder.
+ */
+int match_finder::build_ladder(int num)
+{
+    // Matches longer than the good match share the last slot
+    int top = m_good_match < m_max_match ? m_good_match : m_max_match;
+    int longest = 0;
+    int longest_offset = INT_MAX;
+    int offset;
+    int length;
+    int n;
+
+    for (n = m_min_match; n <= top + 1; n++) {
+        m_nearest[n] = INT_MAX;
+    }
+    for (n = 0; n < num; n++) {
+        offset = m_found[n].offset;
+        length = m_found[n].length;
+
+        if (length > longest) {
+            longest = length;
+            longest_offset = offset;
+        } else if (length == longest && offset < longest_offset) {
+            longest_offset = offset;
+        }
+        if (length > top) {
+            length = top + 1;
+        }
+        if (offset < m_nearest[length]) {
+            m_nearest[length] = offset;
+        }
+    }
+
+    offset = m_nearest[top + 1];
+
+    for (n = top; n >= m_min_match; n--) {
+        if (m_nearest[n] < offset) {
+            offset = m_nearest[n];
+        }
+        m_nearest[n] = offset;
+    }
+
+    num = 0;
+
+    for (n = m_min_match; n <= longest && n <= top; n++) {
+        m_mtch[num].offset = m_nearest[n];
+        m_mtch[num++].length = n;
+    }
+    if (longest > top) {
+        m_mtch[num].offset = longest_offset;
+        m_mtch[num++].length = longest;
+    }
+
+    return num;
+}
+
+void match_finder::impl_init_get_matches(int max_matches, match *matches)
+{
+    m_mtch = matches;
+    m_max_chain = max_matches;
+
+    if (m_found) {
+        // The raw matches go into m_found, and the ladder into matches
+        if (m_max_chain > m_found_size) {
+            m_max_chain = m_found_size;
+        }
+        m_init_get_matches(m_matcher,m_max_chain,m_found);
+    } else {
+        m_init_get_matches(m_matcher,m_max_chain,matches);
+    }
+}
+
+int match_finder::impl_find_matches(const char *buf, int pos, int len, bool only_better_matches)
+{
+    int num;
+
+    if (m_store) {
+        if (pos == 0) {
+            m_store->stream(buf,len,m_max_chain,only_better_matches);
+        }
+
+        num = m_store->next_matches(pos,m_found ? m_found : m_mtch,m_max_chain);
+
+        if (len <= 1) {
+            // The last position of the input..
+            m_store->release();
+        }
+    } else {
+        num = m_find_matches(m_matcher,buf,pos,len,only_better_matches);
+    }
+    if (m_found) {
+        num = build_ladder(num);
+    }
+
+    return num;
+}
+
+/**
+ * @brief Search all matches of the input into the match store.
+ *
+ * @param[in] buf       A ptr to the input buffer.
+ * @param[in] len       The length of the input.
+ * @param[in] max_chain The maximum number of matches per position.
+ * @param[in] only_better_matches True if later matches must be longer.
+ *
+ * @return none.
+ * @throw std::logic_error if there is no match store.
+ */
+void match_finder::store_matches(const char* buf, int len, int max_chain, bool only_better_matches)
+{
+    if (m_store == NULL) {
+        EXCEPTION(std::logic_error,"No match store to search into.");
+    }
+
+    m_store->search(buf,len,max_chain,only_better_matches);
+}
+
+/**
+ * @brief Copy the stored matches of a position. Safe to call from
+ *        several threads, thus the match ladder is not supported.
+ *
+ * @param[in]  pos         The position in the input buffer.
+ * @param[out] matches     A ptr to the array to copy the matches into.
+ * @param[in]  max_matches The size of the @p matches array.
+ *
+ * @return Number of copied matches or 0.
+ */
+int match_finder::get_stored_matches(int pos, match* matches, int max_matches) const
+{
+    assert(m_store && m_found == NULL);
+    return m_store->get_matches(pos,matches,max_matches);
+}
+
+void match_finder::release_matches(void)
+{
+    if (m_store) {
+        m_store->release();
+    }
+}
+
+void match_finder::impl_reinit(void)
+{
+    if (m_store) {
+        m_store->release();
+    }
+
+    m_reinit(m_matcher);
+}
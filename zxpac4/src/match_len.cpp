@@ -0,0 +1,128 @@
+/**
+ * @file match_len.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Match length extension kernels for string matchers and cost
+ *        calculation.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <cstdint>
+#include <cstring>
+#include "match_len.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+/**
+ * @brief Portable kernel comparing 8 bytes per step.
+ */
+int match_length_u64(const char* s, const char* d, int max)
+{
+    uint64_t a, b;
+    int len = 0;
+
+    while (len + 8 <= max) {
+        ::memcpy(&a,s + len,8);
+        ::memcpy(&b,d + len,8);
+
+        if (a ^ b) {
+            return len + match_length_diff64(a ^ b);
+        }
+
+        len += 8;
+    }
+    while (len < max && s[len] == d[len]) {
+        ++len;
+    }
+
+    return len;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * @brief SSE2 kernel comparing 16 bytes per step.
+ */
+__attribute__((target("sse2")))
+int match_length_sse2(const char* s, const char* d, int max)
+{
+    unsigned mask;
+    int len = 0;
+
+    while (len + 16 <= max) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + len));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + len));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a,b)) ^ 0xffff;
+
+        if (mask) {
+            return len + __builtin_ctz(mask);
+        }
+
+        len += 16;
+    }
+
+    return len + match_length_u64(s + len,d + len,max - len);
+}
+
+/**
+ * @brief AVX2 kernel comparing 32 bytes per step.
+ */
+__attribute__((target("avx2")))
+int match_length_avx2(const char* s, const char* d, int max)
+{
+    unsigned mask;
+    int len = 0;
+
+    while (len + 32 <= max) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + len));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + len));
+        mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a,b)));
+
+        if (mask) {
+            return len + __builtin_ctz(mask);
+        }
+
+        len += 32;
+    }
+
+    // The tail runs non-VEX SSE2 code, which stalls on dirty upper halves
+    // of the ymm registers
+    _mm256_zeroupper();
+    return len + match_length_sse2(s + len,d + len,max - len);
+}
+
+#endif  // __x86_64__ || __i386__
+
+static match_len_func_t select_match_length(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return match_length_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return match_length_sse2;
+    }
+#endif
+    return match_length_u64;
+}
+
+match_len_func_t match_length_long = select_match_length();
+
+const char* match_length_kernel_name(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (match_length_long == match_length_avx2) {
+        return "avx2";
+    }
+    if (match_length_long == match_length_sse2) {
+        return "sse2";
+    }
+#endif
+    return "u64";
+}
@@ -0,0 +1,808 @@
+/**
+ * @file match_store.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Multi-threaded match search into a per-position match store.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <new>
+#include <fstream>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lz_util.h"
+#include "match_finder.h"
+#include "match_store.h"
+
+
+match_store::match_store(const lz_config* p_cfg, int num_threads):
+    m_lz_config(p_cfg),
+    m_num_threads(num_threads),
+    m_shard_size(0),
+    m_memory(0),
+    m_peak_memory(0),
+    m_streaming(false),
+    m_buf(NULL),
+    m_len(0),
+    m_max_chain(0),
+    m_only_better(false),
+    m_next(0),
+    m_current(0),
+    m_ready(false),
+    m_stop(false),
+    m_cache_base(0),
+    m_map(NULL),
+    m_map_size(0),
+    m_map_index(NULL),
+    m_map_matches(NULL),
+    m_map_len(0)
+{
+    if (num_threads < 1) {
+        EXCEPTION(std::invalid_argument,"Number of threads must be at least 1.");
+    }
+}
+
+match_store::~match_store(void)
+{
+    release();
+}
+
+void match_store::release(void)
+{
+    stop_stream();
+
+    if (m_map) {
+        ::munmap(m_map,m_map_size);
+    }
+
+    m_map = NULL;
+    m_map_size = 0;
+    m_map_index = NULL;
+    m_map_matches = NULL;
+    m_map_len = 0;
+    m_shards.clear();
+    m_shards.shrink_to_fit();
+    m_shard_size = 0;
+    m_memory = 0;
+    m_peak_memory = 0;
+}
+
+/**
+ * @brief Stop the workers of a streamed search. If the cache file is being
+ *        written and every shard was searched, the rest of the shards are
+ *        written into it before it is closed.
+ *
+ * @return none
+ */
+void match_store::stop_stream(void)
+{
+    bool complete = true;
+
+    if (!m_streaming) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_cond.notify_all();
+
+    for (auto& t : m_workers) {
+        t.join();
+    }
+
+    m_workers.clear();
+
+    for (auto& s : m_shards) {
+        if (!s.done || s.error) {
+            complete = false;
+        }
+    }
+    if (m_lz_config->match_cache) {
+        while (complete && m_current < static_cast<int>(m_shards.size())) {
+            retire_shard(m_current);
+        }
+
+        close_cache(complete);
+    }
+    if (m_lz_config->verbose) {
+        std::cout << "Match store peak memory " << (m_peak_memory + 1023) / 1024
+                  << " KB" << std::endl;
+    }
+
+    m_streaming = false;
+}
+
+/**
+ * @brief Split the input into shards of @p shard_size positions.
+ *
+ * @param[in] len        The length of the input buffer.
+ * @param[in] shard_size The number of positions in a shard.
+ *
+ * @return none
+ */
+void match_store::init_shards(int len, int shard_size)
+{
+    int num_shards = (len + shard_size - 1) / shard_size;
+
+    m_shard_size = shard_size;
+    m_shards.clear();
+    m_shards.resize(num_shards);
+
+    for (int n = 0; n < num_shards; n++) {
+        m_shards[n].start = n * m_shard_size;
+        m_shards[n].end = m_shards[n].start + m_shard_size;
+        m_shards[n].done = false;
+
+        if (m_shards[n].end > len) {
+            m_shards[n].end = len;
+        }
+    }
+}
+
+/**
+ * @brief The bytes allocated for the matches of a shard.
+ */
+size_t match_store::shard_memory(const shard* p_shard)
+{
+    return sizeof(int) * p_shard->index.capacity()
+        + sizeof(match) * p_shard->matches.capacity();
+}
+
+/**
+ * @brief Search matches for positions of a shard with a private matcher.
+ *
+ * @param[in] buf         A ptr to the input buffer.
+ * @param[in] len         The length of the whole input buffer.
+ * @param[inout] p_shard  A ptr to the shard to search.
+ * @param[in] max_chain   The maximum number of matches per position.
+ * @param[in] only_better_matches Passed to the matcher.
+ *
+ * @return none. Running out of memory throws std::runtime_error.
+ */
+void match_store::search_shard(const char* buf, int len, shard* p_shard,
+    int max_chain, bool only_better_matches)
+{
+    lz_config cfg = *m_lz_config;
+    cfg.num_threads = 1;
+    cfg.match_cache = NULL;
+    cfg.parse_split = 1;
+    // The store holds raw matches, the caller's match_finder builds the ladder
+    cfg.match_ladder = false;
+    int pos = p_shard->start - cfg.window_size;
+    int num;
+
+    if (pos < 0) {
+        pos = 0;
+    }
+
+    try {
+        match_finder lz(&cfg);
+        std::vector<match> mtch(max_chain > 0 ? max_chain : 1);
+
+        lz.init_get_matches(max_chain,mtch.data());
+
+        // Build up the history preceding the shard..
+        for (; pos < p_shard->start; pos++) {
+            lz.find_matches(buf,pos,len-pos,only_better_matches);
+        }
+
+        p_shard->index.resize(p_shard->end - p_shard->start + 1);
+        p_shard->matches.clear();
+        // A few matches per position avoid most of the regrowth. Reserving
+        // max_chain per position could need gigabytes with a high -c.
+        p_shard->matches.reserve(static_cast<size_t>(p_shard->end - p_shard->start) *
+            std::clamp(max_chain,1,MATCH_STORE_RESERVE));
+
+        for (; pos < p_shard->end; pos++) {
+            p_shard->index[pos - p_shard->start] = p_shard->matches.size();
+            num = lz.find_matches(buf,pos,len-pos,only_better_matches);
+            p_shard->matches.insert(p_shard->matches.end(),mtch.begin(),mtch.begin()+num);
+        }
+
+        p_shard->index[pos - p_shard->start] = p_shard->matches.size();
+    } catch (std::bad_alloc&) {
+        EXCEPTION(std::runtime_error,"Out of memory in the match search. Try fewer --threads or a smaller --max-chain.");
+    }
+}
+
+/**
+ * @brief Find matches for every position of the input. Shards are
+ *        searched in parallel, the calling thread taking the first one.
+ *        The suffix array matcher builds its tables over the whole input
+ *        thus it is always run in one shard. If a match cache directory
+ *        is configured, matches are loaded from or saved into it.
+ *
+ * @param[in] buf       A ptr to the input buffer.
+ * @param[in] len       The length of the input buffer.
+ * @param[in] max_chain The maximum number of matches per position.
+ * @param[in] only_better_matches Passed to the matchers.
+ *
+ * @return none. Exceptions thrown by matchers are passed to the caller.
+ */
+void match_store::search(const char* buf, int len, int max_chain, bool only_better_matches)
+{
+    int min_shard = m_lz_config->window_size;
+    int num_shards;
+    int n;
+    cache_header hdr;
+
+    release();
+
+    if (m_lz_config->match_cache) {
+        init_cache_header(&hdr,buf,len,max_chain,only_better_matches);
+
+        if (load_cache(&hdr)) {
+            return;
+        }
+    }
+
+    if (min_shard < MATCH_STORE_MIN_SHARD) {
+        min_shard = MATCH_STORE_MIN_SHARD;
+    }
+
+    num_shards = (len + min_shard - 1) / min_shard;
+
+    if (num_shards > m_num_threads) {
+        num_shards = m_num_threads;
+    }
+    if (num_shards < 1 || m_lz_config->matcher == LZ_MATCHER_SUFFIX) {
+        num_shards = 1;
+    }
+
+    m_shard_size = (len + num_shards - 1) / num_shards;
+
+    init_shards(len,m_shard_size > 0 ? m_shard_size : 1);
+
+    if (m_lz_config->verbose) {
+        std::cout << "Searching matches in " << num_shards << " shard(s)" << std::endl;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(num_shards);
+
+    auto worker = [&](int s) {
+        try {
+            search_shard(buf,len,&m_shards[s],max_chain,only_better_matches);
+        } catch (...) {
+            errors[s] = std::current_exception();
+        }
+    };
+
+    for (n = 1; n < num_shards; n++) {
+        threads.emplace_back(worker,n);
+    }
+
+    worker(0);
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+    for (auto& s : m_shards) {
+        s.done = true;
+        m_memory += shard_memory(&s);
+    }
+
+    m_peak_memory = m_memory;
+
+    if (m_lz_config->verbose) {
+        std::cout << "Match store memory " << (m_memory + 1023) / 1024
+                  << " KB" << std::endl;
+    }
+    if (m_lz_config->match_cache) {
+        save_cache(&hdr);
+    }
+}
+
+/**
+ * @brief Start searching matches for every position of the input, which
+ *        are then consumed in the increasing position order with
+ *        next_matches(). Shards of the window size (or 64K) are searched
+ *        by worker threads at most the number of threads ahead of the
+ *        consumer. The suffix array matcher is run in one shard. If a
+ *        match cache directory is configured, matches are loaded from it
+ *        or written into it as the consumer moves past each shard.
+ *
+ * @param[in] buf       A ptr to the input buffer. Must stay valid until
+ *                      release().
+ * @param[in] len       The length of the input buffer.
+ * @param[in] max_chain The maximum number of matches per position.
+ * @param[in] only_better_matches Passed to the matchers.
+ *
+ * @return none
+ */
+void match_store::stream(const char* buf, int len, int max_chain, bool only_better_matches)
+{
+    int shard_size = m_lz_config->window_size;
+    int num_workers;
+
+    release();
+
+    if (m_lz_config->match_cache) {
+        init_cache_header(&m_hdr,buf,len,max_chain,only_better_matches);
+
+        if (load_cache(&m_hdr)) {
+            return;
+        }
+    }
+
+    if (shard_size < MATCH_STORE_MIN_SHARD) {
+        shard_size = MATCH_STORE_MIN_SHARD;
+    }
+    if (shard_size > len || m_lz_config->matcher == LZ_MATCHER_SUFFIX) {
+        shard_size = len > 0 ? len : 1;
+    }
+
+    init_shards(len,shard_size);
+
+    m_buf = buf;
+    m_len = len;
+    m_max_chain = max_chain;
+    m_only_better = only_better_matches;
+    m_next = 0;
+    m_current = 0;
+    m_ready = false;
+    m_stop = false;
+    m_streaming = true;
+
+    if (m_lz_config->match_cache) {
+        open_cache();
+    }
+
+    num_workers = m_num_threads;
+
+    if (num_workers > static_cast<int>(m_shards.size())) {
+        num_workers = m_shards.size();
+    }
+    if (m_lz_config->verbose) {
+        std::cout << "Streaming matches in " << m_shards.size() << " shard(s) of "
+                  << m_shard_size << " positions with " << num_workers
+                  << " thread(s)" << std::endl;
+    }
+    for (int n = 0; n < num_workers; n++) {
+        m_workers.emplace_back(&match_store::stream_worker,this);
+    }
+}
+
+/**
+ * @brief A worker thread of the streamed search. Takes the next shard
+ *        unless it is too far ahead of the consumer.
+ *
+ * @return none. Exceptions are stored into the shard.
+ */
+void match_store::stream_worker(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    int s;
+
+    while (!m_stop && m_next < static_cast<int>(m_shards.size())) {
+        if (m_next > m_current + m_num_threads) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        s = m_next++;
+        lock.unlock();
+
+        try {
+            search_shard(m_buf,m_len,&m_shards[s],m_max_chain,m_only_better);
+        } catch (...) {
+            m_shards[s].error = std::current_exception();
+        }
+
+        lock.lock();
+        m_shards[s].done = true;
+        m_memory += shard_memory(&m_shards[s]);
+
+        if (m_memory > m_peak_memory) {
+            m_peak_memory = m_memory;
+        }
+
+        m_cond.notify_all();
+    }
+}
+
+/**
+ * @brief Release the matches of the consumer's shard once it has moved
+ *        past it and let the workers search one more shard. The shard is
+ *        written into the cache file first, if there is one.
+ *
+ * @param[in] s The shard of the consumer.
+ *
+ * @return none
+ */
+void match_store::retire_shard(int s)
+{
+    shard* p_shard = &m_shards[s];
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_cond.wait(lock,[p_shard] { return p_shard->done; });
+    lock.unlock();
+
+    if (m_cache.is_open() && !p_shard->error) {
+        uint32_t index;
+
+        m_cache.seekp(sizeof(cache_header) + sizeof(uint32_t) * p_shard->start);
+
+        for (int n = 0; n < p_shard->end - p_shard->start; n++) {
+            index = m_cache_base + p_shard->index[n];
+            m_cache.write(reinterpret_cast<const char*>(&index),sizeof(index));
+        }
+
+        m_cache.seekp(sizeof(cache_header) + sizeof(uint32_t) * (m_len + 1)
+            + sizeof(match) * static_cast<size_t>(m_cache_base));
+        m_cache.write(reinterpret_cast<const char*>(p_shard->matches.data()),
+            sizeof(match) * p_shard->matches.size());
+        m_cache_base += p_shard->matches.size();
+    }
+
+    lock.lock();
+    m_memory -= shard_memory(p_shard);
+    std::vector<int>().swap(p_shard->index);
+    std::vector<match>().swap(p_shard->matches);
+    m_current = s + 1;
+    m_ready = false;
+    lock.unlock();
+    m_cond.notify_all();
+}
+
+/**
+ * @brief Copy matches of a position from a searched shard.
+ */
+int match_store::copy_matches(const shard* p_shard, int pos, match* matches, int max_matches) const
+{
+    int n = p_shard->index[pos - p_shard->start];
+    int num = p_shard->index[pos - p_shard->start + 1] - n;
+
+    if (num > max_matches) {
+        num = max_matches;
+    }
+    for (int i = 0; i < num; i++) {
+        matches[i] = p_shard->matches[n + i];
+    }
+
+    return num;
+}
+
+/**
+ * @brief Copy the matches of a position of a streamed search. Positions
+ *        must be asked in the increasing order; the shards before @p pos
+ *        are released. Waits until the shard of @p pos has been searched.
+ *
+ * @param[in] pos         The position in the input buffer.
+ * @param[out] matches    A ptr to the array to copy the matches into.
+ * @param[in] max_matches The size of the @p matches array.
+ *
+ * @return Number of copied matches or 0. An exception thrown by the
+ *         matcher of the shard stops the workers and is passed to the
+ *         caller.
+ */
+int match_store::next_matches(int pos, match* matches, int max_matches)
+{
+    shard* p_shard;
+    int n;
+
+    if (!m_streaming) {
+        return get_matches(pos,matches,max_matches);
+    }
+    if (pos < 0 || pos >= m_len) {
+        return 0;
+    }
+
+    n = pos / m_shard_size;
+    p_shard = &m_shards[n];
+    assert(n >= m_current);
+
+    if (n != m_current || !m_ready) {
+        while (m_current < n) {
+            retire_shard(m_current);
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock,[p_shard] { return p_shard->done; });
+        lock.unlock();
+
+        if (p_shard->error) {
+            std::exception_ptr error = p_shard->error;
+
+            // The caller may free the input buffer while unwinding
+            stop_stream();
+            std::rethrow_exception(error);
+        }
+
+        m_ready = true;
+    }
+
+    return copy_matches(p_shard,pos,matches,max_matches);
+}
+
+/**
+ * @brief Copy stored matches of a position.
+ *
+ * @param[in] pos         The position in the input buffer.
+ * @param[out] matches    A ptr to the array to copy the matches into.
+ * @param[in] max_matches The size of the @p matches array.
+ *
+ * @return Number of copied matches or 0.
+ */
+int match_store::get_matches(int pos, match* matches, int max_matches) const
+{
+    const shard* p_shard;
+    int num;
+    int n;
+
+    if (m_map_index) {
+        if (pos < 0 || pos >= m_map_len) {
+            return 0;
+        }
+
+        n = m_map_index[pos];
+        num = m_map_index[pos+1] - n;
+
+        if (num > max_matches) {
+            num = max_matches;
+        }
+
+        ::memcpy(matches,m_map_matches+n,sizeof(*matches)*num);
+        return num;
+    }
+    if (m_shard_size < 1 || pos < 0) {
+        return 0;
+    }
+
+    n = pos / m_shard_size;
+
+    if (n >= static_cast<int>(m_shards.size())) {
+        return 0;
+    }
+
+    p_shard = &m_shards[n];
+    return copy_matches(p_shard,pos,matches,max_matches);
+}
+
+/**
+ * @brief Fill in the cache header for the current search. The input
+ *        is hashed with 64-bit FNV-1a.
+ *
+ * @param[out] p_hdr     A ptr to the header to initialize.
+ * @param[in] buf        A ptr to the input buffer.
+ * @param[in] len        The length of the input buffer.
+ * @param[in] max_chain  The maximum number of matches per position.
+ * @param[in] only_better_matches Passed to the matchers.
+ *
+ * @return none
+ */
+void match_store::init_cache_header(cache_header* p_hdr, const char* buf, int len,
+    int max_chain, bool only_better_matches)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int n = 0; n < len; n++) {
+        hash ^= static_cast<uint8_t>(buf[n]);
+        hash *= 0x100000001b3ULL;
+    }
+
+    ::memset(p_hdr,0,sizeof(*p_hdr));
+    p_hdr->magic = MATCH_CACHE_MAGIC;
+    p_hdr->version = MATCH_CACHE_VERSION;
+    p_hdr->hash = hash;
+    p_hdr->len = len;
+    p_hdr->window_size = m_lz_config->window_size;
+    p_hdr->min_match = m_lz_config->min_match;
+    p_hdr->max_match = m_lz_config->max_match;
+    p_hdr->good_match = m_lz_config->good_match;
+    p_hdr->max_chain = max_chain;
+    p_hdr->min_match2_threshold = m_lz_config->min_match2_threshold;
+    p_hdr->min_match3_threshold = m_lz_config->min_match3_threshold;
+    p_hdr->matcher = m_lz_config->matcher;
+    p_hdr->hash_bytes = m_lz_config->hash_bytes;
+    p_hdr->only_better_matches = only_better_matches;
+}
+
+/**
+ * @brief The size of a cache file with the given header.
+ */
+size_t match_store::cache_size(const cache_header* p_hdr)
+{
+    return sizeof(cache_header) + sizeof(uint32_t) * (p_hdr->len + 1)
+        + sizeof(match) * static_cast<size_t>(p_hdr->num_matches);
+}
+
+/**
+ * @brief The cache file name is a hash over the header fields that
+ *        must match, i.e. everything up to the number of matches.
+ */
+std::string match_store::cache_file_name(const cache_header* p_hdr)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(p_hdr);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char name[32];
+
+    for (size_t n = 0; n < offsetof(cache_header,num_matches); n++) {
+        hash ^= p[n];
+        hash *= 0x100000001b3ULL;
+    }
+
+    std::snprintf(name,sizeof(name),"%016llx.zxm",
+        static_cast<unsigned long long>(hash));
+    return std::string(m_lz_config->match_cache) + "/" + name;
+}
+
+/**
+ * @brief Memory map a cache file with matching parameters.
+ *
+ * @param[in] p_hdr A ptr to the header of the current search.
+ *
+ * @return true if the matches are now served from the cache file.
+ */
+bool match_store::load_cache(const cache_header* p_hdr)
+{
+    std::string name = cache_file_name(p_hdr);
+    const cache_header* p_file;
+    struct stat st;
+    size_t size;
+    void* map;
+    int fd;
+
+    if ((fd = ::open(name.c_str(),O_RDONLY)) < 0) {
+        return false;
+    }
+    if (::fstat(fd,&st) < 0 || st.st_size < static_cast<off_t>(sizeof(cache_header))) {
+        ::close(fd);
+        return false;
+    }
+
+    size = st.st_size;
+    map = ::mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    p_file = static_cast<const cache_header*>(map);
+
+    if (::memcmp(p_file,p_hdr,offsetof(cache_header,num_matches)) ||
+        size != cache_size(p_file)) {
+        ::munmap(map,size);
+        return false;
+    }
+
+    m_map = map;
+    m_map_size = size;
+    m_map_len = p_hdr->len;
+    m_map_index = reinterpret_cast<const uint32_t*>(p_file + 1);
+    m_map_matches = reinterpret_cast<const match*>(m_map_index + m_map_len + 1);
+
+    if (m_lz_config->verbose) {
+        std::cout << "Using match cache '" << name << "'" << std::endl;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Save the stored matches into the cache directory. The file is
+ *        written under a temporary name and renamed when complete. A
+ *        failure to save the cache is not fatal.
+ *
+ * @param[inout] p_hdr A ptr to the header of the current search.
+ *
+ * @return none
+ */
+void match_store::save_cache(cache_header* p_hdr)
+{
+    std::string name = cache_file_name(p_hdr);
+    std::string tmp_name = name + ".tmp";
+    std::ofstream ofs;
+    uint32_t base = 0;
+    uint32_t index;
+
+    p_hdr->num_matches = 0;
+
+    for (auto& s : m_shards) {
+        p_hdr->num_matches += s.matches.size();
+    }
+
+    ofs.open(tmp_name,std::ios::binary|std::ios::out|std::ios::trunc);
+
+    if (ofs.is_open()) {
+        ofs.write(reinterpret_cast<const char*>(p_hdr),sizeof(*p_hdr));
+
+        for (auto& s : m_shards) {
+            for (int n = 0; n < s.end - s.start; n++) {
+                index = base + s.index[n];
+                ofs.write(reinterpret_cast<const char*>(&index),sizeof(index));
+            }
+
+            base += s.matches.size();
+        }
+
+        ofs.write(reinterpret_cast<const char*>(&base),sizeof(base));
+
+        for (auto& s : m_shards) {
+            ofs.write(reinterpret_cast<const char*>(s.matches.data()),
+                sizeof(match) * s.matches.size());
+        }
+
+        ofs.close();
+    }
+    if (ofs.fail() || std::rename(tmp_name.c_str(),name.c_str())) {
+        std::cerr << "**Warning: failed to save match cache '" << name << "'\n";
+        std::remove(tmp_name.c_str());
+    } else if (m_lz_config->verbose) {
+        std::cout << "Saved match cache '" << name << "' (" << (cache_size(p_hdr) + 1023) / 1024
+                  << " KB)" << std::endl;
+    }
+}
+
+/**
+ * @brief Create the cache file of a streamed search under a temporary
+ *        name. The header is written last when the number of matches
+ *        is known. Shards are written into it by retire_shard().
+ *
+ * @return none
+ */
+void match_store::open_cache(void)
+{
+    std::string tmp_name = cache_file_name(&m_hdr) + ".tmp";
+
+    m_cache_base = 0;
+    m_cache.open(tmp_name,std::ios::binary|std::ios::out|std::ios::trunc);
+}
+
+/**
+ * @brief Finish the cache file of a streamed search and rename it, or
+ *        remove it if the search did not complete. A failure to save the
+ *        cache is not fatal.
+ *
+ * @param[in] complete True if every shard was written into the file.
+ *
+ * @return none
+ */
+void match_store::close_cache(bool complete)
+{
+    std::string name = cache_file_name(&m_hdr);
+    std::string tmp_name = name + ".tmp";
+
+    if (m_cache.is_open()) {
+        if (complete) {
+            m_hdr.num_matches = m_cache_base;
+            m_cache.seekp(sizeof(cache_header) + sizeof(uint32_t) * m_len);
+            m_cache.write(reinterpret_cast<const char*>(&m_cache_base),sizeof(m_cache_base));
+            m_cache.seekp(0);
+            m_cache.write(reinterpret_cast<const char*>(&m_hdr),sizeof(m_hdr));
+        }
+
+        m_cache.close();
+    }
+    if (!complete) {
+        std::remove(tmp_name.c_str());
+    } else if (m_cache.fail() || std::rename(tmp_name.c_str(),name.c_str())) {
+        std::cerr << "**Warning: failed to save match cache '" << name << "'\n";
+        std::remove(tmp_name.c_str());
+    } else if (m_lz_config->verbose) {
+        std::cout << "Saved match cache '" << name << "' (" << (cache_size(&m_hdr) + 1023) / 1024
+                  << " KB)" << std::endl;
+    }
+
+    m_cache.clear();
+}
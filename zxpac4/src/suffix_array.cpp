@@ -0,0 +1,621 @@
+/**
+ * @file suffix_array.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief Suffix array based exhaustive string matcher for LZ engines.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include "lz_util.h"
+#include "radixsort.h"
+#include "suffix_array.h"
+
+
+suffix_array::suffix_array(int window_size, int min_match, int max_match,
+    int good_match,
+    int mm2_thres_offset,
+    int mm3_thres_offset):
+    m_node(NULL),
+    m_iv_lcp(NULL),
+    m_iv_parent(NULL),
+    m_iv_last(NULL),
+    m_iv_short(NULL),
+    m_rank(NULL),
+    m_lcp(NULL),
+    m_seen(NULL),
+    m_mtch(NULL)
+{
+    // All matches are found anyway..
+    (void)good_match;
+    (void)mm2_thres_offset;
+    (void)mm3_thres_offset;
+
+    m_len = 0;
+    m_leaves = 0;
+    m_max_offset = window_size - 1;
+    m_min_match = min_match;
+    m_max_match = max_match;
+    m_long_lcp = SUFFIX_ARRAY_LONG_LCP < max_match ? SUFFIX_ARRAY_LONG_LCP : max_match;
+    m_max_chain = 0;
+}
+
+suffix_array::~suffix_array(void)
+{
+    free_tables();
+}
+
+void suffix_array::free_tables(void)
+{
+    if (m_node) {
+        delete[] m_node;
+    }
+    if (m_iv_lcp) {
+        delete[] m_iv_lcp;
+    }
+    if (m_iv_parent) {
+        delete[] m_iv_parent;
+    }
+    if (m_iv_last) {
+        delete[] m_iv_last;
+    }
+    if (m_iv_short) {
+        delete[] m_iv_short;
+    }
+    if (m_rank) {
+        delete[] m_rank;
+    }
+    if (m_lcp) {
+        delete[] m_lcp;
+    }
+    if (m_seen) {
+        delete[] m_seen;
+    }
+    m_node = NULL;
+    m_iv_lcp = NULL;
+    m_iv_parent = NULL;
+    m_iv_last = NULL;
+    m_iv_short = NULL;
+    m_rank = NULL;
+    m_lcp = NULL;
+    m_seen = NULL;
+    m_len = 0;
+    m_leaves = 0;
+}
+
+void suffix_array::impl_reinit(void)
+{
+    free_tables();
+}
+
+void suffix_array::impl_init_get_matches(int max_matches, match *matches)
+{
+    m_mtch = matches;
+    m_max_chain = max_matches;
+}
+
+/**
+ * @brief Build a suffix array using prefix doubling. Each round sorts
+ *        suffixes by the pair (rank of the first k bytes, rank of the
+ *        next k bytes) with two stable radix sort passes. The number of
+ *        rounds is log2 of the longest repeat in the input.
+ *
+ * @param[in] buf   A ptr to the input buffer.
+ * @param[in] len   The length of the input buffer.
+ * @param[out] sa   The suffix array i.e. positions in the sorted order.
+ * @param[out] rank The inverse of the suffix array.
+ *
+ * @return none
+ */
+void suffix_array::build_suffix_array(const char* buf, int len, int* sa, int* rank)
+{
+    radixsort_8bb<int> rs(len);
+    int* key = new int[len];
+    int bits = 9;
+    int k = 1;
+    int num_ranks;
+    int i, a, b;
+
+    for (i = 0; i < len; i++) {
+        sa[i] = i;
+        rank[i] = static_cast<uint8_t>(buf[i]) + 1;
+    }
+    while (true) {
+        for (i = 0; i < len; i++) {
+            key[i] = i + k < len ? rank[i+k] : 0;
+        }
+
+        rs.sort(sa,key,bits,len);
+        rs.sort(sa,rank,bits,len);
+
+        // Assign new dense ranks. 0 is reserved for "past the end".
+        num_ranks = 1;
+        key[sa[0]] = num_ranks;
+
+        for (i = 1; i < len; i++) {
+            a = sa[i-1];
+            b = sa[i];
+
+            if (rank[a] != rank[b] ||
+                (a + k < len ? rank[a+k] : 0) != (b + k < len ? rank[b+k] : 0)) {
+                ++num_ranks;
+            }
+            key[b] = num_ranks;
+        }
+
+        ::memcpy(rank,key,sizeof(*rank)*len);
+
+        if (num_ranks == len) {
+            break;
+        }
+        for (bits = 0; (num_ranks >> bits) > 0; bits++);
+        k <<= 1;
+    }
+
+    for (i = 0; i < len; i++) {
+        rank[sa[i]] = i;
+    }
+
+    delete[] key;
+}
+
+/**
+ * @brief Build the LCP interval tree and the trees over the suffix ranks.
+ *        The LCP array is computed with the Kasai et al. algorithm. LCPs
+ *        are capped to the maximum match and LCPs shorter than the
+ *        minimum match belong to the root. Each long interval also gets
+ *        its deepest ancestor that is not long.
+ *
+ * @param[in] buf A ptr to the input buffer.
+ * @param[in] len The length of the input buffer.
+ *
+ * @return none
+ */
+void suffix_array::build_intervals(const char* buf, int len)
+{
+    int* sa = new int[len];
+    int* rank = new int[len];
+    int* lcp;
+    int* stack;
+    int num_iv;
+    int sp;
+    int i, j, h, l, r;
+    int pending;
+    int popped;
+
+    build_suffix_array(buf,len,sa,rank);
+
+    for (m_leaves = 1; m_leaves < len; m_leaves <<= 1);
+
+    m_lcp = new int[2*m_leaves];
+    m_seen = new int[2*m_leaves];
+
+    // LCP of sa[r-1] and sa[r] goes into the leaf r. The leaf 0 and the
+    // padding leaves have no match.
+    lcp = m_lcp + m_leaves;
+    lcp[0] = 0;
+
+    for (i = 0, h = 0; i < len; i++) {
+        r = rank[i];
+
+        if (r > 0) {
+            j = sa[r-1];
+
+            while (i + h < len && j + h < len && buf[i+h] == buf[j+h]) {
+                ++h;
+            }
+
+            lcp[r] = h;
+
+            if (h > 0) {
+                --h;
+            }
+        } else {
+            h = 0;
+        }
+    }
+    for (r = 0; r < len; r++) {
+        if (lcp[r] > m_max_match) {
+            lcp[r] = m_max_match;
+        } else if (lcp[r] < m_min_match) {
+            lcp[r] = 0;
+        }
+    }
+    for (r = len; r < m_leaves; r++) {
+        lcp[r] = 0;
+    }
+    for (i = m_leaves - 1; i > 0; i--) {
+        m_lcp[i] = m_lcp[2*i] < m_lcp[2*i+1] ? m_lcp[2*i] : m_lcp[2*i+1];
+    }
+    for (i = 0; i < 2*m_leaves; i++) {
+        m_seen[i] = -1;
+    }
+
+    stack = new int[len+1];
+
+    m_rank = rank;
+    m_node = new int[len];
+    m_iv_lcp = new int[len+1];
+    m_iv_parent = new int[len+1];
+    m_iv_last = new int[len+1];
+    m_iv_short = new int[len+1];
+    m_len = len;
+
+    // Bottom up traversal of LCP intervals. The interval on top of the
+    // stack always has the LCP of the previous boundary.
+    num_iv = 1;
+    m_iv_lcp[0] = 0;
+    m_iv_parent[0] = 0;
+    m_iv_last[0] = -1;
+    m_iv_short[0] = 0;
+    stack[0] = 0;
+    sp = 0;
+
+    for (i = 1; i <= len; i++) {
+        l = i < len ? lcp[i] : 0;
+        pending = -1;
+
+        if (m_iv_lcp[stack[sp]] >= l) {
+            m_node[sa[i-1]] = stack[sp];
+        }
+        while (l < m_iv_lcp[stack[sp]]) {
+            popped = stack[sp--];
+
+            if (l <= m_iv_lcp[stack[sp]]) {
+                m_iv_parent[popped] = stack[sp];
+            } else {
+                pending = popped;
+            }
+        }
+        if (l > m_iv_lcp[stack[sp]]) {
+            m_iv_lcp[num_iv] = l;
+            m_iv_parent[num_iv] = stack[sp];
+            m_iv_last[num_iv] = -1;
+            m_iv_short[num_iv] = -1;
+            stack[++sp] = num_iv;
+
+            if (pending >= 0) {
+                m_iv_parent[pending] = num_iv;
+            }
+            if (i < len && lcp[i-1] < l) {
+                m_node[sa[i-1]] = num_iv;
+            }
+            ++num_iv;
+        }
+    }
+
+    // The deepest short ancestors. Chains are resolved once, thus this
+    // is linear in the number of intervals.
+    for (i = 1; i < num_iv; i++) {
+        sp = 0;
+
+        for (j = i; m_iv_short[j] < 0; j = m_iv_parent[j]) {
+            stack[sp++] = j;
+        }
+        if (m_iv_lcp[j] < m_long_lcp) {
+            h = j;
+        } else {
+            h = m_iv_short[j];
+        }
+        while (sp > 0) {
+            j = stack[--sp];
+
+            if (m_iv_lcp[j] < m_long_lcp) {
+                h = j;
+            }
+
+            m_iv_short[j] = h;
+        }
+    }
+
+    delete[] stack;
+    delete[] sa;
+}
+
+/**
+ * @brief The smallest LCP of the suffix ranks from @p lb to @p rb, i.e.
+ *        the match length of the ranks @p lb - 1 and @p rb.
+ */
+int suffix_array::min_lcp(int lb, int rb) const
+{
+    int l = m_max_match;
+
+    // Bottom up over the tree, leaves are at m_leaves..2*m_leaves-1
+    for (lb += m_leaves, rb += m_leaves + 1; lb < rb; lb >>= 1, rb >>= 1) {
+        if (lb & 1) {
+            if (m_lcp[lb] < l) {
+                l = m_lcp[lb];
+            }
+            ++lb;
+        }
+        if (rb & 1) {
+            --rb;
+
+            if (m_lcp[rb] < l) {
+                l = m_lcp[rb];
+            }
+        }
+    }
+
+    return l;
+}
+
+/**
+ * @brief The most recent visited position within a suffix rank range.
+ *
+ * @param[in] lb The first suffix rank of the range.
+ * @param[in] rb The last suffix rank of the range.
+ *
+ * @return The most recent position or -1 if none was visited.
+ */
+int suffix_array::max_seen(int lb, int rb) const
+{
+    int last = -1;
+
+    for (lb += m_leaves, rb += m_leaves + 1; lb < rb; lb >>= 1, rb >>= 1) {
+        if (lb & 1) {
+            if (m_seen[lb] > last) {
+                last = m_seen[lb];
+            }
+            ++lb;
+        }
+        if (rb & 1) {
+            --rb;
+
+            if (m_seen[rb] > last) {
+                last = m_seen[rb];
+            }
+        }
+    }
+
+    return last;
+}
+
+/**
+ * @brief The first suffix rank of the LCP interval of length @p l around
+ *        the suffix rank @p r, i.e. the nearest rank at or before @p r
+ *        with a smaller LCP.
+ */
+int suffix_array::lcp_left(int r, int l) const
+{
+    int v = r + m_leaves;
+
+    if (m_lcp[v] < l) {
+        return r;
+    }
+    while (v > 1) {
+        if ((v & 1) && m_lcp[v-1] < l) {
+            // The rightmost leaf below the left sibling
+            for (--v; v < m_leaves;) {
+                v = 2*v + 1;
+
+                if (m_lcp[v] >= l) {
+                    --v;
+                }
+            }
+
+            return v - m_leaves;
+        }
+
+        v >>= 1;
+    }
+
+    // Not reached, the LCP of the rank 0 is 0
+    return 0;
+}
+
+/**
+ * @brief The first suffix rank after the LCP interval of length @p l
+ *        around the suffix rank @p r, i.e. the nearest rank after @p r
+ *        with a smaller LCP.
+ */
+int suffix_array::lcp_right(int r, int l) const
+{
+    int v = r + m_leaves;
+
+    while (v > 1) {
+        if (!(v & 1) && m_lcp[v+1] < l) {
+            // The leftmost leaf below the right sibling
+            for (++v; v < m_leaves;) {
+                v = 2*v;
+
+                if (m_lcp[v] >= l) {
+                    ++v;
+                }
+            }
+
+            return v - m_leaves;
+        }
+
+        v >>= 1;
+    }
+
+    return m_len;
+}
+
+/**
+ * @brief The nearest suffix rank before @p r with a visited position
+ *        more recent than @p p.
+ *
+ * @return The suffix rank or -1 if there is none.
+ */
+int suffix_array::seen_left(int r, int p) const
+{
+    int v = r + m_leaves;
+
+    while (v > 1) {
+        if ((v & 1) && m_seen[v-1] > p) {
+            for (--v; v < m_leaves;) {
+                v = 2*v + 1;
+
+                if (m_seen[v] <= p) {
+                    --v;
+                }
+            }
+
+            return v - m_leaves;
+        }
+
+        v >>= 1;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief The nearest suffix rank after @p r with a visited position
+ *        more recent than @p p.
+ *
+ * @return The suffix rank or -1 if there is none.
+ */
+int suffix_array::seen_right(int r, int p) const
+{
+    int v = r + m_leaves;
+
+    while (v > 1) {
+        if (!(v & 1) && m_seen[v+1] > p) {
+            for (++v; v < m_leaves;) {
+                v = 2*v;
+
+                if (m_seen[v] <= p) {
+                    ++v;
+                }
+            }
+
+            return v - m_leaves;
+        }
+
+        v >>= 1;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Find the matches within the long intervals of a position, i.e.
+ *        the ones at least m_long_lcp long. Starting from the suffix rank
+ *        of the position, the rank range is widened to the deepest
+ *        enclosing interval with a more recent position than the last
+ *        found one. The nearest such ranks on both sides tell its length,
+ *        since the LCP with a rank only gets smaller further away.
+ *
+ * @param[in] pos     The current position in the buffer.
+ * @param[in] len     The number of bytes left in the buffer from @p pos.
+ * @param[inout] last The most recent position found so far, i.e. the one
+ *                    of the last interval with a more recent position.
+ *
+ * @return Number of found matches in the decreasing length order.
+ */
+int suffix_array::find_long_matches(int pos, int len, int& last)
+{
+    int low = pos - m_max_offset;
+    int found = 0;
+    int r = m_rank[pos];
+    int lb = r;
+    int rb = r;
+    int a, b;
+    int l, lr;
+    int p;
+
+    while (found < m_max_chain) {
+        a = seen_left(lb,last);
+        b = seen_right(rb,last);
+        l = a >= 0 ? min_lcp(a+1,r) : 0;
+
+        if (b >= 0 && (lr = min_lcp(r+1,b)) > l) {
+            l = lr;
+        }
+        if (l < m_long_lcp) {
+            break;
+        }
+
+        lb = lcp_left(r,l);
+        rb = lcp_right(r,l) - 1;
+        p = max_seen(lb,rb);
+
+        if (p >= low) {
+            m_mtch[found].length = l < len ? l : len;
+            m_mtch[found].offset = pos - p;
+            ++found;
+        }
+
+        last = p;
+    }
+
+    return found;
+}
+
+/**
+ * @brief Find matches for the @p pos. The tables are built over the whole
+ *        input when @p pos is 0, thus positions must be searched in
+ *        increasing order.
+ *
+ * @param[in] buf A ptr to the input buffer.
+ * @param[in] pos The current position in the buffer.
+ * @param[in] len The number of bytes left in the buffer from @p pos.
+ * @param[in] only_better_matches Ignored. Only one match per distinct
+ *                                length is returned anyway.
+ *
+ * @return Number of found matches or 0. Matches are in the increasing
+ *         length order and each has the shortest possible offset for
+ *         its length.
+ */
+int suffix_array::impl_find_matches(const char *buf, int pos, int len, bool only_better_matches=false)
+{
+    int low = pos - m_max_offset;
+    int found = 0;
+    int last = -1;
+    int iv;
+    int p;
+    match t;
+
+    (void)only_better_matches;
+
+    if (pos == 0) {
+        free_tables();
+        build_intervals(buf,len);
+    }
+    if (pos >= m_len) {
+        return 0;
+    }
+
+    // Deeper intervals have longer matches and older positions. Long
+    // intervals are searched through the trees, then each short ancestor
+    // gets this position as its most recent one.
+    iv = m_node[pos];
+
+    if (m_iv_lcp[iv] >= m_long_lcp) {
+        found = find_long_matches(pos,len,last);
+        iv = m_iv_short[iv];
+    }
+    while (iv > 0) {
+        p = m_iv_last[iv];
+        m_iv_last[iv] = pos;
+
+        if (p >= low && p > last) {
+            if (found < m_max_chain) {
+                m_mtch[found].length = m_iv_lcp[iv] < len ? m_iv_lcp[iv] : len;
+                m_mtch[found].offset = pos - p;
+                ++found;
+            }
+            last = p;
+        }
+
+        iv = m_iv_parent[iv];
+    }
+    for (p = m_rank[pos] + m_leaves; p > 0; p >>= 1) {
+        m_seen[p] = pos;
+    }
+
+    // Return in the increasing length order
+    for (p = 0; p < found / 2; p++) {
+        t = m_mtch[p];
+        m_mtch[p] = m_mtch[found-p-1];
+        m_mtch[found-p-1] = t;
+    }
+
+    return found;
+}
@@ -11,8 +11,10 @@
 #include <cerrno>
 #include <cstring>
 #include <iostream>
+#include <iomanip>
 #include "hunk.h"
 #include "target.h"
+#include "m68k_emu.h"
 
 
 
@@ -107,7 +109,8 @@ const decompressor target_amiga::overlay_decompressors[] = {
 
 
 
-target_amiga::target_amiga(const target* trg, const lz_config_t* cfg, std::ofstream& ofs) : target_base(trg,cfg,ofs) {
+target_amiga::target_amiga(const target* trg, const lz_config_t* cfg, std::ofstream& ofs) : target_base(trg,cfg,ofs),
+    m_exe_length(0) {
     // check target and config.. some parameter changes based settings
     // force reverse file if not an overlaid decompression used
     
@@ -180,8 +183,10 @@ int target_amiga::preprocess_exe(char* buf, int len)
                 buf[m] = amiga_exe[m];
             }
         
-            // Add decompressor size + some security length
-            memory_len = n + exe_decompressors[m_cfg->algorithm].length + AMIGA_EXE_SECURITY_DISTANCE;
+            // Add decompressor size. The security distance is known only
+            // after the compression and post_save_exe() adds it.
+            m_exe_length = n;
+            memory_len = n + exe_decompressors[m_cfg->algorithm].length;
 
             // Fabricate a new hunk and insert the size of the compressed data
             new_hunk_info_t new_seg = {
@@ -432,6 +437,27 @@ int target_amiga::save_header_exe(const char* buf, int len)
 }
 
 
+/**
+ * @brief The security distance of a normal executable. The decompressor
+ *        reads words from the decompressed hunk data, so the distance is
+ *        rounded up to even.
+ */
+uint32_t target_amiga::exe_security_distance(void) const
+{
+    return (m_security_distance + 1) & ~1;
+}
+
+/**
+ * @brief The memory size of the last segment of a normal executable. It
+ *        holds the decompressor followed by the compressed data, which
+ *        is decompressed in-place the security distance after the
+ *        decompressor.
+ */
+uint32_t target_amiga::exe_memory_size(void) const
+{
+    return m_exe_length + exe_decompressors[m_cfg->algorithm].length + exe_security_distance();
+}
+
 /**
  * @brief The post compression header/trailer fixing function.
  *
@@ -479,6 +505,17 @@ int target_amiga::post_save_exe(int len)
     write32be(tmp,original_len,false);
     m_ofs.write(tmp,4);
 
+    // Patch the decompressor with the security distance and the
+    // HUNK_HEADER with the memory size the distance needs..
+    m_ofs.seekp(m_new_hunks[n-1].data_size_bytes+46,std::ios_base::beg);
+    write32be(tmp,exe_security_distance(),false);
+    m_ofs.write(tmp,4);
+
+    m_new_hunks[n-1].mem_size_typed_longs = (exe_memory_size() + 3) >> 2;
+    m_ofs.seekp(20+(n-1)*4,std::ios_base::beg);
+    write32be(tmp,m_new_hunks[n-1].mem_size_typed_longs,false);
+    m_ofs.write(tmp,4);
+
     // Seek to the end end and return the final byte size
     m_ofs.seekp(0,std::ios_base::end);
     n = m_ofs.tellp();
@@ -568,3 +605,169 @@ int target_amiga::post_save(const char* buf, int len)
 
     return post_save_exe(len);
 }
+
+// Emulated Amiga memory map. The ExecBase and its library vectors are
+// placed below the stack at the top of the 16M address space.
+#define AMIGA_CLOCK             7093790     // PAL 68000
+#define AMIGA_SEGMENT_BASE      0x10000
+#define AMIGA_EXECBASE          (M68K_MEM_SIZE-0x1000)
+#define AMIGA_STACK_TOP         (M68K_MEM_SIZE-16)
+#define AMIGA_MEM_TOP           (AMIGA_EXECBASE-1024)
+
+const decompressor* target_amiga::emulated_decompressor(void) const
+{
+    const decompressor* dec;
+
+    // The decompressor tables have entries only for zxpac4 and zxpac4_32k
+    if (m_cfg->algorithm != ZXPAC4 && m_cfg->algorithm != ZXPAC4_32K) {
+        return NULL;
+    }
+    if (m_nohunks) {
+        dec = m_cfg->max_match < 256 ? &abs_decompressors_255[m_cfg->algorithm] :
+            &abs_decompressors[m_cfg->algorithm];
+    } else if (m_trg->overlay) {
+        return NULL;
+    } else {
+        dec = m_cfg->max_match < 256 ? &exe_decompressors_255[m_cfg->algorithm] :
+            &exe_decompressors[m_cfg->algorithm];
+    }
+
+    return dec->code ? dec : NULL;
+}
+
+/**
+ * @brief Run the decompressor of the saved file in a 68000 emulator.
+ *
+ * The executable is laid out as AmigaDOS would load it: each hunk is a
+ * segment with its size and the BPTR to the next segment in front of it,
+ * and the first segment has the JSR into the decompressor in the last
+ * segment. The run ends when the decompressor returns into the first
+ * segment and the decompressed hunk data is then compared to the input.
+ * The absolute address decompressor ends when it jumps to the jump
+ * address and the data is compared at the load address.
+ */
+bool target_amiga::can_run_decompressor(void) const
+{
+    return emulated_decompressor() != NULL;
+}
+
+int target_amiga::run_decompressor(const char* buf, int len, const char* p_out, int n)
+{
+    const decompressor* dec = emulated_decompressor();
+    m68k_emu emu;
+    uint64_t max_cycles = 2000 * uint64_t(len) + 1000000;
+    uint32_t data_addr;
+    uint32_t stop_pc;
+    uint32_t addr;
+    uint32_t size;
+    uint32_t next;
+    int num_seg;
+    int pos;
+    int m;
+
+    if (dec == NULL) {
+        return 1;
+    }
+
+    // A minimal ExecBase for the cache flush and the segment release
+    emu.poke32(4,AMIGA_EXECBASE);
+    emu.poke16(AMIGA_EXECBASE+20,37);
+    emu.poke16(AMIGA_EXECBASE-132,0x4e75);
+    emu.poke16(AMIGA_EXECBASE-138,0x4e75);
+    emu.poke16(AMIGA_EXECBASE-210,0x4e75);
+    emu.poke16(AMIGA_EXECBASE-636,0x4e75);
+    emu.set_sp(AMIGA_STACK_TOP);
+    emu.push32(0);
+
+    if (m_nohunks) {
+        addr = (std::max(uint32_t(AMIGA_SEGMENT_BASE),m_trg->load_addr + len) + 15) & ~7;
+        data_addr = m_trg->load_addr;
+        stop_pc = m_trg->jump_addr;
+
+        if (addr + dec->length + n > AMIGA_MEM_TOP) {
+            std::cerr << ERR_PREAMBLE << "the decompressed file does not fit into memory" << std::endl;
+            return -1;
+        }
+
+        emu.load(addr,dec->code,dec->length);
+        emu.load(addr+dec->length,p_out,n);
+        emu.poke32(addr+2,m_trg->load_addr);
+        emu.poke32(addr+12,n);
+        emu.poke32(addr+184,m_trg->jump_addr);
+        emu.set_pc(addr);
+    } else {
+        num_seg = m_new_hunks.size();
+        addr = AMIGA_SEGMENT_BASE;
+        data_addr = 0;
+        stop_pc = addr + 8;
+
+        for (m = 0; m < num_seg; m++) {
+            size = (m_new_hunks[m].mem_size_typed_longs & 0x3fffffff) << 2;
+
+            if (m == num_seg - 1) {
+                size = (exe_memory_size() + 3) & ~3;
+                emu.load(addr+8,dec->code,dec->length);
+                emu.load(addr+8+dec->length,p_out,n);
+                emu.poke32(addr+8+20,n);
+                emu.poke32(addr+8+42,exe_security_distance());
+                data_addr = addr + 8 + dec->length + exe_security_distance();
+
+                // The JSR of the first segment is relocated to here
+                emu.poke32(stop_pc+2,addr+8);
+            }
+            if (m == 0) {
+                emu.poke16(addr+8,0x4eb9);
+                emu.poke16(addr+14,0x4e70);
+            }
+            if (addr + 8 + size > AMIGA_MEM_TOP) {
+                std::cerr << ERR_PREAMBLE << "the segments do not fit into memory" << std::endl;
+                    return -1;
+            }
+
+            // The BPTR points to the link after the segment size
+            next = (addr + 8 + size + 7) & ~7;
+            emu.poke32(addr,size+8);
+            emu.poke32(addr+4,m < num_seg - 1 ? (next + 4) >> 2 : 0);
+            addr = next;
+        }
+        if (data_addr + len > addr) {
+            std::cerr << ERR_PREAMBLE << "the decompressed file does not fit into the last segment" << std::endl;
+            return -1;
+        }
+
+        emu.set_pc(stop_pc);
+    }
+
+    // An executable returns into the first segment it was called from
+    do {
+        if (emu.step() < 0) {
+            std::cerr << ERR_PREAMBLE << "unsupported instruction 0x" << std::hex << emu.opcode()
+                      << " or an address error at 0x" << emu.get_pc() << std::dec << std::endl;
+            return -1;
+        }
+        if (emu.cycles() > max_cycles) {
+            std::cerr << ERR_PREAMBLE << "the decompressor did not return" << std::endl;
+            return -1;
+        }
+    } while (emu.get_pc() != stop_pc || (!m_nohunks && emu.get_sp() != AMIGA_STACK_TOP-4));
+
+    for (pos = 0; pos < len; pos++) {
+        if (emu.peek(data_addr+pos) != uint8_t(buf[m_cfg->reverse_file ? len - 1 - pos : pos])) {
+            std::cerr << ERR_PREAMBLE << "the decompressed file differs at offset " << pos << std::endl;
+            return -1;
+        }
+    }
+
+    std::ios_base::fmtflags fmt = std::cout.flags();
+    std::streamsize prec = std::cout.precision();
+
+    std::cout << "Decompression took " << emu.cycles() << " cycles ("
+              << std::fixed << std::setprecision(2)
+              << double(emu.cycles()) / len << " per byte, "
+              << double(emu.cycles()) / AMIGA_CLOCK << " s on a 7.09 MHz 68000)" << std::endl;
+
+    std::cout.flags(fmt);
+    std::cout.precision(prec);
+
+    return 0;
+}
@@ -12,6 +12,7 @@
 #include <iomanip>
 #include <iosfwd>
 #include "target.h"
+#include "z80_emu.h"
 
 /* The TAP file format..
 
@@ -73,6 +74,13 @@ static const uint8_t tapLoader[] = {
 #define Z80LOADADDR         TAPLOADERSIZE+Z80_LOADADDR_OFFSET   // TAP to start of decompressor + 8
 #define Z80JUMPADDR         TAPLOADERSIZE+Z80_JUMPADDR_OFFSET         
 
+// The emulated 48K Spectrum with the loaded BASIC program
+#define ZXROMSIZE           16384
+#define ZXPROG              23755       // PROG without microdrives
+#define ZXVARS              23627       // system variable VARS
+#define ZXRAMTOP            0xff58      // default RAMTOP, the stack is below it
+#define ZXCLOCK             3500000
+
 char target_spectrum::tap_chksum(const char *b, char c, int n) {
 	int i;
 	
@@ -88,6 +96,7 @@ target_spectrum::target_spectrum(const targets::target* trg, const lz_config_t*
     cfg->reverse_file = true;
     cfg->reverse_encoded = true;
     m_chksum = 0;
+    m_file_length = 0;
 }
 
 target_spectrum::~target_spectrum(void) {
@@ -97,6 +106,7 @@ target_spectrum::~target_spectrum(void) {
 int  target_spectrum::preprocess(char* buf, int len)
 {
     (void)buf;
+    m_file_length = len;
     return len;
 }
 
@@ -127,9 +137,26 @@ int  target_spectrum::save_header(const char* buf, int len)
 int  target_spectrum::post_save(const char* buf, int len)
 {
     char tap[TAPLOADERSIZE+Z80DECSIZE];
+    int data_addr = ZXPROG + TAPBASICSIZE + Z80DECSIZE;
+    int load_addr = m_trg->load_addr;
     int n;
     char c;
 
+    // The decompressor reads and writes from higher to lower memory, so
+    // the decompressed file may overlap the compressed data in the REM
+    // if it starts at least the security distance above the data.
+    if (load_addr < data_addr + len && load_addr + m_file_length > data_addr &&
+        load_addr < data_addr + m_security_distance) {
+        std::cerr << ERR_PREAMBLE << "the load address overlaps the compressed data. The lowest "
+                  << "in-place load address is 0x" << std::hex << data_addr + m_security_distance
+                  << std::dec << std::endl;
+        return -1;
+    }
+    if (m_cfg->verbose) {
+        std::cout << "Lowest in-place load address: 0x" << std::hex
+                  << data_addr + m_security_distance << std::dec << std::endl;
+    }
+
     // Copy the header and the decompressor
     ::memcpy(tap,tapLoader,TAPLOADERSIZE);
     ::memcpy(tap+TAPLOADERSIZE,z80tap_255_32k_bin,Z80DECSIZE);
@@ -189,3 +216,90 @@ int  target_spectrum::post_save(const char* buf, int len)
     return n;
 }
 
+
+/**
+ * @brief Run the TAP decompressor in a Z80 emulator.
+ *
+ *  The memory is laid out as after loading the TAP file: the decompressor
+ *  starts at PROG+44 in the REM statement, the compressed data follows it
+ *  and VARS points right after the data. The decompressor is called like
+ *  the USR function does and the run ends when it returns into the jump
+ *  address.
+ */
+bool target_spectrum::can_run_decompressor(void) const
+{
+    // The TAP decompressor is assembled for zxpac4_32k binary files
+    return m_cfg->algorithm == ZXPAC4_32K;
+}
+
+int target_spectrum::run_decompressor(const char* buf, int len, const char* p_out, int n)
+{
+    z80_emu emu;
+    uint16_t dec_addr = ZXPROG + TAPBASICSIZE;
+    uint16_t data_addr = dec_addr + Z80DECSIZE;
+    uint16_t load_addr = m_trg->load_addr;
+    uint16_t jump_addr = m_trg->jump_addr;
+    uint64_t max_tstates = 1000 * uint64_t(len) + 1000000;
+    int low;
+    int high;
+    int pos;
+
+    if (!can_run_decompressor()) {
+        return 1;
+    }
+    if (data_addr + n > ZXRAMTOP) {
+        std::cerr << ERR_PREAMBLE << "the compressed file does not fit below RAMTOP" << std::endl;
+        return -1;
+    }
+    if (load_addr + len > Z80_MEM_SIZE) {
+        std::cerr << ERR_PREAMBLE << "the decompressed file does not fit into memory" << std::endl;
+        return -1;
+    }
+
+    emu.reset(ZXROMSIZE);
+    emu.load(dec_addr,z80tap_255_32k_bin,Z80DECSIZE);
+    emu.load(data_addr,p_out,n);
+    emu.poke(dec_addr+Z80_JUMPADDR_OFFSET+0,jump_addr);
+    emu.poke(dec_addr+Z80_JUMPADDR_OFFSET+1,jump_addr >> 8);
+    emu.poke(dec_addr+Z80_LOADADDR_OFFSET+0,load_addr);
+    emu.poke(dec_addr+Z80_LOADADDR_OFFSET+1,load_addr >> 8);
+    emu.poke(ZXVARS+0,(data_addr + n));
+    emu.poke(ZXVARS+1,(data_addr + n) >> 8);
+    emu.set_sp(ZXRAMTOP);
+    emu.call(dec_addr,0);
+
+    // The decompressor returns into the jump address it pushed first
+    do {
+        emu.step();
+
+        if (emu.halted() || emu.tstates() > max_tstates) {
+            std::cerr << ERR_PREAMBLE << "the decompressor did not return" << std::endl;
+            return -1;
+        }
+    } while (emu.get_pc() != jump_addr || emu.get_sp() != ZXRAMTOP-2);
+
+    for (pos = 0; pos < len; pos++) {
+        if (emu.peek(load_addr+pos) != uint8_t(buf[m_cfg->reverse_file ? len - 1 - pos : pos])) {
+            std::cerr << ERR_PREAMBLE << "the decompressed file differs at offset " << pos << std::endl;
+            return -1;
+        }
+    }
+
+    low = emu.lowest_touched();
+    high = emu.highest_touched();
+    std::ios_base::fmtflags fmt = std::cout.flags();
+    std::streamsize prec = std::cout.precision();
+
+    std::cout << "Decompression took " << emu.tstates() << " T-states ("
+              << std::fixed << std::setprecision(2)
+              << double(emu.tstates()) / len << " per byte, "
+              << double(emu.tstates()) / ZXCLOCK << " s at 3.5 MHz)\n";
+    std::cout << "Memory touched: " << emu.touched() << " bytes between 0x"
+              << std::hex << low << " and 0x" << high << std::dec
+              << ", stack depth " << ZXRAMTOP - emu.min_sp() << " bytes" << std::endl;
+
+    std::cout.flags(fmt);
+    std::cout.precision(prec);
+
+    return 0;
+}
@@ -0,0 +1,888 @@
+/**
+ * @file z80_emu.cpp
+ * @version 0.1
+ * @author Jouni 'Mr.Spiv' Korhonen
+ * @brief A host side Z80 emulator for timing the decompressors.
+ *
+ * The opcodes are decoded from their x, y, z, p and q bit fields, see
+ * "Decoding Z80 Opcodes" by Cristian Dinu. The T-states of the DD and FD
+ * prefixed instructions are those of the HL instruction plus 4 for the
+ * prefix and 8 for the (IX+d) displacement.
+ *
+ * @copyright The Unlicense
+ */
+
+#include <cstring>
+#include "z80_emu.h"
+
+#define FC      0x01
+#define FN      0x02
+#define FPV     0x04
+#define FX      0x08
+#define FH      0x10
+#define FY      0x20
+#define FZ      0x40
+#define FS      0x80
+
+namespace {
+
+// Sign, zero, the undocumented bits 5 and 3 and the parity of a byte
+struct flag_tables {
+    uint8_t sz53[256];
+    uint8_t sz53p[256];
+
+    flag_tables(void) {
+        for (int n = 0; n < 256; n++) {
+            int p = n ^ n >> 4;
+            p ^= p >> 2;
+            p ^= p >> 1;
+            sz53[n] = (n & (FS|FY|FX)) | (n ? 0 : FZ);
+            sz53p[n] = sz53[n] | (p & 1 ? 0 : FPV);
+        }
+    }
+};
+
+const flag_tables flags;
+
+}   // namespace
+
+
+z80_emu::z80_emu(void)
+{
+    reset();
+}
+
+void z80_emu::reset(int rom_size)
+{
+    std::memset(m_mem,0,sizeof(m_mem));
+    m_touched.reset();
+    m_rom_size = rom_size;
+
+    m_a = m_f = m_b = m_c = m_d = m_e = m_h = m_l = 0xff;
+    m_af2 = m_bc2 = m_de2 = m_hl2 = 0xffff;
+    m_ix = m_iy = 0xffff;
+    m_sp = m_min_sp = 0xffff;
+    m_pc = 0;
+    m_i = m_r = 0;
+    m_iff1 = m_iff2 = false;
+    m_im = 0;
+    m_halted = false;
+    m_index = 0;
+    m_tstates = 0;
+    m_total = 0;
+}
+
+void z80_emu::load(uint16_t addr, const void* p, int len)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(p);
+
+    for (int n = 0; n < len; n++) {
+        m_mem[uint16_t(addr+n)] = src[n];
+    }
+}
+
+void z80_emu::push(uint16_t value)
+{
+    m_sp -= 2;
+    wr16(m_sp,value);
+
+    if (m_sp < m_min_sp) {
+        m_min_sp = m_sp;
+    }
+}
+
+uint16_t z80_emu::pop(void)
+{
+    uint16_t value = rd16(m_sp);
+    m_sp += 2;
+    return value;
+}
+
+void z80_emu::call(uint16_t addr, uint16_t ret)
+{
+    push(ret);
+    m_pc = addr;
+}
+
+int z80_emu::lowest_touched(void) const
+{
+    for (int addr = 0; addr < Z80_MEM_SIZE; addr++) {
+        if (m_touched.test(addr)) {
+            return addr;
+        }
+    }
+
+    return -1;
+}
+
+int z80_emu::highest_touched(void) const
+{
+    for (int addr = Z80_MEM_SIZE-1; addr >= 0; addr--) {
+        if (m_touched.test(addr)) {
+            return addr;
+        }
+    }
+
+    return -1;
+}
+
+//
+// Registers selected by the opcode fields
+//
+
+uint16_t z80_emu::get_index(void) const
+{
+    return m_index == 1 ? m_ix : m_iy;
+}
+
+void z80_emu::set_index(uint16_t value)
+{
+    if (m_index == 1) {
+        m_ix = value;
+    } else {
+        m_iy = value;
+    }
+}
+
+uint16_t z80_emu::get_rp(int p) const
+{
+    switch (p) {
+    case 0: return bc();
+    case 1: return de();
+    case 2: return m_index ? get_index() : hl();
+    default: return m_sp;
+    }
+}
+
+void z80_emu::set_rp(int p, uint16_t value)
+{
+    switch (p) {
+    case 0: set_bc(value); break;
+    case 1: set_de(value); break;
+    case 2:
+        if (m_index) {
+            set_index(value);
+        } else {
+            set_hl(value);
+        }
+        break;
+    default: m_sp = value; break;
+    }
+}
+
+uint16_t z80_emu::get_rp2(int p) const
+{
+    return p == 3 ? m_a << 8 | m_f : get_rp(p);
+}
+
+void z80_emu::set_rp2(int p, uint16_t value)
+{
+    if (p == 3) {
+        m_a = value >> 8;
+        m_f = value;
+    } else {
+        set_rp(p,value);
+    }
+}
+
+// The register r other than (HL). H and L are IXH and IXL etc. unless
+// the instruction also uses (IX+d).
+uint8_t z80_emu::get_r(int r, bool no_index)
+{
+    switch (r) {
+    case 0: return m_b;
+    case 1: return m_c;
+    case 2: return m_d;
+    case 3: return m_e;
+    case 4: return m_index && !no_index ? get_index() >> 8 : m_h;
+    case 5: return m_index && !no_index ? get_index() & 0xff : m_l;
+    default: return m_a;
+    }
+}
+
+void z80_emu::set_r(int r, uint8_t value, bool no_index)
+{
+    switch (r) {
+    case 0: m_b = value; break;
+    case 1: m_c = value; break;
+    case 2: m_d = value; break;
+    case 3: m_e = value; break;
+    case 4:
+        if (m_index && !no_index) {
+            set_index((get_index() & 0x00ff) | value << 8);
+        } else {
+            m_h = value;
+        }
+        break;
+    case 5:
+        if (m_index && !no_index) {
+            set_index((get_index() & 0xff00) | value);
+        } else {
+            m_l = value;
+        }
+        break;
+    default: m_a = value; break;
+    }
+}
+
+// The address of (HL) or (IX+d)
+uint16_t z80_emu::index_addr(void)
+{
+    if (m_index == 0) {
+        return hl();
+    }
+
+    int8_t d = fetch();
+    m_tstates += 8;
+    return get_index() + d;
+}
+
+bool z80_emu::cond(int y) const
+{
+    static const uint8_t mask[] = {FZ,FC,FPV,FS};
+    bool set = m_f & mask[y >> 1];
+
+    return y & 1 ? set : !set;
+}
+
+//
+// Arithmetic
+//
+
+void z80_emu::alu(int op, uint8_t value)
+{
+    int carry = (op == 1 || op == 3) ? m_f & FC : 0;
+    int r;
+
+    switch (op) {
+    case 0:     // ADD
+    case 1:     // ADC
+        r = m_a + value + carry;
+        m_f = (r >> 8 & FC) | ((m_a ^ value ^ r) & FH) | flags.sz53[r & 0xff] |
+            (~(m_a ^ value) & (m_a ^ r) & 0x80 ? FPV : 0);
+        m_a = r;
+        break;
+    case 2:     // SUB
+    case 3:     // SBC
+    case 7:     // CP
+        r = m_a - value - carry;
+        m_f = FN | (r >> 8 & FC) | ((m_a ^ value ^ r) & FH) |
+            ((m_a ^ value) & (m_a ^ r) & 0x80 ? FPV : 0);
+
+        if (op == 7) {
+            m_f |= (r & FS) | (r & 0xff ? 0 : FZ) | (value & (FY|FX));
+        } else {
+            m_f |= flags.sz53[r & 0xff];
+            m_a = r;
+        }
+        break;
+    case 4:     // AND
+        m_a &= value;
+        m_f = flags.sz53p[m_a] | FH;
+        break;
+    case 5:     // XOR
+        m_a ^= value;
+        m_f = flags.sz53p[m_a];
+        break;
+    default:    // OR
+        m_a |= value;
+        m_f = flags.sz53p[m_a];
+        break;
+    }
+}
+
+uint8_t z80_emu::inc8(uint8_t value)
+{
+    uint8_t r = value + 1;
+
+    m_f = (m_f & FC) | flags.sz53[r] | (r == 0x80 ? FPV : 0) | ((r & 0x0f) ? 0 : FH);
+    return r;
+}
+
+uint8_t z80_emu::dec8(uint8_t value)
+{
+    uint8_t r = value - 1;
+
+    m_f = (m_f & FC) | FN | flags.sz53[r] | (r == 0x7f ? FPV : 0) | ((value & 0x0f) ? 0 : FH);
+    return r;
+}
+
+uint16_t z80_emu::add16(uint16_t a, uint16_t b)
+{
+    uint32_t r = a + b;
+
+    m_f = (m_f & (FS|FZ|FPV)) | ((a ^ b ^ r) >> 8 & FH) | (r >> 16 & FC) | (r >> 8 & (FY|FX));
+    return r;
+}
+
+// RLC, RRC, RL, RR, SLA, SRA, SLL and SRL
+uint8_t z80_emu::rot(int op, uint8_t value)
+{
+    uint8_t r;
+    int carry;
+
+    switch (op) {
+    case 0: carry = value >> 7; r = value << 1 | carry; break;
+    case 1: carry = value & 1; r = value >> 1 | carry << 7; break;
+    case 2: carry = value >> 7; r = value << 1 | (m_f & FC); break;
+    case 3: carry = value & 1; r = value >> 1 | (m_f & FC) << 7; break;
+    case 4: carry = value >> 7; r = value << 1; break;
+    case 5: carry = value & 1; r = (value & 0x80) | value >> 1; break;
+    case 6: carry = value >> 7; r = value << 1 | 1; break;
+    default: carry = value & 1; r = value >> 1; break;
+    }
+
+    m_f = flags.sz53p[r] | carry;
+    return r;
+}
+
+//
+// Instructions
+//
+
+int z80_emu::step(void)
+{
+    uint8_t op;
+
+    m_tstates = 0;
+    m_index = 0;
+    op = fetch_opcode();
+
+    while (op == 0xdd || op == 0xfd) {
+        m_index = op == 0xdd ? 1 : 2;
+        m_tstates += 4;
+        op = fetch_opcode();
+    }
+
+    if (op == 0xcb) {
+        if (m_index) {
+            exec_index_cb();
+        } else {
+            exec_cb();
+        }
+    } else if (op == 0xed) {
+        // A DD or FD prefix has no effect on the ED instructions
+        m_index = 0;
+        exec_ed(fetch_opcode());
+    } else {
+        exec_main(op);
+    }
+
+    m_total += m_tstates;
+    return m_tstates;
+}
+
+void z80_emu::exec_main(uint8_t op)
+{
+    int x = op >> 6;
+    int y = op >> 3 & 7;
+    int z = op & 7;
+    int p = y >> 1;
+    int q = y & 1;
+    uint16_t addr;
+    uint16_t tmp;
+    int8_t d;
+    uint8_t carry;
+
+    switch (x) {
+    case 0:
+        switch (z) {
+        case 0:
+            if (y == 0) {           // NOP
+                m_tstates += 4;
+            } else if (y == 1) {    // EX AF,AF'
+                tmp = m_a << 8 | m_f;
+                m_a = m_af2 >> 8;
+                m_f = m_af2;
+                m_af2 = tmp;
+                m_tstates += 4;
+            } else if (y == 2) {    // DJNZ d
+                d = fetch();
+                m_tstates += 8;
+
+                if (--m_b) {
+                    m_pc += d;
+                    m_tstates += 5;
+                }
+            } else {                // JR d and JR cc,d
+                d = fetch();
+                m_tstates += 7;
+
+                if (y == 3 || cond(y-4)) {
+                    m_pc += d;
+                    m_tstates += 5;
+                }
+            }
+            break;
+        case 1:
+            if (q == 0) {           // LD rp,nn
+                set_rp(p,fetch16());
+                m_tstates += 10;
+            } else {                // ADD HL,rp
+                set_rp(2,add16(get_rp(2),get_rp(p)));
+                m_tstates += 11;
+            }
+            break;
+        case 2:
+            switch (y) {
+            case 0: wr(bc(),m_a); m_tstates += 7; break;
+            case 1: m_a = rd(bc()); m_tstates += 7; break;
+            case 2: wr(de(),m_a); m_tstates += 7; break;
+            case 3: m_a = rd(de()); m_tstates += 7; break;
+            case 4: wr16(fetch16(),get_rp(2)); m_tstates += 16; break;
+            case 5: set_rp(2,rd16(fetch16())); m_tstates += 16; break;
+            case 6: wr(fetch16(),m_a); m_tstates += 13; break;
+            default: m_a = rd(fetch16()); m_tstates += 13; break;
+            }
+            break;
+        case 3:                     // INC rp and DEC rp
+            set_rp(p,get_rp(p) + (q ? -1 : 1));
+            m_tstates += 6;
+            break;
+        case 4:                     // INC r
+        case 5:                     // DEC r
+            if (y == 6) {
+                m_tstates += 11;
+                addr = index_addr();
+                wr(addr,z == 4 ? inc8(rd(addr)) : dec8(rd(addr)));
+            } else {
+                m_tstates += 4;
+                set_r(y,z == 4 ? inc8(get_r(y)) : dec8(get_r(y)));
+            }
+            break;
+        case 6:                     // LD r,n
+            if (y == 6) {
+                // The displacement and n are read in parallel
+                m_tstates += m_index ? 10-3 : 10;
+                addr = index_addr();
+                wr(addr,fetch());
+            } else {
+                m_tstates += 7;
+                set_r(y,fetch());
+            }
+            break;
+        default:
+            m_tstates += 4;
+
+            switch (y) {
+            case 0:                 // RLCA
+                m_a = m_a << 1 | m_a >> 7;
+                m_f = (m_f & (FS|FZ|FPV)) | (m_a & (FY|FX|FC));
+                break;
+            case 1:                 // RRCA
+                carry = m_a & 1;
+                m_a = m_a >> 1 | m_a << 7;
+                m_f = (m_f & (FS|FZ|FPV)) | (m_a & (FY|FX)) | carry;
+                break;
+            case 2:                 // RLA
+                carry = m_a >> 7;
+                m_a = m_a << 1 | (m_f & FC);
+                m_f = (m_f & (FS|FZ|FPV)) | (m_a & (FY|FX)) | carry;
+                break;
+            case 3:                 // RRA
+                carry = m_a & 1;
+                m_a = m_a >> 1 | (m_f & FC) << 7;
+                m_f = (m_f & (FS|FZ|FPV)) | (m_a & (FY|FX)) | carry;
+                break;
+            case 4: {               // DAA
+                uint8_t fix = 0;
+                bool half;
+
+                carry = m_f & FC;
+
+                if ((m_f & FH) || (m_a & 0x0f) > 9) {
+                    fix = 0x06;
+                }
+                if (carry || m_a > 0x99) {
+                    fix |= 0x60;
+                    carry = FC;
+                }
+                if (m_f & FN) {
+                    half = (m_f & FH) && (m_a & 0x0f) < 6;
+                    m_a -= fix;
+                } else {
+                    half = (m_a & 0x0f) > 9;
+                    m_a += fix;
+                }
+
+                m_f = flags.sz53p[m_a] | (m_f & FN) | carry | (half ? FH : 0);
+                break;
+            }
+            case 5:                 // CPL
+                m_a = ~m_a;
+                m_f = (m_f & (FS|FZ|FPV|FC)) | FH | FN | (m_a & (FY|FX));
+                break;
+            case 6:                 // SCF
+                m_f = (m_f & (FS|FZ|FPV)) | (m_a & (FY|FX)) | FC;
+                break;
+            default:                // CCF
+                m_f = (m_f & (FS|FZ|FPV)) | (m_a & (FY|FX)) | (m_f & FC ? FH : FC);
+                break;
+            }
+            break;
+        }
+        break;
+    case 1:
+        if (y == 6 && z == 6) {     // HALT
+            m_halted = true;
+            m_tstates += 4;
+        } else if (z == 6) {        // LD r,(HL)
+            m_tstates += 7;
+            addr = index_addr();
+            set_r(y,rd(addr),true);
+        } else if (y == 6) {        // LD (HL),r
+            m_tstates += 7;
+            addr = index_addr();
+            wr(addr,get_r(z,true));
+        } else {                    // LD r,r'
+            m_tstates += 4;
+            set_r(y,get_r(z));
+        }
+        break;
+    case 2:                         // ALU r
+        if (z == 6) {
+            m_tstates += 7;
+            addr = index_addr();
+            alu(y,rd(addr));
+        } else {
+            m_tstates += 4;
+            alu(y,get_r(z));
+        }
+        break;
+    default:
+        switch (z) {
+        case 0:                     // RET cc
+            m_tstates += 5;
+
+            if (cond(y)) {
+                m_pc = pop();
+                m_tstates += 6;
+            }
+            break;
+        case 1:
+            if (q == 0) {           // POP rp2
+                set_rp2(p,pop());
+                m_tstates += 10;
+            } else if (p == 0) {    // RET
+                m_pc = pop();
+                m_tstates += 10;
+            } else if (p == 1) {    // EXX
+                tmp = bc(); set_bc(m_bc2); m_bc2 = tmp;
+                tmp = de(); set_de(m_de2); m_de2 = tmp;
+                tmp = hl(); set_hl(m_hl2); m_hl2 = tmp;
+                m_tstates += 4;
+            } else if (p == 2) {    // JP (HL)
+                m_pc = get_rp(2);
+                m_tstates += 4;
+            } else {                // LD SP,HL
+                m_sp = get_rp(2);
+                m_tstates += 6;
+            }
+            break;
+        case 2:                     // JP cc,nn
+            addr = fetch16();
+            m_tstates += 10;
+
+            if (cond(y)) {
+                m_pc = addr;
+            }
+            break;
+        case 3:
+            switch (y) {
+            case 0:                 // JP nn
+                m_pc = fetch16();
+                m_tstates += 10;
+                break;
+            case 2:                 // OUT (n),A
+                fetch();
+                m_tstates += 11;
+                break;
+            case 3:                 // IN A,(n)
+                fetch();
+                m_a = 0xff;
+                m_tstates += 11;
+                break;
+            case 4:                 // EX (SP),HL
+                tmp = rd16(m_sp);
+                wr16(m_sp,get_rp(2));
+                set_rp(2,tmp);
+                m_tstates += 19;
+                break;
+            case 5:                 // EX DE,HL
+                tmp = de();
+                set_de(hl());
+                set_hl(tmp);
+                m_tstates += 4;
+                break;
+            default:                // DI and EI
+                m_iff1 = m_iff2 = y == 7;
+                m_tstates += 4;
+                break;
+            }
+            break;
+        case 4:                     // CALL cc,nn
+            addr = fetch16();
+            m_tstates += 10;
+
+            if (cond(y)) {
+                push(m_pc);
+                m_pc = addr;
+                m_tstates += 7;
+            }
+            break;
+        case 5:
+            if (q == 0) {           // PUSH rp2
+                push(get_rp2(p));
+                m_tstates += 11;
+            } else {                // CALL nn
+                addr = fetch16();
+                push(m_pc);
+                m_pc = addr;
+                m_tstates += 17;
+            }
+            break;
+        case 6:                     // ALU n
+            alu(y,fetch());
+            m_tstates += 7;
+            break;
+        default:                    // RST
+            push(m_pc);
+            m_pc = y * 8;
+            m_tstates += 11;
+            break;
+        }
+        break;
+    }
+}
+
+void z80_emu::exec_cb(void)
+{
+    uint8_t op = fetch_opcode();
+    int x = op >> 6;
+    int y = op >> 3 & 7;
+    int z = op & 7;
+    uint8_t value = z == 6 ? rd(hl()) : get_r(z);
+
+    if (z == 6) {
+        m_tstates += x == 1 ? 12 : 15;
+    } else {
+        m_tstates += 8;
+    }
+
+    switch (x) {
+    case 0: value = rot(y,value); break;
+    case 1:
+        m_f = (m_f & FC) | FH | (value & (FY|FX));
+
+        if (!(value & 1 << y)) {
+            m_f |= FZ|FPV;
+        } else if (y == 7) {
+            m_f |= FS;
+        }
+        return;
+    case 2: value &= ~(1 << y); break;
+    default: value |= 1 << y; break;
+    }
+
+    if (z == 6) {
+        wr(hl(),value);
+    } else {
+        set_r(z,value);
+    }
+}
+
+// DDCB d op and FDCB d op. The result is also copied into the register
+// of the opcode.
+void z80_emu::exec_index_cb(void)
+{
+    int8_t d = fetch();
+    uint8_t op = fetch();
+    int x = op >> 6;
+    int y = op >> 3 & 7;
+    int z = op & 7;
+    uint16_t addr = get_index() + d;
+    uint8_t value = rd(addr);
+
+    m_tstates += x == 1 ? 16 : 19;
+
+    switch (x) {
+    case 0: value = rot(y,value); break;
+    case 1:
+        m_f = (m_f & FC) | FH | (addr >> 8 & (FY|FX));
+
+        if (!(value & 1 << y)) {
+            m_f |= FZ|FPV;
+        } else if (y == 7) {
+            m_f |= FS;
+        }
+        return;
+    case 2: value &= ~(1 << y); break;
+    default: value |= 1 << y; break;
+    }
+
+    wr(addr,value);
+
+    if (z != 6) {
+        set_r(z,value,true);
+    }
+}
+
+void z80_emu::exec_ed(uint8_t op)
+{
+    static const int im_modes[] = {0,0,1,2,0,0,1,2};
+    int x = op >> 6;
+    int y = op >> 3 & 7;
+    int z = op & 7;
+    int p = y >> 1;
+    int q = y & 1;
+    uint32_t r;
+    uint16_t a;
+    uint16_t b;
+    uint8_t value;
+
+    if (x == 2 && z <= 3 && y >= 4) {
+        block(y,z);
+        return;
+    }
+    if (x != 1) {                   // NONI
+        m_tstates += 8;
+        return;
+    }
+
+    switch (z) {
+    case 0:                         // IN r,(C)
+        if (y != 6) {
+            set_r(y,0xff);
+        }
+        m_f = (m_f & FC) | flags.sz53p[0xff];
+        m_tstates += 12;
+        break;
+    case 1:                         // OUT (C),r
+        m_tstates += 12;
+        break;
+    case 2:                         // SBC HL,rp and ADC HL,rp
+        a = hl();
+        b = get_rp(p);
+
+        if (q == 0) {
+            r = a - b - (m_f & FC);
+            m_f = FN | ((a ^ b) & (a ^ r) & 0x8000 ? FPV : 0);
+        } else {
+            r = a + b + (m_f & FC);
+            m_f = (~(a ^ b) & (a ^ r) & 0x8000 ? FPV : 0);
+        }
+
+        m_f |= (r >> 16 & FC) | ((a ^ b ^ r) >> 8 & FH) | (r >> 8 & (FS|FY|FX)) |
+            (r & 0xffff ? 0 : FZ);
+        set_hl(r);
+        m_tstates += 15;
+        break;
+    case 3:                         // LD (nn),rp and LD rp,(nn)
+        if (q == 0) {
+            wr16(fetch16(),get_rp(p));
+        } else {
+            set_rp(p,rd16(fetch16()));
+        }
+        m_tstates += 20;
+        break;
+    case 4:                         // NEG
+        value = m_a;
+        m_a = 0;
+        alu(2,value);
+        m_tstates += 8;
+        break;
+    case 5:                         // RETN and RETI
+        m_pc = pop();
+        m_iff1 = m_iff2;
+        m_tstates += 14;
+        break;
+    case 6:                         // IM
+        m_im = im_modes[y];
+        m_tstates += 8;
+        break;
+    default:
+        switch (y) {
+        case 0: m_i = m_a; m_tstates += 9; break;
+        case 1: m_r = m_a; m_tstates += 9; break;
+        case 2:                     // LD A,I and LD A,R
+        case 3:
+            m_a = y == 2 ? m_i : m_r;
+            m_f = (m_f & FC) | flags.sz53[m_a] | (m_iff2 ? FPV : 0);
+            m_tstates += 9;
+            break;
+        case 4:                     // RRD
+            value = rd(hl());
+            wr(hl(),m_a << 4 | value >> 4);
+            m_a = (m_a & 0xf0) | (value & 0x0f);
+            m_f = (m_f & FC) | flags.sz53p[m_a];
+            m_tstates += 18;
+            break;
+        case 5:                     // RLD
+            value = rd(hl());
+            wr(hl(),value << 4 | (m_a & 0x0f));
+            m_a = (m_a & 0xf0) | value >> 4;
+            m_f = (m_f & FC) | flags.sz53p[m_a];
+            m_tstates += 18;
+            break;
+        default:
+            m_tstates += 8;
+            break;
+        }
+        break;
+    }
+}
+
+// LDI, CPI, INI and OUTI with their decrementing and repeating forms
+void z80_emu::block(int y, int z)
+{
+    int dir = y & 1 ? -1 : 1;
+    bool repeat = y >= 6;
+    bool again;
+    uint8_t value;
+    uint8_t r;
+    uint8_t n;
+    uint8_t half;
+
+    switch (z) {
+    case 0:                         // LDI
+        value = rd(hl());
+        wr(de(),value);
+        set_hl(hl() + dir);
+        set_de(de() + dir);
+        set_bc(bc() - 1);
+        n = value + m_a;
+        m_f = (m_f & (FS|FZ|FC)) | (bc() ? FPV : 0) | (n & FX) | (n & 0x02 ? FY : 0);
+        again = bc() != 0;
+        break;
+    case 1:                         // CPI
+        value = rd(hl());
+        r = m_a - value;
+        half = (m_a ^ value ^ r) & FH;
+        set_hl(hl() + dir);
+        set_bc(bc() - 1);
+        n = r - (half ? 1 : 0);
+        m_f = (m_f & FC) | FN | half | (r & FS) | (r ? 0 : FZ) | (bc() ? FPV : 0) |
+            (n & FX) | (n & 0x02 ? FY : 0);
+        again = bc() != 0 && r != 0;
+        break;
+    case 2:                         // INI
+        wr(hl(),0xff);
+        set_hl(hl() + dir);
+        m_f = FN | flags.sz53[--m_b];
+        again = m_b != 0;
+        break;
+    default:                        // OUTI
+        rd(hl());
+        set_hl(hl() + dir);
+        m_f = FN | flags.sz53[--m_b];
+        again = m_b != 0;
+        break;
+    }
+
+    m_tstates += 16;
+
+    if (repeat && again) {
+        m_pc -= 2;
+        m_tstates += 5;
+    }
+}
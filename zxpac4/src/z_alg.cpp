@@ -1,7 +1,7 @@
 /**
  * @file z_alg.cpp
  * @brief A Z-array algorithm implemntation for LZ string matching.
- * @version 0.2
+ * @version 0.3
  * @author Jouni 'Mr.Spiv' Korhonen
  * @copyright The Unlicense
  * @date 11-Apr-2022
@@ -20,6 +20,7 @@
 #include <cstdlib>
 
 #include "z_alg.h"
+#include "match_len.h"
 
 /**
  * @brief Return the start of the Z-array for iterators use.
@@ -50,7 +51,7 @@ const int32_t *z_array::begin(void) const
  */
 int32_t *z_array::end(void)
 {
-    return &m_z[m_len];
+    return &m_z[m_window];
 }
 
 /**
@@ -60,7 +61,7 @@ int32_t *z_array::end(void)
  */
 const int32_t *z_array::end(void) const
 {
-    return &m_z[m_len];
+    return &m_z[m_window];
 }
 
 /**
@@ -95,33 +96,62 @@ int32_t& z_array::operator[](int i)
  * @param[in] len Length of the Z-array i.e. the size of search window.
  * @param[in] min Minimum match length.
  * @param[in] max Maximum match length.
+ * @param[in] good_match  Stop reporting longer matches after a match
+ *                        of this length has been found.
+ * @param[in] incremental Keep Z-values of offsets between positions.
  *
  * @return None.
  *
  */
 z_array::z_array(int len, int min, int max, int good_match,
     int mm2_thres_offset,
-    int mm3_thres_offset)
+    int mm3_thres_offset,
+    bool incremental) :
+    m_z(NULL),
+    m_s(NULL),
+    m_m(NULL),
+    m_ladder(NULL)
 {
     //if (len > max_window_size_s) {
-    if (len > Z_ARRAY_MAXSIZE) {
+    if (len > Z_ARRAY_MAXSIZE - 2*max - 1) {
         EXCEPTION(std::out_of_range,": Sliding window size");
     }
 
     // no try catch here..
-    m_z = new int32_t[len];
+    // The pattern, a separator and the window with the pattern overlap
+    m_z = new int32_t[len + 2*max + 1];
+    m_ladder = new match[max + 1];
+
+    if (!incremental) {
+        m_s = new int16_t[len + 2*max + 1];
+    }
+
     m_len = len;
     m_max = max;
     m_min = min;
     m_good = good_match;
+    m_size = 0;
     m_min_match2_threshold_offset = mm2_thres_offset;
     m_min_match3_threshold_offset = mm3_thres_offset;
+    m_incremental = incremental;
+    reinit();
 }
 
 z_array::~z_array(void) 
 {
-    std::cout << "z_array::~z_array(void)\n";
     delete[] m_z;
+    delete[] m_ladder;
+
+    if (m_s) {
+        delete[] m_s;
+    }
+}
+
+void z_array::impl_reinit(void)
+{
+    m_next_pos = -1;
+    m_last_max = 0;
+    m_window = 0;
 }
 
 /**
@@ -136,7 +166,7 @@ z_array::~z_array(void)
  * @return None.
  */
 
-void z_array::init_get_matches(int max_matches, match *matches = NULL)
+void z_array::impl_init_get_matches(int max_matches, match *matches)
 {
     m_m = matches;
     m_size = max_matches;
@@ -148,98 +178,172 @@ int z_array::get_window(void) const
 }
 
 /**
- * @brief Create a Z-array from input of a given length.
+ * @brief Create a Z-array of the string at @\p pos followed by the window.
  *
- * Create a Z-array of maximum size m_len for a given input buffer.
- * The buffer is treated so that the 'prefix string' to search for is
- * at the position 0 of the input buffer. The searching for matching
- * prefixes start at the position 1 of the input buffer.
- *
- * If a ptr to matches vector array was given at the time of init of the
- * Z-array then found matches are alse stored into the match array.
- * Matches of increasing length are stored until the end of Z-array
- * has been reached or the maximum number of matches to store has
- * been reached.
- *
- * If a ptr to macthes vector array was NULL then the longest match
- * is searched from entire Z-array and an index to it is returned.
+ * The string to search for is placed at the start of the Z-array and
+ * followed by a separator, which cannot match any byte, and the window
+ * preceding @\p pos. The window includes @\p len - 1 bytes from @\p pos
+ * on to allow overlapping matches.
  *
  * @param[in] buf A ptr to the buffer to look for matches.
- * @param[in] len Length of the input buffer.
+ * @param[in] pos The current position in the buffer.
+ * @param[in] len The maximum match length at @\p pos.
  *
- * @return 0 if no match was found, otherwise, number of found matches.
+ * @return The index of the Z-array that matches @\p pos i.e. the Z-value
+ *         of an offset d is at the index return value - d.
  *
  * @note This Z-array implementation is more or less a textbook example
  *       of a possible implementation.
  */
-int z_array::find_matches(const char *buf, int pos, int len, bool only_better_matches=false)
+int z_array::build_z_array(const char *buf, int pos, int len)
 {
-    int max = m_min-1;
-    int p, t, i, L=0, R=0;
-    int mm = m_min-1;
-    int num = 0;
+    int low = pos - (m_len - 1);
+    int n, i, L, R;
 
-    /* If the length of the buffer is greater that the Z-array
-     * shorten the search to Z-array length.
-     */
-    if (len > m_len) {
-        len = m_len;
+    if (low < 0) {
+        low = 0;
     }
-    
-    m_z[0] = 0;
-
-    for (i = 1; i < len; i++) {
-        p = 0;          // == R-L
-        
-        if (i > R) {
-            L = R = i;
-            
-            while (R < len && p < m_max && buf[pos+p] == buf[pos+R]) {
-                ++R;
-                ++p;
-            }
+    for (n = 0; n < len; n++) {
+        m_s[n] = static_cast<uint8_t>(buf[pos+n]);
+    }
+
+    m_s[n++] = -1;
 
-            m_z[i] = p;
-            --R;
+    for (i = low; i < pos + len - 1; i++) {
+        m_s[n++] = static_cast<uint8_t>(buf[i]);
+    }
+
+    m_window = n;
+    m_z[0] = n;
+    L = R = 0;
+
+    for (i = 1; i < n; i++) {
+        if (i < R) {
+            m_z[i] = m_z[i-L] < R-i ? m_z[i-L] : R-i;
         } else {
-            t = i-L;
-        
-            if (m_z[t] <= R-i) {
-                m_z[i] = m_z[t];
+            m_z[i] = 0;
+        }
+        while (i + m_z[i] < n && m_s[m_z[i]] == m_s[i + m_z[i]]) {
+            ++m_z[i];
+        }
+        if (i + m_z[i] > R) {
+            L = i;
+            R = i + m_z[i];
+        }
+    }
+
+    return len + 1 + pos - low;
+}
+
+/**
+ * @brief Update the Z-values of each offset for @\p pos. If the previous
+ *        search was for @\p pos - 1, a match of length L at an offset
+ *        is a match of length L-1 at the same offset now. Only offsets
+ *        whose match ended or was cut to the maximum length need to be
+ *        compared again.
+ *
+ * @param[in] buf A ptr to the buffer to look for matches.
+ * @param[in] pos The current position in the buffer.
+ * @param[in] len The maximum match length at @\p pos.
+ *
+ * @return 0 i.e. the Z-value of an offset d is at the index d.
+ */
+int z_array::update_z_values(const char *buf, int pos, int len)
+{
+    int top = pos < m_len - 1 ? pos : m_len - 1;
+    int d, l;
+
+    if (pos != m_next_pos) {
+        for (d = 1; d < m_len; d++) {
+            m_z[d] = d <= top ? match_length(buf+pos,buf+pos-d,len) : 0;
+        }
+    } else {
+        for (d = 1; d <= top; d++) {
+            l = m_z[d];
+
+            if (l > 1 && l < m_last_max) {
+                m_z[d] = l - 1;
             } else {
-                L = i;
-                
-                while (R < len && p < m_max && buf[pos+p] == buf[pos+R]) {
-                    ++R;
-                    ++p;
+                l = l > 0 ? l - 1 : 0;
+
+                // Most offsets do not match at all, thus check the first
+                // byte before calling the match length function.
+                if (l < len && (l > 0 || buf[pos] == buf[pos-d])) {
+                    l += match_length(buf+pos+l,buf+pos-d+l,len-l);
                 }
-               
-                m_z[i] = p;
-                --R;
+
+                m_z[d] = l;
             }
         }
+    }
 
-        if (p > mm) {
-            if (p > max) {
-                max = p;
+    m_window = m_len;
+    m_next_pos = pos + 1;
+    m_last_max = len;
+    return 0;
+}
 
-                if (only_better_matches) {
-                    mm = max;
-                }
-            }
-            if (num < m_size) {
-                m_m[num].offset = i;
-                m_m[num++].length = p;
+/**
+ * @brief Find matches for the @\p pos within the window.
+ *
+ * Offsets are scanned from the nearest to the farthest and a match is
+ * recorded every time it is longer than any nearer match, thus there is
+ * one match per distinct length with the shortest possible offset.
+ * Scanning stops at a good match. If more matches are found than fit
+ * into the match array, the longest ones are kept.
+ *
+ * @param[in] buf A ptr to the buffer to look for matches.
+ * @param[in] pos The current position in the buffer.
+ * @param[in] len Length of the input buffer from @\p pos.
+ * @param[in] only_better_matches Ignored. Matches are always better than
+ *                                the previous ones.
+ *
+ * @return 0 if no match was found, otherwise, number of found matches
+ *         in the increasing length order.
+ */
+int z_array::impl_find_matches(const char *buf, int pos, int len, bool only_better_matches)
+{
+    int max = len < m_max ? len : m_max;
+    int top = pos < m_len - 1 ? pos : m_len - 1;
+    int best = m_min - 1;
+    int num = 0;
+    int step;
+    int base;
+    int d, l;
 
-                // If number of recorded matches has been reached stop searching.
-                if (num == m_size) {
-                    break;
-                }
+    (void)only_better_matches;
+
+    if (max < 1) {
+        return 0;
+    }
+    if (m_incremental) {
+        base = update_z_values(buf,pos,max);
+        step = 1;
+    } else {
+        base = build_z_array(buf,pos,max);
+        step = -1;
+    }
+    for (d = 1; d <= top; d++) {
+        l = m_z[base + step*d];
+
+        if (l > best) {
+            best = l;
+            m_ladder[num].offset = d;
+            m_ladder[num++].length = l;
+
+            if (l >= m_good || l >= max) {
+                break;
             }
         }
     }
 
-    return num;
-}
+    // Keep the longest matches
+    d = num > m_size ? num - m_size : 0;
+    num -= d;
 
+    for (l = 0; l < num; l++) {
+        m_m[l] = m_ladder[d + l];
+    }
 
+    return num;
+}
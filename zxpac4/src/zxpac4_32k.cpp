@@ -23,105 +23,39 @@
 
 
 zxpac4_32k::zxpac4_32k(const lz_config* p_cfg, int ins, int max) :
-    lz_base(p_cfg),
-    m_lz(p_cfg->window_size,
-        p_cfg->min_match,
-        p_cfg->max_match,
-        p_cfg->good_match,
-        p_cfg->min_match2_threshold,
-        p_cfg->min_match3_threshold),  // may throw exception
-    m_cost_array(NULL),
-    m_cost(p_cfg)
+    lz_engine(p_cfg)
 {
     (void)ins;
     (void)max;
-    m_match_array = new match[p_cfg->max_chain];
-    m_alloc_len  = 0;
 }
 
-zxpac4_32k::~zxpac4_32k(void)
+void zxpac4_32k::impl_search_init(const char* buf, int len)
 {
-    if (m_cost_array) {
-        lz_cost_array_done();
-    }
-    delete[] m_match_array;
+    (void)buf;
+    m_window.init(len,m_lz_config->parse_block,m_lz_config->max_match);
+    m_cost.set_max_len(len);
+    m_cost.init_cost(m_cost_array,0,m_window.get_init_len(),m_lz_config->initial_pmr_offset);
+    m_tokens.clear();
 }
 
-
-
-int zxpac4_32k::lz_search_matches(char* buf, int len, int interval)
+/**
+ * @brief Commit the final part of the windowed parse before the cost
+ *        table overflows.
+ *
+ * @return False if the position was committed by a forced checkpoint
+ *         after it and must not be relaxed.
+ */
+bool zxpac4_32k::impl_search_position(int pos, int num)
 {
-    int pos = 0;
-    int num;
-    int offset, length;
-
-    // Unused at the moment..
-    (void)interval;
-
-    // init statistics
-    m_num_literals = 0;
-    m_num_pmr_literals = 0;
-    m_num_matches = 0;
-    m_num_matched_bytes = 0;
-    m_num_pmr_matches = 0;
-
-    m_cost.init_cost(m_cost_array,0,len,m_lz_config->initial_pmr_offset);
-    
-    if (m_lz_config->verbose) {
-        std::cout << "Finding all matches" << std::endl;
-    }
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-        std::cerr << ">- Match debugging phase --------------------------------------------------------\n";
-        std::cerr << "  file pos: asc (hx) -> offset:length(s) or 'no macth'\n";
-    }
-
-    while (pos < len) {
-        m_lz.init_get_matches(m_lz_config->max_chain,m_match_array);
-            
-        // Find all matches at this position. Returned 'num' is the
-        // the number of found matches.
-        num = m_lz.find_matches(buf,pos,len-pos,m_lz_config->only_better_matches);
-        //m_cost_array[pos].num_matches = num;
+    (void)num;
 
-        if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-            std::cerr << std::setw(10) << std::dec << std::setfill(' ') << pos << ": '"
-                << (std::isprint(buf[pos]) ? buf[pos] : ' ')
-                << "' (" << std::setw(2) << std::setfill('0') << std::hex << (buf[pos] & 0xff)
-                << std::dec << std::setw(0) <<  ") -> " << num << ": ";
-            if (num > 0) {
-                for (int n = 0; n < num; n++) {
-                    //assert(m_cost_array[pos].matches[n].offset < 131072);
-                    //std::cerr << m_cost_array[pos].matches[n].offset << ":"
-                    //          << m_cost_array[pos].matches[n].length << " ";
-                    assert(m_match_array[n].offset < 131072);
-                    std::cerr << m_match_array[n].offset << ":"
-                              << m_match_array[n].length << " ";
-                }
-            } else {
-                std::cerr << "no match";
-            }
-            std::cerr << "\n";
-        }
-        
-        // always do literal cost calculation
-        m_cost.literal_cost(pos,m_cost_array,buf);
-        
-        // match cost calculation if not at the end of file and there was a match
-        if (pos < (len - ZXPAC4_32K_MATCH_MIN)) {
-            for (int match_pos = 0; match_pos < num; match_pos++) {
-                offset = m_match_array[match_pos].offset;
-                length = m_match_array[match_pos].length;
-                length = m_cost.match_cost(pos,m_cost_array,buf,offset,length);
-            }
-        }        
-        
-        ++pos;
+    if (m_window.is_full(pos)) {
+        m_window.commit(m_cost_array,pos,[this](int p) { commit_token(p); });
     }
 
-    return 0;
+    return pos >= m_window.get_base();
 }
 
-
 int zxpac4_32k::lz_parse(const char* buf, int len, int interval)
 {
     int length;
@@ -138,7 +72,16 @@ int zxpac4_32k::lz_parse(const char* buf, int len, int interval)
     if (m_lz_config->verbose) {
         std::cout << "Building list of optimally parsed matches" << std::endl;
     }
-    
+    if (m_window.windowed()) {
+        m_window.commit(m_cost_array,len,[this](int p) { commit_token(p); });
+
+        if (m_lz_config->verbose) {
+            std::cout << "Windowed parse committed " << m_window.get_commits() << " times with "
+                      << m_window.get_forced() << " forced checkpoints" << std::endl;
+        }
+        return 0;
+    }
+
     pos = len;
     num_literals = 1;
 
@@ -177,98 +120,40 @@ int zxpac4_32k::lz_parse(const char* buf, int len, int interval)
         m_cost_array[pos-length].next = pos;
         pos -= length;
     }
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-        std::cerr << ">- Cost debugging phase ------------------------------------------------------" << std::endl;
-        std::cerr << "  file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr" << std::endl;
-        pos = 0;
-
-        while (pos < len+1) {
-            std::cerr 
-                // cost array position
-                << std::setw(10) << std::setfill(' ') << pos << ": '"
-                // ascii character at the same file position
-                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
-                // same as hexadecimal
-                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
-                // length of the literal run
-                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals 
-                // PMR offset
-                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
-                // match offset, may be 0 if PMR was selected
-                << std::setw(6) << m_cost_array[pos].offset
-                // match length
-                << ":" << std::setw(3) << m_cost_array[pos].length 
-                // arrival cost
-                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
-                // next position in cost array
-                << " -> " << std::setw(10) << m_cost_array[pos].next << " " 
-                // mark possible PMR match
-                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(l)" : "")
-                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(m)" : "")
-                << "\n";
-            ++pos;
-        }
-    }
-    
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NONE) {
-        std::cerr << ">- Show final selected -------------------------------------------------------" << std::endl;
-        std::cerr << "     file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr    " << std::endl;
-        pos = m_cost_array[0].next;
-
-        do {
-            std::cerr 
-                // Final debug marker
-                << "F: "
-                // cost array position
-                << std::setw(10) << std::setfill(' ') << pos << ": '"
-                // ascii character at the same file position
-                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
-                // same as hexadecimal
-                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
-                // length of the literal run
-                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals 
-                // PMR offset
-                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
-                // match offset, may be 0 if PMR was selected
-                << std::setw(6) << m_cost_array[pos].offset
-                // match length
-                << ":" << std::setw(3) << m_cost_array[pos].length 
-                // arrival cost
-                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
-                // next position in cost array
-                << " -> " << std::setw(10) << m_cost_array[pos].next << " " 
-                // mark possible PMR match
-                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(L)" : "")
-                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(M)" : "")
-                << "\n";
-            pos = m_cost_array[pos].next;
-        } while (pos > 0);
-    }
+    debug_costs(buf,len);
     assert(m_cost_array[1].num_literals >= 1);
+    collect_tokens(false);
     return 0;
 }
 
 
-const cost* zxpac4_32k::lz_cost_array_get(int len)
+/**
+ * @brief Append the literal or match ending at @p pos in the cost table
+ *        to the selected parse and collect statistics.
+ */
+void zxpac4_32k::commit_token(int pos)
 {
-    if (len < 1) {
-       return NULL;
+    int length = m_cost_array[pos].length;
+    int offset = m_cost_array[pos].offset;
+
+    // Collect statistics..
+    if (offset == 0 && length > 1) {
+        ++m_num_pmr_matches;
+        ++m_num_matches;
+        m_num_matched_bytes += length;
+    } else if (offset > 0 && length == 1) {
+        ++m_num_pmr_literals;
+        ++m_num_literals;
+    } else if (offset == 0 && length == 1) {
+        ++m_num_literals;
+    } else {
+        ++m_num_matches;
+        m_num_matched_bytes += length;
     }
-    lz_cost_array_done();
-    m_cost_array = m_cost.alloc_cost(len,m_lz_config->max_chain); 
-    m_alloc_len = len;
 
-    return m_cost_array;
+    add_token(offset,length,m_cost_array[pos].pmr_offset,false);
 }
 
-void zxpac4_32k::lz_cost_array_done(void)
-{
-    if (m_alloc_len > 0) {
-        m_cost.free_cost(m_cost_array); 
-    }
-    m_alloc_len = 0;
-    m_cost_array = NULL;
-}
 
 int zxpac4_32k::encode_history(const char* buf, char* p_out, int len, int pos)
 {
@@ -278,16 +163,10 @@ int zxpac4_32k::encode_history(const char* buf, char* p_out, int len, int pos)
     int length;
     int offset;
     int n;
+    size_t token;
     putbits_history pb(p_out);
-    int header_size_to_sub;
 
-    m_security_distance = 0;
-    
-    if (m_lz_config->reverse_encoded) {
-        header_size_to_sub = 4;
-    } else {
-        header_size_to_sub = 0;
-    }
+    inplace_begin();
 
     // Build header at the beginning of the file.. max 16M files supported.
     if (m_lz_config->is_ascii) {
@@ -300,7 +179,7 @@ int zxpac4_32k::encode_history(const char* buf, char* p_out, int len, int pos)
     pb.byte(len >> 0);
     
     // Always send first literal (which cannot be compressed without a tag..
-    pos = m_cost_array[0].next;
+    pos = m_tokens[0].length;
     literal = buf[0];
 
     // store compressed file..
@@ -320,12 +199,13 @@ int zxpac4_32k::encode_history(const char* buf, char* p_out, int len, int pos)
         }
     }
     
-    while ((pos = m_cost_array[pos].next)) {
-        length = m_cost_array[pos].length;
-        offset = m_cost_array[pos].offset;
+    for (token = 1; token < m_tokens.size(); token++) {
+        length = m_tokens[token].length;
+        offset = m_tokens[token].offset;
+        pos += length;
         literal = buf[pos-1];
 
-        if (offset == 0 && length == 1) {
+        if (m_tokens[token].type == LZ_TOKEN_LITERAL) {
             if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
                 std::cerr << "O: Literal ";
             }
@@ -366,7 +246,7 @@ int zxpac4_32k::encode_history(const char* buf, char* p_out, int len, int pos)
 
                 pb.bits(1,1);
             }
-            if ((offset == 0 && length > 1) || (offset > 0 && length == 1)) {
+            if (m_tokens[token].type == LZ_TOKEN_PMR) {
                 // encode match PMR or literal PMR
                 if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
                     std::cerr << ", PMR bits(1,1) Length " << length;
@@ -408,13 +288,7 @@ int zxpac4_32k::encode_history(const char* buf, char* p_out, int len, int pos)
             return -1;
         }
 
-        n = n - pos - header_size_to_sub;
-
-        if (n > 0) {
-            if (n > m_security_distance) {
-                m_security_distance = n;
-            }
-        }
+        inplace_token(n,pos);
     }
     
     if (m_lz_config->preshift_last_ascii_literal && last_literal_ptr) {
@@ -425,6 +299,7 @@ int zxpac4_32k::encode_history(const char* buf, char* p_out, int len, int pos)
     }
 
     n = pb.flush() - p_out;
+    inplace_end(n,len);
     return n;
 }
 
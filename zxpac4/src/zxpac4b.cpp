@@ -22,100 +22,12 @@
 
 
 zxpac4b::zxpac4b(const lz_config* p_cfg, int ins, int max) :
-    lz_base(p_cfg),
-    m_lz(p_cfg->window_size,
-        p_cfg->min_match,
-        p_cfg->max_match,
-        p_cfg->good_match,
-        p_cfg->min_match2_threshold,
-        p_cfg->min_match3_threshold),  // may throw exception
-    m_cost_array(NULL),
-    m_cost(p_cfg)
+    lz_engine(p_cfg)
 {
     (void)ins;
     (void)max;
-    m_match_array = new match[p_cfg->max_chain];
-    m_alloc_len  = 0;
 }
 
-zxpac4b::~zxpac4b(void)
-{
-    if (m_cost_array) {
-        lz_cost_array_done();
-    }
-}
-
-
-
-int zxpac4b::lz_search_matches(char* buf, int len, int interval)
-{
-    int pos = 0;
-    int num;
-    int offset, length;
-
-    // Unused at the moment..
-    (void)interval;
-
-    // init statistics
-    m_num_literals = 0;
-    m_num_pmr_literals = 0;
-    m_num_matches = 0;
-    m_num_matched_bytes = 0;
-    m_num_pmr_matches = 0;
-    
-    m_cost.init_cost(m_cost_array,0,len,m_lz_config->initial_pmr_offset);
-
-    if (m_lz_config->verbose) {
-        std::cout << "Finding all matches" << std::endl;
-    }
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-        std::cerr << ">- Match debugging phase --------------------------------------------------------\n";
-        std::cerr << "  file pos: asc (hx) -> offset:length(s) or 'no macth'\n";
-    }
-
-    while (pos < len) {
-        m_lz.init_get_matches(m_lz_config->max_chain,m_match_array);
-            
-        // Find all matches at this position. Returned 'num' is the
-        // the number of found matches.
-        num = m_lz.find_matches(buf,pos,len-pos,m_lz_config->only_better_matches);
-
-        if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-            std::cerr << std::setw(10) << std::dec << std::setfill(' ') << pos << ": '"
-                << (std::isprint(buf[pos]) ? buf[pos] : ' ')
-                << "' (" << std::setw(2) << std::setfill('0') << std::hex << (buf[pos] & 0xff)
-                << std::dec << std::setw(0) <<  ") -> " << num << ": ";
-            if (num > 0) {
-                for (int n = 0; n < num; n++) {
-                    assert(m_match_array[n].offset < 131072);
-                    std::cerr << m_match_array[n].offset << ":"
-                              << m_match_array[n].length << " ";
-                }
-            } else {
-                std::cerr << "no match";
-            }
-            std::cerr << "\n";
-        }
-
-        // always do literal cost calculation
-        m_cost.literal_cost(pos,m_cost_array,buf);
-        
-        // match cost calculation if not at the end of file and there was a match
-        if (pos < (len - ZXPAC4B_MATCH_MIN)) {
-            for (int match_pos = 0; match_pos < num; match_pos++) {
-                offset = m_match_array[match_pos].offset;
-                length = m_match_array[match_pos].length;
-                length = m_cost.match_cost(pos,m_cost_array,buf,offset,length);
-            }
-        }        
-
-        ++pos;
-    }
-
-    return 0;
-}
-
-
 int zxpac4b::lz_parse(const char* buf, int len, int interval)
 {
     int length;
@@ -165,7 +77,7 @@ int zxpac4b::lz_parse(const char* buf, int len, int interval)
             previous_was_pmr = pos;
             next = pos;
         } else if (offset > 0 && length == 1) {
-            if (previous_was_pmr > 0) {
+            if (previous_was_pmr > 0 && m_cost_array[previous_was_pmr].length < m_lz_config->max_match) {
                 // Link this literal PMR to previous PMR match.. There are two cases
                 // 1) PMR literal followed by PMR match
                 // 2) PMR literal followed by PMR literal
@@ -186,7 +98,9 @@ int zxpac4b::lz_parse(const char* buf, int len, int interval)
                     --m_num_pmr_literals;
                     --m_num_literals;
                 }
-                // Skip this PMR and add in into the previous
+                // Skip this PMR and add in into the previous. It stays the
+                // previous PMR for a possible PMR literal before this one,
+                // otherwise the skipped node would be linked to.
                 ++m_cost_array[previous_was_pmr].length;
                 m_cost_array[previous_was_pmr].offset = 0;
                 ++m_num_matched_bytes;
@@ -195,8 +109,8 @@ int zxpac4b::lz_parse(const char* buf, int len, int interval)
                 ++m_num_pmr_literals;
                 ++m_num_literals;
                 next = pos;
+                previous_was_pmr = pos;
             }
-            previous_was_pmr = pos;
         } else if (offset == 0 && length == 1) {
             ++m_num_literals;
             previous_was_pmr = 0;
@@ -215,98 +129,13 @@ int zxpac4b::lz_parse(const char* buf, int len, int interval)
     }
 
 
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-        std::cerr << ">- Cost debugging phase ------------------------------------------------------" << std::endl;
-        std::cerr << "  file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr" << std::endl;
-        pos = 0;
-
-        while (pos < len+1) {
-            std::cerr 
-                // cost array position
-                << std::setw(10) << std::setfill(' ') << pos << ": '"
-                // ascii character at the same file position
-                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
-                // same as hexadecimal
-                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
-                // length of the literal run
-                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals 
-                // PMR offset
-                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
-                // match offset, may be 0 if PMR was selected
-                << std::setw(6) << m_cost_array[pos].offset
-                // match length
-                << ":" << std::setw(3) << m_cost_array[pos].length 
-                // arrival cost
-                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
-                // next position in cost array
-                << " -> " << std::setw(10) << m_cost_array[pos].next << " " 
-                // mark possible PMR match
-                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(l)" : "")
-                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(m)" : "")
-                << "\n";
-            ++pos;
-        }
-    }
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NONE) {
-        std::cerr << ">- Show final selected -------------------------------------------------------" << std::endl;
-        std::cerr << "     file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr    " << std::endl;
-        pos = m_cost_array[0].next;
-
-        do {
-            std::cerr 
-                // Final debug marker
-                << "F: "
-                // cost array position
-                << std::setw(10) << std::setfill(' ') << pos << ": '"
-                // ascii character at the same file position
-                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
-                // same as hexadecimal
-                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
-                // length of the literal run
-                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals 
-                // PMR offset
-                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
-                // match offset, may be 0 if PMR was selected
-                << std::setw(6) << m_cost_array[pos].offset
-                // match length
-                << ":" << std::setw(3) << m_cost_array[pos].length 
-                // arrival cost
-                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
-                // next position in cost array
-                << " -> " << std::setw(10) << m_cost_array[pos].next << " " 
-                // mark possible PMR match
-                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(L)" : "")
-                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(M)" : "")
-                << "\n";
-            pos = m_cost_array[pos].next;
-        } while (pos > 0);
-    }
+    debug_costs(buf,len);
     assert(m_cost_array[1].num_literals >= 1);
+    collect_tokens(true);
     return 0;
 }
 
 
-const cost* zxpac4b::lz_cost_array_get(int len)
-{
-    if (len < 1) {
-       return NULL;
-    }
-    lz_cost_array_done();
-    m_cost_array = m_cost.alloc_cost(len,m_lz_config->max_chain); 
-    m_alloc_len = len;
-
-    return m_cost_array;
-}
-
-void zxpac4b::lz_cost_array_done(void)
-{
-    if (m_alloc_len > 0) {
-        m_cost.free_cost(m_cost_array); 
-    }
-    m_alloc_len = 0;
-    m_cost_array = NULL;
-}
-
 int zxpac4b::encode_history(const char* buf, char* p_out, int len, int pos)
 {
     char* last_literal_ptr;
@@ -316,16 +145,10 @@ int zxpac4b::encode_history(const char* buf, char* p_out, int len, int pos)
     int offset;
     int n;
     int run_length;
+    size_t token;
     putbits_history pb(p_out);
-    int header_size_to_sub;
 
-    m_security_distance = 0;
-    
-    if (m_lz_config->reverse_encoded) {
-        header_size_to_sub = 4;
-    } else {
-        header_size_to_sub = 0;
-    }
+    inplace_begin();
 
     // Build header at the beginning of the file.. max 16M files supported.
     if (m_lz_config->is_ascii) {
@@ -339,14 +162,16 @@ int zxpac4b::encode_history(const char* buf, char* p_out, int len, int pos)
     last_literal_ptr = NULL;
     pos = 0;
     
-    while ((pos = m_cost_array[pos].next)) {
-        length = m_cost_array[pos].length;
-        offset = m_cost_array[pos].offset;
+    for (token = 0; token < m_tokens.size(); token++) {
+        length = m_tokens[token].length;
+        offset = m_tokens[token].offset;
+        pos += length;
         literal = buf[pos-1];
 
-        if (offset == 0 && length == 1) {
+        if (m_tokens[token].type == LZ_TOKEN_LITERAL) {
             // encode raw literal run
-            run_length = m_cost_array[pos].num_literals;
+            run_length = length;
+            literal = buf[pos-run_length];
             n = m_cost.impl_get_length_tag(run_length,tag);
 
             if (run_length > 255) {
@@ -365,9 +190,8 @@ int zxpac4b::encode_history(const char* buf, char* p_out, int len, int pos)
             if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
                 std::cerr << ", bits(" << std::hex << tag << "," << std::dec << n << ")";
             }
-            for (n = 0; n < run_length-1; n++) {
-                pb.byte(buf[pos-1]);
-                ++pos;
+            for (n = run_length; n > 1; n--) {
+                pb.byte(buf[pos-n]);
             }
             if (m_lz_config->is_ascii) {
                 last_literal_ptr = pb.byte(buf[pos-1] << 1);
@@ -378,7 +202,7 @@ int zxpac4b::encode_history(const char* buf, char* p_out, int len, int pos)
                 std::cerr << " -> " << std::hex << literal << "\n";
             }
         } else {
-            if ((offset == 0 && length > 1) || (offset > 0 && length == 1)) {
+            if (m_tokens[token].type == LZ_TOKEN_PMR) {
                 tag = 0;
                 if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
                     std::cerr << "O: PMR Match, ";
@@ -437,16 +261,11 @@ int zxpac4b::encode_history(const char* buf, char* p_out, int len, int pos)
             return -1;
         }
 
-        n = n - pos - header_size_to_sub;
-
-        if (n > 0) {
-            if (n > m_security_distance) {
-                m_security_distance = n;
-            }
-        }
+        inplace_token(n,pos);
     }
 
     n = pb.flush() - p_out;
+    inplace_end(n,len);
     return n;
 }
 
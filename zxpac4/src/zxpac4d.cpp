@@ -24,106 +24,172 @@
 
 
 zxpac4d::zxpac4d(const lz_config* p_cfg, int ins, int max) :
-    lz_base(p_cfg),
-    m_lz(p_cfg->window_size,
-        p_cfg->min_match,
-        p_cfg->max_match,
-        p_cfg->good_match,
-        p_cfg->min_match2_threshold,
-        p_cfg->min_match3_threshold),  // may throw exception
-    m_cost_array(NULL),
-    m_cost(p_cfg)
+    lz_engine(p_cfg)
 {
     (void)ins;
     (void)max;
-    m_match_array = new match[p_cfg->max_chain];
-    m_alloc_len  = 0;
 }
 
-zxpac4d::~zxpac4d(void)
+void zxpac4d::impl_search_init(const char* buf, int len)
 {
-    if (m_cost_array) {
-        lz_cost_array_done();
+    (void)buf;
+    m_cost.init_cost(m_cost_array,0,len,m_lz_config->initial_pmr_offset);
+
+    if (m_lz_config->max_passes > 1) {
+        m_pass_index.resize(len+1);
+        m_pass_matches.clear();
     }
 }
 
+bool zxpac4d::impl_search_position(int pos, int num)
+{
+    if (m_lz_config->max_passes > 1) {
+        // Keep the matches for the later parsing passes
+        m_pass_index[pos] = m_pass_matches.size();
+        m_pass_matches.insert(m_pass_matches.end(),m_match_array,m_match_array+num);
+    }
 
+    return true;
+}
 
-int zxpac4d::lz_search_matches(char* buf, int len, int interval)
+void zxpac4d::impl_search_done(int len)
 {
-    int pos = 0;
-    int num;
-    int offset, length;
+    if (m_lz_config->max_passes > 1) {
+        m_pass_index[len] = m_pass_matches.size();
+    }
+}
 
-    // Unused at the moment..
-    (void)interval;
+void zxpac4d::impl_reset(void)
+{
+    // Back to the static costs and the initial tANS states of a new engine
+    m_cost.set_tans_costs(zxpac4d_cost::tans_costs());
+    m_cost.set_tans_state(TANS4D_LENGTH_SYMS,0);
+    m_cost.set_tans_state(TANS4D_OFFSET_SYMS,0);
+}
+
+/**
+ * @brief Recalculate the arrival costs from the matches stored during
+ *        the first pass, i.e. without searching matches again.
+ */
+void zxpac4d::relax_stored_matches(const char* buf, int len)
+{
+    int pos;
 
-    // init statistics
-    m_num_literals = 0;
-    m_num_pmr_literals = 0;
-    m_num_matches = 0;
-    m_num_matched_bytes = 0;
-    m_num_pmr_matches = 0;
-    
     m_cost.init_cost(m_cost_array,0,len,m_lz_config->initial_pmr_offset);
 
+    for (pos = 0; pos < len; pos++) {
+        cost_position(buf,pos,len,&m_pass_matches[m_pass_index[pos]],
+            m_pass_index[pos+1] - m_pass_index[pos]);
+    }
+}
+
+/**
+ * @brief Encode the current parse into a scratch buffer to get its exact
+ *        size. Statistics and tANS states are left untouched.
+ *
+ * @return The encoded size or -1 if the file did not compress.
+ */
+int zxpac4d::trial_encode(const char* buf, int len)
+{
+    std::vector<char> out(len + ZXPAC4D_TRIAL_OVERHEAD);
+    ans_state_t length_state = m_cost.get_tans_state(TANS4D_LENGTH_SYMS);
+    ans_state_t offset_state = m_cost.get_tans_state(TANS4D_OFFSET_SYMS);
+    int stats[5];
+    int n;
+
+    stats[0] = m_num_literals;
+    stats[1] = m_num_pmr_literals;
+    stats[2] = m_num_matches;
+    stats[3] = m_num_matched_bytes;
+    stats[4] = m_num_pmr_matches;
+
+    n = encode_history(buf,out.data(),len,0);
+
+    m_cost.set_tans_state(TANS4D_LENGTH_SYMS,length_state);
+    m_cost.set_tans_state(TANS4D_OFFSET_SYMS,offset_state);
+
+    m_num_literals = stats[0];
+    m_num_pmr_literals = stats[1];
+    m_num_matches = stats[2];
+    m_num_matched_bytes = stats[3];
+    m_num_pmr_matches = stats[4];
+
+    return n;
+}
+
+/**
+ * @brief Select the optimal parse and build the tANS tables from it.
+ *
+ * With more than one parsing pass the symbol statistics of each pass
+ * become the tANS symbol costs of the next pass. The matches found on
+ * the first pass are reused, thus the later passes only recalculate
+ * the arrival costs. Iteration stops when the output does not shrink
+ * anymore, and the parse of the best pass is selected.
+ */
+int zxpac4d::lz_parse(const char* buf, int len, int interval)
+{
+    zxpac4d_cost::tans_costs best_costs;
+    int best_size;
+    int size;
+    int pass;
+
+    // Unused at the moment..
+    (void)interval;
+
+    if (m_lz_config->verbose) {
+        std::cout << "Calculating arrival costs" << std::endl;
+    }
     if (m_lz_config->verbose) {
-        std::cout << "Finding all matches" << std::endl;
+        std::cout << "Building list of optimally parsed matches" << std::endl;
     }
 
-    // find matches..
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-        std::cerr << ">- Match debugging phase --------------------------------------------------------\n";
-        std::cerr << "  file pos: asc (hx) -> offset:length(s) or 'no macth'\n";
+    select_matches(buf,len);
+
+    if (m_lz_config->max_passes <= 1) {
+        return 0;
     }
 
-    while (pos < len) {
-        m_lz.init_get_matches(m_lz_config->max_chain,m_match_array);
-
-
-        // Find all matches at this position. Returned 'num' is the
-        // the number of found matches.
-        num = m_lz.find_matches(buf,pos,len-pos,m_lz_config->only_better_matches);
-
-        if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-            std::cerr << std::setw(10) << std::dec << std::setfill(' ') << pos << ": '"
-                << (std::isprint(buf[pos]) ? buf[pos] : ' ')
-                << "' (" << std::setw(2) << std::setfill('0') << std::hex << (buf[pos] & 0xff)
-                << std::dec << std::setw(0) <<  ") -> " << num << ": ";
-            if (num > 0) {
-                //std::cerr << num << "\n";
-                for (int n = 0; n < num; n++) {
-                    assert(m_match_array[n].offset < m_lz_config->window_size);
-                    assert(m_match_array[n].length <= m_lz_config->max_match);
-                    std::cerr << m_match_array[n].offset << ":"
-                              << m_match_array[n].length << " ";
-                }
-            } else {
-                std::cerr << "no match";
-            }
-            std::cerr << "\n";
-        }
+    best_costs = m_cost.get_tans_costs();
+    best_size = trial_encode(buf,len);
 
-        // always do literal cost calculation
-        m_cost.literal_cost(pos,m_cost_array,buf);
-        
-        // match cost calculation if not at the end of file and there was a match
-        if (pos < (len - m_lz_config->min_match)) {
-            for (int match_pos = 0; match_pos < num; match_pos++) {
-                offset = m_match_array[match_pos].offset;
-                length = m_match_array[match_pos].length;
-                length = m_cost.match_cost(pos,m_cost_array,buf,offset,length);
+    if (m_lz_config->verbose) {
+        std::cout << "Parsing pass 1 encoded to " << best_size << " bytes" << std::endl;
+    }
+    for (pass = 2; pass <= m_lz_config->max_passes && best_size > 0; pass++) {
+        m_cost.update_tans_costs();
+        relax_stored_matches(buf,len);
+        select_matches(buf,len);
+        size = trial_encode(buf,len);
+
+        if (size < 0 || size >= best_size) {
+            if (m_lz_config->verbose) {
+                std::cout << "Parsing pass " << pass << " encoded to " << size
+                          << " bytes, using pass " << pass-1 << std::endl;
             }
-        }        
 
-        ++pos;
+            // Redo the best pass
+            m_cost.set_tans_costs(best_costs);
+            relax_stored_matches(buf,len);
+            select_matches(buf,len);
+            break;
+        }
+        if (m_lz_config->verbose) {
+            std::cout << "Parsing pass " << pass << " encoded to " << size << " bytes" << std::endl;
+        }
+
+        best_costs = m_cost.get_tans_costs();
+        best_size = size;
     }
 
+    m_pass_index.clear();
+    m_pass_index.shrink_to_fit();
+    m_pass_matches.clear();
+    m_pass_matches.shrink_to_fit();
     return 0;
 }
 
 
-int zxpac4d::lz_parse(const char* buf, int len, int interval)
+int zxpac4d::select_matches(const char* buf, int len)
 {
     int length;
     int offset;
@@ -131,18 +197,13 @@ int zxpac4d::lz_parse(const char* buf, int len, int interval)
     int next;
     int num_literals;
     int sym;
+    size_t token;
 	int min_offset_bits = log2(m_lz_config->min_offset);
 
-    // Unused at the moment..
-    (void)interval;
+    // Reset tANS symbol frequencies from the previous pass
+    m_cost.set_tans_symbol_freqs(TANS4D_LENGTH_SYMS);
+    m_cost.set_tans_symbol_freqs(TANS4D_OFFSET_SYMS);
 
-    if (m_lz_config->verbose) {
-        std::cout << "Calculating arrival costs" << std::endl;
-    }
-    if (m_lz_config->verbose) {
-        std::cout << "Building list of optimally parsed matches" << std::endl;
-    }
-    
     pos = len;
     num_literals = 1;
 
@@ -189,87 +250,24 @@ int zxpac4d::lz_parse(const char* buf, int len, int interval)
     }
 
 
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
-        std::cerr << ">- Cost debugging phase ------------------------------------------------------" << std::endl;
-        std::cerr << "  file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr" << std::endl;
-        pos = 0;
-
-        while (pos < len+1) {
-            std::cerr 
-                // cost array position
-                << std::setw(10) << std::setfill(' ') << pos << ": '"
-                // ascii character at the same file position
-                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
-                // same as hexadecimal
-                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
-                // length of the literal run
-                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals 
-                // PMR offset
-                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
-                // match offset, may be 0 if PMR was selected
-                << std::setw(6) << m_cost_array[pos].offset
-                // match length
-                << ":" << std::setw(3) << m_cost_array[pos].length 
-                // arrival cost
-                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
-                // next position in cost array
-                << " -> " << std::setw(10) << m_cost_array[pos].next << " " 
-                // mark possible PMR match
-                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(l)" : "")
-                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(m)" : "")
-                << "\n";
-            ++pos;
-        }
-    }
-    if (m_lz_config->debug_level > DEBUG_LEVEL_NONE) {
-        std::cerr << ">- Show final selected -------------------------------------------------------" << std::endl;
-        std::cerr << "     file pos: asc (hx) #lit (pmroff) offset:len  arri_cost ->     nxtpos pmr    " << std::endl;
-        pos = m_cost_array[0].next;
-
-        do {
-            std::cerr 
-                // Final debug marker
-                << "F: "
-                // cost array position
-                << std::setw(10) << std::setfill(' ') << pos << ": '"
-                // ascii character at the same file position
-                << (std::isprint(buf[pos-1]) ? buf[pos-1] : ' ') << "' ("
-                // same as hexadecimal
-                << std::hex << std::setfill('0') << std::setw(2) << (buf[pos-1] & 0xff) << ") "
-                // length of the literal run
-                << std::dec << std::setw(4) << std::setfill(' ') << m_cost_array[pos].num_literals 
-                // PMR offset
-                << " (" << std::setw(6) << m_cost_array[pos].pmr_offset << ") "
-                // match offset, may be 0 if PMR was selected
-                << std::setw(6) << m_cost_array[pos].offset
-                // match length
-                << ":" << std::setw(3) << m_cost_array[pos].length 
-                // arrival cost
-                << " " << std::setw(10) << m_cost_array[pos].arrival_cost
-                // next position in cost array
-                << " -> " << std::setw(10) << m_cost_array[pos].next << " " 
-                // mark possible PMR match
-                << (m_cost_array[pos].offset > 0 && m_cost_array[pos].length == 1 ? "(L)" : "")
-                << (m_cost_array[pos].offset == 0 && m_cost_array[pos].length > 1 ? "(M)" : "")
-                << "\n";
-            pos = m_cost_array[pos].next;
-        } while (pos > 0);
-    }
+    debug_costs(buf,len);
     assert(m_cost_array[1].num_literals >= 1);
+    collect_tokens(false);
     pos = 0;
 
     if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
         std::cerr << "** TANS DEBUG OUTPUT **\n";
     }
 
-    while ((pos = m_cost_array[pos].next)) {
-        length = m_cost_array[pos].length;
-        offset = m_cost_array[pos].offset;
+    for (token = 0; token < m_tokens.size(); token++) {
+        length = m_tokens[token].length;
+        offset = m_tokens[token].offset;
+        pos += length;
    
         if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) { 
             std::cerr << "pos: " << std::setw(8) << std::left << pos << " ";
         }
-        if (offset == 0 && length == 1) {
+        if (m_tokens[token].type == LZ_TOKEN_LITERAL) {
             // Literals we skip..
 		} else {
 			sym = m_cost.impl_get_length_bits(length);
@@ -279,7 +277,7 @@ int zxpac4d::lz_parse(const char* buf, int len, int interval)
                 std::cerr << "LENGTH_SYMS " << std::setw(8) << std::right << length 
                           << ":" << std::left << sym;
             }
-            if ((offset == 0 && length > 1) || (offset > 0 && length == 1)) {
+            if (m_tokens[token].type == LZ_TOKEN_PMR) {
                 // This is a PMR match
                 if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
                     std::cerr << ", PMR offset\n";
@@ -325,29 +323,16 @@ void zxpac4d::preload_tans(int type, uint8_t* freqs, int len)
 }
 
 
-const cost* zxpac4d::lz_cost_array_get(int len)
+void zxpac4d::lz_cost_array_get(int len)
 {
     if (len < 1) {
-       return NULL;
+       return;
     }
-    lz_cost_array_done();
-    m_cost_array = m_cost.alloc_cost(len,m_lz_config->max_chain); 
-    m_alloc_len = len;
+    lz_engine::lz_cost_array_get(len);
 
 	// Init tANS symbold freqs.. these could have be preloaded..
     m_cost.set_tans_symbol_freqs(TANS4D_LENGTH_SYMS);
     m_cost.set_tans_symbol_freqs(TANS4D_OFFSET_SYMS);
-
-    return m_cost_array;
-}
-
-void zxpac4d::lz_cost_array_done(void)
-{
-    if (m_alloc_len > 0) {
-        m_cost.free_cost(m_cost_array); 
-    }
-    m_alloc_len = 0;
-    m_cost_array = NULL;
 }
 
 int zxpac4d::encode_history(const char* buf, char* p_out, int len, int pos)
@@ -357,18 +342,12 @@ int zxpac4d::encode_history(const char* buf, char* p_out, int len, int pos)
     int length;
     int offset;
     int m,n;
+    size_t token;
     putbits_history pb(p_out);
-    int header_size_to_sub;
 	int min_offset_bits = log2(m_lz_config->min_offset);
 	int literal_size = 0;
 
-    m_security_distance = 0;
-    
-    if (m_lz_config->reverse_encoded) {
-        header_size_to_sub = 4;
-    } else {
-        header_size_to_sub = 0;
-    }
+    inplace_begin();
 
     // Build header at the beginning of the file.. max 16M files supported.
     pb.byte(m_lz_config->initial_pmr_offset);
@@ -413,14 +392,15 @@ int zxpac4d::encode_history(const char* buf, char* p_out, int len, int pos)
 
     pos = 0;
 
-    while ((pos = m_cost_array[pos].next)) {
-        length = m_cost_array[pos].length;
-        offset = m_cost_array[pos].offset;
+    for (token = 0; token < m_tokens.size(); token++) {
+        length = m_tokens[token].length;
+        offset = m_tokens[token].offset;
+        pos += length;
 		literal = buf[pos-1];
 
 		assert(length <= m_lz_config->max_match);
 
-        if (offset == 0 && length == 1) {
+        if (m_tokens[token].type == LZ_TOKEN_LITERAL) {
             if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
                 std::cerr << "O: Literal ";
             }
@@ -443,7 +423,7 @@ int zxpac4d::encode_history(const char* buf, char* p_out, int len, int pos)
 		} else {
             n = 0;
 
-			if ((offset == 0 && length > 1) || (offset > 0 && length == 1)) {
+			if (m_tokens[token].type == LZ_TOKEN_PMR) {
                 if (m_lz_config->debug_level > DEBUG_LEVEL_NORMAL) {
                     std::cerr << "O: PMR Match, ";
                 }
@@ -500,13 +480,7 @@ int zxpac4d::encode_history(const char* buf, char* p_out, int len, int pos)
             return -1;
         }
 
-        n = n - pos - header_size_to_sub;
-
-        if (n > 0) {
-            if (n > m_security_distance) {
-                m_security_distance = n;
-            }
-        }
+        inplace_token(n,pos);
     }
 	if (m_lz_config->verbose) {
 		std::cout << "Encoding literal took " << literal_size << " bits, "
@@ -514,6 +488,7 @@ int zxpac4d::encode_history(const char* buf, char* p_out, int len, int pos)
 	}
 
     n = pb.flush() - p_out;
+    inplace_end(n,len);
     return n;
 }
 